@@ -0,0 +1,33 @@
+/*
+ * audio_output.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_AUDIO_OUTPUT_H_
+#define HELPERS_AUDIO_OUTPUT_H_
+
+#include <stdint.h>
+
+/*
+ * The audio clock: I2S2 is the master transmitter of a stereo stream of 32-bit samples, clocked
+ * by PLLI2S from the same crystal as the core. Its samples are fed by DMA1 stream 4 from a buffer
+ * of two periods, and each period is refilled while the other one is played.
+ */
+
+/// \brief The sample rate of the stream: PLLI2S gives 76.8 MHz, divided by 64 bits per frame and 25
+#define AUDIO_OUTPUT_SAMPLE_RATE 48000
+
+/// \brief The stereo frames of a period (1 ms)
+#define AUDIO_OUTPUT_PERIOD_FRAMES (AUDIO_OUTPUT_SAMPLE_RATE / 1000)
+
+/**
+ * \brief Fill a period with stereo frames (left and right samples, 32 bits left-justified)
+ * \details Called from the DMA interrupt, once per period.
+ */
+typedef void (*AudioOutputFill)(int32_t *samples, uint32_t frame_count);
+
+void audio_output_start(AudioOutputFill fill);
+
+#endif /* HELPERS_AUDIO_OUTPUT_H_ */
@@ -0,0 +1,31 @@
+/*
+ * block_device.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_BLOCK_DEVICE_H_
+#define HELPERS_BLOCK_DEVICE_H_
+
+#include <stdint.h>
+
+/// \brief The size of a block of every block device in bytes
+#define BLOCK_DEVICE_BLOCK_SIZE 512
+
+/**
+ * \brief A storage of fixed-size blocks (e.g. the medium of a mass storage function)
+ * \details The operations may take long (e.g. to erase flash), so they are only called from the
+ * main loop, never from interrupts. They return non-zero on success.
+ */
+typedef struct
+{
+	uint32_t block_count;
+	uint8_t read_only; /**<\brief Writes are refused (the write operation may be NULL). */
+	uint8_t (*read)(uint32_t block, uint8_t *data, uint32_t count);
+	uint8_t (*write)(uint32_t block, uint8_t const *data, uint32_t count);
+	uint8_t (*flush)(); /**<\brief Commit the blocks written so far to the medium, may be NULL. */
+	void (*poll)(); /**<\brief Do the background work of the medium while no operation runs, may be NULL. */
+} BlockDevice;
+
+#endif /* HELPERS_BLOCK_DEVICE_H_ */
@@ -0,0 +1,34 @@
+/*
+ * cpu_load.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_CPU_LOAD_H_
+#define HELPERS_CPU_LOAD_H_
+
+#include <stdint.h>
+
+/// \brief The rolling average weights the last interval by 1 / 2^CPU_LOAD_AVERAGE_SHIFT
+#define CPU_LOAD_AVERAGE_SHIFT 6
+
+/** \brief CPU load of the measurement intervals (one SOF period each), in hundredths of a percent */
+typedef struct
+{
+	uint16_t load; /**<\brief Busy (not sleeping) share of the last interval. */
+	uint16_t load_average; /**<\brief Rolling average of `load`. */
+	uint16_t load_peak; /**<\brief Highest `load` seen. */
+	uint16_t usb_load; /**<\brief Share of the last interval spent in the USB interrupt. */
+	uint16_t usb_load_average; /**<\brief Rolling average of `usb_load`. */
+	uint16_t usb_load_peak; /**<\brief Highest `usb_load` seen. */
+	uint32_t interval_cycles; /**<\brief Length of the last interval in core clock cycles. */
+} CpuLoad;
+
+void cpu_load_initialize();
+void cpu_load_idle();
+void cpu_load_add_usb_cycles(uint32_t cycles);
+void cpu_load_close_interval();
+void cpu_load_read(CpuLoad *cpu_load);
+
+#endif /* HELPERS_CPU_LOAD_H_ */
@@ -0,0 +1,32 @@
+/*
+ * cycle_counter.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_CYCLE_COUNTER_H_
+#define HELPERS_CYCLE_COUNTER_H_
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+/**
+ * @brief Start the DWT cycle counter (if it is not running already)
+ */
+inline static void cycle_counter_initialize()
+{
+	// The DWT unit is only accessible when the trace is enabled
+	SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+	SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+}
+
+/**
+ * @brief Return the count of core clock cycles elapsed since the counter was started (wraps around)
+ */
+inline static uint32_t cycle_counter_read()
+{
+	return DWT->CYCCNT;
+}
+
+#endif /* HELPERS_CYCLE_COUNTER_H_ */
@@ -0,0 +1,38 @@
+/*
+ * flash.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_FLASH_H_
+#define HELPERS_FLASH_H_
+
+#include <stdint.h>
+
+/*
+ * The 2 MB of flash are two banks of 12 sectors: 4 x 16 KB, 1 x 64 KB and 7 x 128 KB each.
+ * The firmware runs from bank 1 (sectors 0 to 11), so bank 2 (sectors 12 to 23) can be erased
+ * and programmed while the code keeps running (read-while-write). Reading a bank that is being
+ * erased or programmed stalls the bus until the operation ends.
+ */
+
+/// \brief The first sector of bank 2
+#define FLASH_BANK2_FIRST_SECTOR 12
+
+/// \brief The total count of sectors
+#define FLASH_SECTOR_COUNT 24
+
+uint32_t flash_sector_address(uint8_t sector);
+uint32_t flash_sector_size(uint8_t sector);
+
+void flash_unlock();
+void flash_lock();
+
+void flash_start_erase(uint8_t sector);
+uint8_t flash_is_busy();
+uint8_t flash_finish();
+
+uint8_t flash_program(uint32_t address, uint32_t const *data, uint32_t word_count);
+
+#endif /* HELPERS_FLASH_H_ */
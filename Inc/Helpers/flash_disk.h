@@ -0,0 +1,37 @@
+/*
+ * flash_disk.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_FLASH_DISK_H_
+#define HELPERS_FLASH_DISK_H_
+
+#include "Helpers/block_device.h"
+
+#ifndef FLASH_DISK_FIRST_SECTOR
+#define FLASH_DISK_FIRST_SECTOR 17 /**<\brief First flash sector of the disk (one of the 128 KB sectors of bank 2, 17 to 23) */
+#endif
+
+#ifndef FLASH_DISK_SECTOR_COUNT
+#define FLASH_DISK_SECTOR_COUNT 7 /**<\brief Count of flash sectors of the disk, one of them is kept as the spare */
+#endif
+
+#ifndef FLASH_DISK_CACHE_BLOCKS
+#define FLASH_DISK_CACHE_BLOCKS 64 /**<\brief Count of blocks held by the write-back cache in CCM RAM (32 KiB) */
+#endif
+
+#ifndef FLASH_DISK_FLUSH_DELAY_MS
+#define FLASH_DISK_FLUSH_DELAY_MS 250 /**<\brief Time without writes after which the cache is flushed */
+#endif
+
+/**
+ * \brief A block device in the internal flash, with a write-back cache
+ * \details Call flash_disk_initialize() before using it.
+ */
+extern const BlockDevice flash_disk;
+
+void flash_disk_initialize();
+
+#endif /* HELPERS_FLASH_DISK_H_ */
@@ -0,0 +1,32 @@
+/*
+ * frame_grabber.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_FRAME_GRABBER_H_
+#define HELPERS_FRAME_GRABBER_H_
+
+#include <stdint.h>
+
+/*
+ * Copies bands of lines of the framebuffer shown by the LTDC (layer 1) into a buffer of ARGB8888
+ * pixels with the DMA2D, which converts them from the pixel format of the layer on the way. The
+ * layer is looked up at the start of each frame, so the application may move or reformat it.
+ * While the layer is off (or in a format the DMA2D cannot expand without the CLUT of the LTDC),
+ * the bands are filled with a plain color that changes from frame to frame instead.
+ */
+
+/**
+ * \brief Called from the DMA2D interrupt when a band is in the buffer
+ * \details The DMA2D interrupt has the priority of the USB interrupt, so they never preempt each other.
+ */
+typedef void (*FrameGrabberDone)();
+
+void frame_grabber_initialize(FrameGrabberDone done);
+uint8_t frame_grabber_open(uint16_t width, uint16_t height);
+void frame_grabber_start(uint32_t *pixels, uint16_t first_line, uint16_t line_count);
+void frame_grabber_abort();
+
+#endif /* HELPERS_FRAME_GRABBER_H_ */
@@ -13,4 +13,8 @@ extern LogLevel system_log_level;
 void log_error(char const * const format, ...);
 void log_info(char const * const format, ...);
 void log_debug(char const * const format, ...);
-void log_debug_array(char const * const label, void const *array, uint16_t const len);
\ No newline at end of file
+void log_debug_array(char const * const label, void const *array, uint16_t const len);
+
+/// Print the log lines of the interrupts, which are queued instead of printed (call it from the main loop).
+/// From an interrupt, a format may have up to 4 arguments, all of them 32-bit integers.
+void log_process();
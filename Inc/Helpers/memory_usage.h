@@ -0,0 +1,28 @@
+/*
+ * memory_usage.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_MEMORY_USAGE_H_
+#define HELPERS_MEMORY_USAGE_H_
+
+#include <stdint.h>
+
+/** \brief Stack and heap usage (all sizes in bytes) */
+typedef struct
+{
+	uint32_t stack_size; /**<\brief Stack size reserved by the linker script (_Min_Stack_Size). */
+	uint32_t stack_high_water_mark; /**<\brief The deepest stack usage seen since the stack was painted. */
+	uint32_t heap_size; /**<\brief Heap size reserved by the linker script (_Min_Heap_Size). */
+	uint32_t heap_used; /**<\brief Bytes handed out by _sbrk(). */
+	uint32_t heap_failed_requests; /**<\brief Count of _sbrk() requests refused for lack of memory. */
+	uint32_t unused_ram; /**<\brief RAM never touched between the end of the heap and the deepest stack usage. */
+} MemoryUsage;
+
+void memory_usage_paint_stack();
+void memory_usage_update();
+void memory_usage_read(MemoryUsage *memory_usage);
+
+#endif /* HELPERS_MEMORY_USAGE_H_ */
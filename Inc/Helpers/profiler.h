@@ -0,0 +1,35 @@
+/*
+ * profiler.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_PROFILER_H_
+#define HELPERS_PROFILER_H_
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 0 /**<\brief Stream PC samples and exception events over SWO */
+#endif
+
+#ifndef PROFILER_SAMPLE_DIVIDER
+#define PROFILER_SAMPLE_DIVIDER 16 /**<\brief One PC sample every (PROFILER_SAMPLE_DIVIDER * 1024) cycles (1..16) */
+#endif
+
+#ifndef PROFILER_SWO_BAUDRATE
+#define PROFILER_SWO_BAUDRATE 0 /**<\brief SWO bit rate to configure, or 0 to keep the debugger's settings */
+#endif
+
+#if PROFILER_ENABLED
+
+void profiler_start();
+void profiler_stop();
+
+#else
+
+inline static void profiler_start() {}
+inline static void profiler_stop() {}
+
+#endif
+
+#endif /* HELPERS_PROFILER_H_ */
@@ -0,0 +1,23 @@
+/*
+ * ram_disk.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_RAM_DISK_H_
+#define HELPERS_RAM_DISK_H_
+
+#include "Helpers/block_device.h"
+
+#ifndef RAM_DISK_BLOCK_COUNT
+#define RAM_DISK_BLOCK_COUNT 128 /**<\brief Size of the RAM disk in blocks (64 KiB) */
+#endif
+
+/**
+ * \brief A block device held in RAM, lost at reset
+ * \details It only depends on the C library, so the same backend serves a host build.
+ */
+extern const BlockDevice ram_disk;
+
+#endif /* HELPERS_RAM_DISK_H_ */
@@ -0,0 +1,41 @@
+/*
+ * ring_buffer.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_RING_BUFFER_H_
+#define HELPERS_RING_BUFFER_H_
+
+#include <stdint.h>
+
+/**
+ * \brief A byte ring with one producer and one consumer (e.g. an interrupt and the main loop)
+ * \details The size is a power of 2 and the indexes run freely (they wrap at 2^32), so the ring
+ * can be completely filled. Each index is only written by its owner, so no locking is needed.
+ *
+ * Besides copying, the ring hands out its contiguous free and used spans, so a driver can move
+ * packets between the FIFO and the ring without an intermediate buffer.
+ */
+typedef struct
+{
+	uint8_t *buffer;
+	uint32_t size;
+	volatile uint32_t write_index; /**<\brief Only written by the producer. */
+	volatile uint32_t read_index; /**<\brief Only written by the consumer. */
+} RingBuffer;
+
+void ring_buffer_initialize(RingBuffer *ring, uint8_t *buffer, uint32_t size);
+uint32_t ring_buffer_used(RingBuffer const *ring);
+uint32_t ring_buffer_free(RingBuffer const *ring);
+
+uint32_t ring_buffer_write(RingBuffer *ring, void const *data, uint32_t size);
+uint32_t ring_buffer_write_span(RingBuffer const *ring, uint8_t **span);
+void ring_buffer_commit(RingBuffer *ring, uint32_t size);
+
+uint32_t ring_buffer_read(RingBuffer *ring, void *data, uint32_t size);
+uint32_t ring_buffer_read_span(RingBuffer const *ring, uint8_t const **span);
+void ring_buffer_consume(RingBuffer *ring, uint32_t size);
+
+#endif /* HELPERS_RING_BUFFER_H_ */
@@ -0,0 +1,87 @@
+/*
+ * sample_format.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef HELPERS_SAMPLE_FORMAT_H_
+#define HELPERS_SAMPLE_FORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * Conversion kernels between the sample formats of USB audio packets and the internal formats.
+ *
+ * A packet holds signed little-endian samples of 2, 3 (packed) or 4 bytes, interleaved by channel,
+ * at any alignment. Internally a sample is 32 bits, left-justified (full scale is the full range
+ * of int32_t), or 16 bits where the stream never needs more. Narrowing rounds to nearest and
+ * saturates. Gains are Q2.14: SAMPLE_FORMAT_UNITY_GAIN is 1.0, the range is -2.0 to 2.0.
+ *
+ * The kernels use the SIMD instructions of the Cortex-M4 where the core has them (see
+ * SAMPLE_FORMAT_SIMD) and fall back to the reference kernels otherwise. The reference kernels
+ * are plain portable C and always built: Tools/sample_format_check.c runs both on the host and
+ * compares them.
+ */
+
+/// \brief Use the DSP instructions of the core (on by default when the compiler targets them)
+#ifndef SAMPLE_FORMAT_SIMD
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#define SAMPLE_FORMAT_SIMD 1
+#else
+#define SAMPLE_FORMAT_SIMD 0
+#endif
+#endif
+
+/// \brief A gain of 1.0 in Q2.14
+#define SAMPLE_FORMAT_UNITY_GAIN (1 << 14)
+
+/** \name Packet samples to 32-bit samples
+ *@{*/
+void sample_format_from_s16(int32_t *samples, void const *data, uint32_t count);
+void sample_format_from_s24(int32_t *samples, void const *data, uint32_t count);
+void sample_format_from_s32(int32_t *samples, void const *data, uint32_t count);
+/**@}*/
+
+/** \name 32-bit samples to packet samples
+ *@{*/
+void sample_format_to_s16(void *data, int32_t const *samples, uint32_t count);
+void sample_format_to_s24(void *data, int32_t const *samples, uint32_t count);
+void sample_format_to_s32(void *data, int32_t const *samples, uint32_t count);
+/**@}*/
+
+/** \name Stereo frames to and from separate channels
+ *@{*/
+void sample_format_deinterleave(int32_t *left, int32_t *right, int32_t const *frames, uint32_t frame_count);
+void sample_format_interleave(int32_t *frames, int32_t const *left, int32_t const *right, uint32_t frame_count);
+void sample_format_deinterleave_s16(int16_t *left, int16_t *right, int16_t const *frames, uint32_t frame_count);
+void sample_format_interleave_s16(int16_t *frames, int16_t const *left, int16_t const *right, uint32_t frame_count);
+/**@}*/
+
+/** \name Gain and mixing in place
+ *@{*/
+void sample_format_gain(int32_t *samples, uint32_t count, int16_t gain);
+void sample_format_gain_s16(int16_t *samples, uint32_t count, int16_t gain);
+void sample_format_mix(int32_t *samples, int32_t const *source, uint32_t count);
+void sample_format_mix_s16(int16_t *samples, int16_t const *source, uint32_t count);
+/**@}*/
+
+/** \name The reference kernels (portable C, the same results as the kernels above)
+ *@{*/
+void sample_format_reference_from_s16(int32_t *samples, void const *data, uint32_t count);
+void sample_format_reference_from_s24(int32_t *samples, void const *data, uint32_t count);
+void sample_format_reference_from_s32(int32_t *samples, void const *data, uint32_t count);
+void sample_format_reference_to_s16(void *data, int32_t const *samples, uint32_t count);
+void sample_format_reference_to_s24(void *data, int32_t const *samples, uint32_t count);
+void sample_format_reference_to_s32(void *data, int32_t const *samples, uint32_t count);
+void sample_format_reference_deinterleave(int32_t *left, int32_t *right, int32_t const *frames, uint32_t frame_count);
+void sample_format_reference_interleave(int32_t *frames, int32_t const *left, int32_t const *right, uint32_t frame_count);
+void sample_format_reference_deinterleave_s16(int16_t *left, int16_t *right, int16_t const *frames, uint32_t frame_count);
+void sample_format_reference_interleave_s16(int16_t *frames, int16_t const *left, int16_t const *right, uint32_t frame_count);
+void sample_format_reference_gain(int32_t *samples, uint32_t count, int16_t gain);
+void sample_format_reference_gain_s16(int16_t *samples, uint32_t count, int16_t gain);
+void sample_format_reference_mix(int32_t *samples, int32_t const *source, uint32_t count);
+void sample_format_reference_mix_s16(int16_t *samples, int16_t const *source, uint32_t count);
+/**@}*/
+
+#endif /* HELPERS_SAMPLE_FORMAT_H_ */
@@ -20,7 +20,10 @@ typedef struct
 	/** \defgroup usbDeviceOutInVufferPointers
 	 *@{*/
 	void const *ptr_out_buffer;
+	/// \brief Count of bytes received in the data stage of a control OUT request
 	uint32_t out_data_size;
+	/// \brief Where the data stage of a control OUT request is received (provided by the request handler)
+	void *ptr_control_out_data;
 	void const *ptr_in_buffer;
 	uint32_t in_data_size;
 	/**@}*/
@@ -20,12 +20,31 @@ typedef struct
 {
  void (*on_usb_reset_received)();
  void (*on_setup_data_received)(uint8_t endpoint_number, uint16_t bcnt);
+ void (*on_setup_stage_completed)(uint8_t endpoint_number);
  void (*on_out_data_received)(uint8_t endpoint_number, uint16_t bcnt);
  void (*on_in_transfer_completed)(uint8_t endpoint_number);
  void (*on_out_transfer_completed)(uint8_t endpoint_number);
+ void (*on_start_of_frame_received)();
+ void (*on_end_of_periodic_frame)();
  void (*on_usb_polled)();
 } UsbEvents;
 
+/// \brief The transfer events of a non-control endpoint, handled by the function that owns it
+typedef struct
+{
+ void (*on_out_data_received)(uint8_t endpoint_number, uint16_t bcnt);
+ void (*on_out_transfer_completed)(uint8_t endpoint_number);
+ void (*on_in_transfer_completed)(uint8_t endpoint_number);
+ /// Optional: the endpoint was activated by SET_CONFIGURATION or SET_INTERFACE
+ void (*on_endpoint_activated)(uint8_t endpoint_address, uint16_t max_packet_size);
+ /// Optional: the endpoint was deactivated (bus reset, SET_CONFIGURATION or SET_INTERFACE), its transfer was dropped
+ void (*on_endpoint_deactivated)(uint8_t endpoint_address);
+ /// Optional: the host cleared the halt of the endpoint, its transfer in progress was dropped
+ void (*on_endpoint_halt_cleared)(uint8_t endpoint_address);
+ /// Optional (IN endpoints): the frame is about to end (see USBD_PERIODIC_FRAME_INTERVAL), the last chance to arm the next one
+ void (*on_end_of_periodic_frame)(uint8_t endpoint_address);
+} UsbEndpointHandler;
+
 typedef enum
 {
 	USB_DEVICE_STATE_DEFAULT,
@@ -39,7 +58,6 @@ typedef enum
 	USB_CONTROL_STAGE_SETUP, // Can also be called USB_CONTROL_STAGE_IDLE
 	USB_CONTROL_STAGE_DATA_OUT,
 	USB_CONTROL_STAGE_DATA_IN,
-	USB_CONTROL_STAGE_DATA_IN_IDLE,
 	USB_CONTROL_STAGE_DATA_IN_ZERO,
 	USB_CONTROL_STAGE_STATUS_OUT,
 	USB_CONTROL_STAGE_STATUS_IN
@@ -66,6 +84,7 @@ typedef struct
 #define USB_BM_REQUEST_TYPE_TYPE_STANDARD (0 << 5)
 #define USB_BM_REQUEST_TYPE_TYPE_CLASS (1 << 5)
 #define USB_BM_REQUEST_TYPE_TYPE_VENDOR (2 << 5)
+#define USB_BM_REQUEST_TYPE_TYPE_RESERVED (3 << 5)
 
 #define USB_BM_REQUEST_TYPE_RECIPIENT_MASK (3 << 0)
 #define USB_BM_REQUEST_TYPE_RECIPIENT_DEVICE (0 << 0)
@@ -89,6 +108,20 @@ typedef struct
 #define USB_STANDARD_SYNCH_FRAME 0x0C /**<\brief Set and then report an endpoint's synchronization */
 /**@}*/
 
+/** \name USB standard feature selectors (wValue of CLEAR_FEATURE and SET_FEATURE)
+ *@{*/
+#define USB_FEATURE_ENDPOINT_HALT 0x00 /**<\brief Endpoint recipient */
+#define USB_FEATURE_DEVICE_REMOTE_WAKEUP 0x01 /**<\brief Device recipient */
+#define USB_FEATURE_TEST_MODE 0x02 /**<\brief Device recipient (high-speed only) */
+/**@}*/
+
+/** \name USB standard status bits (data stage of GET_STATUS)
+ *@{*/
+#define USB_STATUS_DEVICE_SELF_POWERED (1 << 0)
+#define USB_STATUS_DEVICE_REMOTE_WAKEUP (1 << 1)
+#define USB_STATUS_ENDPOINT_HALT (1 << 0)
+/**@}*/
+
 /** \name USB standard descriptor types
  * @{ */
 #define USB_DESCRIPTOR_TYPE_DEVICE 0x01
@@ -102,6 +135,8 @@ typedef struct
 #define USB_DESCRIPTOR_TYPE_OTG 0x09
 #define USB_DESCRIPTOR_TYPE_DEBUG 0x0A
 #define USB_DESCRIPTOR_TYPE_INTERFASEASSOC 0x0B
+#define USB_DESCRIPTOR_TYPE_BOS 0x0F
+#define USB_DESCRIPTOR_TYPE_DEVICE_CAPABILITY 0x10
 #define USB_DESCRIPTOR_TYPE_CS_INTERFACE 0x24
 #define USB_DESCRIPTOR_TYPE_CS_ENDPOINT 0x25
 /** @} */
@@ -110,11 +145,14 @@ typedef struct
  * @{ */
 #define USB_CLASS_PER_INTERFACE 0x00 /**<\brief Class defined on interface level */
 #define USB_CLASS_AUDIO 0x01 /**<\brief Audio device class */
+#define USB_CLASS_CDC 0x02 /**<\brief Communications device class (communication interface) */
+#define USB_CLASS_HID 0x03 /**<\brief Human interface device class */
 #define USB_CLASS_PHYSICAL 0x05 /**<\brief Physical device class */
 #define USB_CLASS_STILL_IMAGE 0x06 /**<\brief Still Imaging device class */
 #define USB_CLASS_PRINTER 0x07 /**<\brief Printer device class */
 #define USB_CLASS_MASS_STORAGE 0x08 /**<\brief Mass Storage device class */
 #define USB_CLASS_HUB 0x09 /**<\brief HUB device class */
+#define USB_CLASS_CDC_DATA 0x0A /**<\brief Communications device class (data interface) */
 #define USB_CLASS_CSCID 0x0B /**<\brief Smart Card device class */
 #define USB_CLASS_CONTENT_SEC 0x0D /**<\brief Content Security device class */
 #define USB_CLASS_VIDEO 0x0E /**<\brief Video device class */
@@ -127,7 +165,7 @@ typedef struct
 #define USB_CLASS_MISC 0xEF /**<\brief Miscellaneous device class */
 #define USB_CLASS_IAD 0xEF /**<\brief Class defined on interface association level */
 #define USB_CLASS_APP_SPEC 0xFE /**<\brief Application Specific class */
-#define USB_CLASS_VENDOR 0xFE /**<\brief Vendor specific class */
+#define USB_CLASS_VENDOR 0xFF /**<\brief Vendor specific class */
 
 #define USB_SUBCLASS_NONE 0x00 /**<\brief No subclass defined */
 #define USB_SUBCLASS_IAD 0x02 /**<\brief Subclass defined on interface association level */
@@ -144,7 +182,7 @@ typedef struct
  * device has only one device descriptor. A high-speed capable device that has different device
  * information for full-speed and high-speed must also have a \ref usb_qualifier_descriptor.
  */
-typedef struct {
+typedef struct __attribute__((packed)) {
 	uint8_t bLength; /**<\brief Size of the descriptor (in bytes). */
 	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_DEVICE device descriptor. */
 	uint16_t bcdUSB; /**<\brief USB specification release number. */
@@ -161,10 +199,13 @@ typedef struct {
 	uint8_t bNumConfigurations; /**<\brief Total number of configurations supported by the USB device. */
 } UsbDeviceDescriptor;
 
-typedef struct {
+/**\brief Represent a USB standard configuration descriptor
+ * \details It is followed by the descriptors of all interfaces and endpoints of the configuration.
+ */
+typedef struct __attribute__((packed)) {
 	uint8_t bLength; /**<\brief Size of the descriptor (in bytes). */
 	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_CONFIGURATION descriptor. */
-	uint8_t wTotalLength; /**<\brief Size of the configuration descriptor header, and all subdescriptors. */
+	uint16_t wTotalLength; /**<\brief Size of the configuration descriptor header, and all subdescriptors. */
 	uint8_t bNumInterfaces; /**<\brief Total number of interfaces in the configuration. */
 	uint8_t bConfigurationValue; /**<\brief Configuration value of the current configuration descriptor. */
 	uint8_t iConfiguration; /**<\brief Index of a string descriptor describing this configuration. */
@@ -172,4 +213,116 @@ typedef struct {
 	uint8_t bMaxPower; /**<\brief Maximum power consumption of the device. */
 } UsbConfigurationDescriptor;
 
+/** \name USB configuration attributes
+ * @{ */
+#define USB_CONFIGURATION_ATTRIBUTES_RESERVED (1 << 7) /**<\brief Must always be set */
+#define USB_CONFIGURATION_ATTRIBUTES_SELF_POWERED (1 << 6)
+#define USB_CONFIGURATION_ATTRIBUTES_REMOTE_WAKEUP (1 << 5)
+/** @} */
+
+/**\brief Represent a USB interface association descriptor
+ * \details It precedes the interfaces of a function of a composite device and groups them.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t bLength; /**<\brief Size of the descriptor (in bytes). */
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_INTERFASEASSOC descriptor. */
+	uint8_t bFirstInterface; /**<\brief Number of the first interface of the function. */
+	uint8_t bInterfaceCount; /**<\brief Count of contiguous interfaces of the function. */
+	uint8_t bFunctionClass; /**<\brief USB function class. */
+	uint8_t bFunctionSubClass; /**<\brief USB function subclass. */
+	uint8_t bFunctionProtocol; /**<\brief USB function protocol. */
+	uint8_t iFunction; /**<\brief Index of a string descriptor describing this function. */
+} UsbInterfaceAssociationDescriptor;
+
+/**\brief Represent a USB standard interface descriptor
+ * \details It is followed by the descriptors of the endpoints of the interface.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t bLength; /**<\brief Size of the descriptor (in bytes). */
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_INTERFACE descriptor. */
+	uint8_t bInterfaceNumber; /**<\brief Zero-based number of the interface. */
+	uint8_t bAlternateSetting; /**<\brief Value used to select this alternate setting. */
+	uint8_t bNumEndpoints; /**<\brief Count of endpoints used by the interface (excluding endpoint0). */
+	uint8_t bInterfaceClass; /**<\brief USB interface class. */
+	uint8_t bInterfaceSubClass; /**<\brief USB interface subclass. */
+	uint8_t bInterfaceProtocol; /**<\brief USB interface protocol. */
+	uint8_t iInterface; /**<\brief Index of a string descriptor describing this interface. */
+} UsbInterfaceDescriptor;
+
+/**\brief Represent a USB standard endpoint descriptor */
+typedef struct __attribute__((packed)) {
+	uint8_t bLength; /**<\brief Size of the descriptor (in bytes). */
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_ENDPOINT descriptor. */
+	uint8_t bEndpointAddress; /**<\brief Endpoint number, bit 7 is set for IN endpoints. */
+	uint8_t bmAttributes; /**<\brief \ref UsbEndpointType of the endpoint (and the isochronous synchronization type). */
+	uint16_t wMaxPacketSize; /**<\brief Maximum packet size of the endpoint. */
+	uint8_t bInterval; /**<\brief Polling interval in frames (interrupt and isochronous endpoints). */
+} UsbEndpointDescriptor;
+
+/** \name USB endpoint attributes (bmAttributes of isochronous endpoints, added to the \ref UsbEndpointType)
+ * @{ */
+#define USB_ENDPOINT_TYPE_MASK 0x03
+#define USB_ENDPOINT_SYNC_ASYNCHRONOUS (1 << 2) /**<\brief Runs on its own clock (a sink tells the host its rate through a feedback endpoint) */
+#define USB_ENDPOINT_SYNC_ADAPTIVE (2 << 2)
+#define USB_ENDPOINT_SYNC_SYNCHRONOUS (3 << 2)
+#define USB_ENDPOINT_USAGE_FEEDBACK (1 << 4) /**<\brief Carries the rate of the data endpoint it is synchronized with */
+/** @} */
+
+/**\brief Represent the endpoint descriptor of USB 1.x audio streaming endpoints
+ * \details Audio 1.0 keeps the two trailing fields that USB 2.0 removed from \ref UsbEndpointDescriptor.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t bLength; /**<\brief Size of the descriptor (in bytes). */
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_ENDPOINT descriptor. */
+	uint8_t bEndpointAddress; /**<\brief Endpoint number, bit 7 is set for IN endpoints. */
+	uint8_t bmAttributes; /**<\brief \ref UsbEndpointType of the endpoint and its synchronization and usage types. */
+	uint16_t wMaxPacketSize; /**<\brief Maximum packet size of the endpoint. */
+	uint8_t bInterval; /**<\brief Polling interval in frames (1 for isochronous endpoints). */
+	uint8_t bRefresh; /**<\brief Feedback endpoints: the feedback is updated every 2^bRefresh frames, 0 otherwise. */
+	uint8_t bSynchAddress; /**<\brief Data endpoints: the address of their feedback endpoint, 0 otherwise. */
+} UsbAudioEndpointDescriptor;
+
+/** \name USB string descriptors
+ * @{ */
+#define USB_LANGID_ENGLISH_US 0x0409
+
+/**
+ * \brief Declare a string descriptor type sized for `string` (a u"" literal)
+ * \details The string is stored in UTF-16LE without its terminating null.
+ */
+#define USB_STRING_DESCRIPTOR_STRUCT(string) struct __attribute__((packed)) { \
+	uint8_t bLength; \
+	uint8_t bDescriptorType; \
+	uint16_t bString[sizeof(string) / sizeof(uint16_t) - 1]; \
+}
+
+/// \brief Initialize a string descriptor declared with \ref USB_STRING_DESCRIPTOR_STRUCT
+#define USB_STRING_DESCRIPTOR(string) { \
+	.bLength = sizeof(string), /* 2 bytes of header instead of the terminating null */ \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_STRING, \
+	.bString = string \
+}
+/** @} */
+
+/**\brief Represent a USB binary device object store (BOS) descriptor
+ * \details It is followed by the device capability descriptors. Hosts only read it from devices
+ * with bcdUSB 0x0201 or higher.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t bLength; /**<\brief Size of this descriptor (in bytes). */
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_BOS descriptor. */
+	uint16_t wTotalLength; /**<\brief Size of this descriptor and all device capability descriptors. */
+	uint8_t bNumDeviceCaps; /**<\brief Count of the device capability descriptors. */
+} UsbBosDescriptor;
+
+#define USB_DEVICE_CAPABILITY_USB20_EXTENSION 0x02
+
+/**\brief Represent a USB 2.0 extension device capability descriptor */
+typedef struct __attribute__((packed)) {
+	uint8_t bLength; /**<\brief Size of the descriptor (in bytes). */
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_DEVICE_CAPABILITY descriptor. */
+	uint8_t bDevCapabilityType; /**<\brief \ref USB_DEVICE_CAPABILITY_USB20_EXTENSION capability. */
+	uint32_t bmAttributes; /**<\brief Bit 1 is set when the link power management is supported. */
+} UsbUsb20ExtensionDescriptor;
+
 #endif /* USB_STANDARDS_H_ */
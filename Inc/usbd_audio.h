@@ -0,0 +1,211 @@
+/*
+ * usbd_audio.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_AUDIO_H_
+#define USBD_AUDIO_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+
+/** \name Audio 1.0 subclass codes
+ *@{*/
+#define USB_SUBCLASS_AUDIO_CONTROL 0x01
+#define USB_SUBCLASS_AUDIO_STREAMING 0x02
+/**@}*/
+
+/** \name Audio class-specific descriptor subtypes
+ *@{*/
+#define USB_AUDIO_SUBTYPE_HEADER 0x01 /**<\brief Audio control interface */
+#define USB_AUDIO_SUBTYPE_INPUT_TERMINAL 0x02 /**<\brief Audio control interface */
+#define USB_AUDIO_SUBTYPE_OUTPUT_TERMINAL 0x03 /**<\brief Audio control interface */
+#define USB_AUDIO_SUBTYPE_AS_GENERAL 0x01 /**<\brief Audio streaming interface */
+#define USB_AUDIO_SUBTYPE_FORMAT_TYPE 0x02 /**<\brief Audio streaming interface */
+#define USB_AUDIO_SUBTYPE_EP_GENERAL 0x01 /**<\brief Isochronous data endpoint */
+/**@}*/
+
+/** \name Audio terminal types and formats
+ *@{*/
+#define USB_AUDIO_TERMINAL_USB_STREAMING 0x0101
+#define USB_AUDIO_TERMINAL_MICROPHONE 0x0201
+#define USB_AUDIO_TERMINAL_SPEAKER 0x0301
+#define USB_AUDIO_FORMAT_PCM 0x0001 /**<\brief wFormatTag */
+#define USB_AUDIO_FORMAT_TYPE_I 0x01 /**<\brief bFormatType */
+/**@}*/
+
+/** \name The streams of the function
+ *@{*/
+#define USBD_AUDIO_SAMPLE_RATE 48000
+#define USBD_AUDIO_SPEAKER_CHANNELS 2
+#define USBD_AUDIO_MICROPHONE_CHANNELS 1
+/// \brief The terminals of the audio control interface: USB -> speaker and microphone -> USB
+#define USBD_AUDIO_TERMINAL_SPEAKER_INPUT 1
+#define USBD_AUDIO_TERMINAL_SPEAKER_OUTPUT 2
+#define USBD_AUDIO_TERMINAL_MICROPHONE_INPUT 3
+#define USBD_AUDIO_TERMINAL_MICROPHONE_OUTPUT 4
+/// \brief The feedback is updated every 2^USBD_AUDIO_FEEDBACK_REFRESH frames (bRefresh)
+#define USBD_AUDIO_FEEDBACK_REFRESH 1
+/**@}*/
+
+/**
+ * \brief The largest packet of a stream
+ * \details Both clocks drift, so a frame carries one sample per channel more than the nominal rate.
+ */
+#define USBD_AUDIO_PACKET_SIZE(channels, bytes_per_sample) \
+	((USBD_AUDIO_SAMPLE_RATE / 1000 + 1) * (channels) * (bytes_per_sample))
+
+/** \brief The header of the audio control interface, followed by its terminals */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_CS_INTERFACE */
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_AUDIO_SUBTYPE_HEADER */
+	uint16_t bcdADC;
+	uint16_t wTotalLength; /**<\brief Size of the header and of all terminals and units. */
+	uint8_t bInCollection; /**<\brief Count of streaming interfaces. */
+	uint8_t baInterfaceNr[2];
+} UsbAudioHeaderDescriptor;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_AUDIO_SUBTYPE_INPUT_TERMINAL */
+	uint8_t bTerminalID;
+	uint16_t wTerminalType;
+	uint8_t bAssocTerminal;
+	uint8_t bNrChannels;
+	uint16_t wChannelConfig; /**<\brief Spatial location of the channels (bit 0 - left front, bit 1 - right front). */
+	uint8_t iChannelNames;
+	uint8_t iTerminal;
+} UsbAudioInputTerminalDescriptor;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_AUDIO_SUBTYPE_OUTPUT_TERMINAL */
+	uint8_t bTerminalID;
+	uint16_t wTerminalType;
+	uint8_t bAssocTerminal;
+	uint8_t bSourceID;
+	uint8_t iTerminal;
+} UsbAudioOutputTerminalDescriptor;
+
+/** \brief Links a streaming interface to its terminal */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_AUDIO_SUBTYPE_AS_GENERAL */
+	uint8_t bTerminalLink;
+	uint8_t bDelay;
+	uint16_t wFormatTag;
+} UsbAudioStreamingDescriptor;
+
+/** \brief The format of a streaming alternate setting (a single sample rate) */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_AUDIO_SUBTYPE_FORMAT_TYPE */
+	uint8_t bFormatType;
+	uint8_t bNrChannels;
+	uint8_t bSubframeSize; /**<\brief Bytes per sample. */
+	uint8_t bBitResolution;
+	uint8_t bSamFreqType; /**<\brief Count of discrete sample rates. */
+	uint8_t tSamFreq[3];
+} UsbAudioFormatDescriptor;
+
+/** \brief Follows the endpoint descriptor of an isochronous data endpoint */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_CS_ENDPOINT */
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_AUDIO_SUBTYPE_EP_GENERAL */
+	uint8_t bmAttributes; /**<\brief Controls of the endpoint (none). */
+	uint8_t bLockDelayUnits;
+	uint16_t wLockDelay;
+} UsbAudioDataEndpointDescriptor;
+
+/** \name Initializers of the class-specific descriptors (used by the configuration lists)
+ *@{*/
+#define USBD_AUDIO_HEADER_DESCRIPTOR(speaker_interface, microphone_interface) { \
+	.bLength = sizeof(UsbAudioHeaderDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_AUDIO_SUBTYPE_HEADER, \
+	.bcdADC = 0x0100, \
+	.wTotalLength = sizeof(UsbAudioHeaderDescriptor) + 2 * sizeof(UsbAudioInputTerminalDescriptor) + \
+		2 * sizeof(UsbAudioOutputTerminalDescriptor), \
+	.bInCollection = 2, \
+	.baInterfaceNr = { (speaker_interface), (microphone_interface) } \
+}
+
+#define USBD_AUDIO_INPUT_TERMINAL_DESCRIPTOR(id, type, channels, channel_config) { \
+	.bLength = sizeof(UsbAudioInputTerminalDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_AUDIO_SUBTYPE_INPUT_TERMINAL, \
+	.bTerminalID = (id), \
+	.wTerminalType = (type), \
+	.bAssocTerminal = 0, \
+	.bNrChannels = (channels), \
+	.wChannelConfig = (channel_config), \
+	.iChannelNames = 0, \
+	.iTerminal = 0 \
+}
+
+#define USBD_AUDIO_OUTPUT_TERMINAL_DESCRIPTOR(id, type, source) { \
+	.bLength = sizeof(UsbAudioOutputTerminalDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_AUDIO_SUBTYPE_OUTPUT_TERMINAL, \
+	.bTerminalID = (id), \
+	.wTerminalType = (type), \
+	.bAssocTerminal = 0, \
+	.bSourceID = (source), \
+	.iTerminal = 0 \
+}
+
+// The delay is one packet: a frame is received completely before it is played
+#define USBD_AUDIO_STREAMING_DESCRIPTOR(terminal) { \
+	.bLength = sizeof(UsbAudioStreamingDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_AUDIO_SUBTYPE_AS_GENERAL, \
+	.bTerminalLink = (terminal), \
+	.bDelay = 1, \
+	.wFormatTag = USB_AUDIO_FORMAT_PCM \
+}
+
+#define USBD_AUDIO_FORMAT_DESCRIPTOR(channels, bytes_per_sample) { \
+	.bLength = sizeof(UsbAudioFormatDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_AUDIO_SUBTYPE_FORMAT_TYPE, \
+	.bFormatType = USB_AUDIO_FORMAT_TYPE_I, \
+	.bNrChannels = (channels), \
+	.bSubframeSize = (bytes_per_sample), \
+	.bBitResolution = 8 * (bytes_per_sample), \
+	.bSamFreqType = 1, \
+	.tSamFreq = { USBD_AUDIO_SAMPLE_RATE & 0xFF, (USBD_AUDIO_SAMPLE_RATE >> 8) & 0xFF, USBD_AUDIO_SAMPLE_RATE >> 16 } \
+}
+
+// The only sample rate needs no sampling frequency control
+#define USBD_AUDIO_DATA_ENDPOINT_DESCRIPTOR { \
+	.bLength = sizeof(UsbAudioDataEndpointDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_ENDPOINT, \
+	.bDescriptorSubtype = USB_AUDIO_SUBTYPE_EP_GENERAL, \
+	.bmAttributes = 0, \
+	.bLockDelayUnits = 0, \
+	.wLockDelay = 0 \
+}
+/**@}*/
+
+/// \brief Receives the speaker stream and sends its rate back on the feedback endpoint
+extern const UsbEndpointHandler usbd_audio_speaker_endpoint_handler;
+/// \brief Sends the microphone stream at the rate of the audio clock
+extern const UsbEndpointHandler usbd_audio_microphone_endpoint_handler;
+
+void usbd_audio_initialize();
+
+#endif /* USBD_AUDIO_H_ */
@@ -0,0 +1,73 @@
+/*
+ * usbd_capture.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_CAPTURE_H_
+#define USBD_CAPTURE_H_
+
+#include <stdint.h>
+#include "usbd_config.h"
+
+/// \brief Identifies a capture buffer in a memory dump ("UCAP")
+#define USBD_CAPTURE_MAGIC 0x50414355
+#define USBD_CAPTURE_VERSION 1
+
+/** \name Captured packet events
+ *@{*/
+#define USBD_CAPTURE_EVENT_SETUP 0x00 /**<\brief A SETUP packet was received */
+#define USBD_CAPTURE_EVENT_OUT 0x01 /**<\brief An OUT data packet was received */
+#define USBD_CAPTURE_EVENT_IN 0x02 /**<\brief An IN data packet was pushed to the TxFIFO */
+/**@}*/
+
+/** \brief One captured packet (header and the first bytes of its payload) */
+typedef struct
+{
+	uint32_t timestamp; /**<\brief Value of the cycle counter when the packet was captured. */
+	uint16_t frame_number; /**<\brief Frame number of the last received SOF. */
+	uint16_t length; /**<\brief Full length of the packet in bytes. */
+	uint8_t endpoint_address; /**<\brief Endpoint number, bit 7 is set for IN endpoints. */
+	uint8_t transfer_type; /**<\brief \ref UsbEndpointType of the endpoint. */
+	uint8_t event; /**<\brief One of USBD_CAPTURE_EVENT_* values. */
+	uint8_t captured_length; /**<\brief Count of payload bytes stored in `data`. */
+	uint8_t device_address; /**<\brief The address assigned to the device when the packet was captured. */
+	uint8_t reserved[3];
+	uint8_t data[USBD_CAPTURE_PAYLOAD_SIZE];
+} UsbCaptureRecord;
+
+/**
+ * \brief The capture ring as laid out in memory
+ * \details The host tool (Tools/usbd_capture_to_pcapng.py) parses a raw dump of this structure, so
+ * any change of the layout must bump \ref USBD_CAPTURE_VERSION.
+ */
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t record_count;
+	uint32_t timestamp_frequency; /**<\brief Frequency of the cycle counter in Hz. */
+	volatile uint32_t write_index; /**<\brief Count of captured packets since the capture was started. */
+	volatile uint32_t enabled;
+	UsbCaptureRecord records[USBD_CAPTURE_RECORD_COUNT];
+} UsbCaptureBuffer;
+
+#if USBD_CAPTURE_ENABLED
+
+extern UsbCaptureBuffer usbd_capture_buffer;
+
+void usbd_capture_start();
+void usbd_capture_stop();
+void usbd_capture_packet(uint8_t event, uint8_t endpoint_address, uint8_t transfer_type, void const *data, uint16_t length);
+
+#else
+
+inline static void usbd_capture_start() {}
+inline static void usbd_capture_stop() {}
+inline static void usbd_capture_packet(uint8_t event, uint8_t endpoint_address, uint8_t transfer_type, void const *data, uint16_t length) {}
+
+#endif
+
+#endif /* USBD_CAPTURE_H_ */
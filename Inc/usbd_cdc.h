@@ -0,0 +1,142 @@
+/*
+ * usbd_cdc.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_CDC_H_
+#define USBD_CDC_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+
+/** \name CDC subclass and protocol codes
+ *@{*/
+#define USB_SUBCLASS_CDC_ACM 0x02 /**<\brief Abstract control model */
+#define USB_PROTOCOL_CDC_NONE 0x00 /**<\brief No class-specific protocol (a plain serial port) */
+/**@}*/
+
+/** \name CDC functional descriptor subtypes
+ *@{*/
+#define USB_CDC_SUBTYPE_HEADER 0x00
+#define USB_CDC_SUBTYPE_CALL_MANAGEMENT 0x01
+#define USB_CDC_SUBTYPE_ACM 0x02
+#define USB_CDC_SUBTYPE_UNION 0x06
+/**@}*/
+
+/** \name CDC-ACM class requests
+ *@{*/
+#define USB_CDC_REQUEST_SET_LINE_CODING 0x20 /**<\brief Set the baud rate, stop bits, parity and data bits */
+#define USB_CDC_REQUEST_GET_LINE_CODING 0x21 /**<\brief Return the line coding */
+#define USB_CDC_REQUEST_SET_CONTROL_LINE_STATE 0x22 /**<\brief Set the DTR and RTS signals */
+#define USB_CDC_REQUEST_SEND_BREAK 0x23 /**<\brief Send a break of wValue milliseconds */
+/**@}*/
+
+/** \name CDC-ACM control line state (wValue of SET_CONTROL_LINE_STATE)
+ *@{*/
+#define USB_CDC_CONTROL_LINE_DTR (1 << 0)
+#define USB_CDC_CONTROL_LINE_RTS (1 << 1)
+/**@}*/
+
+/** \name CDC-ACM serial state (data of the SERIAL_STATE notification)
+ *@{*/
+#define USB_CDC_NOTIFICATION_SERIAL_STATE 0x20
+#define USB_CDC_SERIAL_STATE_DCD (1 << 0)
+#define USB_CDC_SERIAL_STATE_DSR (1 << 1)
+/**@}*/
+
+/** \brief The header functional descriptor, first of the functional descriptors */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_CS_INTERFACE */
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_CDC_SUBTYPE_HEADER */
+	uint16_t bcdCDC;
+} UsbCdcHeaderDescriptor;
+
+/** \brief The call management functional descriptor */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_CDC_SUBTYPE_CALL_MANAGEMENT */
+	uint8_t bmCapabilities;
+	uint8_t bDataInterface;
+} UsbCdcCallManagementDescriptor;
+
+/** \brief The abstract control management functional descriptor */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_CDC_SUBTYPE_ACM */
+	uint8_t bmCapabilities;
+} UsbCdcAcmDescriptor;
+
+/** \brief The union functional descriptor, which binds the data interface to the communication interface */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_CDC_SUBTYPE_UNION */
+	uint8_t bControlInterface;
+	uint8_t bSubordinateInterface0;
+} UsbCdcUnionDescriptor;
+
+/** \name Initializers of the functional descriptors (used by the configuration lists)
+ *@{*/
+#define USBD_CDC_HEADER_DESCRIPTOR { \
+	.bLength = sizeof(UsbCdcHeaderDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_CDC_SUBTYPE_HEADER, \
+	.bcdCDC = 0x0110 \
+}
+
+// The device does not handle call management
+#define USBD_CDC_CALL_MANAGEMENT_DESCRIPTOR(data_interface) { \
+	.bLength = sizeof(UsbCdcCallManagementDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_CDC_SUBTYPE_CALL_MANAGEMENT, \
+	.bmCapabilities = 0x00, \
+	.bDataInterface = (data_interface) \
+}
+
+// Supports SET_LINE_CODING, GET_LINE_CODING, SET_CONTROL_LINE_STATE (0x02) and SEND_BREAK (0x04)
+#define USBD_CDC_ACM_DESCRIPTOR { \
+	.bLength = sizeof(UsbCdcAcmDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_CDC_SUBTYPE_ACM, \
+	.bmCapabilities = 0x06 \
+}
+
+#define USBD_CDC_UNION_DESCRIPTOR(control_interface, data_interface) { \
+	.bLength = sizeof(UsbCdcUnionDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_CDC_SUBTYPE_UNION, \
+	.bControlInterface = (control_interface), \
+	.bSubordinateInterface0 = (data_interface) \
+}
+/**@}*/
+
+/** \brief The line coding set by the host (the device does not use it, it has no UART) */
+typedef struct __attribute__((packed))
+{
+	uint32_t dwDTERate; /**<\brief Baud rate */
+	uint8_t bCharFormat; /**<\brief Stop bits: 0 - 1, 1 - 1.5, 2 - 2 */
+	uint8_t bParityType; /**<\brief 0 - none, 1 - odd, 2 - even, 3 - mark, 4 - space */
+	uint8_t bDataBits;
+} UsbCdcLineCoding;
+
+/// \brief Handles the notification and both data endpoints of the CDC-ACM function
+extern const UsbEndpointHandler usbd_cdc_endpoint_handler;
+
+void usbd_cdc_initialize();
+uint32_t usbd_cdc_read(void *data, uint32_t size);
+uint32_t usbd_cdc_write(void const *data, uint32_t size);
+uint32_t usbd_cdc_available();
+uint32_t usbd_cdc_write_space();
+uint8_t usbd_cdc_control_line_state();
+UsbCdcLineCoding usbd_cdc_line_coding();
+
+#endif /* USBD_CDC_H_ */
@@ -0,0 +1,211 @@
+/*
+ * usbd_config.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_CONFIG_H_
+#define USBD_CONFIG_H_
+
+/*
+ * Build options of the USB device stack.
+ * Every option can be overridden from the compiler command line (e.g. -DUSBD_CAPTURE_ENABLED=1).
+ */
+
+/** \name Endpoint0
+ *@{*/
+#ifndef USBD_EP0_MAX_PACKET_SIZE
+#define USBD_EP0_MAX_PACKET_SIZE 64 /**<\brief Maximum packet size of endpoint0 (8, 16, 32 or 64 bytes) */
+#endif
+
+#ifndef USBD_MAX_OUT_PACKET_SIZE
+#define USBD_MAX_OUT_PACKET_SIZE 64 /**<\brief Largest packet of all OUT endpoints (sizes the shared RxFIFO) */
+#endif
+/**@}*/
+
+/** \name Frames
+ *@{*/
+#ifndef USBD_PERIODIC_FRAME_INTERVAL
+#define USBD_PERIODIC_FRAME_INTERVAL 90 /**<\brief Percentage of the frame at which the end of periodic frame is raised (80, 85, 90 or 95) */
+#endif
+/**@}*/
+
+/** \name Strings (u"" literals)
+ *@{*/
+#ifndef USBD_MANUFACTURER_STRING
+#define USBD_MANUFACTURER_STRING u"lototskyi"
+#endif
+
+#ifndef USBD_PRODUCT_STRING
+#define USBD_PRODUCT_STRING u"STM32 USB Peripheral Driver"
+#endif
+/**@}*/
+
+/** \name Requests
+ *@{*/
+#ifndef USBD_MAX_INTERFACE_COUNT
+#define USBD_MAX_INTERFACE_COUNT 8 /**<\brief Count of interfaces that can have class or vendor request handlers */
+#endif
+
+#ifndef USBD_CONTROL_OUT_MAX_SIZE
+#define USBD_CONTROL_OUT_MAX_SIZE 2048 /**<\brief Largest data stage of a control OUT request, larger ones are stalled (at least USBD_DFU_TRANSFER_SIZE) */
+#endif
+/**@}*/
+
+/** \name Functions of the composite device (see USBD_FUNCTIONS)
+ *@{*/
+#ifndef USBD_VENDOR_ENABLED
+#define USBD_VENDOR_ENABLED 1 /**<\brief Vendor bulk loopback */
+#endif
+
+#ifndef USBD_STREAM_ENABLED
+#define USBD_STREAM_ENABLED 1 /**<\brief Vendor isochronous stream with several bandwidth profiles */
+#endif
+
+#ifndef USBD_CDC_ENABLED
+#define USBD_CDC_ENABLED 1 /**<\brief CDC-ACM virtual serial port */
+#endif
+
+#ifndef USBD_HID_ENABLED
+#define USBD_HID_ENABLED 1 /**<\brief HID control panel with a 1 ms interrupt endpoint */
+#endif
+
+#ifndef USBD_NCM_ENABLED
+#define USBD_NCM_ENABLED 0 /**<\brief CDC-NCM network adapter (needs the IN endpoints of the vendor and stream functions) */
+#endif
+
+#ifndef USBD_MSC_ENABLED
+#define USBD_MSC_ENABLED 0 /**<\brief Mass storage on a RAM disk and a flash disk (needs the IN endpoint of another function, e.g. the stream) */
+#endif
+
+#ifndef USBD_AUDIO_ENABLED
+#define USBD_AUDIO_ENABLED 0 /**<\brief Audio speaker and microphone (needs the IN endpoints of the vendor and stream functions and a USBD_MAX_OUT_PACKET_SIZE of 294) */
+#endif
+
+#ifndef USBD_VIDEO_ENABLED
+#define USBD_VIDEO_ENABLED 0 /**<\brief Video capture of the LTDC framebuffer (needs the IN endpoint of another function, e.g. the stream) */
+#endif
+
+#ifndef USBD_DFU_ENABLED
+#define USBD_DFU_ENABLED 1 /**<\brief Firmware download (DFU 1.1) into bank 2 of the flash, without endpoints */
+#endif
+
+#ifndef USBD_MIDI_ENABLED
+#define USBD_MIDI_ENABLED 0 /**<\brief USB-MIDI 1.0 ports, one per cable (needs the IN endpoint of another function, e.g. the stream) */
+#endif
+/**@}*/
+
+/** \name CDC-ACM
+ *@{*/
+#ifndef USBD_CDC_RX_BUFFER_SIZE
+#define USBD_CDC_RX_BUFFER_SIZE 4096 /**<\brief Size of the ring of data received from the host (a power of 2) */
+#endif
+
+#ifndef USBD_CDC_TX_BUFFER_SIZE
+#define USBD_CDC_TX_BUFFER_SIZE 4096 /**<\brief Size of the ring of data sent to the host (a power of 2) */
+#endif
+/**@}*/
+
+/** \name CDC-NCM
+ *@{*/
+#ifndef USBD_NCM_NTB_IN_SIZE
+#define USBD_NCM_NTB_IN_SIZE 4096 /**<\brief Largest NTB sent to the host (a multiple of 4, at least 2048 bytes) */
+#endif
+
+#ifndef USBD_NCM_NTB_OUT_SIZE
+#define USBD_NCM_NTB_OUT_SIZE 4096 /**<\brief Largest NTB received from the host (a multiple of 64, at least 2048 bytes) */
+#endif
+
+#ifndef USBD_NCM_DATAGRAM_ALIGNMENT
+#define USBD_NCM_DATAGRAM_ALIGNMENT 4 /**<\brief Alignment of the datagrams in the NTBs of both directions (a power of 2, at least 4) */
+#endif
+
+#ifndef USBD_NCM_MAX_IN_DATAGRAMS
+#define USBD_NCM_MAX_IN_DATAGRAMS 32 /**<\brief Count of datagrams batched into one NTB sent to the host */
+#endif
+/**@}*/
+
+/** \name Mass storage
+ *@{*/
+#ifndef USBD_MSC_LUN_COUNT
+#define USBD_MSC_LUN_COUNT 2 /**<\brief Count of logical units (1 to 16), their media are attached by the application */
+#endif
+
+#ifndef USBD_MSC_BUFFER_SIZE
+#define USBD_MSC_BUFFER_SIZE 4096 /**<\brief Size of each of the two data buffers (a multiple of 512 bytes) */
+#endif
+/**@}*/
+
+/** \name Audio
+ *@{*/
+#ifndef USBD_AUDIO_BUFFER_FRAMES
+#define USBD_AUDIO_BUFFER_FRAMES 256 /**<\brief Count of stereo frames buffered for the speaker (a power of 2), the feedback keeps it half full */
+#endif
+
+#ifndef USBD_AUDIO_FEEDBACK_WINDOW
+#define USBD_AUDIO_FEEDBACK_WINDOW 64 /**<\brief Count of frames the SOF period is measured over (a power of 2, at most 256) */
+#endif
+/**@}*/
+
+/** \name Video
+ *@{*/
+#ifndef USBD_VIDEO_BAND_LINES
+#define USBD_VIDEO_BAND_LINES 4 /**<\brief Count of lines per payload transfer (a divisor of the frame height) */
+#endif
+/**@}*/
+
+/** \name Device firmware upgrade
+ *@{*/
+#ifndef USBD_DFU_TRANSFER_SIZE
+#define USBD_DFU_TRANSFER_SIZE 2048 /**<\brief Largest DNLOAD block (wTransferSize, a multiple of 4 bytes), two of them are buffered */
+#endif
+
+#ifndef USBD_DFU_FIRST_SECTOR
+#define USBD_DFU_FIRST_SECTOR 12 /**<\brief First flash sector the firmware is downloaded into (in bank 2) */
+#endif
+
+#ifndef USBD_DFU_SECTOR_COUNT
+#define USBD_DFU_SECTOR_COUNT 5 /**<\brief Count of flash sectors of the download (the 128 KB before the flash disk) */
+#endif
+/**@}*/
+
+/** \name MIDI
+ *@{*/
+#ifndef USBD_MIDI_QUEUE_SIZE
+#define USBD_MIDI_QUEUE_SIZE 256 /**<\brief Count of events queued for the host (a power of 2) */
+#endif
+
+#ifndef USBD_MIDI_RX_BUFFER_SIZE
+#define USBD_MIDI_RX_BUFFER_SIZE 1024 /**<\brief Size of the ring of events received from the host (a power of 2, at least 64 bytes) */
+#endif
+/**@}*/
+
+/** \name Packet capture
+ *@{*/
+#ifndef USBD_CAPTURE_ENABLED
+#define USBD_CAPTURE_ENABLED 0 /**<\brief Compile the packet capture hooks into the driver */
+#endif
+
+#ifndef USBD_CAPTURE_RECORD_COUNT
+#define USBD_CAPTURE_RECORD_COUNT 512 /**<\brief Count of records in the capture ring (a power of 2) */
+#endif
+
+#ifndef USBD_CAPTURE_PAYLOAD_SIZE
+#define USBD_CAPTURE_PAYLOAD_SIZE 16 /**<\brief Count of payload bytes stored per packet (a multiple of 4) */
+#endif
+/**@}*/
+
+/** \name Statistics
+ *@{*/
+#ifndef USBD_STATISTICS_COUNT_NAKS
+#define USBD_STATISTICS_COUNT_NAKS 0 /**<\brief Count NAKed IN tokens, a diagnostic: costs one interrupt per NAK, which skews the CPU load and latencies */
+#endif
+/**@}*/
+
+/** \name Vendor requests (bmRequestType: vendor, device recipient)
+ *@{*/
+#define USBD_VENDOR_REQUEST_GET_STATISTICS 0x01 /**<\brief Return a \ref UsbStatistics snapshot */
+/**@}*/
+
+#endif /* USBD_CONFIG_H_ */
@@ -0,0 +1,545 @@
+/*
+ * usbd_configuration.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_CONFIGURATION_H_
+#define USBD_CONFIGURATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "usbd_driver.h"
+#include "usbd_config.h"
+#include "usbd_vendor.h"
+#include "usbd_stream.h"
+#include "usbd_cdc.h"
+#include "usbd_hid.h"
+#include "usbd_ncm.h"
+#include "usbd_msc.h"
+#include "usbd_audio.h"
+#include "usbd_video.h"
+#include "usbd_dfu.h"
+#include "usbd_midi.h"
+#include "usbd_descriptors.h"
+
+/*
+ * The functions of the (composite) device, their interfaces, alternate settings and endpoints,
+ * each listed once. The configuration descriptor (see usbd_descriptors.c), the interface and
+ * endpoint numbers and the endpoint activation tables (see usbd_configuration.c) are all
+ * generated from these lists, so a function is added or removed by editing a single line.
+ *
+ * FUNCTION(name, class, subclass, protocol, initialize, endpoint_addresses, interfaces, ...)
+ *     - announced by an interface association descriptor; `initialize` is called once at startup
+ *       (e.g. to register the class requests of its interfaces) and may be NULL
+ * IN_ENDPOINT(name) / OUT_ENDPOINT(name) - the entries of `endpoint_addresses`, which get the
+ *     addresses USBD_ENDPOINT_<name>, numbered from 1 in each direction in the order of the lists
+ * INTERFACE(name, class, subclass, protocol, alternate_settings) - numbered from 0 as
+ *     USBD_INTERFACE_<name>, in the order of the lists
+ * ALTERNATE_SETTING(name, endpoints, ...) - numbered from 0 in the order of the list, the
+ *                                           arguments of the interface are passed on as `...`
+ * ENDPOINT(name, address, type, max_packet_size, interval, handler) - `address` is one of the
+ *     USBD_ENDPOINT_<name> of the function (alternate settings may share it)
+ * DESCRIPTOR(name, type, initializer) - a class-specific descriptor placed in the configuration
+ *     descriptor where it appears in the `endpoints` list of the alternate setting
+ * AUDIO_ENDPOINT(name, address, type, max_packet_size, interval, handler, refresh, synch_address)
+ *     - an endpoint of an Audio 1.0 streaming interface (isochronous, or the bulk one of MIDI),
+ *       announced with the 9-byte \ref UsbAudioEndpointDescriptor; `type` may include the
+ *       synchronization and usage bits
+ *
+ * The names of the functions, alternate settings and endpoints must be unique in the configuration.
+ */
+#define USBD_FUNCTIONS(FUNCTION, ...) \
+	USBD_VENDOR_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_STREAM_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_CDC_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_HID_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_NCM_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_MSC_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_AUDIO_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_VIDEO_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_DFU_FUNCTION(FUNCTION, __VA_ARGS__) \
+	USBD_MIDI_FUNCTION(FUNCTION, __VA_ARGS__)
+
+/* Vendor bulk loopback */
+#if USBD_VENDOR_ENABLED
+#define USBD_VENDOR_FUNCTION(FUNCTION, ...) \
+	FUNCTION(VENDOR, USB_CLASS_VENDOR, USB_SUBCLASS_VENDOR, USB_PROTOCOL_VENDOR, NULL, \
+		USBD_VENDOR_ENDPOINT_ADDRESSES, USBD_VENDOR_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_VENDOR_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_VENDOR_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	OUT_ENDPOINT(VENDOR_OUT) \
+	IN_ENDPOINT(VENDOR_IN)
+
+#define USBD_VENDOR_INTERFACES(INTERFACE) \
+	INTERFACE(VENDOR, USB_CLASS_VENDOR, USB_SUBCLASS_VENDOR, USB_PROTOCOL_VENDOR, USBD_VENDOR_ALTERNATE_SETTINGS)
+
+#define USBD_VENDOR_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(VENDOR_LOOPBACK, USBD_VENDOR_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_VENDOR_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	ENDPOINT(VENDOR_OUT, USBD_ENDPOINT_VENDOR_OUT, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_vendor_endpoint_handler) \
+	ENDPOINT(VENDOR_IN, USBD_ENDPOINT_VENDOR_IN, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_vendor_endpoint_handler)
+
+/* Isochronous stream */
+#if USBD_STREAM_ENABLED
+#define USBD_STREAM_FUNCTION(FUNCTION, ...) \
+	FUNCTION(STREAM, USB_CLASS_VENDOR, USB_SUBCLASS_VENDOR, USB_PROTOCOL_VENDOR, NULL, \
+		USBD_STREAM_ENDPOINT_ADDRESSES, USBD_STREAM_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_STREAM_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_STREAM_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	IN_ENDPOINT(STREAM_IN)
+
+#define USBD_STREAM_INTERFACES(INTERFACE) \
+	INTERFACE(STREAM, USB_CLASS_VENDOR, USB_SUBCLASS_VENDOR, USB_PROTOCOL_VENDOR, USBD_STREAM_ALTERNATE_SETTINGS)
+
+/// \brief The bandwidth profiles of the stream: the host selects the one the bus can afford
+#define USBD_STREAM_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(STREAM_IDLE, USBD_NO_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(STREAM_LOW, USBD_STREAM_LOW_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(STREAM_MEDIUM, USBD_STREAM_MEDIUM_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(STREAM_HIGH, USBD_STREAM_HIGH_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_STREAM_LOW_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	ENDPOINT(STREAM_LOW_IN, USBD_ENDPOINT_STREAM_IN, USB_ENDPOINT_TYPE_ISOCHRONOUS, 256, 1, &usbd_stream_endpoint_handler)
+#define USBD_STREAM_MEDIUM_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	ENDPOINT(STREAM_MEDIUM_IN, USBD_ENDPOINT_STREAM_IN, USB_ENDPOINT_TYPE_ISOCHRONOUS, 512, 1, &usbd_stream_endpoint_handler)
+#define USBD_STREAM_HIGH_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	ENDPOINT(STREAM_HIGH_IN, USBD_ENDPOINT_STREAM_IN, USB_ENDPOINT_TYPE_ISOCHRONOUS, 1023, 1, &usbd_stream_endpoint_handler)
+
+/* CDC-ACM virtual serial port */
+#if USBD_CDC_ENABLED
+#define USBD_CDC_FUNCTION(FUNCTION, ...) \
+	FUNCTION(CDC, USB_CLASS_CDC, USB_SUBCLASS_CDC_ACM, USB_PROTOCOL_CDC_NONE, &usbd_cdc_initialize, \
+		USBD_CDC_ENDPOINT_ADDRESSES, USBD_CDC_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_CDC_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_CDC_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	IN_ENDPOINT(CDC_NOTIFICATION) \
+	OUT_ENDPOINT(CDC_OUT) \
+	IN_ENDPOINT(CDC_IN)
+
+#define USBD_CDC_INTERFACES(INTERFACE) \
+	INTERFACE(CDC_CONTROL, USB_CLASS_CDC, USB_SUBCLASS_CDC_ACM, USB_PROTOCOL_CDC_NONE, USBD_CDC_CONTROL_ALTERNATE_SETTINGS) \
+	INTERFACE(CDC_DATA, USB_CLASS_CDC_DATA, USB_SUBCLASS_NONE, USB_PROTOCOL_NONE, USBD_CDC_DATA_ALTERNATE_SETTINGS)
+
+#define USBD_CDC_CONTROL_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(CDC_CONTROL_DEFAULT, USBD_CDC_CONTROL_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_CDC_CONTROL_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(CDC_HEADER, UsbCdcHeaderDescriptor, USBD_CDC_HEADER_DESCRIPTOR) \
+	DESCRIPTOR(CDC_CALL_MANAGEMENT, UsbCdcCallManagementDescriptor, \
+		USBD_CDC_CALL_MANAGEMENT_DESCRIPTOR(USBD_INTERFACE_CDC_DATA)) \
+	DESCRIPTOR(CDC_ACM, UsbCdcAcmDescriptor, USBD_CDC_ACM_DESCRIPTOR) \
+	DESCRIPTOR(CDC_UNION, UsbCdcUnionDescriptor, \
+		USBD_CDC_UNION_DESCRIPTOR(USBD_INTERFACE_CDC_CONTROL, USBD_INTERFACE_CDC_DATA)) \
+	ENDPOINT(CDC_NOTIFICATION, USBD_ENDPOINT_CDC_NOTIFICATION, USB_ENDPOINT_TYPE_INTERRUPT, 16, 16, &usbd_cdc_endpoint_handler)
+
+#define USBD_CDC_DATA_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(CDC_DATA_DEFAULT, USBD_CDC_DATA_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_CDC_DATA_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	ENDPOINT(CDC_OUT, USBD_ENDPOINT_CDC_OUT, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_cdc_endpoint_handler) \
+	ENDPOINT(CDC_IN, USBD_ENDPOINT_CDC_IN, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_cdc_endpoint_handler)
+
+/* HID control panel */
+#if USBD_HID_ENABLED
+#define USBD_HID_FUNCTION(FUNCTION, ...) \
+	FUNCTION(HID, USB_CLASS_HID, USB_SUBCLASS_NONE, USB_PROTOCOL_NONE, &usbd_hid_initialize, \
+		USBD_HID_ENDPOINT_ADDRESSES, USBD_HID_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_HID_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_HID_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	IN_ENDPOINT(HID_IN)
+
+#define USBD_HID_INTERFACES(INTERFACE) \
+	INTERFACE(HID, USB_CLASS_HID, USB_SUBCLASS_NONE, USB_PROTOCOL_NONE, USBD_HID_ALTERNATE_SETTINGS)
+
+#define USBD_HID_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(HID_DEFAULT, USBD_HID_ENDPOINTS, __VA_ARGS__)
+
+/// \brief Polled every frame, the reports are armed at the end of the frame before (see usbd_hid.c)
+#define USBD_HID_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(HID_CLASS, UsbHidDescriptor, USBD_HID_DESCRIPTOR) \
+	ENDPOINT(HID_IN, USBD_ENDPOINT_HID_IN, USB_ENDPOINT_TYPE_INTERRUPT, sizeof(UsbHidInputReport), 1, &usbd_hid_endpoint_handler)
+
+/* CDC-NCM network adapter */
+#if USBD_NCM_ENABLED
+#define USBD_NCM_FUNCTION(FUNCTION, ...) \
+	FUNCTION(NCM, USB_CLASS_CDC, USB_SUBCLASS_CDC_NCM, USB_PROTOCOL_CDC_NONE, &usbd_ncm_initialize, \
+		USBD_NCM_ENDPOINT_ADDRESSES, USBD_NCM_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_NCM_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_NCM_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	IN_ENDPOINT(NCM_NOTIFICATION) \
+	OUT_ENDPOINT(NCM_OUT) \
+	IN_ENDPOINT(NCM_IN)
+
+#define USBD_NCM_INTERFACES(INTERFACE) \
+	INTERFACE(NCM_CONTROL, USB_CLASS_CDC, USB_SUBCLASS_CDC_NCM, USB_PROTOCOL_CDC_NONE, USBD_NCM_CONTROL_ALTERNATE_SETTINGS) \
+	INTERFACE(NCM_DATA, USB_CLASS_CDC_DATA, USB_SUBCLASS_NONE, USB_PROTOCOL_CDC_NTB, USBD_NCM_DATA_ALTERNATE_SETTINGS)
+
+#define USBD_NCM_CONTROL_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(NCM_CONTROL_DEFAULT, USBD_NCM_CONTROL_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_NCM_CONTROL_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(NCM_HEADER, UsbCdcHeaderDescriptor, USBD_CDC_HEADER_DESCRIPTOR) \
+	DESCRIPTOR(NCM_UNION, UsbCdcUnionDescriptor, \
+		USBD_CDC_UNION_DESCRIPTOR(USBD_INTERFACE_NCM_CONTROL, USBD_INTERFACE_NCM_DATA)) \
+	DESCRIPTOR(NCM_ETHERNET, UsbCdcEthernetDescriptor, USBD_CDC_ETHERNET_DESCRIPTOR(USBD_STRING_INDEX_MAC_ADDRESS)) \
+	DESCRIPTOR(NCM_NETWORK_CONTROL, UsbCdcNcmDescriptor, USBD_CDC_NCM_DESCRIPTOR) \
+	ENDPOINT(NCM_NOTIFICATION, USBD_ENDPOINT_NCM_NOTIFICATION, USB_ENDPOINT_TYPE_INTERRUPT, 16, 16, &usbd_ncm_endpoint_handler)
+
+/// \brief The data interface has no endpoints until the host brings the network up (alternate setting 1)
+#define USBD_NCM_DATA_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(NCM_DATA_IDLE, USBD_NO_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(NCM_DATA_ACTIVE, USBD_NCM_DATA_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_NCM_DATA_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	ENDPOINT(NCM_OUT, USBD_ENDPOINT_NCM_OUT, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_ncm_endpoint_handler) \
+	ENDPOINT(NCM_IN, USBD_ENDPOINT_NCM_IN, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_ncm_endpoint_handler)
+
+/* Mass storage (bulk-only transport) */
+#if USBD_MSC_ENABLED
+#define USBD_MSC_FUNCTION(FUNCTION, ...) \
+	FUNCTION(MSC, USB_CLASS_MASS_STORAGE, USB_SUBCLASS_MSC_SCSI, USB_PROTOCOL_MSC_BOT, &usbd_msc_initialize, \
+		USBD_MSC_ENDPOINT_ADDRESSES, USBD_MSC_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_MSC_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_MSC_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	OUT_ENDPOINT(MSC_OUT) \
+	IN_ENDPOINT(MSC_IN)
+
+#define USBD_MSC_INTERFACES(INTERFACE) \
+	INTERFACE(MSC, USB_CLASS_MASS_STORAGE, USB_SUBCLASS_MSC_SCSI, USB_PROTOCOL_MSC_BOT, USBD_MSC_ALTERNATE_SETTINGS)
+
+#define USBD_MSC_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(MSC_DEFAULT, USBD_MSC_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_MSC_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	ENDPOINT(MSC_OUT, USBD_ENDPOINT_MSC_OUT, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_msc_endpoint_handler) \
+	ENDPOINT(MSC_IN, USBD_ENDPOINT_MSC_IN, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_msc_endpoint_handler)
+
+/* Audio 1.0 speaker and microphone */
+#if USBD_AUDIO_ENABLED
+#define USBD_AUDIO_FUNCTION(FUNCTION, ...) \
+	FUNCTION(AUDIO, USB_CLASS_AUDIO, USB_SUBCLASS_NONE, USB_PROTOCOL_NONE, &usbd_audio_initialize, \
+		USBD_AUDIO_ENDPOINT_ADDRESSES, USBD_AUDIO_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_AUDIO_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_AUDIO_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	OUT_ENDPOINT(AUDIO_SPEAKER) \
+	IN_ENDPOINT(AUDIO_FEEDBACK) \
+	IN_ENDPOINT(AUDIO_MICROPHONE)
+
+#define USBD_AUDIO_INTERFACES(INTERFACE) \
+	INTERFACE(AUDIO_CONTROL, USB_CLASS_AUDIO, USB_SUBCLASS_AUDIO_CONTROL, USB_PROTOCOL_NONE, USBD_AUDIO_CONTROL_ALTERNATE_SETTINGS) \
+	INTERFACE(AUDIO_SPEAKER, USB_CLASS_AUDIO, USB_SUBCLASS_AUDIO_STREAMING, USB_PROTOCOL_NONE, USBD_AUDIO_SPEAKER_ALTERNATE_SETTINGS) \
+	INTERFACE(AUDIO_MICROPHONE, USB_CLASS_AUDIO, USB_SUBCLASS_AUDIO_STREAMING, USB_PROTOCOL_NONE, USBD_AUDIO_MICROPHONE_ALTERNATE_SETTINGS)
+
+#define USBD_AUDIO_CONTROL_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(AUDIO_CONTROL_DEFAULT, USBD_AUDIO_CONTROL_ENDPOINTS, __VA_ARGS__)
+
+/// \brief The topology: USB streaming -> speaker, microphone -> USB streaming (no units, so no class requests)
+#define USBD_AUDIO_CONTROL_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(AUDIO_HEADER, UsbAudioHeaderDescriptor, \
+		USBD_AUDIO_HEADER_DESCRIPTOR(USBD_INTERFACE_AUDIO_SPEAKER, USBD_INTERFACE_AUDIO_MICROPHONE)) \
+	DESCRIPTOR(AUDIO_SPEAKER_INPUT, UsbAudioInputTerminalDescriptor, USBD_AUDIO_INPUT_TERMINAL_DESCRIPTOR( \
+		USBD_AUDIO_TERMINAL_SPEAKER_INPUT, USB_AUDIO_TERMINAL_USB_STREAMING, USBD_AUDIO_SPEAKER_CHANNELS, 0x0003)) \
+	DESCRIPTOR(AUDIO_SPEAKER_OUTPUT, UsbAudioOutputTerminalDescriptor, USBD_AUDIO_OUTPUT_TERMINAL_DESCRIPTOR( \
+		USBD_AUDIO_TERMINAL_SPEAKER_OUTPUT, USB_AUDIO_TERMINAL_SPEAKER, USBD_AUDIO_TERMINAL_SPEAKER_INPUT)) \
+	DESCRIPTOR(AUDIO_MICROPHONE_INPUT, UsbAudioInputTerminalDescriptor, USBD_AUDIO_INPUT_TERMINAL_DESCRIPTOR( \
+		USBD_AUDIO_TERMINAL_MICROPHONE_INPUT, USB_AUDIO_TERMINAL_MICROPHONE, USBD_AUDIO_MICROPHONE_CHANNELS, 0x0000)) \
+	DESCRIPTOR(AUDIO_MICROPHONE_OUTPUT, UsbAudioOutputTerminalDescriptor, USBD_AUDIO_OUTPUT_TERMINAL_DESCRIPTOR( \
+		USBD_AUDIO_TERMINAL_MICROPHONE_OUTPUT, USB_AUDIO_TERMINAL_USB_STREAMING, USBD_AUDIO_TERMINAL_MICROPHONE_INPUT))
+
+/// \brief Alternate setting 0 is the zero-bandwidth one, the host picks the sample size with 1 (16 bits) or 2 (24 bits)
+#define USBD_AUDIO_SPEAKER_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(AUDIO_SPEAKER_IDLE, USBD_NO_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(AUDIO_SPEAKER_16, USBD_AUDIO_SPEAKER_16_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(AUDIO_SPEAKER_24, USBD_AUDIO_SPEAKER_24_ENDPOINTS, __VA_ARGS__)
+
+/// \brief The asynchronous data endpoint names the feedback endpoint that carries the rate of the audio clock
+#define USBD_AUDIO_SPEAKER_16_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(AUDIO_SPEAKER_16_GENERAL, UsbAudioStreamingDescriptor, \
+		USBD_AUDIO_STREAMING_DESCRIPTOR(USBD_AUDIO_TERMINAL_SPEAKER_INPUT)) \
+	DESCRIPTOR(AUDIO_SPEAKER_16_FORMAT, UsbAudioFormatDescriptor, USBD_AUDIO_FORMAT_DESCRIPTOR(USBD_AUDIO_SPEAKER_CHANNELS, 2)) \
+	AUDIO_ENDPOINT(AUDIO_SPEAKER_16_OUT, USBD_ENDPOINT_AUDIO_SPEAKER, USB_ENDPOINT_TYPE_ISOCHRONOUS | USB_ENDPOINT_SYNC_ASYNCHRONOUS, \
+		USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_SPEAKER_CHANNELS, 2), 1, &usbd_audio_speaker_endpoint_handler, 0, USBD_ENDPOINT_AUDIO_FEEDBACK) \
+	DESCRIPTOR(AUDIO_SPEAKER_16_DATA, UsbAudioDataEndpointDescriptor, USBD_AUDIO_DATA_ENDPOINT_DESCRIPTOR) \
+	AUDIO_ENDPOINT(AUDIO_SPEAKER_16_FEEDBACK, USBD_ENDPOINT_AUDIO_FEEDBACK, USB_ENDPOINT_TYPE_ISOCHRONOUS | USB_ENDPOINT_USAGE_FEEDBACK, \
+		3, 1, &usbd_audio_speaker_endpoint_handler, USBD_AUDIO_FEEDBACK_REFRESH, 0)
+#define USBD_AUDIO_SPEAKER_24_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(AUDIO_SPEAKER_24_GENERAL, UsbAudioStreamingDescriptor, \
+		USBD_AUDIO_STREAMING_DESCRIPTOR(USBD_AUDIO_TERMINAL_SPEAKER_INPUT)) \
+	DESCRIPTOR(AUDIO_SPEAKER_24_FORMAT, UsbAudioFormatDescriptor, USBD_AUDIO_FORMAT_DESCRIPTOR(USBD_AUDIO_SPEAKER_CHANNELS, 3)) \
+	AUDIO_ENDPOINT(AUDIO_SPEAKER_24_OUT, USBD_ENDPOINT_AUDIO_SPEAKER, USB_ENDPOINT_TYPE_ISOCHRONOUS | USB_ENDPOINT_SYNC_ASYNCHRONOUS, \
+		USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_SPEAKER_CHANNELS, 3), 1, &usbd_audio_speaker_endpoint_handler, 0, USBD_ENDPOINT_AUDIO_FEEDBACK) \
+	DESCRIPTOR(AUDIO_SPEAKER_24_DATA, UsbAudioDataEndpointDescriptor, USBD_AUDIO_DATA_ENDPOINT_DESCRIPTOR) \
+	AUDIO_ENDPOINT(AUDIO_SPEAKER_24_FEEDBACK, USBD_ENDPOINT_AUDIO_FEEDBACK, USB_ENDPOINT_TYPE_ISOCHRONOUS | USB_ENDPOINT_USAGE_FEEDBACK, \
+		3, 1, &usbd_audio_speaker_endpoint_handler, USBD_AUDIO_FEEDBACK_REFRESH, 0)
+
+#define USBD_AUDIO_MICROPHONE_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(AUDIO_MICROPHONE_IDLE, USBD_NO_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(AUDIO_MICROPHONE_16, USBD_AUDIO_MICROPHONE_16_ENDPOINTS, __VA_ARGS__) \
+	ALTERNATE_SETTING(AUDIO_MICROPHONE_24, USBD_AUDIO_MICROPHONE_24_ENDPOINTS, __VA_ARGS__)
+
+/// \brief An asynchronous source: the packet sizes follow the audio clock, so it needs no feedback
+#define USBD_AUDIO_MICROPHONE_16_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(AUDIO_MICROPHONE_16_GENERAL, UsbAudioStreamingDescriptor, \
+		USBD_AUDIO_STREAMING_DESCRIPTOR(USBD_AUDIO_TERMINAL_MICROPHONE_OUTPUT)) \
+	DESCRIPTOR(AUDIO_MICROPHONE_16_FORMAT, UsbAudioFormatDescriptor, USBD_AUDIO_FORMAT_DESCRIPTOR(USBD_AUDIO_MICROPHONE_CHANNELS, 2)) \
+	AUDIO_ENDPOINT(AUDIO_MICROPHONE_16_IN, USBD_ENDPOINT_AUDIO_MICROPHONE, USB_ENDPOINT_TYPE_ISOCHRONOUS | USB_ENDPOINT_SYNC_ASYNCHRONOUS, \
+		USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_MICROPHONE_CHANNELS, 2), 1, &usbd_audio_microphone_endpoint_handler, 0, 0) \
+	DESCRIPTOR(AUDIO_MICROPHONE_16_DATA, UsbAudioDataEndpointDescriptor, USBD_AUDIO_DATA_ENDPOINT_DESCRIPTOR)
+#define USBD_AUDIO_MICROPHONE_24_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(AUDIO_MICROPHONE_24_GENERAL, UsbAudioStreamingDescriptor, \
+		USBD_AUDIO_STREAMING_DESCRIPTOR(USBD_AUDIO_TERMINAL_MICROPHONE_OUTPUT)) \
+	DESCRIPTOR(AUDIO_MICROPHONE_24_FORMAT, UsbAudioFormatDescriptor, USBD_AUDIO_FORMAT_DESCRIPTOR(USBD_AUDIO_MICROPHONE_CHANNELS, 3)) \
+	AUDIO_ENDPOINT(AUDIO_MICROPHONE_24_IN, USBD_ENDPOINT_AUDIO_MICROPHONE, USB_ENDPOINT_TYPE_ISOCHRONOUS | USB_ENDPOINT_SYNC_ASYNCHRONOUS, \
+		USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_MICROPHONE_CHANNELS, 3), 1, &usbd_audio_microphone_endpoint_handler, 0, 0) \
+	DESCRIPTOR(AUDIO_MICROPHONE_24_DATA, UsbAudioDataEndpointDescriptor, USBD_AUDIO_DATA_ENDPOINT_DESCRIPTOR)
+
+/* Video capture of the framebuffer */
+#if USBD_VIDEO_ENABLED
+#define USBD_VIDEO_FUNCTION(FUNCTION, ...) \
+	FUNCTION(VIDEO, USB_CLASS_VIDEO, USB_SUBCLASS_VIDEO_INTERFACE_COLLECTION, USB_PROTOCOL_NONE, &usbd_video_initialize, \
+		USBD_VIDEO_ENDPOINT_ADDRESSES, USBD_VIDEO_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_VIDEO_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_VIDEO_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	IN_ENDPOINT(VIDEO_IN)
+
+#define USBD_VIDEO_INTERFACES(INTERFACE) \
+	INTERFACE(VIDEO_CONTROL, USB_CLASS_VIDEO, USB_SUBCLASS_VIDEO_CONTROL, USB_PROTOCOL_NONE, USBD_VIDEO_CONTROL_ALTERNATE_SETTINGS) \
+	INTERFACE(VIDEO_STREAMING, USB_CLASS_VIDEO, USB_SUBCLASS_VIDEO_STREAMING, USB_PROTOCOL_NONE, USBD_VIDEO_STREAMING_ALTERNATE_SETTINGS)
+
+#define USBD_VIDEO_CONTROL_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(VIDEO_CONTROL_DEFAULT, USBD_VIDEO_CONTROL_ENDPOINTS, __VA_ARGS__)
+
+/// \brief The topology: camera (the framebuffer) -> USB streaming, without units or an interrupt endpoint
+#define USBD_VIDEO_CONTROL_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(VIDEO_CONTROL_HEADER, UsbVideoControlHeaderDescriptor, \
+		USBD_VIDEO_CONTROL_HEADER_DESCRIPTOR(USBD_INTERFACE_VIDEO_STREAMING)) \
+	DESCRIPTOR(VIDEO_CAMERA, UsbVideoCameraTerminalDescriptor, USBD_VIDEO_CAMERA_TERMINAL_DESCRIPTOR) \
+	DESCRIPTOR(VIDEO_OUTPUT, UsbVideoOutputTerminalDescriptor, USBD_VIDEO_OUTPUT_TERMINAL_DESCRIPTOR)
+
+/// \brief A bulk stream needs no zero-bandwidth setting: it starts with the commit control
+#define USBD_VIDEO_STREAMING_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(VIDEO_STREAMING_DEFAULT, USBD_VIDEO_STREAMING_ENDPOINTS, __VA_ARGS__)
+
+#define USBD_VIDEO_STREAMING_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(VIDEO_INPUT_HEADER, UsbVideoInputHeaderDescriptor, USBD_VIDEO_INPUT_HEADER_DESCRIPTOR(USBD_ENDPOINT_VIDEO_IN)) \
+	DESCRIPTOR(VIDEO_FORMAT, UsbVideoUncompressedFormatDescriptor, USBD_VIDEO_YUY2_FORMAT_DESCRIPTOR) \
+	DESCRIPTOR(VIDEO_FRAME, UsbVideoUncompressedFrameDescriptor, USBD_VIDEO_FRAME_DESCRIPTOR) \
+	DESCRIPTOR(VIDEO_COLOR_MATCHING, UsbVideoColorMatchingDescriptor, USBD_VIDEO_COLOR_MATCHING_DESCRIPTOR) \
+	ENDPOINT(VIDEO_IN, USBD_ENDPOINT_VIDEO_IN, USB_ENDPOINT_TYPE_BULK, 64, 0, &usbd_video_endpoint_handler)
+
+/* Device firmware upgrade (the runtime interface, see usbd_dfu.c for the DFU mode) */
+#if USBD_DFU_ENABLED
+#define USBD_DFU_FUNCTION(FUNCTION, ...) \
+	FUNCTION(DFU, USB_CLASS_APP_SPEC, USB_SUBCLASS_DFU, USB_PROTOCOL_DFU_RUNTIME, &usbd_dfu_initialize, \
+		USBD_NO_ENDPOINT_ADDRESSES, USBD_DFU_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_DFU_FUNCTION(FUNCTION, ...)
+#endif
+
+#define USBD_DFU_INTERFACES(INTERFACE) \
+	INTERFACE(DFU, USB_CLASS_APP_SPEC, USB_SUBCLASS_DFU, USB_PROTOCOL_DFU_RUNTIME, USBD_DFU_ALTERNATE_SETTINGS)
+
+#define USBD_DFU_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(DFU_RUNTIME, USBD_DFU_ENDPOINTS, __VA_ARGS__)
+
+/// \brief The blocks of the firmware go over endpoint 0, the interface only has its functional descriptor
+#define USBD_DFU_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(DFU_FUNCTIONAL, UsbDfuFunctionalDescriptor, USBD_DFU_FUNCTIONAL_DESCRIPTOR)
+
+/* USB-MIDI 1.0 ports */
+#if USBD_MIDI_ENABLED
+#define USBD_MIDI_FUNCTION(FUNCTION, ...) \
+	FUNCTION(MIDI, USB_CLASS_AUDIO, USB_SUBCLASS_NONE, USB_PROTOCOL_NONE, &usbd_midi_initialize, \
+		USBD_MIDI_ENDPOINT_ADDRESSES, USBD_MIDI_INTERFACES, __VA_ARGS__)
+#else
+#define USBD_MIDI_FUNCTION(FUNCTION, ...)
+#endif
+
+/**
+ * \brief The cables of the MIDI function, numbered from 0 (at most 16)
+ * \details Each cable is a port of its own on the host, with the four jacks of \ref USBD_MIDI_JACK_ID.
+ */
+#define USBD_MIDI_CABLES(CABLE, ...) \
+	CABLE(0, __VA_ARGS__) \
+	CABLE(1, __VA_ARGS__)
+
+#define USBD_MIDI_CABLE_PLUS_ONE(...) + 1
+#define USBD_MIDI_CABLE_COUNT (0 USBD_MIDI_CABLES(USBD_MIDI_CABLE_PLUS_ONE))
+
+#define USBD_MIDI_EMBEDDED_IN_JACK_ID(cable, ...) USBD_MIDI_JACK_ID(cable, EMBEDDED_IN),
+#define USBD_MIDI_EMBEDDED_OUT_JACK_ID(cable, ...) USBD_MIDI_JACK_ID(cable, EMBEDDED_OUT),
+
+#define USBD_MIDI_JACKS(cable, DESCRIPTOR) \
+	DESCRIPTOR(MIDI_EMBEDDED_IN_JACK_##cable, UsbMidiInJackDescriptor, \
+		USBD_MIDI_IN_JACK_DESCRIPTOR(USB_MIDI_JACK_EMBEDDED, USBD_MIDI_JACK_ID(cable, EMBEDDED_IN))) \
+	DESCRIPTOR(MIDI_EXTERNAL_IN_JACK_##cable, UsbMidiInJackDescriptor, \
+		USBD_MIDI_IN_JACK_DESCRIPTOR(USB_MIDI_JACK_EXTERNAL, USBD_MIDI_JACK_ID(cable, EXTERNAL_IN))) \
+	DESCRIPTOR(MIDI_EMBEDDED_OUT_JACK_##cable, UsbMidiOutJackDescriptor, USBD_MIDI_OUT_JACK_DESCRIPTOR( \
+		USB_MIDI_JACK_EMBEDDED, USBD_MIDI_JACK_ID(cable, EMBEDDED_OUT), USBD_MIDI_JACK_ID(cable, EXTERNAL_IN))) \
+	DESCRIPTOR(MIDI_EXTERNAL_OUT_JACK_##cable, UsbMidiOutJackDescriptor, USBD_MIDI_OUT_JACK_DESCRIPTOR( \
+		USB_MIDI_JACK_EXTERNAL, USBD_MIDI_JACK_ID(cable, EXTERNAL_OUT), USBD_MIDI_JACK_ID(cable, EMBEDDED_IN)))
+
+#define USBD_MIDI_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT) \
+	OUT_ENDPOINT(MIDI_OUT) \
+	IN_ENDPOINT(MIDI_IN)
+
+#define USBD_MIDI_INTERFACES(INTERFACE) \
+	INTERFACE(MIDI_CONTROL, USB_CLASS_AUDIO, USB_SUBCLASS_AUDIO_CONTROL, USB_PROTOCOL_NONE, USBD_MIDI_CONTROL_ALTERNATE_SETTINGS) \
+	INTERFACE(MIDI_STREAMING, USB_CLASS_AUDIO, USB_SUBCLASS_MIDI_STREAMING, USB_PROTOCOL_NONE, USBD_MIDI_STREAMING_ALTERNATE_SETTINGS)
+
+#define USBD_MIDI_CONTROL_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(MIDI_CONTROL_DEFAULT, USBD_MIDI_CONTROL_ENDPOINTS, __VA_ARGS__)
+
+/// \brief The audio control interface only names the streaming interface
+#define USBD_MIDI_CONTROL_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(MIDI_CONTROL_HEADER, UsbMidiControlHeaderDescriptor, \
+		USBD_MIDI_CONTROL_HEADER_DESCRIPTOR(USBD_INTERFACE_MIDI_STREAMING))
+
+#define USBD_MIDI_STREAMING_ALTERNATE_SETTINGS(ALTERNATE_SETTING, ...) \
+	ALTERNATE_SETTING(MIDI_STREAMING_DEFAULT, USBD_MIDI_STREAMING_ENDPOINTS, __VA_ARGS__)
+
+/// \brief Each endpoint carries the embedded jacks of all cables, the events are told apart by their cable number
+#define USBD_MIDI_STREAMING_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT) \
+	DESCRIPTOR(MIDI_HEADER, UsbMidiHeaderDescriptor, USBD_MIDI_HEADER_DESCRIPTOR(USBD_MIDI_CABLE_COUNT)) \
+	USBD_MIDI_CABLES(USBD_MIDI_JACKS, DESCRIPTOR) \
+	AUDIO_ENDPOINT(MIDI_OUT, USBD_ENDPOINT_MIDI_OUT, USB_ENDPOINT_TYPE_BULK, USBD_MIDI_PACKET_SIZE, 0, \
+		&usbd_midi_endpoint_handler, 0, 0) \
+	DESCRIPTOR(MIDI_OUT_GENERAL, USB_MIDI_ENDPOINT_DESCRIPTOR_STRUCT(USBD_MIDI_CABLE_COUNT), \
+		USBD_MIDI_ENDPOINT_DESCRIPTOR(USBD_MIDI_CABLE_COUNT, USBD_MIDI_CABLES(USBD_MIDI_EMBEDDED_IN_JACK_ID))) \
+	AUDIO_ENDPOINT(MIDI_IN, USBD_ENDPOINT_MIDI_IN, USB_ENDPOINT_TYPE_BULK, USBD_MIDI_PACKET_SIZE, 0, \
+		&usbd_midi_endpoint_handler, 0, 0) \
+	DESCRIPTOR(MIDI_IN_GENERAL, USB_MIDI_ENDPOINT_DESCRIPTOR_STRUCT(USBD_MIDI_CABLE_COUNT), \
+		USBD_MIDI_ENDPOINT_DESCRIPTOR(USBD_MIDI_CABLE_COUNT, USBD_MIDI_CABLES(USBD_MIDI_EMBEDDED_OUT_JACK_ID)))
+
+/// \brief The endpoint addresses of a function without endpoints
+#define USBD_NO_ENDPOINT_ADDRESSES(IN_ENDPOINT, OUT_ENDPOINT)
+
+/// \brief The endpoint list of an alternate setting without endpoints (e.g. a zero-bandwidth one)
+#define USBD_NO_ENDPOINTS(ENDPOINT, DESCRIPTOR, AUDIO_ENDPOINT)
+
+/// \brief The value of the only configuration (bConfigurationValue)
+#define USBD_CONFIGURATION_VALUE 1
+
+/// \brief The attributes of the configuration (bmAttributes), also reported by GET_STATUS
+#define USBD_CONFIGURATION_ATTRIBUTES (USB_CONFIGURATION_ATTRIBUTES_RESERVED | USB_CONFIGURATION_ATTRIBUTES_SELF_POWERED)
+
+/// \brief Skips the class-specific descriptors of an `endpoints` list
+#define USBD_NO_DESCRIPTOR(name, type, initializer)
+
+#define USBD_INTERFACES_OF_FUNCTION(name, class, subclass, protocol, initialize, endpoint_addresses, interfaces, INTERFACE) \
+	interfaces(INTERFACE)
+
+/// \brief All interfaces of the configuration, function after function
+#define USBD_INTERFACES(INTERFACE) USBD_FUNCTIONS(USBD_INTERFACES_OF_FUNCTION, INTERFACE)
+
+#define USBD_INTERFACE_NUMBER(name, ...) USBD_INTERFACE_##name,
+// Note: The second enumerator rewinds the counter, so the first interface of the function gets the same number
+#define USBD_INTERFACE_NUMBERS_OF_FUNCTION(name, class, subclass, protocol, initialize, endpoint_addresses, interfaces, ...) \
+	USBD_FIRST_INTERFACE_OF_##name, \
+	USBD_FIRST_INTERFACE_OF_##name##_REWIND = USBD_FIRST_INTERFACE_OF_##name - 1, \
+	interfaces(USBD_INTERFACE_NUMBER)
+
+/// \brief The interface numbers, in the order of \ref USBD_FUNCTIONS (and the first interface of each function)
+typedef enum
+{
+	USBD_FUNCTIONS(USBD_INTERFACE_NUMBERS_OF_FUNCTION)
+	USBD_INTERFACE_COUNT
+} UsbdInterfaceNumber;
+
+#define USBD_ENDPOINT_ADDRESS(name) USBD_ENDPOINT_##name,
+#define USBD_NO_ENDPOINT_ADDRESS(name)
+#define USBD_IN_ENDPOINT_ADDRESSES_OF_FUNCTION(name, class, subclass, protocol, initialize, endpoint_addresses, ...) \
+	endpoint_addresses(USBD_ENDPOINT_ADDRESS, USBD_NO_ENDPOINT_ADDRESS)
+#define USBD_OUT_ENDPOINT_ADDRESSES_OF_FUNCTION(name, class, subclass, protocol, initialize, endpoint_addresses, ...) \
+	endpoint_addresses(USBD_NO_ENDPOINT_ADDRESS, USBD_ENDPOINT_ADDRESS)
+
+/// \brief The addresses of the IN endpoints, in the order of \ref USBD_FUNCTIONS
+enum
+{
+	USBD_IN_ENDPOINT_ADDRESS_BASE = 0x80,
+	USBD_FUNCTIONS(USBD_IN_ENDPOINT_ADDRESSES_OF_FUNCTION)
+	USBD_IN_ENDPOINT_ADDRESS_END
+};
+
+/// \brief The addresses of the OUT endpoints, in the order of \ref USBD_FUNCTIONS
+enum
+{
+	USBD_OUT_ENDPOINT_ADDRESS_BASE = 0x00,
+	USBD_FUNCTIONS(USBD_OUT_ENDPOINT_ADDRESSES_OF_FUNCTION)
+	USBD_OUT_ENDPOINT_ADDRESS_END
+};
+
+_Static_assert(USBD_IN_ENDPOINT_ADDRESS_END - 0x80 <= ENDPOINT_COUNT, "Too many IN endpoints for the core");
+_Static_assert(USBD_OUT_ENDPOINT_ADDRESS_END <= ENDPOINT_COUNT, "Too many OUT endpoints for the core");
+
+/** \brief An endpoint of the configuration: how to activate it and who handles its transfers */
+typedef struct
+{
+	UsbEndpointActivation activation;
+	UsbEndpointHandler const *handler;
+} UsbEndpointConfiguration;
+
+#define USBD_ALTERNATE_SETTING_NUMBER(name, ...) USBD_ALTERNATE_SETTING_##name,
+#define USBD_ALTERNATE_SETTING_NUMBERS(name, class, subclass, protocol, alternate_settings) \
+	enum { alternate_settings(USBD_ALTERNATE_SETTING_NUMBER) };
+
+/// \brief The alternate setting numbers, counted from 0 in each interface
+USBD_INTERFACES(USBD_ALTERNATE_SETTING_NUMBERS)
+
+/** \brief An alternate setting of an interface: the endpoints it activates */
+typedef struct
+{
+	UsbEndpointConfiguration const *endpoints;
+	uint8_t endpoint_count;
+} UsbAlternateSettingConfiguration;
+
+/** \brief An interface of the configuration and its alternate settings */
+typedef struct
+{
+	UsbAlternateSettingConfiguration const *alternate_settings;
+	uint8_t alternate_setting_count;
+} UsbInterfaceConfiguration;
+
+/** \brief A function of the device */
+typedef struct
+{
+	void (*initialize)();
+	uint8_t first_interface;
+	uint8_t interface_count;
+} UsbFunctionConfiguration;
+
+/// \brief The interfaces of the configuration, by interface number
+extern const UsbInterfaceConfiguration usbd_interface_configurations[USBD_INTERFACE_COUNT];
+
+/// \brief The functions of the device, in the order of \ref USBD_FUNCTIONS
+extern const UsbFunctionConfiguration usbd_function_configurations[];
+extern const uint8_t usbd_function_count;
+
+#endif /* USBD_CONFIGURATION_H_ */
@@ -8,36 +8,21 @@
 #ifndef USBD_DESCRIPTORS_H_
 #define USBD_DESCRIPTORS_H_
 
-#include "usb_standards.h"
-
-const UsbDeviceDescriptor device_descriptor = {
-	.bLength = sizeof(UsbDeviceDescriptor),
-	.bDescriptorType = USB_DESCRIPTOR_TYPE_DEVICE,
-	.bcdUSB = 0x0200, // 0xJJMN
-	.bDeviceClass = USB_CLASS_PER_INTERFACE,
-	.bDeviceSubClass = USB_SUBCLASS_NONE,
-	.bDeviceProtocol = USB_PROTOCOL_NONE,
-	.bMaxPacketSize0 = 8,
-	.idVendor = 0x6666,
-	.idProduct = 0x13AA,
-	.bcdDevice = 0x0100,
-	.iManufacturer = 0,
-	.iProduct = 0,
-	.iSerialNumber = 0,
-	.bNumConfigurations = 1
-};
-
-const UsbConfigurationDescriptor configuration_descriptor = {
-
-};
-
-typedef struct {
-	UsbConfigurationDescriptor usb_configuration_descriptor;
-	//TODO: Add the remaining necessary descriptors
-} UsbConfigurationDescriptorCombination;
-
-const UsbConfigurationDescriptorCombination configuration_descriptor_combination = {
-	.usb_configuration_descriptor = configuration_descriptor
-};
+#include <stdint.h>
+
+/// \brief Index of the string holding the MAC address of the network function (iMACAddress)
+#define USBD_STRING_INDEX_MAC_ADDRESS 4
+
+/** \brief Where a descriptor lies in the descriptor blob */
+typedef struct
+{
+	uint16_t offset; /**<\brief Offset of the descriptor from the start of the blob. */
+	uint16_t length; /**<\brief Size of the descriptor in bytes (wTotalLength for the compound ones). */
+} UsbDescriptorLocation;
+
+void usbd_descriptors_initialize();
+uint8_t usbd_get_descriptor(uint8_t descriptor_type, uint8_t descriptor_index, void const **descriptor, uint16_t *length);
+void usbd_register_interface_descriptor(uint8_t interface_number, uint8_t descriptor_type, void const *descriptor, uint16_t length);
+uint8_t usbd_get_interface_descriptor(uint8_t interface_number, uint8_t descriptor_type, void const **descriptor, uint16_t *length);
 
 #endif /* USBD_DESCRIPTORS_H_ */
@@ -0,0 +1,111 @@
+/*
+ * usbd_dfu.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_DFU_H_
+#define USBD_DFU_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+#include "usbd_config.h"
+
+/** \name DFU class codes
+ *@{*/
+#define USB_SUBCLASS_DFU 0x01 /**<\brief Device firmware upgrade */
+#define USB_PROTOCOL_DFU_RUNTIME 0x01 /**<\brief The interface of the application */
+#define USB_PROTOCOL_DFU_MODE 0x02 /**<\brief The interface of the device in DFU mode */
+/**@}*/
+
+/// \brief The type of the DFU functional descriptor
+#define USB_DESCRIPTOR_TYPE_DFU_FUNCTIONAL 0x21
+
+/** \name DFU class requests (bRequest)
+ *@{*/
+#define USB_DFU_REQUEST_DETACH 0x00 /**<\brief Enter DFU mode (runtime only) */
+#define USB_DFU_REQUEST_DNLOAD 0x01 /**<\brief A block of the firmware, a zero-length one ends the download */
+#define USB_DFU_REQUEST_UPLOAD 0x02 /**<\brief Read a block of the firmware back */
+#define USB_DFU_REQUEST_GETSTATUS 0x03
+#define USB_DFU_REQUEST_CLRSTATUS 0x04 /**<\brief Leave the error state */
+#define USB_DFU_REQUEST_GETSTATE 0x05
+#define USB_DFU_REQUEST_ABORT 0x06 /**<\brief Return to the idle state */
+/**@}*/
+
+/** \name DFU functional attributes (bmAttributes)
+ *@{*/
+#define USB_DFU_ATTRIBUTE_CAN_DNLOAD 0x01
+#define USB_DFU_ATTRIBUTE_CAN_UPLOAD 0x02
+#define USB_DFU_ATTRIBUTE_MANIFESTATION_TOLERANT 0x04 /**<\brief Answers requests after the manifestation */
+#define USB_DFU_ATTRIBUTE_WILL_DETACH 0x08 /**<\brief Detaches itself after DETACH, without waiting for a bus reset */
+/**@}*/
+
+/** \name DFU states (bState)
+ *@{*/
+#define USB_DFU_STATE_APP_IDLE 0
+#define USB_DFU_STATE_APP_DETACH 1
+#define USB_DFU_STATE_IDLE 2
+#define USB_DFU_STATE_DNLOAD_SYNC 3
+#define USB_DFU_STATE_DNBUSY 4
+#define USB_DFU_STATE_DNLOAD_IDLE 5
+#define USB_DFU_STATE_MANIFEST_SYNC 6
+#define USB_DFU_STATE_MANIFEST 7
+#define USB_DFU_STATE_MANIFEST_WAIT_RESET 8
+#define USB_DFU_STATE_UPLOAD_IDLE 9
+#define USB_DFU_STATE_ERROR 10
+/**@}*/
+
+/** \name DFU status codes (bStatus)
+ *@{*/
+#define USB_DFU_STATUS_OK 0x00
+#define USB_DFU_STATUS_ERR_WRITE 0x03 /**<\brief The memory could not be written */
+#define USB_DFU_STATUS_ERR_ERASE 0x04 /**<\brief The memory could not be erased */
+#define USB_DFU_STATUS_ERR_PROG 0x06 /**<\brief Programming the memory failed */
+#define USB_DFU_STATUS_ERR_VERIFY 0x07 /**<\brief The programmed memory does not read back as written */
+#define USB_DFU_STATUS_ERR_ADDRESS 0x08 /**<\brief The firmware does not fit in the memory */
+#define USB_DFU_STATUS_ERR_NOTDONE 0x09 /**<\brief The download ended before the memory was written */
+#define USB_DFU_STATUS_ERR_FIRMWARE 0x0A /**<\brief The downloaded firmware is not valid */
+#define USB_DFU_STATUS_ERR_STALLEDPKT 0x0F /**<\brief A request was stalled */
+/**@}*/
+
+/** \brief The answer to GETSTATUS */
+typedef struct __attribute__((packed))
+{
+	uint8_t bStatus;
+	uint8_t bwPollTimeout[3]; /**<\brief Milliseconds the host waits before the next GETSTATUS (24 bits, little endian). */
+	uint8_t bState;
+	uint8_t iString;
+} UsbDfuStatus;
+
+/** \brief The DFU functional descriptor, which follows the DFU interface */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_DFU_FUNCTIONAL */
+	uint8_t bmAttributes;
+	uint16_t wDetachTimeOut; /**<\brief Milliseconds the device waits for a bus reset after DETACH. */
+	uint16_t wTransferSize; /**<\brief The largest block of DNLOAD and UPLOAD. */
+	uint16_t bcdDFUVersion;
+} UsbDfuFunctionalDescriptor;
+
+// The application detaches itself, the device stays in DFU mode after the manifestation
+#define USBD_DFU_FUNCTIONAL_DESCRIPTOR { \
+	.bLength = sizeof(UsbDfuFunctionalDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_DFU_FUNCTIONAL, \
+	.bmAttributes = USB_DFU_ATTRIBUTE_CAN_DNLOAD | USB_DFU_ATTRIBUTE_CAN_UPLOAD | \
+		USB_DFU_ATTRIBUTE_MANIFESTATION_TOLERANT | USB_DFU_ATTRIBUTE_WILL_DETACH, \
+	.wDetachTimeOut = 1000, \
+	.wTransferSize = USBD_DFU_TRANSFER_SIZE, \
+	.bcdDFUVersion = 0x0110 \
+}
+
+/// \brief The product ID of the device in DFU mode, so the host does not mistake it for the application
+#define USBD_DFU_MODE_PRODUCT_ID 0x13AB
+
+void usbd_dfu_initialize();
+uint8_t usbd_dfu_mode_active();
+void usbd_dfu_reset_received();
+void usbd_dfu_process();
+
+#endif /* USBD_DFU_H_ */
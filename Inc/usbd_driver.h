@@ -18,6 +18,30 @@
 // Total count of IN or OUT endpoints
 #define ENDPOINT_COUNT	6
 
+// Total size of the FIFO RAM in 32-bit words
+#define FIFO_RAM_DEPTH 1024
+
+/// \brief Depth of the RxFIFO in 32-bit words (including the space for the status entries)
+#define RXFIFO_DEPTH(max_packet_size) (10 + (2 * (((max_packet_size) / 4) + 1)))
+
+/** \brief The settings of an endpoint of a configuration, computed when the firmware is built */
+typedef struct
+{
+	uint8_t endpoint_address; /**<\brief Endpoint number, bit 7 is set for IN endpoints. */
+	UsbEndpointType type;
+	uint16_t max_packet_size;
+	uint16_t txfifo_start; /**<\brief Start of the TxFIFO (IN endpoints) in 32-bit words. */
+	uint16_t txfifo_depth; /**<\brief Depth of the TxFIFO (IN endpoints) in 32-bit words. */
+} UsbEndpointActivation;
+
+/** \brief The FIFOs used by endpoint0, computed with the FIFO layout of the configuration (all in 32-bit words) */
+typedef struct
+{
+	uint16_t rxfifo_depth; /**<\brief Depth of the RxFIFO, which starts at 0 and is shared by all OUT endpoints. */
+	uint16_t txfifo0_start;
+	uint16_t txfifo0_depth;
+} UsbEndpoint0Fifos;
+
 /// \brief USB driver functions exposed to USB framework
 typedef struct
 {
@@ -28,14 +52,21 @@ typedef struct
 	void (*disconnect)();
 	void (*flush_rxfifo)();
 	void (*flush_txfifo)(uint8_t endpoint_number);
-	void (*configure_in_endpoint)(uint8_t endpoint_number, UsbEndpointType endpoint_type, uint16_t endpoint_size);
+	void (*activate_endpoint)(UsbEndpointActivation const *activation);
+	void (*deconfigure_endpoint)(uint8_t endpoint_number);
+	void (*enable_out_endpoint)(uint8_t endpoint_number);
+	void (*start_out_transfer)(uint8_t endpoint_number, uint32_t size);
 	void (*read_packet)(void const *buffer, uint16_t size);
 	void (*write_packet)(uint8_t endpoint_number, void const *buffer, uint16_t size);
+	void (*start_in_transfer)(uint8_t endpoint_number, void const *buffer, uint32_t size);
+	void (*set_endpoint_stall)(uint8_t endpoint_address, uint8_t stall);
 	void (*poll)();
 	// TODO: Add pointers to the other driver functions
 } UsbDriver;
 
 extern const UsbDriver usb_driver;
+/// \brief Defined with the FIFO layout (see usbd_configuration.c)
+extern const UsbEndpoint0Fifos usbd_endpoint0_fifos;
 extern UsbEvents usb_events;
 
 /**
@@ -12,5 +12,6 @@
 
 void usbd_initialize();
 void usbd_poll();
+void usbd_set_endpoint_halt(uint8_t endpoint_address, uint8_t halt);
 
 #endif /* USBD_FRAMEWORK_H_ */
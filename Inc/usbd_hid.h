@@ -0,0 +1,117 @@
+/*
+ * usbd_hid.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_HID_H_
+#define USBD_HID_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+
+/** \name HID descriptor types
+ *@{*/
+#define USB_DESCRIPTOR_TYPE_HID 0x21
+#define USB_DESCRIPTOR_TYPE_HID_REPORT 0x22
+/**@}*/
+
+/** \name HID class requests (bRequest)
+ *@{*/
+#define USB_HID_REQUEST_GET_REPORT 0x01 /**<\brief Return a report (wValue: report type and ID) */
+#define USB_HID_REQUEST_GET_IDLE 0x02 /**<\brief Return the idle rate */
+#define USB_HID_REQUEST_SET_REPORT 0x09 /**<\brief Set a report (wValue: report type and ID) */
+#define USB_HID_REQUEST_SET_IDLE 0x0A /**<\brief Set the idle rate (high byte of wValue, in 4 ms units, 0 - only on change) */
+/**@}*/
+
+/** \name HID report types (high byte of wValue of GET_REPORT and SET_REPORT)
+ *@{*/
+#define USB_HID_REPORT_TYPE_INPUT 0x01
+#define USB_HID_REPORT_TYPE_OUTPUT 0x02
+#define USB_HID_REPORT_TYPE_FEATURE 0x03
+/**@}*/
+
+/** \brief The HID descriptor, placed between the interface descriptor and its endpoints */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_HID */
+	uint16_t bcdHID;
+	uint8_t bCountryCode;
+	uint8_t bNumDescriptors;
+	uint8_t bReportDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_HID_REPORT */
+	uint16_t wReportDescriptorLength;
+} UsbHidDescriptor;
+
+/**
+ * \brief The report descriptor of the control panel: 16 buttons and 3 axes in, 16 LEDs out
+ * \details The layouts of \ref UsbHidInputReport and \ref UsbHidOutputReport follow it.
+ */
+#define USBD_HID_REPORT_DESCRIPTOR \
+	0x05, 0x01,       /* Usage Page (Generic Desktop) */ \
+	0x09, 0x05,       /* Usage (Game Pad) */ \
+	0xA1, 0x01,       /* Collection (Application) */ \
+	0x05, 0x09,       /*   Usage Page (Button) */ \
+	0x19, 0x01,       /*   Usage Minimum (1) */ \
+	0x29, 0x10,       /*   Usage Maximum (16) */ \
+	0x15, 0x00,       /*   Logical Minimum (0) */ \
+	0x25, 0x01,       /*   Logical Maximum (1) */ \
+	0x75, 0x01,       /*   Report Size (1) */ \
+	0x95, 0x10,       /*   Report Count (16) */ \
+	0x81, 0x02,       /*   Input (Data, Variable, Absolute) */ \
+	0x05, 0x01,       /*   Usage Page (Generic Desktop) */ \
+	0x09, 0x30,       /*   Usage (X) */ \
+	0x09, 0x31,       /*   Usage (Y) */ \
+	0x09, 0x32,       /*   Usage (Z) */ \
+	0x16, 0x01, 0x80, /*   Logical Minimum (-32767) */ \
+	0x26, 0xFF, 0x7F, /*   Logical Maximum (32767) */ \
+	0x75, 0x10,       /*   Report Size (16) */ \
+	0x95, 0x03,       /*   Report Count (3) */ \
+	0x81, 0x02,       /*   Input (Data, Variable, Absolute) */ \
+	0x05, 0x08,       /*   Usage Page (LEDs) */ \
+	0x19, 0x01,       /*   Usage Minimum (1) */ \
+	0x29, 0x10,       /*   Usage Maximum (16) */ \
+	0x15, 0x00,       /*   Logical Minimum (0) */ \
+	0x25, 0x01,       /*   Logical Maximum (1) */ \
+	0x75, 0x01,       /*   Report Size (1) */ \
+	0x95, 0x10,       /*   Report Count (16) */ \
+	0x91, 0x02,       /*   Output (Data, Variable, Absolute) */ \
+	0xC0              /* End Collection */
+
+#define USBD_HID_REPORT_DESCRIPTOR_SIZE sizeof((uint8_t const[]){ USBD_HID_REPORT_DESCRIPTOR })
+
+/// \brief Initializer of the HID descriptor (used by the configuration lists)
+#define USBD_HID_DESCRIPTOR { \
+	.bLength = sizeof(UsbHidDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_HID, \
+	.bcdHID = 0x0111, \
+	.bCountryCode = 0, \
+	.bNumDescriptors = 1, \
+	.bReportDescriptorType = USB_DESCRIPTOR_TYPE_HID_REPORT, \
+	.wReportDescriptorLength = USBD_HID_REPORT_DESCRIPTOR_SIZE \
+}
+
+/** \brief The input report (sent to the host) */
+typedef struct __attribute__((packed))
+{
+	uint16_t buttons; /**<\brief Bit 0 is button 1 */
+	int16_t x;
+	int16_t y;
+	int16_t z;
+} UsbHidInputReport;
+
+/** \brief The output report (set by the host) */
+typedef struct __attribute__((packed))
+{
+	uint16_t leds; /**<\brief Bit 0 is LED 1 */
+} UsbHidOutputReport;
+
+/// \brief Handles the interrupt IN endpoint of the HID function
+extern const UsbEndpointHandler usbd_hid_endpoint_handler;
+
+void usbd_hid_initialize();
+void usbd_hid_send_report(UsbHidInputReport const *report);
+UsbHidOutputReport usbd_hid_output_report();
+
+#endif /* USBD_HID_H_ */
@@ -0,0 +1,195 @@
+/*
+ * usbd_midi.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_MIDI_H_
+#define USBD_MIDI_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+#include "usbd_audio.h"
+
+/// \brief The subclass of the streaming interface of a MIDI function (its control interface is an audio control one)
+#define USB_SUBCLASS_MIDI_STREAMING 0x03
+
+/** \name MIDI streaming class-specific descriptor subtypes
+ *@{*/
+#define USB_MIDI_SUBTYPE_MS_HEADER 0x01 /**<\brief MIDI streaming interface */
+#define USB_MIDI_SUBTYPE_IN_JACK 0x02 /**<\brief MIDI streaming interface */
+#define USB_MIDI_SUBTYPE_OUT_JACK 0x03 /**<\brief MIDI streaming interface */
+#define USB_MIDI_SUBTYPE_MS_GENERAL 0x01 /**<\brief Bulk data endpoint */
+/**@}*/
+
+/** \name MIDI jack types (bJackType)
+ *@{*/
+#define USB_MIDI_JACK_EMBEDDED 0x01 /**<\brief Connected to the host over the endpoints */
+#define USB_MIDI_JACK_EXTERNAL 0x02 /**<\brief Stands for a connector of the device */
+/**@}*/
+
+/**
+ * \name The jacks of a cable
+ * \details Each cable has four jacks: the data of the host enters through the embedded IN jack
+ * and leaves through the external OUT jack, the data for the host enters through the external
+ * IN jack and leaves through the embedded OUT jack. The jack IDs are 4 * cable + jack.
+ *@{*/
+#define USBD_MIDI_JACK_EMBEDDED_IN 1
+#define USBD_MIDI_JACK_EXTERNAL_IN 2
+#define USBD_MIDI_JACK_EMBEDDED_OUT 3
+#define USBD_MIDI_JACK_EXTERNAL_OUT 4
+#define USBD_MIDI_JACK_ID(cable, jack) (4 * (cable) + USBD_MIDI_JACK_##jack)
+/**@}*/
+
+/// \brief The count of event packets in a full packet of the bulk endpoints
+#define USBD_MIDI_EVENTS_PER_PACKET 16
+
+/// \brief The maximum packet size of both bulk endpoints (4 bytes per event)
+#define USBD_MIDI_PACKET_SIZE (USBD_MIDI_EVENTS_PER_PACKET * 4)
+
+/** \name Code index numbers (the low nibble of the event header)
+ *@{*/
+#define USB_MIDI_CIN_MISC 0x0 /**<\brief Reserved, hosts use it as padding */
+#define USB_MIDI_CIN_SYSTEM_COMMON_2 0x2 /**<\brief A two-byte system common message */
+#define USB_MIDI_CIN_SYSTEM_COMMON_3 0x3 /**<\brief A three-byte system common message */
+#define USB_MIDI_CIN_SYSEX_START 0x4 /**<\brief Three bytes of a system exclusive message that goes on */
+#define USB_MIDI_CIN_SYSEX_END_1 0x5 /**<\brief A single-byte system common message, or the last byte of a system exclusive one */
+#define USB_MIDI_CIN_SYSEX_END_2 0x6 /**<\brief The last two bytes of a system exclusive message */
+#define USB_MIDI_CIN_SYSEX_END_3 0x7 /**<\brief The last three bytes of a system exclusive message */
+#define USB_MIDI_CIN_SINGLE_BYTE 0xF /**<\brief A real-time message */
+/**@}*/
+
+/**
+ * \brief A USB-MIDI event packet: a MIDI message tagged with its cable
+ * \details The channel voice messages have the upper nibble of their status byte as the code index
+ * number. The bytes a message does not use are 0.
+ */
+typedef struct __attribute__((packed))
+{
+	uint8_t header; /**<\brief The cable number in the upper nibble, the code index number in the lower one. */
+	uint8_t midi[3];
+} UsbMidiEvent;
+
+/// \brief Receives the events the host sent on a cable
+typedef void (*UsbMidiEventHandler)(UsbMidiEvent event);
+
+/** \brief The header of the audio control interface of a MIDI function, which has no terminals */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_CS_INTERFACE */
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_AUDIO_SUBTYPE_HEADER */
+	uint16_t bcdADC;
+	uint16_t wTotalLength; /**<\brief Size of the header alone. */
+	uint8_t bInCollection; /**<\brief The MIDI streaming interface only. */
+	uint8_t baInterfaceNr[1];
+} UsbMidiControlHeaderDescriptor;
+
+/** \brief The header of the MIDI streaming interface, followed by its jacks */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_MIDI_SUBTYPE_MS_HEADER */
+	uint16_t bcdMSC;
+	uint16_t wTotalLength; /**<\brief Size of the header and of all jacks, endpoints and their class-specific descriptors. */
+} UsbMidiHeaderDescriptor;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_MIDI_SUBTYPE_IN_JACK */
+	uint8_t bJackType;
+	uint8_t bJackID;
+	uint8_t iJack;
+} UsbMidiInJackDescriptor;
+
+/** \brief An OUT jack with a single input pin */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_MIDI_SUBTYPE_OUT_JACK */
+	uint8_t bJackType;
+	uint8_t bJackID;
+	uint8_t bNrInputPins;
+	uint8_t baSourceID;
+	uint8_t baSourcePin;
+	uint8_t iJack;
+} UsbMidiOutJackDescriptor;
+
+/// \brief Follows the endpoint descriptor of a bulk data endpoint, lists the embedded jacks it carries (one per cable)
+#define USB_MIDI_ENDPOINT_DESCRIPTOR_STRUCT(jack_count) struct __attribute__((packed)) { \
+	uint8_t bLength; \
+	uint8_t bDescriptorType; /* USB_DESCRIPTOR_TYPE_CS_ENDPOINT */ \
+	uint8_t bDescriptorSubtype; /* USB_MIDI_SUBTYPE_MS_GENERAL */ \
+	uint8_t bNumEmbMIDIJack; \
+	uint8_t baAssocJackID[jack_count]; \
+}
+
+/** \name Initializers of the class-specific descriptors (used by the configuration lists)
+ *@{*/
+#define USBD_MIDI_CONTROL_HEADER_DESCRIPTOR(streaming_interface) { \
+	.bLength = sizeof(UsbMidiControlHeaderDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_AUDIO_SUBTYPE_HEADER, \
+	.bcdADC = 0x0100, \
+	.wTotalLength = sizeof(UsbMidiControlHeaderDescriptor), \
+	.bInCollection = 1, \
+	.baInterfaceNr = { (streaming_interface) } \
+}
+
+// Each cable adds four jacks, each endpoint is the 9-byte audio endpoint descriptor and lists one jack per cable
+#define USBD_MIDI_HEADER_DESCRIPTOR(cable_count) { \
+	.bLength = sizeof(UsbMidiHeaderDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_MIDI_SUBTYPE_MS_HEADER, \
+	.bcdMSC = 0x0100, \
+	.wTotalLength = sizeof(UsbMidiHeaderDescriptor) + \
+		(cable_count) * (2 * sizeof(UsbMidiInJackDescriptor) + 2 * sizeof(UsbMidiOutJackDescriptor)) + \
+		2 * (sizeof(UsbAudioEndpointDescriptor) + sizeof(USB_MIDI_ENDPOINT_DESCRIPTOR_STRUCT(cable_count))) \
+}
+
+#define USBD_MIDI_IN_JACK_DESCRIPTOR(type, id) { \
+	.bLength = sizeof(UsbMidiInJackDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_MIDI_SUBTYPE_IN_JACK, \
+	.bJackType = (type), \
+	.bJackID = (id), \
+	.iJack = 0 \
+}
+
+#define USBD_MIDI_OUT_JACK_DESCRIPTOR(type, id, source) { \
+	.bLength = sizeof(UsbMidiOutJackDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_MIDI_SUBTYPE_OUT_JACK, \
+	.bJackType = (type), \
+	.bJackID = (id), \
+	.bNrInputPins = 1, \
+	.baSourceID = (source), \
+	.baSourcePin = 1, \
+	.iJack = 0 \
+}
+
+// The jack IDs are passed as a list, one per cable
+#define USBD_MIDI_ENDPOINT_DESCRIPTOR(jack_count, ...) { \
+	.bLength = sizeof(USB_MIDI_ENDPOINT_DESCRIPTOR_STRUCT(jack_count)), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_ENDPOINT, \
+	.bDescriptorSubtype = USB_MIDI_SUBTYPE_MS_GENERAL, \
+	.bNumEmbMIDIJack = (jack_count), \
+	.baAssocJackID = { __VA_ARGS__ } \
+}
+/**@}*/
+
+/// \brief Handles both bulk endpoints of the MIDI function
+extern const UsbEndpointHandler usbd_midi_endpoint_handler;
+
+void usbd_midi_initialize();
+void usbd_midi_route(uint8_t cable, UsbMidiEventHandler handler);
+uint8_t usbd_midi_send_event(UsbMidiEvent event);
+uint8_t usbd_midi_send(uint8_t cable, uint8_t status, uint8_t data1, uint8_t data2);
+void usbd_midi_process();
+
+#endif /* USBD_MIDI_H_ */
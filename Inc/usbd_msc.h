@@ -0,0 +1,106 @@
+/*
+ * usbd_msc.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_MSC_H_
+#define USBD_MSC_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+#include "Helpers/block_device.h"
+
+/** \name Mass storage class codes
+ *@{*/
+#define USB_SUBCLASS_MSC_SCSI 0x06 /**<\brief SCSI transparent command set */
+#define USB_PROTOCOL_MSC_BOT 0x50 /**<\brief Bulk-only transport */
+/**@}*/
+
+/** \name Bulk-only transport class requests (bRequest)
+ *@{*/
+#define USB_MSC_REQUEST_GET_MAX_LUN 0xFE /**<\brief Return the highest logical unit number */
+#define USB_MSC_REQUEST_RESET 0xFF /**<\brief Bulk-only mass storage reset: be ready for the next CBW */
+/**@}*/
+
+/** \name Bulk-only transport wrappers
+ *@{*/
+#define USB_MSC_CBW_SIGNATURE 0x43425355 /**<\brief "USBC" */
+#define USB_MSC_CSW_SIGNATURE 0x53425355 /**<\brief "USBS" */
+#define USB_MSC_CBW_FLAGS_DIRECTION_IN 0x80 /**<\brief The data stage goes to the host */
+
+#define USB_MSC_CSW_STATUS_PASSED 0x00
+#define USB_MSC_CSW_STATUS_FAILED 0x01
+#define USB_MSC_CSW_STATUS_PHASE_ERROR 0x02
+/**@}*/
+
+/** \brief The command block wrapper, sent by the host to start a command */
+typedef struct __attribute__((packed))
+{
+	uint32_t dCBWSignature; /**<\brief \ref USB_MSC_CBW_SIGNATURE */
+	uint32_t dCBWTag; /**<\brief Echoed by the CSW of the command */
+	uint32_t dCBWDataTransferLength; /**<\brief The size of the data stage expected by the host */
+	uint8_t bmCBWFlags;
+	uint8_t bCBWLUN;
+	uint8_t bCBWCBLength;
+	uint8_t CBWCB[16]; /**<\brief The SCSI command block */
+} UsbMscCommandBlockWrapper;
+
+/** \brief The command status wrapper, sent to the host to end a command */
+typedef struct __attribute__((packed))
+{
+	uint32_t dCSWSignature; /**<\brief \ref USB_MSC_CSW_SIGNATURE */
+	uint32_t dCSWTag;
+	uint32_t dCSWDataResidue; /**<\brief The part of the data stage expected by the host that was not transferred */
+	uint8_t bCSWStatus;
+} UsbMscCommandStatusWrapper;
+
+/** \name SCSI operation codes
+ *@{*/
+#define SCSI_TEST_UNIT_READY 0x00
+#define SCSI_REQUEST_SENSE 0x03
+#define SCSI_INQUIRY 0x12
+#define SCSI_MODE_SENSE_6 0x1A
+#define SCSI_START_STOP_UNIT 0x1B
+#define SCSI_PREVENT_ALLOW_MEDIUM_REMOVAL 0x1E
+#define SCSI_READ_FORMAT_CAPACITIES 0x23
+#define SCSI_READ_CAPACITY_10 0x25
+#define SCSI_READ_10 0x28
+#define SCSI_WRITE_10 0x2A
+#define SCSI_VERIFY_10 0x2F
+#define SCSI_SYNCHRONIZE_CACHE_10 0x35
+#define SCSI_MODE_SENSE_10 0x5A
+/**@}*/
+
+/** \name SCSI sense keys
+ *@{*/
+#define SCSI_SENSE_NO_SENSE 0x00
+#define SCSI_SENSE_NOT_READY 0x02
+#define SCSI_SENSE_MEDIUM_ERROR 0x03
+#define SCSI_SENSE_ILLEGAL_REQUEST 0x05
+#define SCSI_SENSE_UNIT_ATTENTION 0x06
+#define SCSI_SENSE_DATA_PROTECT 0x07
+/**@}*/
+
+/** \name SCSI additional sense codes
+ *@{*/
+#define SCSI_ASC_WRITE_FAULT 0x03
+#define SCSI_ASC_UNRECOVERED_READ_ERROR 0x11
+#define SCSI_ASC_INVALID_COMMAND_OPERATION_CODE 0x20
+#define SCSI_ASC_LBA_OUT_OF_RANGE 0x21
+#define SCSI_ASC_INVALID_FIELD_IN_CDB 0x24
+#define SCSI_ASC_LOGICAL_UNIT_NOT_SUPPORTED 0x25
+#define SCSI_ASC_WRITE_PROTECTED 0x27
+#define SCSI_ASC_MEDIUM_MAY_HAVE_CHANGED 0x28
+#define SCSI_ASC_MEDIUM_NOT_PRESENT 0x3A
+/**@}*/
+
+/// \brief Handles both bulk endpoints of the mass storage function
+extern const UsbEndpointHandler usbd_msc_endpoint_handler;
+
+void usbd_msc_initialize();
+void usbd_msc_attach(uint8_t lun, BlockDevice const *device);
+void usbd_msc_process();
+
+#endif /* USBD_MSC_H_ */
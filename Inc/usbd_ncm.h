@@ -0,0 +1,147 @@
+/*
+ * usbd_ncm.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_NCM_H_
+#define USBD_NCM_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+#include "usbd_cdc.h"
+
+/** \name Network control model (the header and union descriptors are the ones of \ref usbd_cdc.h)
+ *@{*/
+#define USB_SUBCLASS_CDC_NCM 0x0D /**<\brief Network control model */
+#define USB_PROTOCOL_CDC_NTB 0x01 /**<\brief The data interface carries network transfer blocks */
+
+#define USB_CDC_SUBTYPE_ETHERNET 0x0F
+#define USB_CDC_SUBTYPE_NCM 0x1A
+/**@}*/
+
+/** \name NCM class requests (bRequest)
+ *@{*/
+#define USB_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER 0x43 /**<\brief Select the frames passed to the host */
+#define USB_NCM_REQUEST_GET_NTB_PARAMETERS 0x80 /**<\brief Return the \ref UsbNcmNtbParameters */
+#define USB_NCM_REQUEST_GET_NTB_INPUT_SIZE 0x85 /**<\brief Return the largest NTB sent to the host */
+#define USB_NCM_REQUEST_SET_NTB_INPUT_SIZE 0x86 /**<\brief Set the largest NTB sent to the host */
+/**@}*/
+
+/** \name NCM notifications (bRequest of the notification header)
+ *@{*/
+#define USB_CDC_NOTIFICATION_NETWORK_CONNECTION 0x00 /**<\brief wValue: 1 - connected, 0 - disconnected */
+#define USB_CDC_NOTIFICATION_CONNECTION_SPEED_CHANGE 0x2A /**<\brief Followed by the downlink and uplink bit rates */
+/**@}*/
+
+/** \name NTB16 signatures
+ *@{*/
+#define USB_NCM_NTH16_SIGNATURE 0x484D434E /**<\brief "NCMH" */
+#define USB_NCM_NDP16_SIGNATURE 0x304D434E /**<\brief "NCM0" (the datagrams have no CRC) */
+/**@}*/
+
+/** \brief The Ethernet networking functional descriptor */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_CDC_SUBTYPE_ETHERNET */
+	uint8_t iMACAddress; /**<\brief Index of the string holding the MAC address in 12 hexadecimal digits */
+	uint32_t bmEthernetStatistics;
+	uint16_t wMaxSegmentSize;
+	uint16_t wNumberMCFilters;
+	uint8_t bNumberPowerFilters;
+} UsbCdcEthernetDescriptor;
+
+/** \brief The NCM functional descriptor */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_CDC_SUBTYPE_NCM */
+	uint16_t bcdNcmVersion;
+	uint8_t bmNetworkCapabilities;
+} UsbCdcNcmDescriptor;
+
+/// \brief The largest Ethernet frame carried by the function (without the CRC)
+#define USBD_NCM_MAX_SEGMENT_SIZE 1514
+
+/** \name Initializers of the functional descriptors (used by the configuration lists)
+ *@{*/
+// No Ethernet statistics and no multicast or power filters
+#define USBD_CDC_ETHERNET_DESCRIPTOR(mac_address_string) { \
+	.bLength = sizeof(UsbCdcEthernetDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_CDC_SUBTYPE_ETHERNET, \
+	.iMACAddress = (mac_address_string), \
+	.bmEthernetStatistics = 0, \
+	.wMaxSegmentSize = USBD_NCM_MAX_SEGMENT_SIZE, \
+	.wNumberMCFilters = 0, \
+	.bNumberPowerFilters = 0 \
+}
+
+// Only the mandatory requests, NTB16 and 4-byte SET_NTB_INPUT_SIZE
+#define USBD_CDC_NCM_DESCRIPTOR { \
+	.bLength = sizeof(UsbCdcNcmDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_CDC_SUBTYPE_NCM, \
+	.bcdNcmVersion = 0x0100, \
+	.bmNetworkCapabilities = 0x00 \
+}
+/**@}*/
+
+/** \brief The NTB parameters (the answer to GET_NTB_PARAMETERS) */
+typedef struct __attribute__((packed))
+{
+	uint16_t wLength;
+	uint16_t bmNtbFormatsSupported; /**<\brief Bit 0: NTB16, bit 1: NTB32 */
+	uint32_t dwNtbInMaxSize;
+	uint16_t wNdpInDivisor;
+	uint16_t wNdpInPayloadRemainder;
+	uint16_t wNdpInAlignment;
+	uint16_t wReserved;
+	uint32_t dwNtbOutMaxSize;
+	uint16_t wNdpOutDivisor;
+	uint16_t wNdpOutPayloadRemainder;
+	uint16_t wNdpOutAlignment;
+	uint16_t wNtbOutMaxDatagrams; /**<\brief 0 - no limit */
+} UsbNcmNtbParameters;
+
+/** \brief The header of an NTB16 (NTH16) */
+typedef struct __attribute__((packed))
+{
+	uint32_t dwSignature; /**<\brief \ref USB_NCM_NTH16_SIGNATURE */
+	uint16_t wHeaderLength;
+	uint16_t wSequence;
+	uint16_t wBlockLength; /**<\brief The size of the whole NTB */
+	uint16_t wNdpIndex; /**<\brief Offset of the first datagram pointer table */
+} UsbNcmNth16;
+
+/** \brief An entry of a datagram pointer table, the table ends with an entry of zeros */
+typedef struct __attribute__((packed))
+{
+	uint16_t wDatagramIndex;
+	uint16_t wDatagramLength;
+} UsbNcmDatagramPointer16;
+
+/** \brief A datagram pointer table of an NTB16 (NDP16) */
+typedef struct __attribute__((packed))
+{
+	uint32_t dwSignature; /**<\brief \ref USB_NCM_NDP16_SIGNATURE */
+	uint16_t wLength; /**<\brief The size of the table, including all of its entries */
+	uint16_t wNextNdpIndex; /**<\brief Offset of the next table (0 - this is the last one) */
+	UsbNcmDatagramPointer16 datagrams[];
+} UsbNcmNdp16;
+
+/// \brief Handles the notification and both data endpoints of the NCM function
+extern const UsbEndpointHandler usbd_ncm_endpoint_handler;
+
+void usbd_ncm_initialize();
+uint8_t const *usbd_ncm_receive(uint16_t *size);
+void usbd_ncm_release();
+uint8_t *usbd_ncm_allocate(uint16_t size);
+void usbd_ncm_send(uint16_t size);
+uint8_t usbd_ncm_is_connected();
+
+#endif /* USBD_NCM_H_ */
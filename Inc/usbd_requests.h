@@ -0,0 +1,43 @@
+/*
+ * usbd_requests.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_REQUESTS_H_
+#define USBD_REQUESTS_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+#include "usb_device.h"
+
+/**
+ * \brief Handle one control request
+ * \details For a device-to-host request the handler points `ptr_in_buffer` to the data and sets
+ * `in_data_size` (at most wLength). The framework then runs the data and status stages.
+ *
+ * For a host-to-device request with a data stage the handler is called twice. When the SETUP
+ * arrives (`control_transfer_stage` is \ref USB_CONTROL_STAGE_SETUP) it points `ptr_control_out_data`
+ * to a buffer of at least wLength bytes. Once the whole data stage is received in that buffer
+ * (`control_transfer_stage` is \ref USB_CONTROL_STAGE_DATA_OUT and `out_data_size` holds the count
+ * of received bytes) it processes the data, before the status stage is sent.
+ * \return Non-zero when the request was accepted, zero to stall it
+ */
+typedef uint8_t (*UsbRequestHandler)(UsbDevice *usb_device, UsbRequest const *request);
+
+/**
+ * \brief The handlers of a range of bRequest codes
+ * \details `handlers[i]` handles bRequest `first_request + i`, a NULL entry stalls the request.
+ */
+typedef struct
+{
+	uint8_t first_request;
+	uint8_t request_count;
+	UsbRequestHandler const *handlers;
+} UsbRequestHandlers;
+
+void usbd_register_request_handlers(uint8_t request_type, uint8_t target, UsbRequestHandlers const *handlers);
+UsbRequestHandler usbd_find_request_handler(UsbRequest const *request);
+
+#endif /* USBD_REQUESTS_H_ */
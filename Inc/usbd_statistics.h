@@ -0,0 +1,107 @@
+/*
+ * usbd_statistics.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_STATISTICS_H_
+#define USBD_STATISTICS_H_
+
+#include <stdint.h>
+#include "usbd_driver.h"
+#include "Helpers/cpu_load.h"
+#include "Helpers/memory_usage.h"
+
+#define USBD_STATISTICS_VERSION 6
+
+/** \brief Traffic and error counters of one endpoint direction */
+typedef struct
+{
+	uint32_t packets; /**<\brief Count of data packets transferred. */
+	uint32_t bytes; /**<\brief Count of payload bytes transferred. */
+	uint32_t naks; /**<\brief Count of tokens answered with NAK (only counted with USBD_STATISTICS_COUNT_NAKS). */
+	uint32_t transfer_completions; /**<\brief Count of completed transfers. */
+	uint16_t short_packets; /**<\brief Count of packets shorter than the maximum packet size. */
+	uint16_t fifo_underruns; /**<\brief Count of TxFIFO underruns (IN) . */
+	uint16_t fifo_overruns; /**<\brief Count of packets lost because the RxFIFO was full (OUT). */
+	uint16_t incomplete_isochronous; /**<\brief Count of isochronous transfers not completed in their frame. */
+	uint16_t max_fifo_fill; /**<\brief Highest TxFIFO occupancy (IN) or largest popped packet (OUT) in bytes. */
+	uint16_t reserved;
+} UsbEndpointStatistics;
+
+/// \brief The width of a bucket of \ref UsbLatencyStatistics::histogram in microseconds
+#define USBD_LATENCY_HISTOGRAM_BUCKET_US 250
+#define USBD_LATENCY_HISTOGRAM_BUCKET_COUNT 8
+
+/** \brief Latency of the reports of a function: from their submission to the acknowledgment of the host */
+typedef struct
+{
+	uint32_t reports; /**<\brief Count of reports delivered. */
+	uint32_t overwritten; /**<\brief Count of reports replaced by a newer one before they were sent. */
+	uint32_t total_us; /**<\brief Sum of the latencies (the average is total_us / reports). */
+	uint16_t min_us;
+	uint16_t max_us;
+	uint16_t histogram[USBD_LATENCY_HISTOGRAM_BUCKET_COUNT]; /**<\brief Count of reports per bucket of latency (the last one counts all longer ones). */
+} UsbLatencyStatistics;
+
+/// \brief The width of a bucket of \ref UsbAudioStatistics::sof_jitter_histogram in nanoseconds
+#define USBD_SOF_JITTER_HISTOGRAM_BUCKET_NS 50
+#define USBD_SOF_JITTER_HISTOGRAM_BUCKET_COUNT 8
+
+/** \brief The clock and the buffer of the audio function */
+typedef struct
+{
+	uint32_t feedback; /**<\brief The rate last reported to the host (samples per frame, 10.14 fixed point). */
+	uint32_t sof_period_ns; /**<\brief The SOF period averaged over the feedback window, measured by the audio clock. */
+	uint16_t sof_jitter_max_ns; /**<\brief Largest deviation of a SOF period from the average. */
+	uint16_t sof_jitter_histogram[USBD_SOF_JITTER_HISTOGRAM_BUCKET_COUNT]; /**<\brief Count of SOF periods per bucket of deviation (the last one counts all larger ones). */
+	uint16_t missed_sofs; /**<\brief Count of SOF captures lost because the interrupt was late. */
+	uint16_t speaker_level; /**<\brief Frames in the speaker buffer when the last period was played. */
+	uint16_t speaker_level_min; /**<\brief Lowest `speaker_level` since the stream started. */
+	uint16_t speaker_level_max; /**<\brief Highest `speaker_level` since the stream started. */
+	uint16_t speaker_underruns; /**<\brief Count of periods padded with silence because the buffer ran dry. */
+	uint16_t speaker_overruns; /**<\brief Count of packets cut short because the buffer was full. */
+	uint16_t reserved;
+} UsbAudioStatistics;
+
+/** \brief The stream of the video function */
+typedef struct
+{
+	uint32_t frames; /**<\brief Count of frames sent. */
+	uint32_t bytes; /**<\brief Count of payload bytes sent (headers included). */
+	uint32_t frame_period_us; /**<\brief Time between the ends of the last two frames (the frame rate is its inverse). */
+	uint32_t bytes_per_second; /**<\brief Throughput of the last frame. */
+	uint16_t conversion_max_us; /**<\brief Longest conversion of a band to YUY2. */
+	uint16_t conversion_stalls; /**<\brief Count of converted bands that waited for a free payload (the bus is the bottleneck). */
+	uint16_t usb_starvations; /**<\brief Count of payloads sent before the next one was ready (the conversion is the bottleneck). */
+	uint16_t reserved;
+} UsbVideoStatistics;
+
+/**
+ * \brief The statistics block returned by \ref USBD_VENDOR_REQUEST_GET_STATISTICS
+ * \details The layout is little-endian and packed by construction. New fields are only appended
+ * and each layout change bumps \ref USBD_STATISTICS_VERSION.
+ */
+typedef struct
+{
+	uint16_t version;
+	uint16_t size; /**<\brief Size of the whole block in bytes. */
+	uint8_t endpoint_count; /**<\brief Count of entries in each of the endpoint arrays. */
+	uint8_t reserved[3];
+	UsbEndpointStatistics in_endpoints[ENDPOINT_COUNT];
+	UsbEndpointStatistics out_endpoints[ENDPOINT_COUNT];
+	MemoryUsage memory; /**<\brief Measured when the snapshot is taken. */
+	CpuLoad cpu; /**<\brief Of the last SOF interval before the snapshot. */
+	UsbLatencyStatistics hid_latency; /**<\brief Of the input reports of the HID function. */
+	UsbAudioStatistics audio; /**<\brief Of the audio function. */
+	UsbVideoStatistics video; /**<\brief Of the video function. */
+} UsbStatistics;
+
+/// \brief The live counters (updated by the driver)
+extern UsbStatistics usbd_statistics;
+
+void usbd_statistics_initialize();
+UsbStatistics const *usbd_statistics_snapshot();
+
+#endif /* USBD_STATISTICS_H_ */
@@ -0,0 +1,17 @@
+/*
+ * usbd_stream.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_STREAM_H_
+#define USBD_STREAM_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+
+/// \brief Sends one packet of the selected size every frame: a frame counter followed by a test pattern
+extern const UsbEndpointHandler usbd_stream_endpoint_handler;
+
+#endif /* USBD_STREAM_H_ */
@@ -0,0 +1,17 @@
+/*
+ * usbd_vendor.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_VENDOR_H_
+#define USBD_VENDOR_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+
+/// \brief Sends every packet received on the OUT endpoint back on the IN endpoint (loopback)
+extern const UsbEndpointHandler usbd_vendor_endpoint_handler;
+
+#endif /* USBD_VENDOR_H_ */
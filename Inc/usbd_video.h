@@ -0,0 +1,321 @@
+/*
+ * usbd_video.h
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#ifndef USBD_VIDEO_H_
+#define USBD_VIDEO_H_
+
+#include <stdint.h>
+#include "usb_standards.h"
+
+/** \name Video class codes
+ *@{*/
+#define USB_SUBCLASS_VIDEO_CONTROL 0x01
+#define USB_SUBCLASS_VIDEO_STREAMING 0x02
+#define USB_SUBCLASS_VIDEO_INTERFACE_COLLECTION 0x03 /**<\brief Interface association */
+/**@}*/
+
+/** \name Video class-specific descriptor subtypes
+ *@{*/
+#define USB_VIDEO_SUBTYPE_VC_HEADER 0x01 /**<\brief Video control interface */
+#define USB_VIDEO_SUBTYPE_VC_INPUT_TERMINAL 0x02 /**<\brief Video control interface */
+#define USB_VIDEO_SUBTYPE_VC_OUTPUT_TERMINAL 0x03 /**<\brief Video control interface */
+#define USB_VIDEO_SUBTYPE_VS_INPUT_HEADER 0x01 /**<\brief Video streaming interface */
+#define USB_VIDEO_SUBTYPE_VS_FORMAT_UNCOMPRESSED 0x04 /**<\brief Video streaming interface */
+#define USB_VIDEO_SUBTYPE_VS_FRAME_UNCOMPRESSED 0x05 /**<\brief Video streaming interface */
+#define USB_VIDEO_SUBTYPE_VS_COLOR_FORMAT 0x0D /**<\brief Video streaming interface */
+/**@}*/
+
+/** \name Video terminal types
+ *@{*/
+#define USB_VIDEO_TERMINAL_STREAMING 0x0101
+#define USB_VIDEO_TERMINAL_CAMERA 0x0201
+/**@}*/
+
+/** \name Video class requests (bRequest)
+ *@{*/
+#define USB_VIDEO_REQUEST_SET_CUR 0x01
+#define USB_VIDEO_REQUEST_GET_CUR 0x81
+#define USB_VIDEO_REQUEST_GET_MIN 0x82
+#define USB_VIDEO_REQUEST_GET_MAX 0x83
+#define USB_VIDEO_REQUEST_GET_RES 0x84
+#define USB_VIDEO_REQUEST_GET_LEN 0x85 /**<\brief Return the size of a control */
+#define USB_VIDEO_REQUEST_GET_INFO 0x86 /**<\brief Return the capabilities of a control */
+#define USB_VIDEO_REQUEST_GET_DEF 0x87
+/**@}*/
+
+/** \name Video streaming controls (the high byte of wValue)
+ *@{*/
+#define USB_VIDEO_CONTROL_PROBE 0x01 /**<\brief Negotiate the stream parameters */
+#define USB_VIDEO_CONTROL_COMMIT 0x02 /**<\brief Apply the negotiated parameters (starts a bulk stream) */
+#define USB_VIDEO_CONTROL_INFO_GET 0x01 /**<\brief GET_INFO: the control supports GET requests */
+#define USB_VIDEO_CONTROL_INFO_SET 0x02 /**<\brief GET_INFO: the control supports SET_CUR */
+/**@}*/
+
+/** \name Payload header bits (bmHeaderInfo)
+ *@{*/
+#define USB_VIDEO_HEADER_FRAME_ID 0x01 /**<\brief Toggles with each video frame */
+#define USB_VIDEO_HEADER_END_OF_FRAME 0x02 /**<\brief The payload ends a video frame */
+#define USB_VIDEO_HEADER_END_OF_HEADER 0x80
+/**@}*/
+
+/** \name The stream of the function: the framebuffer of the panel in YUY2
+ *@{*/
+#define USBD_VIDEO_WIDTH 240
+#define USBD_VIDEO_HEIGHT 320
+/// \brief The frame interval in 100 ns units (5 frames per second, about what a full-speed bulk endpoint carries)
+#define USBD_VIDEO_FRAME_INTERVAL 2000000
+/// \brief The clock of the video control interface (no timestamps are sent, so it only has to be plausible)
+#define USBD_VIDEO_CLOCK_FREQUENCY 48000000
+#define USBD_VIDEO_TERMINAL_CAMERA 1
+#define USBD_VIDEO_TERMINAL_STREAMING 2
+/**@}*/
+
+/// \brief The size of a YUY2 frame (2 bytes per pixel)
+#define USBD_VIDEO_FRAME_SIZE (USBD_VIDEO_WIDTH * USBD_VIDEO_HEIGHT * 2)
+
+/// \brief The bit rate of the stream at the frame interval
+#define USBD_VIDEO_BIT_RATE (USBD_VIDEO_FRAME_SIZE * 8 * (10000000 / USBD_VIDEO_FRAME_INTERVAL))
+
+/** \brief The header of each payload transfer of the stream (no timestamps) */
+typedef struct __attribute__((packed))
+{
+	uint8_t bHeaderLength;
+	uint8_t bmHeaderInfo;
+} UsbVideoPayloadHeader;
+
+/** \brief The probe and commit controls (Video 1.1) */
+typedef struct __attribute__((packed))
+{
+	uint16_t bmHint;
+	uint8_t bFormatIndex;
+	uint8_t bFrameIndex;
+	uint32_t dwFrameInterval;
+	uint16_t wKeyFrameRate;
+	uint16_t wPFrameRate;
+	uint16_t wCompQuality;
+	uint16_t wCompWindowSize;
+	uint16_t wDelay;
+	uint32_t dwMaxVideoFrameSize;
+	uint32_t dwMaxPayloadTransferSize; /**<\brief The size of a payload transfer: a header and a band of lines. */
+	uint32_t dwClockFrequency;
+	uint8_t bmFramingInfo;
+	uint8_t bPreferedVersion;
+	uint8_t bMinVersion;
+	uint8_t bMaxVersion;
+} UsbVideoProbeCommit;
+
+/** \brief The header of the video control interface, followed by its terminals */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType; /**<\brief \ref USB_DESCRIPTOR_TYPE_CS_INTERFACE */
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_VIDEO_SUBTYPE_VC_HEADER */
+	uint16_t bcdUVC;
+	uint16_t wTotalLength; /**<\brief Size of the header and of all terminals and units. */
+	uint32_t dwClockFrequency;
+	uint8_t bInCollection; /**<\brief Count of streaming interfaces. */
+	uint8_t baInterfaceNr[1];
+} UsbVideoControlHeaderDescriptor;
+
+/** \brief A camera terminal (without controls), the source of the stream */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_VIDEO_SUBTYPE_VC_INPUT_TERMINAL */
+	uint8_t bTerminalID;
+	uint16_t wTerminalType;
+	uint8_t bAssocTerminal;
+	uint8_t iTerminal;
+	uint16_t wObjectiveFocalLengthMin;
+	uint16_t wObjectiveFocalLengthMax;
+	uint16_t wOcularFocalLength;
+	uint8_t bControlSize;
+	uint8_t bmControls[3];
+} UsbVideoCameraTerminalDescriptor;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_VIDEO_SUBTYPE_VC_OUTPUT_TERMINAL */
+	uint8_t bTerminalID;
+	uint16_t wTerminalType;
+	uint8_t bAssocTerminal;
+	uint8_t bSourceID;
+	uint8_t iTerminal;
+} UsbVideoOutputTerminalDescriptor;
+
+/** \brief The header of the video streaming interface, followed by its format and frame */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_VIDEO_SUBTYPE_VS_INPUT_HEADER */
+	uint8_t bNumFormats;
+	uint16_t wTotalLength; /**<\brief Size of all class-specific descriptors of the interface. */
+	uint8_t bEndpointAddress;
+	uint8_t bmInfo;
+	uint8_t bTerminalLink;
+	uint8_t bStillCaptureMethod;
+	uint8_t bTriggerSupport;
+	uint8_t bTriggerUsage;
+	uint8_t bControlSize;
+	uint8_t bmaControls[1];
+} UsbVideoInputHeaderDescriptor;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_VIDEO_SUBTYPE_VS_FORMAT_UNCOMPRESSED */
+	uint8_t bFormatIndex;
+	uint8_t bNumFrameDescriptors;
+	uint8_t guidFormat[16];
+	uint8_t bBitsPerPixel;
+	uint8_t bDefaultFrameIndex;
+	uint8_t bAspectRatioX;
+	uint8_t bAspectRatioY;
+	uint8_t bmInterlaceFlags;
+	uint8_t bCopyProtect;
+} UsbVideoUncompressedFormatDescriptor;
+
+/** \brief A frame size of the format, with a single frame interval */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_VIDEO_SUBTYPE_VS_FRAME_UNCOMPRESSED */
+	uint8_t bFrameIndex;
+	uint8_t bmCapabilities;
+	uint16_t wWidth;
+	uint16_t wHeight;
+	uint32_t dwMinBitRate;
+	uint32_t dwMaxBitRate;
+	uint32_t dwMaxVideoFrameBufferSize;
+	uint32_t dwDefaultFrameInterval;
+	uint8_t bFrameIntervalType; /**<\brief Count of discrete frame intervals. */
+	uint32_t dwFrameInterval[1];
+} UsbVideoUncompressedFrameDescriptor;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype; /**<\brief \ref USB_VIDEO_SUBTYPE_VS_COLOR_FORMAT */
+	uint8_t bColorPrimaries;
+	uint8_t bTransferCharacteristics;
+	uint8_t bMatrixCoefficients;
+} UsbVideoColorMatchingDescriptor;
+
+/** \name Initializers of the class-specific descriptors (used by the configuration lists)
+ *@{*/
+#define USBD_VIDEO_CONTROL_HEADER_DESCRIPTOR(streaming_interface) { \
+	.bLength = sizeof(UsbVideoControlHeaderDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_VIDEO_SUBTYPE_VC_HEADER, \
+	.bcdUVC = 0x0110, \
+	.wTotalLength = sizeof(UsbVideoControlHeaderDescriptor) + sizeof(UsbVideoCameraTerminalDescriptor) + \
+		sizeof(UsbVideoOutputTerminalDescriptor), \
+	.dwClockFrequency = USBD_VIDEO_CLOCK_FREQUENCY, \
+	.bInCollection = 1, \
+	.baInterfaceNr = { (streaming_interface) } \
+}
+
+#define USBD_VIDEO_CAMERA_TERMINAL_DESCRIPTOR { \
+	.bLength = sizeof(UsbVideoCameraTerminalDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_VIDEO_SUBTYPE_VC_INPUT_TERMINAL, \
+	.bTerminalID = USBD_VIDEO_TERMINAL_CAMERA, \
+	.wTerminalType = USB_VIDEO_TERMINAL_CAMERA, \
+	.bAssocTerminal = 0, \
+	.iTerminal = 0, \
+	.wObjectiveFocalLengthMin = 0, \
+	.wObjectiveFocalLengthMax = 0, \
+	.wOcularFocalLength = 0, \
+	.bControlSize = 3, \
+	.bmControls = { 0, 0, 0 } \
+}
+
+#define USBD_VIDEO_OUTPUT_TERMINAL_DESCRIPTOR { \
+	.bLength = sizeof(UsbVideoOutputTerminalDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_VIDEO_SUBTYPE_VC_OUTPUT_TERMINAL, \
+	.bTerminalID = USBD_VIDEO_TERMINAL_STREAMING, \
+	.wTerminalType = USB_VIDEO_TERMINAL_STREAMING, \
+	.bAssocTerminal = 0, \
+	.bSourceID = USBD_VIDEO_TERMINAL_CAMERA, \
+	.iTerminal = 0 \
+}
+
+// Neither still images nor triggers, and no per-format controls
+#define USBD_VIDEO_INPUT_HEADER_DESCRIPTOR(endpoint_address) { \
+	.bLength = sizeof(UsbVideoInputHeaderDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_VIDEO_SUBTYPE_VS_INPUT_HEADER, \
+	.bNumFormats = 1, \
+	.wTotalLength = sizeof(UsbVideoInputHeaderDescriptor) + sizeof(UsbVideoUncompressedFormatDescriptor) + \
+		sizeof(UsbVideoUncompressedFrameDescriptor) + sizeof(UsbVideoColorMatchingDescriptor), \
+	.bEndpointAddress = (endpoint_address), \
+	.bmInfo = 0, \
+	.bTerminalLink = USBD_VIDEO_TERMINAL_STREAMING, \
+	.bStillCaptureMethod = 0, \
+	.bTriggerSupport = 0, \
+	.bTriggerUsage = 0, \
+	.bControlSize = 1, \
+	.bmaControls = { 0 } \
+}
+
+// The GUID of YUY2: the FOURCC followed by the base GUID of the media subtypes
+#define USBD_VIDEO_YUY2_FORMAT_DESCRIPTOR { \
+	.bLength = sizeof(UsbVideoUncompressedFormatDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_VIDEO_SUBTYPE_VS_FORMAT_UNCOMPRESSED, \
+	.bFormatIndex = 1, \
+	.bNumFrameDescriptors = 1, \
+	.guidFormat = { 'Y', 'U', 'Y', '2', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 }, \
+	.bBitsPerPixel = 16, \
+	.bDefaultFrameIndex = 1, \
+	.bAspectRatioX = 0, \
+	.bAspectRatioY = 0, \
+	.bmInterlaceFlags = 0, \
+	.bCopyProtect = 0 \
+}
+
+#define USBD_VIDEO_FRAME_DESCRIPTOR { \
+	.bLength = sizeof(UsbVideoUncompressedFrameDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_VIDEO_SUBTYPE_VS_FRAME_UNCOMPRESSED, \
+	.bFrameIndex = 1, \
+	.bmCapabilities = 0, \
+	.wWidth = USBD_VIDEO_WIDTH, \
+	.wHeight = USBD_VIDEO_HEIGHT, \
+	.dwMinBitRate = USBD_VIDEO_BIT_RATE, \
+	.dwMaxBitRate = USBD_VIDEO_BIT_RATE, \
+	.dwMaxVideoFrameBufferSize = USBD_VIDEO_FRAME_SIZE, \
+	.dwDefaultFrameInterval = USBD_VIDEO_FRAME_INTERVAL, \
+	.bFrameIntervalType = 1, \
+	.dwFrameInterval = { USBD_VIDEO_FRAME_INTERVAL } \
+}
+
+// sRGB primaries and transfer, the BT.601 matrix of the conversion
+#define USBD_VIDEO_COLOR_MATCHING_DESCRIPTOR { \
+	.bLength = sizeof(UsbVideoColorMatchingDescriptor), \
+	.bDescriptorType = USB_DESCRIPTOR_TYPE_CS_INTERFACE, \
+	.bDescriptorSubtype = USB_VIDEO_SUBTYPE_VS_COLOR_FORMAT, \
+	.bColorPrimaries = 1, \
+	.bTransferCharacteristics = 1, \
+	.bMatrixCoefficients = 4 \
+}
+/**@}*/
+
+/// \brief Sends the payloads of the stream on the bulk endpoint
+extern const UsbEndpointHandler usbd_video_endpoint_handler;
+
+void usbd_video_initialize();
+
+#endif /* USBD_VIDEO_H_ */
@@ -0,0 +1,119 @@
+/*
+ * audio_output.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include <stddef.h>
+#include "Helpers/audio_output.h"
+#include "stm32f4xx.h"
+
+/** \name PLLI2S (its input is the 2 MHz of the main PLL): 2 MHz * 192 / 5 = 76.8 MHz
+ *@{*/
+#define PLLI2S_N 192
+#define PLLI2S_R 5
+/**@}*/
+
+/** \name The I2S prescaler: 76.8 MHz / (64 * (2 * 12 + 1)) = 48 kHz
+ *@{*/
+#define I2S_DIVIDER 12
+#define I2S_ODD 1
+/**@}*/
+
+/** \name I2S configuration fields
+ *@{*/
+#define I2S_MODE_MASTER_TRANSMIT 2
+#define I2S_DATA_LENGTH_32_BITS 2
+/**@}*/
+
+/** \name DMA configuration fields
+ *@{*/
+#define DMA_CHANNEL_SPI2_TX 0
+#define DMA_SIZE_HALF_WORD 1
+#define DMA_DIRECTION_MEMORY_TO_PERIPHERAL 1
+#define DMA_PRIORITY_HIGH 2
+/**@}*/
+
+/// \brief Two periods of samples, in the order they are shifted out (the DMA must not access the CCM RAM)
+static uint32_t samples[2 * AUDIO_OUTPUT_PERIOD_FRAMES * 2];
+static AudioOutputFill fill_period;
+
+/**
+ * @brief Refill a period of the buffer
+ */
+static void refill(uint32_t *period)
+{
+	uint32_t const count = AUDIO_OUTPUT_PERIOD_FRAMES * 2;
+
+	fill_period((int32_t *)period, AUDIO_OUTPUT_PERIOD_FRAMES);
+
+	// The data register takes the upper half of a sample first, but the DMA reads the lower half first
+	for (uint32_t i = 0; i < count; i++) {
+		period[i] = __ROR(period[i], 16);
+	}
+}
+
+/**
+ * @brief Start the audio clock and the stream
+ * @param fill Fills each period before it is played
+ * @note The stream starts with a period of silence. No pins are assigned, so the stream is
+ * only clocked internally until a codec is connected.
+ */
+void audio_output_start(AudioOutputFill fill)
+{
+	fill_period = fill;
+	refill(&samples[AUDIO_OUTPUT_PERIOD_FRAMES * 2]);
+
+	// PLLI2S feeds the I2S peripherals (I2SSRC is 0 after reset)
+	MODIFY_REG(RCC->PLLI2SCFGR,
+		RCC_PLLI2SCFGR_PLLI2SN | RCC_PLLI2SCFGR_PLLI2SR,
+		_VAL2FLD(RCC_PLLI2SCFGR_PLLI2SN, PLLI2S_N) | _VAL2FLD(RCC_PLLI2SCFGR_PLLI2SR, PLLI2S_R)
+	);
+	SET_BIT(RCC->CR, RCC_CR_PLLI2SON);
+	while (!READ_BIT(RCC->CR, RCC_CR_PLLI2SRDY));
+
+	SET_BIT(RCC->APB1ENR, RCC_APB1ENR_SPI2EN);
+	SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_DMA1EN);
+
+	// Philips standard, 32-bit channels of 32-bit data
+	WRITE_REG(SPI2->I2SCFGR,
+		SPI_I2SCFGR_I2SMOD | _VAL2FLD(SPI_I2SCFGR_I2SCFG, I2S_MODE_MASTER_TRANSMIT) |
+		_VAL2FLD(SPI_I2SCFGR_DATLEN, I2S_DATA_LENGTH_32_BITS) | SPI_I2SCFGR_CHLEN
+	);
+	WRITE_REG(SPI2->I2SPR, _VAL2FLD(SPI_I2SPR_I2SDIV, I2S_DIVIDER) | (I2S_ODD ? SPI_I2SPR_ODD : 0));
+	SET_BIT(SPI2->CR2, SPI_CR2_TXDMAEN);
+
+	// The buffer is played in a loop, with an interrupt after each period
+	WRITE_REG(DMA1_Stream4->PAR, (uint32_t)&SPI2->DR);
+	WRITE_REG(DMA1_Stream4->M0AR, (uint32_t)samples);
+	WRITE_REG(DMA1_Stream4->NDTR, sizeof(samples) / sizeof(uint16_t));
+	WRITE_REG(DMA1_Stream4->CR,
+		_VAL2FLD(DMA_SxCR_CHSEL, DMA_CHANNEL_SPI2_TX) | _VAL2FLD(DMA_SxCR_PL, DMA_PRIORITY_HIGH) |
+		_VAL2FLD(DMA_SxCR_MSIZE, DMA_SIZE_HALF_WORD) | _VAL2FLD(DMA_SxCR_PSIZE, DMA_SIZE_HALF_WORD) |
+		DMA_SxCR_MINC | DMA_SxCR_CIRC | _VAL2FLD(DMA_SxCR_DIR, DMA_DIRECTION_MEMORY_TO_PERIPHERAL) |
+		DMA_SxCR_HTIE | DMA_SxCR_TCIE
+	);
+	SET_BIT(DMA1_Stream4->CR, DMA_SxCR_EN);
+	NVIC_EnableIRQ(DMA1_Stream4_IRQn);
+
+	SET_BIT(SPI2->I2SCFGR, SPI_I2SCFGR_I2SE);
+}
+
+/**
+ * @brief Refill the period that has just been played
+ */
+void DMA1_Stream4_IRQHandler()
+{
+	uint32_t status = DMA1->HISR;
+
+	if (status & DMA_HISR_HTIF4) {
+		WRITE_REG(DMA1->HIFCR, DMA_HIFCR_CHTIF4);
+		refill(&samples[0]);
+	}
+
+	if (status & DMA_HISR_TCIF4) {
+		WRITE_REG(DMA1->HIFCR, DMA_HIFCR_CTCIF4);
+		refill(&samples[AUDIO_OUTPUT_PERIOD_FRAMES * 2]);
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * cpu_load.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "Helpers/cpu_load.h"
+#include "Helpers/cycle_counter.h"
+
+/// \brief 100% expressed in hundredths of a percent
+#define CPU_LOAD_FULL 10000
+
+static uint32_t interval_start;
+static uint32_t idle_cycles;
+static uint32_t usb_cycles;
+
+/// \brief The rolling averages scaled by 2^CPU_LOAD_AVERAGE_SHIFT (to keep the fraction)
+static uint32_t load_average_accumulator;
+static uint32_t usb_load_average_accumulator;
+
+static CpuLoad current_load;
+
+void cpu_load_initialize()
+{
+	cycle_counter_initialize();
+	interval_start = cycle_counter_read();
+}
+
+/**
+ * @brief Sleep until the next interrupt and account the time spent sleeping as idle
+ * @note Called from the main loop whenever it has nothing to do.
+ */
+void cpu_load_idle()
+{
+	// WFI wakes up on a pending interrupt even when PRIMASK is set, so the interrupt
+	// is only serviced (and counted as busy time) after the idle time is accounted
+	__disable_irq();
+	uint32_t sleep_start = cycle_counter_read();
+	__WFI();
+	idle_cycles += cycle_counter_read() - sleep_start;
+	__enable_irq();
+}
+
+/**
+ * @brief Account cycles spent in the USB interrupt
+ */
+void cpu_load_add_usb_cycles(uint32_t cycles)
+{
+	usb_cycles += cycles;
+}
+
+/**
+ * @brief Return the share of `cycles` in `interval` in hundredths of a percent
+ */
+static uint16_t load_of(uint32_t cycles, uint32_t interval)
+{
+	if (cycles >= interval) {
+		return CPU_LOAD_FULL;
+	}
+
+	return ((uint64_t)cycles * CPU_LOAD_FULL) / interval;
+}
+
+/**
+ * @brief Finish the current measurement interval and start the next one
+ * @note Called from the USB interrupt on every SOF (every 1 ms at full speed).
+ */
+void cpu_load_close_interval()
+{
+	uint32_t now = cycle_counter_read();
+	uint32_t interval = now - interval_start;
+
+	if (interval == 0) {
+		return;
+	}
+
+	uint16_t load = CPU_LOAD_FULL - load_of(idle_cycles, interval);
+	uint16_t usb_load = load_of(usb_cycles, interval);
+
+	interval_start = now;
+	idle_cycles = 0;
+	usb_cycles = 0;
+
+	load_average_accumulator += load - (load_average_accumulator >> CPU_LOAD_AVERAGE_SHIFT);
+	usb_load_average_accumulator += usb_load - (usb_load_average_accumulator >> CPU_LOAD_AVERAGE_SHIFT);
+
+	current_load.load = load;
+	current_load.load_average = load_average_accumulator >> CPU_LOAD_AVERAGE_SHIFT;
+	current_load.usb_load = usb_load;
+	current_load.usb_load_average = usb_load_average_accumulator >> CPU_LOAD_AVERAGE_SHIFT;
+	current_load.interval_cycles = interval;
+
+	if (load > current_load.load_peak) {
+		current_load.load_peak = load;
+	}
+
+	if (usb_load > current_load.usb_load_peak) {
+		current_load.usb_load_peak = usb_load;
+	}
+}
+
+/**
+ * @brief Copy the results of the last closed interval
+ */
+void cpu_load_read(CpuLoad *cpu_load)
+{
+	*cpu_load = current_load;
+}
@@ -0,0 +1,145 @@
+/*
+ * flash.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "Helpers/flash.h"
+#include "stm32f4xx.h"
+
+/** \name Unlock sequence of FLASH_CR
+ *@{*/
+#define FLASH_KEY1 0x45670123
+#define FLASH_KEY2 0xCDEF89AB
+/**@}*/
+
+/// \brief The error flags of the status register
+#define FLASH_SR_ERRORS (FLASH_SR_SOP | FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR | FLASH_SR_RDERR)
+
+/// \brief The parallelism of the operations (x32, for a supply of 2.7 to 3.6 V)
+#define FLASH_PSIZE_WORD 2
+
+/**
+ * @brief Return the address of the first byte of a sector
+ */
+uint32_t flash_sector_address(uint8_t sector)
+{
+	uint32_t bank_address = FLASH_BASE + (sector / FLASH_BANK2_FIRST_SECTOR) * 0x100000;
+	uint8_t index = sector % FLASH_BANK2_FIRST_SECTOR;
+
+	if (index < 4) {
+		return bank_address + index * 0x4000;
+	}
+
+	// The 64 KB sector follows the four 16 KB ones, the 128 KB sectors start at 128 KB
+	return bank_address + (index == 4 ? 0x10000 : (index - 4) * 0x20000);
+}
+
+/**
+ * @brief Return the size of a sector in bytes
+ */
+uint32_t flash_sector_size(uint8_t sector)
+{
+	uint8_t index = sector % FLASH_BANK2_FIRST_SECTOR;
+
+	if (index < 4) {
+		return 0x4000;
+	}
+
+	return index == 4 ? 0x10000 : 0x20000;
+}
+
+void flash_unlock()
+{
+	if (READ_BIT(FLASH->CR, FLASH_CR_LOCK)) {
+		WRITE_REG(FLASH->KEYR, FLASH_KEY1);
+		WRITE_REG(FLASH->KEYR, FLASH_KEY2);
+	}
+}
+
+void flash_lock()
+{
+	SET_BIT(FLASH->CR, FLASH_CR_LOCK);
+}
+
+/**
+ * @brief Start erasing a sector and return at once (see flash_is_busy() and flash_finish())
+ * @note The flash must be unlocked.
+ */
+void flash_start_erase(uint8_t sector)
+{
+	// The sectors of bank 2 are numbered from 16 in the SNB field
+	uint8_t sector_number = sector < FLASH_BANK2_FIRST_SECTOR ? sector : 0x10 | (sector - FLASH_BANK2_FIRST_SECTOR);
+
+	WRITE_REG(FLASH->SR, FLASH_SR_EOP | FLASH_SR_ERRORS);
+	MODIFY_REG(FLASH->CR,
+		FLASH_CR_PG | FLASH_CR_SER | FLASH_CR_SNB | FLASH_CR_PSIZE,
+		FLASH_CR_SER | _VAL2FLD(FLASH_CR_SNB, sector_number) | _VAL2FLD(FLASH_CR_PSIZE, FLASH_PSIZE_WORD)
+	);
+	SET_BIT(FLASH->CR, FLASH_CR_STRT);
+}
+
+uint8_t flash_is_busy()
+{
+	return READ_BIT(FLASH->SR, FLASH_SR_BSY) ? 1 : 0;
+}
+
+/**
+ * @brief Wait for the operation in progress to end
+ * @return Non-zero if it succeeded
+ * @note The data cache is reset as well, so the next reads see the new content of the flash.
+ */
+uint8_t flash_finish()
+{
+	while (flash_is_busy()) {
+	}
+
+	uint32_t errors = READ_BIT(FLASH->SR, FLASH_SR_ERRORS);
+
+	WRITE_REG(FLASH->SR, FLASH_SR_EOP | FLASH_SR_ERRORS);
+	CLEAR_BIT(FLASH->CR, FLASH_CR_PG | FLASH_CR_SER);
+
+	// The data cache may only be reset while it is disabled
+	CLEAR_BIT(FLASH->ACR, FLASH_ACR_DCEN);
+	SET_BIT(FLASH->ACR, FLASH_ACR_DCRST);
+	CLEAR_BIT(FLASH->ACR, FLASH_ACR_DCRST);
+	SET_BIT(FLASH->ACR, FLASH_ACR_DCEN);
+
+	return errors == 0;
+}
+
+/**
+ * @brief Program words into erased flash, waiting for each of them
+ * @return Non-zero if all words were programmed
+ * @note The flash must be unlocked. A word takes about 16 us.
+ */
+uint8_t flash_program(uint32_t address, uint32_t const *data, uint32_t word_count)
+{
+	while (flash_is_busy()) {
+	}
+
+	WRITE_REG(FLASH->SR, FLASH_SR_EOP | FLASH_SR_ERRORS);
+	MODIFY_REG(FLASH->CR,
+		FLASH_CR_PG | FLASH_CR_SER | FLASH_CR_PSIZE,
+		FLASH_CR_PG | _VAL2FLD(FLASH_CR_PSIZE, FLASH_PSIZE_WORD)
+	);
+
+	for (uint32_t i = 0; i < word_count; i++) {
+		// An erased word already holds all ones
+		if (data[i] == 0xFFFFFFFF) {
+			continue;
+		}
+
+		*(__IO uint32_t *)(address + i * 4) = data[i];
+
+		while (flash_is_busy()) {
+		}
+
+		if (READ_BIT(FLASH->SR, FLASH_SR_ERRORS)) {
+			break;
+		}
+	}
+
+	return flash_finish();
+}
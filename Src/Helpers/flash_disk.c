@@ -0,0 +1,422 @@
+/*
+ * flash_disk.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include <string.h>
+#include "Helpers/flash_disk.h"
+#include "Helpers/flash.h"
+#include "Helpers/cycle_counter.h"
+#include "Helpers/logger.h"
+
+_Static_assert(FLASH_DISK_FIRST_SECTOR >= FLASH_BANK2_FIRST_SECTOR + 5 &&
+	FLASH_DISK_FIRST_SECTOR + FLASH_DISK_SECTOR_COUNT <= FLASH_SECTOR_COUNT,
+	"The disk must lie in the 128 KB sectors of bank 2 (17 to 23), away from the code");
+_Static_assert(FLASH_DISK_SECTOR_COUNT >= 2, "The disk needs a spare sector besides its data");
+_Static_assert(FLASH_DISK_CACHE_BLOCKS >= 1 && FLASH_DISK_CACHE_BLOCKS < 255, "The cache lines are indexed by a byte");
+
+#define SECTOR_SIZE 0x20000
+
+/// \brief The blocks of data of a flash sector, its last block holds the header
+#define BLOCKS_PER_SECTOR (SECTOR_SIZE / BLOCK_DEVICE_BLOCK_SIZE - 1)
+
+/// \brief The logical sectors of the disk (the flash sectors but the spare)
+#define LOGICAL_SECTOR_COUNT (FLASH_DISK_SECTOR_COUNT - 1)
+
+#define FLASH_DISK_HEADER_MAGIC 0x4B534446 /* "FDSK" */
+
+#define NO_SECTOR 0xFF
+#define NO_LINE 0xFF
+#define NO_BLOCK 0xFFFFFFFF
+
+/**
+ * \brief Written at the last block of a flash sector once its data is complete
+ * \details The magic goes last, so a sector whose programming was interrupted has no header.
+ * A logical sector claimed by two flash sectors (the copy was interrupted before the old one was
+ * erased) belongs to the one with the newer sequence.
+ */
+typedef struct
+{
+	uint32_t logical_sector;
+	uint32_t sequence;
+	uint32_t magic;
+} FlashDiskHeader;
+
+typedef enum
+{
+	SECTOR_ERASED, /**<\brief The spare: ready to take over a logical sector */
+	SECTOR_MAPPED,
+	SECTOR_STALE /**<\brief Must be erased before it is used again */
+} FlashDiskSectorState;
+
+static uint8_t sector_states[FLASH_DISK_SECTOR_COUNT];
+/// \brief The flash sector of each logical sector (NO_SECTOR - never written, reads as erased)
+static uint8_t logical_map[LOGICAL_SECTOR_COUNT];
+static uint32_t sequence;
+/// \brief The flash sector erased in the background
+static uint8_t erasing = NO_SECTOR;
+
+/*
+ * The write-back cache only holds written blocks (the flash is read in place). The blocks of one
+ * logical sector are written to the flash together, so a sector is rewritten once for many blocks.
+ */
+static uint8_t cache[FLASH_DISK_CACHE_BLOCKS][BLOCK_DEVICE_BLOCK_SIZE] __attribute__((section(".ccmbss"), aligned(4)));
+/// \brief The block held by each cache line (NO_BLOCK - free)
+static uint32_t cache_blocks[FLASH_DISK_CACHE_BLOCKS];
+/// \brief When each cache line was written (in writes)
+static uint32_t cache_ages[FLASH_DISK_CACHE_BLOCKS];
+static uint32_t cache_used;
+static uint32_t write_count;
+/// \brief When the last block was written (cycle counter)
+static uint32_t last_write_time;
+
+static uint8_t const *block_address(uint8_t physical, uint32_t index)
+{
+	return (uint8_t const *)(flash_sector_address(FLASH_DISK_FIRST_SECTOR + physical) + index * BLOCK_DEVICE_BLOCK_SIZE);
+}
+
+static FlashDiskHeader const *header_of(uint8_t physical)
+{
+	return (FlashDiskHeader const *)block_address(physical, BLOCKS_PER_SECTOR);
+}
+
+static uint8_t is_erased(uint8_t const *data, uint32_t size)
+{
+	uint32_t const *words = (uint32_t const *)data;
+
+	for (uint32_t i = 0; i < size / 4; i++) {
+		if (words[i] != 0xFFFFFFFF) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static uint8_t find_line(uint32_t block)
+{
+	for (uint8_t line = 0; line < FLASH_DISK_CACHE_BLOCKS; line++) {
+		if (cache_blocks[line] == block) {
+			return line;
+		}
+	}
+
+	return NO_LINE;
+}
+
+/**
+ * @brief Wait for the background erase (if any) and account its result
+ */
+static void finish_erase()
+{
+	if (erasing == NO_SECTOR) {
+		return;
+	}
+
+	if (flash_finish()) {
+		sector_states[erasing] = SECTOR_ERASED;
+	} else {
+		log_error("Flash disk: failed to erase sector %u.", FLASH_DISK_FIRST_SECTOR + erasing);
+	}
+
+	erasing = NO_SECTOR;
+	flash_lock();
+}
+
+static void start_erase(uint8_t physical)
+{
+	flash_unlock();
+	flash_start_erase(FLASH_DISK_FIRST_SECTOR + physical);
+	erasing = physical;
+}
+
+/**
+ * @brief Return an erased flash sector, erasing one now if none was erased ahead
+ * @note Leaves the flash unlocked.
+ */
+static uint8_t take_erased_sector()
+{
+	finish_erase();
+
+	for (uint8_t physical = 0; physical < FLASH_DISK_SECTOR_COUNT; physical++) {
+		if (sector_states[physical] == SECTOR_ERASED) {
+			flash_unlock();
+			return physical;
+		}
+	}
+
+	for (uint8_t physical = 0; physical < FLASH_DISK_SECTOR_COUNT; physical++) {
+		if (sector_states[physical] == SECTOR_STALE) {
+			start_erase(physical);
+			finish_erase();
+			flash_unlock();
+			return sector_states[physical] == SECTOR_ERASED ? physical : NO_SECTOR;
+		}
+	}
+
+	return NO_SECTOR;
+}
+
+static uint8_t program_block(uint8_t physical, uint32_t index, uint8_t const *data)
+{
+	return flash_program((uint32_t)block_address(physical, index), (uint32_t const *)data,
+		BLOCK_DEVICE_BLOCK_SIZE / 4);
+}
+
+static uint8_t write_header(uint8_t physical, uint32_t logical)
+{
+	FlashDiskHeader header = {
+		.logical_sector = logical,
+		.sequence = ++sequence,
+		.magic = FLASH_DISK_HEADER_MAGIC
+	};
+
+	return flash_program((uint32_t)header_of(physical), (uint32_t const *)&header, sizeof(header) / 4);
+}
+
+/**
+ * @brief Write the cached blocks of a logical sector to the flash in one go
+ * @details The blocks whose flash is still erased are programmed in place. Otherwise the whole
+ * sector is copied into the spare, merging the cached blocks with the unchanged ones, and the
+ * spare takes over the logical sector. The old flash sector is erased ahead of the next copy,
+ * in the background while the host sends the next blocks, so a copy seldom waits for an erase.
+ */
+static uint8_t flush_sector(uint32_t logical)
+{
+	uint8_t lines[BLOCKS_PER_SECTOR];
+	uint8_t physical = logical_map[logical];
+	uint8_t copy = 0;
+	uint8_t success = 1;
+
+	memset(lines, NO_LINE, sizeof(lines));
+	for (uint8_t line = 0; line < FLASH_DISK_CACHE_BLOCKS; line++) {
+		if (cache_blocks[line] != NO_BLOCK && cache_blocks[line] / BLOCKS_PER_SECTOR == logical) {
+			lines[cache_blocks[line] % BLOCKS_PER_SECTOR] = line;
+		}
+	}
+
+	finish_erase();
+
+	if (physical == NO_SECTOR) {
+		// The first write to the logical sector: the spare takes it over as it is
+		physical = take_erased_sector();
+		if (physical == NO_SECTOR || !write_header(physical, logical)) {
+			if (physical != NO_SECTOR) {
+				sector_states[physical] = SECTOR_STALE;
+			}
+			flash_lock();
+			return 0;
+		}
+		logical_map[logical] = physical;
+		sector_states[physical] = SECTOR_MAPPED;
+	} else {
+		for (uint32_t index = 0; index < BLOCKS_PER_SECTOR && !copy; index++) {
+			copy = lines[index] != NO_LINE && !is_erased(block_address(physical, index), BLOCK_DEVICE_BLOCK_SIZE);
+		}
+	}
+
+	if (!copy) {
+		flash_unlock();
+		for (uint32_t index = 0; index < BLOCKS_PER_SECTOR && success; index++) {
+			if (lines[index] != NO_LINE) {
+				success = program_block(physical, index, cache[lines[index]]);
+			}
+		}
+	} else {
+		uint8_t spare = take_erased_sector();
+
+		success = spare != NO_SECTOR;
+
+		// Note: The erased words are skipped, so the free space of the sector costs nothing
+		for (uint32_t index = 0; index < BLOCKS_PER_SECTOR && success; index++) {
+			success = program_block(spare, index,
+				lines[index] != NO_LINE ? cache[lines[index]] : block_address(physical, index));
+		}
+
+		if (success && write_header(spare, logical)) {
+			logical_map[logical] = spare;
+			sector_states[spare] = SECTOR_MAPPED;
+			sector_states[physical] = SECTOR_STALE;
+		} else {
+			success = 0;
+			if (spare != NO_SECTOR) {
+				sector_states[spare] = SECTOR_STALE;
+			}
+		}
+	}
+
+	flash_lock();
+
+	if (!success) {
+		log_error("Flash disk: failed to write logical sector %u.", logical);
+		return 0;
+	}
+
+	for (uint32_t index = 0; index < BLOCKS_PER_SECTOR; index++) {
+		if (lines[index] != NO_LINE) {
+			cache_blocks[lines[index]] = NO_BLOCK;
+			cache_used--;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Flush the logical sector of the oldest cached block (with all of its cached blocks)
+ */
+static uint8_t flush_oldest()
+{
+	uint8_t oldest = NO_LINE;
+
+	for (uint8_t line = 0; line < FLASH_DISK_CACHE_BLOCKS; line++) {
+		if (cache_blocks[line] != NO_BLOCK &&
+			(oldest == NO_LINE || (int32_t)(cache_ages[line] - cache_ages[oldest]) < 0)) {
+			oldest = line;
+		}
+	}
+
+	return oldest == NO_LINE || flush_sector(cache_blocks[oldest] / BLOCKS_PER_SECTOR);
+}
+
+static uint8_t flash_disk_flush()
+{
+	while (cache_used > 0) {
+		if (!flush_oldest()) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static uint8_t flash_disk_read(uint32_t block, uint8_t *data, uint32_t count)
+{
+	if (block > flash_disk.block_count || count > flash_disk.block_count - block) {
+		return 0;
+	}
+
+	// Reading the bank being erased would stall the bus (and the interrupts) until the erase ends
+	finish_erase();
+
+	for (; count > 0; count--, block++, data += BLOCK_DEVICE_BLOCK_SIZE) {
+		uint8_t line = find_line(block);
+		uint8_t physical = logical_map[block / BLOCKS_PER_SECTOR];
+
+		if (line != NO_LINE) {
+			memcpy(data, cache[line], BLOCK_DEVICE_BLOCK_SIZE);
+		} else if (physical == NO_SECTOR) {
+			memset(data, 0xFF, BLOCK_DEVICE_BLOCK_SIZE);
+		} else {
+			memcpy(data, block_address(physical, block % BLOCKS_PER_SECTOR), BLOCK_DEVICE_BLOCK_SIZE);
+		}
+	}
+
+	return 1;
+}
+
+static uint8_t flash_disk_write(uint32_t block, uint8_t const *data, uint32_t count)
+{
+	if (block > flash_disk.block_count || count > flash_disk.block_count - block) {
+		return 0;
+	}
+
+	for (; count > 0; count--, block++, data += BLOCK_DEVICE_BLOCK_SIZE) {
+		uint8_t line = find_line(block);
+
+		if (line == NO_LINE) {
+			if (cache_used == FLASH_DISK_CACHE_BLOCKS && !flush_oldest()) {
+				return 0;
+			}
+			line = find_line(NO_BLOCK);
+			cache_used++;
+		}
+
+		memcpy(cache[line], data, BLOCK_DEVICE_BLOCK_SIZE);
+		cache_blocks[line] = block;
+		cache_ages[line] = write_count++;
+	}
+
+	last_write_time = cycle_counter_read();
+	return 1;
+}
+
+/**
+ * @brief Flush the cache once the writes stop, and erase the stale sectors ahead of their use
+ */
+static void flash_disk_poll()
+{
+	if (erasing != NO_SECTOR) {
+		if (flash_is_busy()) {
+			return;
+		}
+		finish_erase();
+	}
+
+	if (cache_used > 0 &&
+		cycle_counter_read() - last_write_time >= FLASH_DISK_FLUSH_DELAY_MS * (SystemCoreClock / 1000)) {
+		// A failed flush is retried after the delay again
+		if (!flash_disk_flush()) {
+			last_write_time = cycle_counter_read();
+		}
+	}
+
+	// The erase overlaps with the blocks the host sends meanwhile, so the next copy finds the spare ready
+	for (uint8_t physical = 0; physical < FLASH_DISK_SECTOR_COUNT; physical++) {
+		if (sector_states[physical] == SECTOR_STALE) {
+			start_erase(physical);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Find the logical sectors in the flash from the headers of its sectors
+ */
+void flash_disk_initialize()
+{
+	cycle_counter_initialize();
+
+	memset(logical_map, NO_SECTOR, sizeof(logical_map));
+	for (uint8_t line = 0; line < FLASH_DISK_CACHE_BLOCKS; line++) {
+		cache_blocks[line] = NO_BLOCK;
+	}
+
+	for (uint8_t physical = 0; physical < FLASH_DISK_SECTOR_COUNT; physical++) {
+		FlashDiskHeader const *header = header_of(physical);
+
+		if (header->magic != FLASH_DISK_HEADER_MAGIC || header->logical_sector >= LOGICAL_SECTOR_COUNT) {
+			uint8_t const *data = block_address(physical, 0);
+
+			sector_states[physical] = is_erased(data, SECTOR_SIZE) ? SECTOR_ERASED : SECTOR_STALE;
+			continue;
+		}
+
+		uint8_t *mapped = &logical_map[header->logical_sector];
+
+		if (*mapped == NO_SECTOR || (int32_t)(header->sequence - header_of(*mapped)->sequence) > 0) {
+			if (*mapped != NO_SECTOR) {
+				sector_states[*mapped] = SECTOR_STALE;
+			}
+			*mapped = physical;
+			sector_states[physical] = SECTOR_MAPPED;
+		} else {
+			sector_states[physical] = SECTOR_STALE;
+		}
+
+		if ((int32_t)(header->sequence - sequence) > 0) {
+			sequence = header->sequence;
+		}
+	}
+}
+
+const BlockDevice flash_disk = {
+	.block_count = LOGICAL_SECTOR_COUNT * BLOCKS_PER_SECTOR,
+	.read_only = 0,
+	.read = &flash_disk_read,
+	.write = &flash_disk_write,
+	.flush = &flash_disk_flush,
+	.poll = &flash_disk_poll
+};
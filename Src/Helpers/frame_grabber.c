@@ -0,0 +1,130 @@
+/*
+ * frame_grabber.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "Helpers/frame_grabber.h"
+#include "stm32f4xx.h"
+
+/** \name DMA2D configuration fields
+ *@{*/
+#define DMA2D_MODE_MEMORY_TO_MEMORY_PFC 1 /**<\brief Copy and convert the pixel format */
+#define DMA2D_MODE_REGISTER_TO_MEMORY 3 /**<\brief Fill with the output color */
+#define DMA2D_COLOR_MODE_ARGB8888 0
+/**@}*/
+
+/// \brief The LTDC formats the DMA2D reads without a CLUT (ARGB8888, RGB888, RGB565, ARGB1555, ARGB4444), which share its codes
+static const uint8_t bytes_per_pixel[] = { 4, 3, 2, 2, 2 };
+
+static FrameGrabberDone band_done;
+
+/// \brief The first line of the layer, 0 when the frame is filled with `fill_color` instead
+static uint32_t source_address;
+static uint32_t source_pitch;
+static uint8_t source_format;
+static uint16_t frame_width;
+static uint32_t fill_color;
+static uint8_t fill_level;
+
+/**
+ * @brief Enable the DMA2D and its interrupt
+ * @param done Called once per band
+ */
+void frame_grabber_initialize(FrameGrabberDone done)
+{
+	band_done = done;
+
+	SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_DMA2DEN);
+	NVIC_SetPriority(DMA2D_IRQn, NVIC_GetPriority(OTG_HS_IRQn));
+	NVIC_EnableIRQ(DMA2D_IRQn);
+}
+
+/**
+ * @brief Look up the layer for the next frame
+ * @param width The pixels per line of the frame
+ * @param height The lines of the frame
+ * @return 1 when the frame shows the layer, 0 when it is filled with a plain color
+ */
+uint8_t frame_grabber_open(uint16_t width, uint16_t height)
+{
+	frame_width = width;
+	source_address = 0;
+
+	// Note: The registers of the LTDC read as 0 while its clock is off
+	uint32_t format = _FLD2VAL(LTDC_LxPFCR_PF, LTDC_Layer1->PFCR);
+
+	if (READ_BIT(RCC->APB2ENR, RCC_APB2ENR_LTDCEN) && READ_BIT(LTDC->GCR, LTDC_GCR_LTDCEN) &&
+		READ_BIT(LTDC_Layer1->CR, LTDC_LxCR_LEN) && format < sizeof(bytes_per_pixel)) {
+		uint8_t size = bytes_per_pixel[format];
+		// The line length is programmed as the bytes of a line plus 3
+		uint32_t line_length = _FLD2VAL(LTDC_LxCFBLR_CFBLL, LTDC_Layer1->CFBLR) - 3;
+		uint32_t pitch = _FLD2VAL(LTDC_LxCFBLR_CFBP, LTDC_Layer1->CFBLR);
+		uint32_t lines = _FLD2VAL(LTDC_LxCFBLNR_CFBLNBR, LTDC_Layer1->CFBLNR);
+
+		// The frame is the top left corner of the layer
+		if (line_length >= width * size && pitch % size == 0 && lines >= height) {
+			source_address = READ_REG(LTDC_Layer1->CFBAR);
+			source_pitch = pitch;
+			source_format = format;
+			return 1;
+		}
+	}
+
+	fill_level += 4;
+	fill_color = 0xFF000000 | fill_level * 0x010101;
+	return 0;
+}
+
+/**
+ * @brief Start copying a band of lines of the frame
+ * @param pixels Receives `line_count` lines of ARGB8888 pixels (the DMA2D must not access the CCM RAM)
+ */
+void frame_grabber_start(uint32_t *pixels, uint16_t first_line, uint16_t line_count)
+{
+	WRITE_REG(DMA2D->OMAR, (uint32_t)pixels);
+	WRITE_REG(DMA2D->OOR, 0);
+	WRITE_REG(DMA2D->OPFCCR, _VAL2FLD(DMA2D_OPFCCR_CM, DMA2D_COLOR_MODE_ARGB8888));
+	WRITE_REG(DMA2D->NLR, _VAL2FLD(DMA2D_NLR_PL, frame_width) | _VAL2FLD(DMA2D_NLR_NL, line_count));
+
+	if (source_address) {
+		uint8_t size = bytes_per_pixel[source_format];
+
+		WRITE_REG(DMA2D->FGMAR, source_address + first_line * source_pitch);
+		WRITE_REG(DMA2D->FGOR, source_pitch / size - frame_width);
+		WRITE_REG(DMA2D->FGPFCCR, _VAL2FLD(DMA2D_FGPFCCR_CM, source_format));
+		WRITE_REG(DMA2D->CR,
+			_VAL2FLD(DMA2D_CR_MODE, DMA2D_MODE_MEMORY_TO_MEMORY_PFC) | DMA2D_CR_TCIE | DMA2D_CR_TEIE | DMA2D_CR_START);
+	} else {
+		WRITE_REG(DMA2D->OCOLR, fill_color);
+		WRITE_REG(DMA2D->CR, _VAL2FLD(DMA2D_CR_MODE, DMA2D_MODE_REGISTER_TO_MEMORY) | DMA2D_CR_TCIE | DMA2D_CR_START);
+	}
+}
+
+/**
+ * @brief Stop the band in progress, if any (its callback is not called)
+ */
+void frame_grabber_abort()
+{
+	if (READ_BIT(DMA2D->CR, DMA2D_CR_START)) {
+		SET_BIT(DMA2D->CR, DMA2D_CR_ABORT);
+		while (READ_BIT(DMA2D->CR, DMA2D_CR_START));
+	}
+
+	WRITE_REG(DMA2D->IFCR, DMA2D_IFCR_CTCIF | DMA2D_IFCR_CTEIF);
+	NVIC_ClearPendingIRQ(DMA2D_IRQn);
+}
+
+/**
+ * @brief Hand the band over (a transfer error, e.g. a layer in unmapped memory, ends the band too)
+ */
+void DMA2D_IRQHandler()
+{
+	uint32_t status = DMA2D->ISR & (DMA2D_ISR_TCIF | DMA2D_ISR_TEIF);
+
+	if (status) {
+		WRITE_REG(DMA2D->IFCR, status);
+		band_done();
+	}
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "Helpers/logger.h"
 #include "stm32f4xx.h"
@@ -31,12 +32,99 @@ char const * const _get_log_level_string(LogLevel const log_level)
     return "";
 }
 
+/*
+ * The interrupts do not print: stdio of newlib is not reentrant, and the busy wait of the SWO
+ * would count as interrupt time. Their log lines are kept raw (the format and its arguments, or
+ * the first bytes of an array) in a queue, which log_process() prints from the main loop.
+ */
+
+/// \brief The count of log lines of the interrupts kept until log_process() prints them (a power of 2)
+#ifndef LOG_QUEUE_SIZE
+#define LOG_QUEUE_SIZE 32
+#endif
+
+/// \brief The arguments kept of a log line of an interrupt (all of them must be 32-bit integers)
+#define LOG_DEFERRED_ARGUMENTS 4
+
+/// \brief The bytes kept of an array logged by an interrupt
+#define LOG_DEFERRED_ARRAY_SIZE 16
+
+_Static_assert((LOG_QUEUE_SIZE & (LOG_QUEUE_SIZE - 1)) == 0, "The log queue size must be a power of 2");
+
+typedef struct
+{
+	LogLevel level;
+	char const *format; /**<\brief The format string, or the label of an array (both must stay valid) */
+	uint8_t is_array;
+	uint16_t array_size; /**<\brief The full length of an array, of which the first bytes are kept */
+	union
+	{
+		uint32_t arguments[LOG_DEFERRED_ARGUMENTS];
+		uint8_t bytes[LOG_DEFERRED_ARRAY_SIZE];
+	};
+} DeferredLog;
+
+static DeferredLog deferred_logs[LOG_QUEUE_SIZE];
+/// \brief Advanced by the interrupts
+static volatile uint32_t deferred_head;
+/// \brief Advanced by log_process()
+static volatile uint32_t deferred_tail;
+/// \brief The log lines of the interrupts lost because the queue was full
+static volatile uint32_t deferred_dropped;
+
+static uint8_t in_interrupt()
+{
+	return __get_IPSR() != 0;
+}
+
+/**
+ * @brief Queue a log line of an interrupt
+ * @note Interrupts of any priority may log, so the slot is claimed and filled with them disabled.
+ */
+static void defer(LogLevel const log_level, char const * const format, uint8_t const is_array, uint16_t const array_size,
+	void const *data, uint8_t const data_size)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (deferred_head - deferred_tail == LOG_QUEUE_SIZE) {
+		deferred_dropped++;
+	} else {
+		DeferredLog *log = &deferred_logs[deferred_head % LOG_QUEUE_SIZE];
+
+		log->level = log_level;
+		log->format = format;
+		log->is_array = is_array;
+		log->array_size = array_size;
+		memcpy(log->bytes, data, data_size);
+		deferred_head++;
+	}
+	__set_PRIMASK(primask);
+}
+
 static void _log(LogLevel const log_level, char const * const format, va_list args)
 {
     if (log_level > system_log_level) {
     	return;
     }
 
+	if (in_interrupt()) {
+		uint32_t arguments[LOG_DEFERRED_ARGUMENTS] = { 0 };
+		uint8_t count = 0;
+
+		// Only the arguments the format has are read (a "%%" is not one)
+		for (char const *c = format; *c != '\0' && count < LOG_DEFERRED_ARGUMENTS; c++) {
+			if (c[0] == '%' && c[1] == '%') {
+				c++;
+			} else if (c[0] == '%' && c[1] != '\0') {
+				arguments[count++] = va_arg(args, uint32_t);
+			}
+		}
+
+		defer(log_level, format, 0, 0, arguments, sizeof(arguments));
+		return;
+	}
+
 	printf("[%s] ", _get_log_level_string(log_level));
 	vfprintf(stdout, format, args);
 	printf("\n");
@@ -66,10 +154,27 @@ void log_debug(char const * const format, ...)
     va_end(args);
 }
 
+static void print_array(char const * const label, uint8_t const *bytes, uint16_t const count, uint16_t const len)
+{
+	printf("[%s] %s[%d]: {", _get_log_level_string(LOG_LEVEL_DEBUG), label, len);
+    for (uint16_t i = 0; i < count; i++)
+    {
+    	printf("0x%02X", bytes[i]);
+    	
+    	// Add ", " after all elements except the last one.
+    	if (i < count - 1)
+    	{
+    	    printf(", ");
+    	}
+    }
+	printf(count < len ? ", ...}\n" : "}\n");
+}
+
 /** \brief Log the content of an array.
  * \param label The label of the array.
  * \param array Pointer to the array.
  * \param len The length of data in bytes.
+ * \note From an interrupt only the first bytes are kept.
  */
 void log_debug_array(char const * const label, void const *array, uint16_t const len)
 {
@@ -77,18 +182,39 @@ void log_debug_array(char const * const label, void const *array, uint16_t const
     	return;
     }
 
-        
-	printf("[%s] %s[%d]: {", _get_log_level_string(LOG_LEVEL_DEBUG), label, len);
-    for (uint16_t i = 0; i < len; i++)
-    {
-    	uint8_t val = *((uint8_t *)(array + i));
-    	printf("0x%02X", val);
-    	
-    	// Add ", " after all elements except the last one.
-    	if (i < len - 1)
-    	{
-    	    printf(", ");
-    	}
-    }
-	printf("}\n");
+	if (in_interrupt()) {
+		defer(LOG_LEVEL_DEBUG, label, 1, len, array, len < LOG_DEFERRED_ARRAY_SIZE ? len : LOG_DEFERRED_ARRAY_SIZE);
+		return;
+	}
+
+	print_array(label, array, len, len);
+}
+
+/** \brief Print the log lines the interrupts have queued.
+ * Called from the main loop.
+ */
+void log_process()
+{
+	static uint32_t reported_dropped;
+	uint32_t dropped = deferred_dropped - reported_dropped;
+
+	while (deferred_tail != deferred_head) {
+		DeferredLog const *log = &deferred_logs[deferred_tail % LOG_QUEUE_SIZE];
+
+		if (log->is_array) {
+			print_array(log->format, log->bytes,
+				log->array_size < LOG_DEFERRED_ARRAY_SIZE ? log->array_size : LOG_DEFERRED_ARRAY_SIZE, log->array_size);
+		} else {
+			printf("[%s] ", _get_log_level_string(log->level));
+			printf(log->format, log->arguments[0], log->arguments[1], log->arguments[2], log->arguments[3]);
+			printf("\n");
+		}
+
+		deferred_tail++;
+	}
+
+	if (dropped > 0) {
+		printf("[%s] %lu log lines of interrupts were dropped\n", _get_log_level_string(LOG_LEVEL_ERROR), (unsigned long)dropped);
+		reported_dropped += dropped;
+	}
 }
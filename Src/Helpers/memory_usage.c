@@ -0,0 +1,104 @@
+/*
+ * memory_usage.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: olexandr
+ */
+
+#include "Helpers/memory_usage.h"
+#include "stm32f4xx.h"
+
+/// \brief The pattern written to the unused RAM (unlikely to be a stored value)
+#define STACK_PAINT_PATTERN 0xA5C3A5C3
+
+/// \brief Count of words memory_usage_update() checks per call, which bounds its time
+#define SCAN_WORDS_PER_UPDATE 256
+
+/* Symbols defined in the linker script */
+extern uint8_t _end;
+extern uint8_t _estack;
+extern uint8_t _Min_Stack_Size;
+extern uint8_t _Min_Heap_Size;
+
+/* Heap accounting of _sbrk() (sysmem.c) */
+extern uint32_t sbrk_heap_used;
+extern uint32_t sbrk_failed_requests;
+
+/*
+ * The deepest point of the stack is the first overwritten word above the heap. Scanning the whole
+ * free RAM for it takes long, so memory_usage_update() scans it a chunk at a time from the main
+ * loop, and memory_usage_read() only copies the result (it may run in an interrupt).
+ */
+/// \brief The deepest word the stack has reached so far
+static uint32_t *volatile deepest_word;
+/// \brief The next word to check, runs from the end of the heap up to the deepest word
+static uint32_t *scan_word;
+
+/**
+ * @brief Return the first word after the memory given to the heap
+ */
+static uint32_t *heap_end()
+{
+	return (uint32_t *)(((uint32_t)&_end + sbrk_heap_used + 3) & ~3);
+}
+
+/**
+ * @brief Fill the RAM between the end of the heap and the current stack pointer with a known pattern
+ * @note Must be called as early as possible (first thing in main()), before the stack grows deep.
+ */
+void memory_usage_paint_stack()
+{
+	uint32_t *stack_pointer = (uint32_t *)__get_MSP();
+
+	for (uint32_t *word = heap_end(); word < stack_pointer; word++) {
+		*word = STACK_PAINT_PATTERN;
+	}
+
+	deepest_word = stack_pointer;
+	scan_word = heap_end();
+}
+
+/**
+ * @brief Check the next chunk of the painted RAM for a deeper stack usage
+ * @note Called from the main loop. A new high-water mark is found after (free RAM / 1 KB) calls at most.
+ */
+void memory_usage_update()
+{
+	uint32_t *deepest = deepest_word;
+
+	// The heap may have grown over the words already checked
+	if (scan_word < heap_end()) {
+		scan_word = heap_end();
+	}
+
+	for (uint32_t i = 0; i < SCAN_WORDS_PER_UPDATE && scan_word < deepest; i++, scan_word++) {
+		// The first overwritten word is the deepest point the stack has reached
+		if (*scan_word != STACK_PAINT_PATTERN) {
+			deepest_word = scan_word;
+			break;
+		}
+	}
+
+	// A pass is over (or a deeper word was found), the next one starts at the heap again
+	if (scan_word >= deepest_word) {
+		scan_word = heap_end();
+	}
+}
+
+/**
+ * @brief Collect the stack high-water mark found by memory_usage_update() and the heap usage
+ * @param memory_usage Pointer to the structure to fill
+ * @note Takes constant time, so it may be called from an interrupt.
+ */
+void memory_usage_read(MemoryUsage *memory_usage)
+{
+	uint32_t *word = deepest_word;
+	uint32_t *end = heap_end();
+
+	memory_usage->stack_size = (uint32_t)&_Min_Stack_Size;
+	memory_usage->stack_high_water_mark = (uint32_t)&_estack - (uint32_t)word;
+	memory_usage->heap_size = (uint32_t)&_Min_Heap_Size;
+	memory_usage->heap_used = sbrk_heap_used;
+	memory_usage->heap_failed_requests = sbrk_failed_requests;
+	memory_usage->unused_ram = word > end ? (uint32_t)word - (uint32_t)end : 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * profiler.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: olexandr
+ */
+
+#include "Helpers/profiler.h"
+
+#if PROFILER_ENABLED
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+#include "Helpers/cycle_counter.h"
+
+_Static_assert(PROFILER_SAMPLE_DIVIDER >= 1 && PROFILER_SAMPLE_DIVIDER <= 16, "The sample divider must be in 1..16");
+
+/**
+ * @brief Start streaming periodic PC samples and exception entry/exit events through the ITM
+ * @note The stream is decoded by Tools/swo_profile.py. The ITM stimulus port 0 keeps carrying the log output.
+ */
+void profiler_start()
+{
+	cycle_counter_initialize();
+
+	// Route the SWO pin to the trace port (asynchronous mode)
+	MODIFY_REG(DBGMCU->CR, DBGMCU_CR_TRACE_MODE, DBGMCU_CR_TRACE_IOEN);
+
+#if PROFILER_SWO_BAUDRATE
+	// Asynchronous NRZ (UART) encoding, bypass the formatter
+	TPI->SPPR = 2;
+	TPI->ACPR = (SystemCoreClock / PROFILER_SWO_BAUDRATE) - 1;
+	TPI->FFCR = TPI_FFCR_TrigIn_Msk;
+#endif
+
+	// Unlock the ITM, enable it with local timestamps, and let it forward the DWT packets
+	ITM->LAR = 0xC5ACCE55;
+	MODIFY_REG(ITM->TCR,
+		ITM_TCR_TraceBusID_Msk | ITM_TCR_TSPrescale_Msk,
+		_VAL2FLD(ITM_TCR_TraceBusID, 1) | ITM_TCR_DWTENA_Msk | ITM_TCR_SYNCENA_Msk | ITM_TCR_TSENA_Msk | ITM_TCR_ITMENA_Msk
+	);
+	SET_BIT(ITM->TER, 1 << 0);
+
+	// Sample the PC every (POSTPRESET + 1) * 1024 cycles (CYCTAP = bit 10 of the cycle counter),
+	// emit synchronization packets and trace every exception entry, exit and return
+	MODIFY_REG(DWT->CTRL,
+		DWT_CTRL_POSTPRESET_Msk | DWT_CTRL_POSTINIT_Msk | DWT_CTRL_SYNCTAP_Msk,
+		_VAL2FLD(DWT_CTRL_POSTPRESET, PROFILER_SAMPLE_DIVIDER - 1) | DWT_CTRL_CYCTAP_Msk |
+		_VAL2FLD(DWT_CTRL_SYNCTAP, 1) | DWT_CTRL_PCSAMPLENA_Msk | DWT_CTRL_EXCTRCENA_Msk
+	);
+}
+
+/**
+ * @brief Stop emitting PC samples and exception events (the log output stays enabled)
+ */
+void profiler_stop()
+{
+	CLEAR_BIT(DWT->CTRL, DWT_CTRL_PCSAMPLENA_Msk | DWT_CTRL_EXCTRCENA_Msk);
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * ram_disk.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include <string.h>
+#include "Helpers/ram_disk.h"
+
+static uint8_t blocks[RAM_DISK_BLOCK_COUNT][BLOCK_DEVICE_BLOCK_SIZE] __attribute__((aligned(4)));
+
+static uint8_t ram_disk_read(uint32_t block, uint8_t *data, uint32_t count)
+{
+	if (block > RAM_DISK_BLOCK_COUNT || count > RAM_DISK_BLOCK_COUNT - block) {
+		return 0;
+	}
+
+	memcpy(data, blocks[block], count * BLOCK_DEVICE_BLOCK_SIZE);
+	return 1;
+}
+
+static uint8_t ram_disk_write(uint32_t block, uint8_t const *data, uint32_t count)
+{
+	if (block > RAM_DISK_BLOCK_COUNT || count > RAM_DISK_BLOCK_COUNT - block) {
+		return 0;
+	}
+
+	memcpy(blocks[block], data, count * BLOCK_DEVICE_BLOCK_SIZE);
+	return 1;
+}
+
+const BlockDevice ram_disk = {
+	.block_count = RAM_DISK_BLOCK_COUNT,
+	.read_only = 0,
+	.read = &ram_disk_read,
+	.write = &ram_disk_write,
+	.flush = NULL,
+	.poll = NULL
+};
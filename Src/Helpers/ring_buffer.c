@@ -0,0 +1,120 @@
+/*
+ * ring_buffer.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include <string.h>
+#include "Helpers/ring_buffer.h"
+#include "Helpers/math.h"
+#include "stm32f4xx.h"
+
+/**
+ * @brief Initialize an empty ring
+ * @param size The size of `buffer` in bytes (a power of 2)
+ */
+void ring_buffer_initialize(RingBuffer *ring, uint8_t *buffer, uint32_t size)
+{
+	ring->buffer = buffer;
+	ring->size = size;
+	ring->write_index = 0;
+	ring->read_index = 0;
+}
+
+uint32_t ring_buffer_used(RingBuffer const *ring)
+{
+	return ring->write_index - ring->read_index;
+}
+
+uint32_t ring_buffer_free(RingBuffer const *ring)
+{
+	return ring->size - ring_buffer_used(ring);
+}
+
+/**
+ * @brief Return the contiguous free space at the write index (it ends at the end of the buffer)
+ * @param span Receives the start of the span
+ * @return The size of the span in bytes, fill it and then call ring_buffer_commit()
+ */
+uint32_t ring_buffer_write_span(RingBuffer const *ring, uint8_t **span)
+{
+	uint32_t offset = ring->write_index & (ring->size - 1);
+
+	*span = ring->buffer + offset;
+	return MIN(ring_buffer_free(ring), ring->size - offset);
+}
+
+/**
+ * @brief Publish `size` bytes written into the free space to the consumer
+ */
+void ring_buffer_commit(RingBuffer *ring, uint32_t size)
+{
+	// Note: The data must be in memory before the consumer sees the new index
+	__DMB();
+	ring->write_index += size;
+}
+
+/**
+ * @brief Copy as much of `data` as fits into the ring
+ * @return The count of bytes copied
+ */
+uint32_t ring_buffer_write(RingBuffer *ring, void const *data, uint32_t size)
+{
+	uint32_t written = 0;
+	uint8_t *span;
+	uint32_t span_size;
+
+	// At most two spans: up to the end of the buffer, then from its start
+	while (written < size && (span_size = ring_buffer_write_span(ring, &span)) > 0) {
+		span_size = MIN(span_size, size - written);
+		memcpy(span, (uint8_t const *)data + written, span_size);
+		ring_buffer_commit(ring, span_size);
+		written += span_size;
+	}
+
+	return written;
+}
+
+/**
+ * @brief Return the contiguous data at the read index (it ends at the end of the buffer)
+ * @param span Receives the start of the span
+ * @return The size of the span in bytes, release it with ring_buffer_consume() once used
+ */
+uint32_t ring_buffer_read_span(RingBuffer const *ring, uint8_t const **span)
+{
+	uint32_t offset = ring->read_index & (ring->size - 1);
+
+	*span = ring->buffer + offset;
+	return MIN(ring_buffer_used(ring), ring->size - offset);
+}
+
+/**
+ * @brief Give `size` bytes of read data back to the producer
+ */
+void ring_buffer_consume(RingBuffer *ring, uint32_t size)
+{
+	// Note: The data must be read before the producer may overwrite it
+	__DMB();
+	ring->read_index += size;
+}
+
+/**
+ * @brief Copy up to `size` bytes out of the ring
+ * @return The count of bytes copied
+ */
+uint32_t ring_buffer_read(RingBuffer *ring, void *data, uint32_t size)
+{
+	uint32_t read = 0;
+	uint8_t const *span;
+	uint32_t span_size;
+
+	while (read < size && (span_size = ring_buffer_read_span(ring, &span)) > 0) {
+		span_size = MIN(span_size, size - read);
+		memcpy((uint8_t *)data + read, span, span_size);
+		ring_buffer_consume(ring, span_size);
+		read += span_size;
+	}
+
+	return read;
+}
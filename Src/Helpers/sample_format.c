@@ -0,0 +1,276 @@
+/*
+ * sample_format.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "Helpers/sample_format.h"
+
+// 32-bit frames are moved a word at a time either way, there is nothing to pack
+void sample_format_deinterleave(int32_t *left, int32_t *right, int32_t const *frames, uint32_t frame_count)
+{
+	sample_format_reference_deinterleave(left, right, frames, frame_count);
+}
+
+void sample_format_interleave(int32_t *frames, int32_t const *left, int32_t const *right, uint32_t frame_count)
+{
+	sample_format_reference_interleave(frames, left, right, frame_count);
+}
+
+#if SAMPLE_FORMAT_SIMD
+
+#include "stm32f4xx.h"
+
+/*
+ * The SIMD kernels work on whole words: 2 samples of 16 bits or 4 samples of 24 bits at a time,
+ * and leave the odd samples at the end to the reference kernels. The packets may be unaligned,
+ * which single word loads and stores of the Cortex-M4 handle.
+ */
+
+/** \name Rounding offsets of the narrowing conversions (half of the lowest bit kept)
+ *@{*/
+#define ROUND_16 (1 << 15)
+#define ROUND_24 (1 << 7)
+/**@}*/
+
+void sample_format_from_s16(int32_t *samples, void const *data, uint32_t count)
+{
+	uint8_t const *bytes = data;
+
+	for (uint32_t i = 0; i < count / 2; i++, bytes += 4, samples += 2) {
+		uint32_t word = __UNALIGNED_UINT32_READ(bytes);
+
+		samples[0] = (int32_t)(word << 16);
+		samples[1] = (int32_t)(word & 0xFFFF0000);
+	}
+
+	sample_format_reference_from_s16(samples, bytes, count % 2);
+}
+
+/**
+ * @brief Unpack 24-bit samples: 3 words hold 4 samples
+ */
+void sample_format_from_s24(int32_t *samples, void const *data, uint32_t count)
+{
+	uint8_t const *bytes = data;
+
+	for (uint32_t i = 0; i < count / 4; i++, bytes += 12, samples += 4) {
+		uint32_t word0 = __UNALIGNED_UINT32_READ(bytes);
+		uint32_t word1 = __UNALIGNED_UINT32_READ(bytes + 4);
+		uint32_t word2 = __UNALIGNED_UINT32_READ(bytes + 8);
+
+		samples[0] = (int32_t)(word0 << 8);
+		samples[1] = (int32_t)(__PKHBT(word0 >> 16, word1, 16) & 0xFFFFFF00);
+		samples[2] = (int32_t)((word2 << 24) | ((word1 >> 8) & 0x00FFFF00));
+		samples[3] = (int32_t)(word2 & 0xFFFFFF00);
+	}
+
+	sample_format_reference_from_s24(samples, bytes, count % 4);
+}
+
+void sample_format_from_s32(int32_t *samples, void const *data, uint32_t count)
+{
+	uint8_t const *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++, bytes += 4) {
+		samples[i] = (int32_t)__UNALIGNED_UINT32_READ(bytes);
+	}
+}
+
+/**
+ * @brief Round and saturate 32-bit samples to 16 bits, 2 samples at a time
+ */
+void sample_format_to_s16(void *data, int32_t const *samples, uint32_t count)
+{
+	uint8_t *bytes = data;
+
+	for (uint32_t i = 0; i < count / 2; i++, bytes += 4, samples += 2) {
+		// The saturating add rounds without wrapping, the pack takes the upper halves
+		uint32_t low = __QADD(samples[0], ROUND_16);
+		uint32_t high = __QADD(samples[1], ROUND_16);
+
+		__UNALIGNED_UINT32_WRITE(bytes, __PKHTB(high, low, 16));
+	}
+
+	sample_format_reference_to_s16(bytes, samples, count % 2);
+}
+
+/**
+ * @brief Round and saturate 32-bit samples to 24 bits, 4 samples into 3 words at a time
+ */
+void sample_format_to_s24(void *data, int32_t const *samples, uint32_t count)
+{
+	uint8_t *bytes = data;
+
+	for (uint32_t i = 0; i < count / 4; i++, bytes += 12, samples += 4) {
+		uint32_t sample0 = __QADD(samples[0], ROUND_24);
+		uint32_t sample1 = __QADD(samples[1], ROUND_24);
+		uint32_t sample2 = __QADD(samples[2], ROUND_24);
+		uint32_t sample3 = __QADD(samples[3], ROUND_24);
+
+		__UNALIGNED_UINT32_WRITE(bytes, (sample0 >> 8) | ((sample1 << 16) & 0xFF000000));
+		__UNALIGNED_UINT32_WRITE(bytes + 4, __PKHBT(sample1 >> 16, sample2, 8));
+		__UNALIGNED_UINT32_WRITE(bytes + 8, (sample2 >> 24) | (sample3 & 0xFFFFFF00));
+	}
+
+	sample_format_reference_to_s24(bytes, samples, count % 4);
+}
+
+void sample_format_to_s32(void *data, int32_t const *samples, uint32_t count)
+{
+	uint8_t *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++, bytes += 4) {
+		__UNALIGNED_UINT32_WRITE(bytes, samples[i]);
+	}
+}
+
+/**
+ * @brief Split 16-bit stereo frames, 2 frames at a time
+ */
+void sample_format_deinterleave_s16(int16_t *left, int16_t *right, int16_t const *frames, uint32_t frame_count)
+{
+	for (uint32_t i = 0; i < frame_count / 2; i++, frames += 4, left += 2, right += 2) {
+		uint32_t frame0 = __UNALIGNED_UINT32_READ(frames);
+		uint32_t frame1 = __UNALIGNED_UINT32_READ(frames + 2);
+
+		__UNALIGNED_UINT32_WRITE(left, __PKHBT(frame0, frame1, 16));
+		__UNALIGNED_UINT32_WRITE(right, __PKHTB(frame1, frame0, 16));
+	}
+
+	sample_format_reference_deinterleave_s16(left, right, frames, frame_count % 2);
+}
+
+/**
+ * @brief Join 16-bit channels into stereo frames, 2 frames at a time
+ */
+void sample_format_interleave_s16(int16_t *frames, int16_t const *left, int16_t const *right, uint32_t frame_count)
+{
+	for (uint32_t i = 0; i < frame_count / 2; i++, frames += 4, left += 2, right += 2) {
+		uint32_t lefts = __UNALIGNED_UINT32_READ(left);
+		uint32_t rights = __UNALIGNED_UINT32_READ(right);
+
+		__UNALIGNED_UINT32_WRITE(frames, __PKHBT(lefts, rights, 16));
+		__UNALIGNED_UINT32_WRITE(frames + 2, __PKHTB(rights, lefts, 16));
+	}
+
+	sample_format_reference_interleave_s16(frames, left, right, frame_count % 2);
+}
+
+/**
+ * @brief Scale 32-bit samples
+ * @details The most significant word of the product with the gain in Q2.30 is a quarter of the
+ * result, which is saturated to 30 bits and shifted back (the lowest 2 bits of the result are 0).
+ */
+void sample_format_gain(int32_t *samples, uint32_t count, int16_t gain)
+{
+	int32_t const gain_q30 = (int32_t)((uint32_t)(uint16_t)gain << 16);
+
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = (int32_t)((uint32_t)__SSAT(__SMMLA(samples[i], gain_q30, 0), 30) << 2);
+	}
+}
+
+/**
+ * @brief Scale 16-bit samples, 2 samples at a time
+ */
+void sample_format_gain_s16(int16_t *samples, uint32_t count, int16_t gain)
+{
+	// The dual multiplies take the gain from one half and zero from the other
+	uint32_t const gain_low = (uint16_t)gain;
+	uint32_t const gain_high = gain_low << 16;
+
+	for (uint32_t i = 0; i < count / 2; i++, samples += 2) {
+		uint32_t pair = __UNALIGNED_UINT32_READ(samples);
+		int32_t low = __SSAT((int32_t)__SMUAD(pair, gain_low) >> 14, 16);
+		int32_t high = __SSAT((int32_t)__SMUAD(pair, gain_high) >> 14, 16);
+
+		__UNALIGNED_UINT32_WRITE(samples, __PKHBT(low, high, 16));
+	}
+
+	sample_format_reference_gain_s16(samples, count % 2, gain);
+}
+
+void sample_format_mix(int32_t *samples, int32_t const *source, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = __QADD(samples[i], source[i]);
+	}
+}
+
+/**
+ * @brief Add 16-bit samples with saturation, 2 samples at a time
+ */
+void sample_format_mix_s16(int16_t *samples, int16_t const *source, uint32_t count)
+{
+	for (uint32_t i = 0; i < count / 2; i++, samples += 2, source += 2) {
+		__UNALIGNED_UINT32_WRITE(samples, __QADD16(__UNALIGNED_UINT32_READ(samples), __UNALIGNED_UINT32_READ(source)));
+	}
+
+	sample_format_reference_mix_s16(samples, source, count % 2);
+}
+
+#else
+
+void sample_format_from_s16(int32_t *samples, void const *data, uint32_t count)
+{
+	sample_format_reference_from_s16(samples, data, count);
+}
+
+void sample_format_from_s24(int32_t *samples, void const *data, uint32_t count)
+{
+	sample_format_reference_from_s24(samples, data, count);
+}
+
+void sample_format_from_s32(int32_t *samples, void const *data, uint32_t count)
+{
+	sample_format_reference_from_s32(samples, data, count);
+}
+
+void sample_format_to_s16(void *data, int32_t const *samples, uint32_t count)
+{
+	sample_format_reference_to_s16(data, samples, count);
+}
+
+void sample_format_to_s24(void *data, int32_t const *samples, uint32_t count)
+{
+	sample_format_reference_to_s24(data, samples, count);
+}
+
+void sample_format_to_s32(void *data, int32_t const *samples, uint32_t count)
+{
+	sample_format_reference_to_s32(data, samples, count);
+}
+
+void sample_format_deinterleave_s16(int16_t *left, int16_t *right, int16_t const *frames, uint32_t frame_count)
+{
+	sample_format_reference_deinterleave_s16(left, right, frames, frame_count);
+}
+
+void sample_format_interleave_s16(int16_t *frames, int16_t const *left, int16_t const *right, uint32_t frame_count)
+{
+	sample_format_reference_interleave_s16(frames, left, right, frame_count);
+}
+
+void sample_format_gain(int32_t *samples, uint32_t count, int16_t gain)
+{
+	sample_format_reference_gain(samples, count, gain);
+}
+
+void sample_format_gain_s16(int16_t *samples, uint32_t count, int16_t gain)
+{
+	sample_format_reference_gain_s16(samples, count, gain);
+}
+
+void sample_format_mix(int32_t *samples, int32_t const *source, uint32_t count)
+{
+	sample_format_reference_mix(samples, source, count);
+}
+
+void sample_format_mix_s16(int16_t *samples, int16_t const *source, uint32_t count)
+{
+	sample_format_reference_mix_s16(samples, source, count);
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * sample_format_reference.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "Helpers/sample_format.h"
+
+/*
+ * The reference kernels: one sample at a time, byte by byte, in portable C (they depend on no
+ * core, so they build on the host as well). The SIMD kernels must give exactly the same results.
+ */
+
+/**
+ * @brief Limit a value to the range of a signed integer
+ * @param bits The width of the integer
+ */
+static int32_t saturate(int64_t value, uint8_t bits)
+{
+	int64_t const max = ((int64_t)1 << (bits - 1)) - 1;
+
+	return value > max ? max : value < -max - 1 ? -max - 1 : value;
+}
+
+/**
+ * @brief Round a 32-bit sample to its upper bits (to nearest, saturated at the top)
+ * @param shift The count of lower bits dropped
+ */
+static int32_t round_sample(int32_t sample, uint8_t shift)
+{
+	return saturate((int64_t)sample + (1 << (shift - 1)), 32) >> shift;
+}
+
+void sample_format_reference_from_s16(int32_t *samples, void const *data, uint32_t count)
+{
+	uint8_t const *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++, bytes += 2) {
+		samples[i] = (int32_t)((uint32_t)bytes[0] << 16 | (uint32_t)bytes[1] << 24);
+	}
+}
+
+void sample_format_reference_from_s24(int32_t *samples, void const *data, uint32_t count)
+{
+	uint8_t const *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++, bytes += 3) {
+		samples[i] = (int32_t)((uint32_t)bytes[0] << 8 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 24);
+	}
+}
+
+void sample_format_reference_from_s32(int32_t *samples, void const *data, uint32_t count)
+{
+	uint8_t const *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++, bytes += 4) {
+		samples[i] = (int32_t)((uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 |
+			(uint32_t)bytes[3] << 24);
+	}
+}
+
+void sample_format_reference_to_s16(void *data, int32_t const *samples, uint32_t count)
+{
+	uint8_t *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++) {
+		int32_t sample = round_sample(samples[i], 16);
+
+		*bytes++ = sample;
+		*bytes++ = sample >> 8;
+	}
+}
+
+void sample_format_reference_to_s24(void *data, int32_t const *samples, uint32_t count)
+{
+	uint8_t *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++) {
+		int32_t sample = round_sample(samples[i], 8);
+
+		*bytes++ = sample;
+		*bytes++ = sample >> 8;
+		*bytes++ = sample >> 16;
+	}
+}
+
+void sample_format_reference_to_s32(void *data, int32_t const *samples, uint32_t count)
+{
+	uint8_t *bytes = data;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t sample = samples[i];
+
+		*bytes++ = sample;
+		*bytes++ = sample >> 8;
+		*bytes++ = sample >> 16;
+		*bytes++ = sample >> 24;
+	}
+}
+
+void sample_format_reference_deinterleave(int32_t *left, int32_t *right, int32_t const *frames, uint32_t frame_count)
+{
+	for (uint32_t i = 0; i < frame_count; i++) {
+		left[i] = frames[2 * i];
+		right[i] = frames[2 * i + 1];
+	}
+}
+
+void sample_format_reference_interleave(int32_t *frames, int32_t const *left, int32_t const *right, uint32_t frame_count)
+{
+	for (uint32_t i = 0; i < frame_count; i++) {
+		frames[2 * i] = left[i];
+		frames[2 * i + 1] = right[i];
+	}
+}
+
+void sample_format_reference_deinterleave_s16(int16_t *left, int16_t *right, int16_t const *frames, uint32_t frame_count)
+{
+	for (uint32_t i = 0; i < frame_count; i++) {
+		left[i] = frames[2 * i];
+		right[i] = frames[2 * i + 1];
+	}
+}
+
+void sample_format_reference_interleave_s16(int16_t *frames, int16_t const *left, int16_t const *right, uint32_t frame_count)
+{
+	for (uint32_t i = 0; i < frame_count; i++) {
+		frames[2 * i] = left[i];
+		frames[2 * i + 1] = right[i];
+	}
+}
+
+/**
+ * @brief Scale 32-bit samples
+ * @note The product keeps 30 bits (the lowest 2 bits of the result are 0), as the SIMD kernel does.
+ */
+void sample_format_reference_gain(int32_t *samples, uint32_t count, int16_t gain)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		int32_t sample = saturate(((int64_t)samples[i] * gain) >> 16, 30);
+
+		samples[i] = (int32_t)((uint32_t)sample << 2);
+	}
+}
+
+void sample_format_reference_gain_s16(int16_t *samples, uint32_t count, int16_t gain)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = saturate(((int32_t)samples[i] * gain) >> 14, 16);
+	}
+}
+
+void sample_format_reference_mix(int32_t *samples, int32_t const *source, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = saturate((int64_t)samples[i] + source[i], 32);
+	}
+}
+
+void sample_format_reference_mix_s16(int16_t *samples, int16_t const *source, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = saturate((int32_t)samples[i] + source[i], 16);
+	}
+}
@@ -17,25 +17,257 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#include "Helpers/cpu_load.h"
 #include "Helpers/logger.h"
+#include "Helpers/memory_usage.h"
+#include "Helpers/profiler.h"
+#include "Helpers/math.h"
+#include "Helpers/flash_disk.h"
+#include "Helpers/ram_disk.h"
+#include "usbd_cdc.h"
+#include "usbd_config.h"
+#include "usbd_configuration.h"
+#include "usbd_dfu.h"
+#include "usbd_hid.h"
+#include "usbd_midi.h"
+#include "usbd_msc.h"
+#include "usbd_ncm.h"
 #include "usbd_framework.h"
 #include "usb_device.h"
 
+/** \name Baud rates that switch the CDC port into a benchmark mode (see Tools/cdc_benchmark.py)
+ *@{*/
+#define CDC_SINK_BAUD_RATE 300 /**<\brief Discard the received data */
+#define CDC_SOURCE_BAUD_RATE 600 /**<\brief Send data as fast as the host reads it */
+/**@}*/
+
+/// \brief The note the user button plays on the cable 0 of the MIDI function (middle C)
+#define MIDI_BUTTON_NOTE 60
+
 UsbDevice usb_device;
 uint32_t buffer[8];
 
+/**
+ * @brief Echo the data received on the CDC port, or sink or source it to measure one direction alone
+ */
+static void serve_cdc()
+{
+#if USBD_CDC_ENABLED
+	static uint8_t cdc_buffer[512];
+	uint32_t baud_rate = usbd_cdc_line_coding().dwDTERate;
+	uint32_t size;
+
+	if (baud_rate == CDC_SINK_BAUD_RATE) {
+		while (usbd_cdc_read(cdc_buffer, sizeof(cdc_buffer)) > 0) {
+		}
+	} else if (baud_rate == CDC_SOURCE_BAUD_RATE) {
+		// Only while the port is open, so the ring does not fill up with stale data
+		while ((usbd_cdc_control_line_state() & USB_CDC_CONTROL_LINE_DTR) &&
+			usbd_cdc_write(cdc_buffer, sizeof(cdc_buffer)) == sizeof(cdc_buffer)) {
+		}
+	} else {
+		while ((size = usbd_cdc_read(cdc_buffer, MIN(sizeof(cdc_buffer), usbd_cdc_write_space()))) > 0) {
+			usbd_cdc_write(cdc_buffer, size);
+		}
+	}
+#endif
+}
+
+/**
+ * @brief Send every frame received on the network function back to its sender (a loopback for throughput tests)
+ */
+static void serve_ncm()
+{
+#if USBD_NCM_ENABLED
+	uint8_t const *frame;
+	uint16_t size;
+
+	while ((frame = usbd_ncm_receive(&size)) != NULL) {
+		// Shorter than an Ethernet header, or longer than the function can send
+		if (size < 14 || size > USBD_NCM_MAX_SEGMENT_SIZE) {
+			usbd_ncm_release();
+			continue;
+		}
+
+		uint8_t *reply = usbd_ncm_allocate(size);
+
+		// Both NTBs to the host are full, the frame is taken again once one is sent
+		if (!reply) {
+			break;
+		}
+
+		// Swap the destination and the source addresses
+		memcpy(reply, frame + 6, 6);
+		memcpy(reply + 6, frame, 6);
+		memcpy(reply + 12, frame + 12, size - 12);
+		usbd_ncm_send(size);
+		usbd_ncm_release();
+	}
+#endif
+}
+
+/**
+ * @brief Configure the user button (PA0, interrupt on both edges) and the green and red LEDs (PG13, PG14) of the panel
+ */
+static void initialize_panel()
+{
+#if USBD_HID_ENABLED || USBD_MIDI_ENABLED
+	SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOGEN);
+	SET_BIT(RCC->APB2ENR, RCC_APB2ENR_SYSCFGEN);
+
+	// PA0 is an input after reset, route it to the line 0 of the EXTI
+	MODIFY_REG(SYSCFG->EXTICR[0], SYSCFG_EXTICR1_EXTI0, SYSCFG_EXTICR1_EXTI0_PA);
+	SET_BIT(EXTI->RTSR, EXTI_RTSR_TR0);
+	SET_BIT(EXTI->FTSR, EXTI_FTSR_TR0);
+	SET_BIT(EXTI->IMR, EXTI_IMR_MR0);
+	NVIC_EnableIRQ(EXTI0_IRQn);
+
+	MODIFY_REG(GPIOG->MODER,
+		GPIO_MODER_MODER13 | GPIO_MODER_MODER14,
+		_VAL2FLD(GPIO_MODER_MODER13, 1) | _VAL2FLD(GPIO_MODER_MODER14, 1)
+	);
+#endif
+}
+
+/**
+ * @brief Submit the panel state as soon as the button changes (rather than polling it, to keep the latency minimal)
+ */
+void EXTI0_IRQHandler()
+{
+	WRITE_REG(EXTI->PR, EXTI_PR_PR0);
+
+#if USBD_HID_ENABLED
+	UsbHidInputReport report = {
+		.buttons = READ_BIT(GPIOA->IDR, GPIO_IDR_ID0) ? 1 : 0
+	};
+
+	usbd_hid_send_report(&report);
+#endif
+
+#if USBD_MIDI_ENABLED
+	// Note on when pressed, note off (a note on with velocity 0) when released
+	usbd_midi_send(0, 0x90, MIDI_BUTTON_NOTE, READ_BIT(GPIOA->IDR, GPIO_IDR_ID0) ? 100 : 0);
+#endif
+}
+
+/**
+ * @brief Show the LEDs 1 and 2 of the output report on the green and red LEDs
+ */
+static void serve_hid()
+{
+#if USBD_HID_ENABLED
+	uint16_t leds = usbd_hid_output_report().leds;
+
+	WRITE_REG(GPIOG->BSRR,
+		((leds & (1 << 0)) ? GPIO_BSRR_BS13 : GPIO_BSRR_BR13) | ((leds & (1 << 1)) ? GPIO_BSRR_BS14 : GPIO_BSRR_BR14));
+#endif
+}
+
+/**
+ * @brief Insert the RAM disk and the flash disk into the logical units of the mass storage function
+ */
+static void initialize_storage()
+{
+#if USBD_MSC_ENABLED
+	usbd_msc_attach(0, &ram_disk);
+#if USBD_MSC_LUN_COUNT > 1
+	flash_disk_initialize();
+	usbd_msc_attach(1, &flash_disk);
+#endif
+#endif
+}
+
+/**
+ * @brief Read and write the blocks of the mass storage command in progress
+ */
+static void serve_msc()
+{
+#if USBD_MSC_ENABLED
+	usbd_msc_process();
+#endif
+}
+
+#if USBD_MIDI_ENABLED
+/**
+ * @brief Send an event received from the host back on its cable
+ */
+static void echo_midi_event(UsbMidiEvent event)
+{
+	usbd_midi_send_event(event);
+}
+#endif
+
+/**
+ * @brief Loop every cable of the MIDI function back to the host (a loopback for latency tests)
+ */
+static void initialize_midi()
+{
+#if USBD_MIDI_ENABLED
+	for (uint8_t cable = 0; cable < USBD_MIDI_CABLE_COUNT; cable++) {
+		usbd_midi_route(cable, &echo_midi_event);
+	}
+#endif
+}
+
+/**
+ * @brief Hand the MIDI events received from the host to their routes
+ */
+static void serve_midi()
+{
+#if USBD_MIDI_ENABLED
+	usbd_midi_process();
+#endif
+}
+
+/**
+ * @brief Write the firmware received in DFU mode to the flash, or reset into DFU mode once detached
+ */
+static void serve_dfu()
+{
+#if USBD_DFU_ENABLED
+	usbd_dfu_process();
+#endif
+}
+
 int main(void)
 {
+	memory_usage_paint_stack();
+
 	log_info("Program entry point.");
 
+	profiler_start();
+
 	usb_device.ptr_out_buffer = &buffer;
 
 	usbd_initialize(&usb_device);
 
+#if USBD_DFU_ENABLED
+	// In DFU mode the other functions are off, until the firmware restarts
+	while (usbd_dfu_mode_active()) {
+		serve_dfu();
+		log_process();
+		cpu_load_idle();
+	}
+#endif
+
+	initialize_panel();
+	initialize_storage();
+	initialize_midi();
+
     /* Loop forever */
 	for(;;)
 	{
-		usbd_poll();
+		serve_cdc();
+		serve_ncm();
+		serve_hid();
+		serve_msc();
+		serve_dfu();
+		serve_midi();
+		memory_usage_update();
+		log_process();
 
+		// The USB stack runs in its interrupt, so sleep until there is something to do
+		cpu_load_idle();
 	}
 }
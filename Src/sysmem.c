@@ -22,6 +22,7 @@
 
 /* Includes */
 #include <errno.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -29,6 +30,12 @@
  */
 static uint8_t *__sbrk_heap_end = NULL;
 
+/**
+ * Count of bytes handed out to the heap and count of requests refused for lack of memory
+ */
+uint32_t sbrk_heap_used = 0;
+uint32_t sbrk_failed_requests = 0;
+
 /**
  * @brief _sbrk() allocates memory to the newlib heap and is used by malloc
  *        and others from the C library
@@ -69,11 +76,13 @@ void *_sbrk(ptrdiff_t incr)
   if (__sbrk_heap_end + incr > max_heap)
   {
     errno = ENOMEM;
+    sbrk_failed_requests++;
     return (void *)-1;
   }
 
   prev_heap_end = __sbrk_heap_end;
   __sbrk_heap_end += incr;
+  sbrk_heap_used += incr;
 
   return (void *)prev_heap_end;
 }
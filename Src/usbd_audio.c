@@ -0,0 +1,397 @@
+/*
+ * usbd_audio.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_audio.h"
+#include "usbd_config.h"
+
+#if USBD_AUDIO_ENABLED
+
+#include <string.h>
+#include "usbd_driver.h"
+#include "usbd_statistics.h"
+#include "Helpers/audio_output.h"
+#include "Helpers/math.h"
+#include "Helpers/ring_buffer.h"
+#include "Helpers/sample_format.h"
+
+_Static_assert(AUDIO_OUTPUT_SAMPLE_RATE == USBD_AUDIO_SAMPLE_RATE, "The audio clock runs at another rate than the streams");
+
+/*
+ * The speaker is an asynchronous sink: the samples are played at the rate of the audio clock,
+ * which is not locked to the SOF of the host. Its feedback endpoint tells the host how many
+ * samples the audio clock consumes per frame, so the host sends exactly as many on average.
+ *
+ * The rate is measured in hardware: TIM2 captures its counter at every SOF (its ITR1 is the SOF
+ * of the OTG_HS core), and the SOF period is averaged over USBD_AUDIO_FEEDBACK_WINDOW frames.
+ * The timer and PLLI2S share the crystal, so the timer ticks are an exact measure of the audio
+ * clock. (A codec with its own crystal would clock the timer with its MCLK through ETR instead.)
+ * A small correction steers the speaker buffer back to half full, so the error of the measurement
+ * does not add up to an underrun or an overflow.
+ *
+ * The microphone is an asynchronous source: each frame carries the samples the audio clock has
+ * produced since the previous one, so the same measured rate sets its packet sizes.
+ */
+
+/// \brief TIM2 is clocked by twice the APB1 clock (its prescaler is 2), which is the core clock
+#define SOF_TIMER_CLOCK SystemCoreClock
+
+/// \brief A SOF period further than 1/8 from 1 ms means SOFs were missing (e.g. the bus was suspended)
+#define SOF_PERIOD_TOLERANCE 8
+
+/// \brief The nominal rate, samples per frame in 10.14 fixed point
+#define NOMINAL_RATE ((USBD_AUDIO_SAMPLE_RATE << 14) / 1000)
+
+/// \brief The correction of the feedback per frame of deviation from the target level (1/1024 sample)
+#define LEVEL_CORRECTION 16
+
+/// \brief The speaker buffer starts playing, and is steered back to, half full
+#define TARGET_LEVEL (USBD_AUDIO_BUFFER_FRAMES / 2)
+
+_Static_assert((USBD_AUDIO_BUFFER_FRAMES & (USBD_AUDIO_BUFFER_FRAMES - 1)) == 0, "The speaker buffer must be a power of 2");
+_Static_assert((USBD_AUDIO_FEEDBACK_WINDOW & (USBD_AUDIO_FEEDBACK_WINDOW - 1)) == 0 && USBD_AUDIO_FEEDBACK_WINDOW <= 256,
+	"The feedback window must be a power of 2, at most 256");
+
+typedef struct
+{
+	int32_t left;
+	int32_t right;
+} StereoFrame;
+
+static uint8_t speaker_buffer[USBD_AUDIO_BUFFER_FRAMES * sizeof(StereoFrame)] __attribute__((aligned(4)));
+static RingBuffer speaker_ring;
+/// \brief The bytes per sample of the selected alternate setting, 0 while the speaker is idle
+static volatile uint8_t speaker_sample_size;
+static uint16_t speaker_max_packet_size;
+/// \brief The buffer has filled up to the target level once, so it is played (owned by the DMA interrupt)
+static uint8_t speaker_playing;
+static uint32_t speaker_packet[(USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_SPEAKER_CHANNELS, 3) + 3) / 4];
+static StereoFrame speaker_frames[USBD_AUDIO_SAMPLE_RATE / 1000 + 1];
+
+/// \brief The SOF captures of the last window, the oldest at `sof_index` once the window is full
+static uint32_t sof_captures[USBD_AUDIO_FEEDBACK_WINDOW];
+static uint8_t sof_index;
+static uint16_t sof_count;
+/// \brief The measured rate of the audio clock, samples per frame in 10.14 fixed point
+static uint32_t audio_rate = NOMINAL_RATE;
+
+static uint8_t feedback_packet[3];
+static uint8_t feedback_busy = 1;
+
+static uint8_t microphone_sample_size;
+static uint8_t microphone_busy = 1;
+/// \brief The fraction of a sample carried over to the next frame (10.14 fixed point)
+static uint32_t microphone_remainder;
+/// \brief The frames a microphone packet holds: one more than the nominal rate
+#define MICROPHONE_MAX_FRAMES (USBD_AUDIO_SAMPLE_RATE / 1000 + 1)
+static uint8_t microphone_packet[USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_MICROPHONE_CHANNELS, 3)];
+static int32_t microphone_samples[USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_MICROPHONE_CHANNELS, 1)];
+/// \brief A 1 kHz sine oscillator (24-bit samples): the state rotates by 2 * pi / 48 each sample
+static int32_t tone_sine;
+static int32_t tone_cosine = 0x200000;
+/// \brief 2 * sin(pi / 48) in Q15
+#define TONE_STEP 4286
+
+/**
+ * @brief Start measuring the SOF period with TIM2
+ */
+static void initialize_sof_timer()
+{
+	SET_BIT(RCC->APB1ENR, RCC_APB1ENR_TIM2EN);
+
+	// ITR1 is the SOF of the OTG_HS core, and channel 1 captures the counter on it (TRC)
+	WRITE_REG(TIM2->OR, _VAL2FLD(TIM_OR_ITR1_RMP, 3));
+	WRITE_REG(TIM2->SMCR, _VAL2FLD(TIM_SMCR_TS, 1));
+	WRITE_REG(TIM2->CCMR1, _VAL2FLD(TIM_CCMR1_CC1S, 3));
+	WRITE_REG(TIM2->CCER, TIM_CCER_CC1E);
+	WRITE_REG(TIM2->ARR, 0xFFFFFFFF);
+	SET_BIT(TIM2->CR1, TIM_CR1_CEN);
+}
+
+/**
+ * @brief Account the deviation of a SOF period from the average of the window
+ * @param deviation The deviation in 1/USBD_AUDIO_FEEDBACK_WINDOW of a timer tick
+ */
+static void record_jitter(uint32_t deviation)
+{
+	UsbAudioStatistics *statistics = &usbd_statistics.audio;
+	uint32_t nanoseconds = MIN((uint64_t)deviation * 1000000000 / ((uint64_t)SOF_TIMER_CLOCK * USBD_AUDIO_FEEDBACK_WINDOW), 0xFFFF);
+
+	if (nanoseconds > statistics->sof_jitter_max_ns) {
+		statistics->sof_jitter_max_ns = nanoseconds;
+	}
+
+	statistics->sof_jitter_histogram[MIN(nanoseconds / USBD_SOF_JITTER_HISTOGRAM_BUCKET_NS, USBD_SOF_JITTER_HISTOGRAM_BUCKET_COUNT - 1)]++;
+}
+
+/**
+ * @brief Take the SOF capture of the frame and update the measured rate of the audio clock
+ * @note Called at the end of the periodic frame by both IN endpoints, the second call finds no capture.
+ */
+static void measure_start_of_frame()
+{
+	uint32_t status = TIM2->SR;
+
+	if (!(status & TIM_SR_CC1IF)) {
+		return;
+	}
+
+	// Reading the capture clears its flag
+	uint32_t capture = TIM2->CCR1;
+	uint32_t period = capture - sof_captures[(sof_index - 1) & (USBD_AUDIO_FEEDBACK_WINDOW - 1)];
+	uint32_t nominal_period = SOF_TIMER_CLOCK / 1000;
+
+	if (status & TIM_SR_CC1OF) {
+		WRITE_REG(TIM2->SR, (uint32_t)~TIM_SR_CC1OF);
+		usbd_statistics.audio.missed_sofs++;
+		sof_count = 0;
+	} else if (period < nominal_period - nominal_period / SOF_PERIOD_TOLERANCE ||
+		period > nominal_period + nominal_period / SOF_PERIOD_TOLERANCE) {
+		// The window restarts from this SOF
+		sof_count = 0;
+	}
+
+	uint32_t span = capture - sof_captures[sof_index];
+
+	sof_captures[sof_index] = capture;
+	sof_index = (sof_index + 1) & (USBD_AUDIO_FEEDBACK_WINDOW - 1);
+
+	if (sof_count < USBD_AUDIO_FEEDBACK_WINDOW) {
+		sof_count++;
+		return;
+	}
+
+	// The span covers the last USBD_AUDIO_FEEDBACK_WINDOW periods
+	uint64_t window_clock = (uint64_t)SOF_TIMER_CLOCK * USBD_AUDIO_FEEDBACK_WINDOW;
+	int32_t deviation = (int32_t)(period * USBD_AUDIO_FEEDBACK_WINDOW - span);
+
+	uint32_t rate = (uint64_t)span * ((uint64_t)USBD_AUDIO_SAMPLE_RATE << 14) / window_clock;
+
+	// A clock further than a sample per frame from the nominal rate is a bad measurement, and would overrun the packets
+	audio_rate = MIN(MAX(rate, NOMINAL_RATE - (1 << 14)), NOMINAL_RATE + (1 << 14));
+	usbd_statistics.audio.sof_period_ns = (uint64_t)span * 1000000000 / window_clock;
+	record_jitter(deviation < 0 ? -deviation : deviation);
+}
+
+/**
+ * @brief Return the rate to report to the host: the measured one, steered towards the target level
+ */
+static uint32_t feedback_rate()
+{
+	int32_t level = ring_buffer_used(&speaker_ring) / sizeof(StereoFrame);
+	int32_t rate = audio_rate + (TARGET_LEVEL - level) * LEVEL_CORRECTION;
+
+	// The host may send one sample per channel more or less than the nominal rate
+	return MIN(MAX(rate, NOMINAL_RATE - (1 << 14)), NOMINAL_RATE + (1 << 14));
+}
+
+/**
+ * @brief Play the frames received from the host, or silence until the buffer has filled up
+ * @note Called from the DMA interrupt of the audio output, once per period.
+ */
+static void play_period(int32_t *samples, uint32_t frame_count)
+{
+	UsbAudioStatistics *statistics = &usbd_statistics.audio;
+	uint32_t size = frame_count * sizeof(StereoFrame);
+	uint32_t level = ring_buffer_used(&speaker_ring) / sizeof(StereoFrame);
+
+	if (!speaker_sample_size) {
+		// The stream has stopped, what is left of it is dropped
+		ring_buffer_consume(&speaker_ring, ring_buffer_used(&speaker_ring));
+		speaker_playing = 0;
+	} else if (!speaker_playing && level >= TARGET_LEVEL) {
+		speaker_playing = 1;
+		statistics->speaker_level_min = level;
+		statistics->speaker_level_max = level;
+	}
+
+	if (!speaker_playing) {
+		memset(samples, 0, size);
+		return;
+	}
+
+	statistics->speaker_level = level;
+	statistics->speaker_level_min = MIN(statistics->speaker_level_min, level);
+	statistics->speaker_level_max = MAX(statistics->speaker_level_max, level);
+
+	uint32_t read = ring_buffer_read(&speaker_ring, samples, size);
+
+	if (read < size) {
+		// Fill up again before playing on
+		memset((uint8_t *)samples + read, 0, size - read);
+		statistics->speaker_underruns++;
+		speaker_playing = 0;
+	}
+}
+
+/**
+ * @brief Convert a packet of the speaker into stereo frames of 32-bit samples and buffer them
+ */
+static void speaker_out_data_received(uint8_t endpoint_number, uint16_t byte_count)
+{
+	usb_driver.read_packet(speaker_packet, byte_count);
+
+	if (!speaker_sample_size) {
+		return;
+	}
+
+	uint32_t frame_count = MIN(byte_count / (USBD_AUDIO_SPEAKER_CHANNELS * speaker_sample_size),
+		sizeof(speaker_frames) / sizeof(StereoFrame));
+
+	if (speaker_sample_size == 2) {
+		sample_format_from_s16((int32_t *)speaker_frames, speaker_packet, frame_count * USBD_AUDIO_SPEAKER_CHANNELS);
+	} else {
+		sample_format_from_s24((int32_t *)speaker_frames, speaker_packet, frame_count * USBD_AUDIO_SPEAKER_CHANNELS);
+	}
+
+	uint32_t size = frame_count * sizeof(StereoFrame);
+
+	if (ring_buffer_write(&speaker_ring, speaker_frames, size) < size) {
+		usbd_statistics.audio.speaker_overruns++;
+	}
+}
+
+static void speaker_out_transfer_completed(uint8_t endpoint_number)
+{
+	usb_driver.start_out_transfer(endpoint_number, speaker_max_packet_size);
+}
+
+static void feedback_in_transfer_completed(uint8_t endpoint_number)
+{
+	feedback_busy = 0;
+}
+
+/**
+ * @brief Arm the newest feedback value once the host has read the previous one
+ */
+static void feedback_end_of_periodic_frame(uint8_t endpoint_address)
+{
+	measure_start_of_frame();
+
+	if (feedback_busy) {
+		return;
+	}
+
+	uint32_t rate = feedback_rate();
+
+	// 10.14 fixed point in 3 bytes, little-endian
+	feedback_packet[0] = rate;
+	feedback_packet[1] = rate >> 8;
+	feedback_packet[2] = rate >> 16;
+	usbd_statistics.audio.feedback = rate;
+
+	feedback_busy = 1;
+	usb_driver.start_in_transfer(endpoint_address & 0x0F, feedback_packet, sizeof(feedback_packet));
+}
+
+/**
+ * @brief Start the speaker stream (the data endpoint) or its feedback
+ */
+static void speaker_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	if (endpoint_address & 0x80) {
+		feedback_busy = 0;
+		return;
+	}
+
+	// The alternate settings differ in the sample size only
+	speaker_max_packet_size = max_packet_size;
+	speaker_sample_size = max_packet_size / USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_SPEAKER_CHANNELS, 1);
+}
+
+static void speaker_endpoint_deactivated(uint8_t endpoint_address)
+{
+	if (endpoint_address & 0x80) {
+		feedback_busy = 1;
+	} else {
+		speaker_sample_size = 0;
+	}
+}
+
+const UsbEndpointHandler usbd_audio_speaker_endpoint_handler = {
+	.on_out_data_received = &speaker_out_data_received,
+	.on_out_transfer_completed = &speaker_out_transfer_completed,
+	.on_in_transfer_completed = &feedback_in_transfer_completed,
+	.on_endpoint_activated = &speaker_endpoint_activated,
+	.on_endpoint_deactivated = &speaker_endpoint_deactivated,
+	.on_end_of_periodic_frame = &feedback_end_of_periodic_frame
+};
+
+static void microphone_in_transfer_completed(uint8_t endpoint_number)
+{
+	microphone_busy = 0;
+}
+
+/**
+ * @brief Arm the samples produced by the audio clock during the frame
+ */
+static void microphone_end_of_periodic_frame(uint8_t endpoint_address)
+{
+	measure_start_of_frame();
+
+	if (microphone_busy) {
+		return;
+	}
+
+	microphone_remainder += audio_rate;
+	// Note: With a fractional nominal rate, the remainder could still add a frame more than the packet holds
+	uint32_t frame_count = MIN(microphone_remainder >> 14, MICROPHONE_MAX_FRAMES);
+	microphone_remainder &= (1 << 14) - 1;
+
+	int32_t *samples = microphone_samples;
+
+	for (uint32_t i = 0; i < frame_count; i++) {
+		tone_cosine -= ((int64_t)TONE_STEP * tone_sine) >> 15;
+		tone_sine += ((int64_t)TONE_STEP * tone_cosine) >> 15;
+
+		// The same tone on every channel, left-justified
+		for (uint8_t channel = 0; channel < USBD_AUDIO_MICROPHONE_CHANNELS; channel++) {
+			*samples++ = (int32_t)((uint32_t)tone_sine << 8);
+		}
+	}
+
+	uint32_t count = frame_count * USBD_AUDIO_MICROPHONE_CHANNELS;
+
+	if (microphone_sample_size == 2) {
+		sample_format_to_s16(microphone_packet, microphone_samples, count);
+	} else {
+		sample_format_to_s24(microphone_packet, microphone_samples, count);
+	}
+
+	microphone_busy = 1;
+	usb_driver.start_in_transfer(endpoint_address & 0x0F, microphone_packet, count * microphone_sample_size);
+}
+
+static void microphone_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	microphone_sample_size = max_packet_size / USBD_AUDIO_PACKET_SIZE(USBD_AUDIO_MICROPHONE_CHANNELS, 1);
+	microphone_remainder = 0;
+	microphone_busy = 0;
+}
+
+static void microphone_endpoint_deactivated(uint8_t endpoint_address)
+{
+	microphone_busy = 1;
+}
+
+const UsbEndpointHandler usbd_audio_microphone_endpoint_handler = {
+	.on_in_transfer_completed = &microphone_in_transfer_completed,
+	.on_endpoint_activated = &microphone_endpoint_activated,
+	.on_endpoint_deactivated = &microphone_endpoint_deactivated,
+	.on_end_of_periodic_frame = &microphone_end_of_periodic_frame
+};
+
+/**
+ * @brief Start the audio clock and the measurement of the SOF against it
+ */
+void usbd_audio_initialize()
+{
+	ring_buffer_initialize(&speaker_ring, speaker_buffer, sizeof(speaker_buffer));
+	initialize_sof_timer();
+	audio_output_start(&play_period);
+}
+
+#endif
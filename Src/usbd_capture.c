@@ -0,0 +1,80 @@
+/*
+ * usbd_capture.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_capture.h"
+
+#if USBD_CAPTURE_ENABLED
+
+#include <string.h>
+#include "usbd_driver.h"
+#include "Helpers/cycle_counter.h"
+#include "Helpers/math.h"
+
+_Static_assert((USBD_CAPTURE_RECORD_COUNT & (USBD_CAPTURE_RECORD_COUNT - 1)) == 0, "The record count must be a power of 2");
+_Static_assert((USBD_CAPTURE_PAYLOAD_SIZE % 4) == 0, "The payload size must be a multiple of 4");
+
+/// \note Placed in the CCM-RAM (not zeroed at startup) to keep the main RAM for the USB buffers
+UsbCaptureBuffer usbd_capture_buffer __attribute__((section(".ccmbss")));
+
+/**
+ * @brief Reset the capture ring and start capturing packets
+ */
+void usbd_capture_start()
+{
+	cycle_counter_initialize();
+
+	usbd_capture_buffer.enabled = 0;
+	usbd_capture_buffer.magic = USBD_CAPTURE_MAGIC;
+	usbd_capture_buffer.version = USBD_CAPTURE_VERSION;
+	usbd_capture_buffer.record_size = sizeof(UsbCaptureRecord);
+	usbd_capture_buffer.record_count = USBD_CAPTURE_RECORD_COUNT;
+	usbd_capture_buffer.timestamp_frequency = SystemCoreClock;
+	usbd_capture_buffer.write_index = 0;
+	usbd_capture_buffer.enabled = 1;
+}
+
+/**
+ * @brief Stop capturing packets (the captured records are kept for the dump)
+ */
+void usbd_capture_stop()
+{
+	usbd_capture_buffer.enabled = 0;
+}
+
+/**
+ * @brief Store a packet in the capture ring, overwriting the oldest record when the ring is full
+ * @param event One of USBD_CAPTURE_EVENT_* values
+ * @param endpoint_address The endpoint number (bit 7 is set for IN endpoints)
+ * @param transfer_type The type of the endpoint
+ * @param data Pointer to the payload of the packet
+ * @param length The length of the payload in bytes
+ * @note Called by the driver for every packet, so it must stay short: a fixed-size slot and a bounded copy.
+ */
+void usbd_capture_packet(uint8_t event, uint8_t endpoint_address, uint8_t transfer_type, void const *data, uint16_t length)
+{
+	if (!usbd_capture_buffer.enabled) {
+		return;
+	}
+
+	uint32_t write_index = usbd_capture_buffer.write_index;
+	UsbCaptureRecord *record = &usbd_capture_buffer.records[write_index & (USBD_CAPTURE_RECORD_COUNT - 1)];
+	uint8_t captured_length = MIN(length, USBD_CAPTURE_PAYLOAD_SIZE);
+
+	record->timestamp = cycle_counter_read();
+	record->frame_number = _FLD2VAL(USB_OTG_DSTS_FNSOF, USB_OTG_HS_DEVICE->DSTS);
+	record->device_address = _FLD2VAL(USB_OTG_DCFG_DAD, USB_OTG_HS_DEVICE->DCFG);
+	record->length = length;
+	record->endpoint_address = endpoint_address;
+	record->transfer_type = transfer_type;
+	record->event = event;
+	record->captured_length = captured_length;
+	memcpy(record->data, data, captured_length);
+
+	usbd_capture_buffer.write_index = write_index + 1;
+}
+
+#endif
@@ -0,0 +1,351 @@
+/*
+ * usbd_cdc.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_cdc.h"
+#include "usbd_config.h"
+
+#if USBD_CDC_ENABLED
+
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+#include "usbd_requests.h"
+#include "Helpers/logger.h"
+#include "Helpers/math.h"
+#include "Helpers/ring_buffer.h"
+
+_Static_assert((USBD_CDC_RX_BUFFER_SIZE & (USBD_CDC_RX_BUFFER_SIZE - 1)) == 0, "The receive ring size must be a power of 2");
+_Static_assert((USBD_CDC_TX_BUFFER_SIZE & (USBD_CDC_TX_BUFFER_SIZE - 1)) == 0, "The transmit ring size must be a power of 2");
+
+/// \brief The maximum packet size of both data endpoints
+#define CDC_DATA_PACKET_SIZE 64
+
+/** \brief The SERIAL_STATE notification: a request header followed by the state bits */
+typedef struct __attribute__((packed))
+{
+	UsbRequest header;
+	uint16_t serial_state;
+} UsbCdcSerialStateNotification;
+
+static uint8_t rx_storage[USBD_CDC_RX_BUFFER_SIZE];
+static uint8_t tx_storage[USBD_CDC_TX_BUFFER_SIZE];
+
+/// \brief Filled by the USB interrupt, emptied by the application
+static RingBuffer rx_ring;
+/// \brief Filled by the application, emptied by the USB interrupt
+static RingBuffer tx_ring;
+
+/// \brief The OUT endpoint answers NAK until the application frees enough of the receive ring
+static volatile uint8_t rx_paused;
+/// \brief The IN endpoint is sending (or is not active), the transfer completion starts the next one
+static volatile uint8_t tx_busy = 1;
+/// \brief The size of the IN transfer in progress
+static uint32_t tx_size;
+
+static UsbCdcLineCoding line_coding = {
+	.dwDTERate = 115200,
+	.bCharFormat = 0,
+	.bParityType = 0,
+	.bDataBits = 8
+};
+static uint8_t control_line_state;
+
+static UsbCdcSerialStateNotification serial_state_notification;
+static uint8_t notification_busy = 1;
+
+/**
+ * @brief Arm the OUT endpoint for as many whole packets as fit in the free part of the receive ring
+ * @note Called from the USB interrupt, or by the application with the interrupt disabled.
+ */
+static void receive_next()
+{
+	uint32_t free_size = ring_buffer_free(&rx_ring);
+
+	if (free_size < CDC_DATA_PACKET_SIZE) {
+		rx_paused = 1;
+		return;
+	}
+
+	rx_paused = 0;
+	usb_driver.start_out_transfer(USBD_ENDPOINT_CDC_OUT, free_size);
+}
+
+/**
+ * @brief Send the next part of the transmit ring, or a zero-length packet to end the transfer
+ * @param previous_size The size of the transfer just completed (0 if there was none)
+ * @note Called from the USB interrupt, or by the application with the interrupt disabled.
+ */
+static void send_next(uint32_t previous_size)
+{
+	uint8_t const *span;
+	uint32_t used = ring_buffer_used(&tx_ring);
+	uint32_t span_size = ring_buffer_read_span(&tx_ring, &span);
+
+	if (span_size == 0) {
+		// The host only returns a read at a short packet, so a transfer ending with a full packet
+		// is terminated by a zero-length packet once there is nothing more to send
+		if (previous_size > 0 && (previous_size % CDC_DATA_PACKET_SIZE) == 0) {
+			tx_size = 0;
+			usb_driver.start_in_transfer(USBD_ENDPOINT_CDC_IN & 0x0F, NULL, 0);
+		} else {
+			tx_busy = 0;
+		}
+		return;
+	}
+
+	// When the data wraps around the end of the ring, keep the packets full up to the wrap
+	if (used > span_size && span_size >= CDC_DATA_PACKET_SIZE) {
+		span_size -= span_size % CDC_DATA_PACKET_SIZE;
+	}
+
+	tx_busy = 1;
+	tx_size = span_size;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_CDC_IN & 0x0F, span, span_size);
+}
+
+/**
+ * @brief Report DCD and DSR to the host (they follow DTR, as if the device was always ready)
+ */
+static void notify_serial_state()
+{
+	if (notification_busy) {
+		return;
+	}
+
+	uint16_t state = (control_line_state & USB_CDC_CONTROL_LINE_DTR)
+		? USB_CDC_SERIAL_STATE_DCD | USB_CDC_SERIAL_STATE_DSR
+		: 0;
+
+	serial_state_notification = (UsbCdcSerialStateNotification){
+		.header = {
+			.bmRequestType = USB_BM_REQUEST_TYPE_DIRECTION_TOHOST | USB_BM_REQUEST_TYPE_TYPE_CLASS |
+				USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE,
+			.bRequest = USB_CDC_NOTIFICATION_SERIAL_STATE,
+			.wValue = 0,
+			.wIndex = USBD_INTERFACE_CDC_CONTROL,
+			.wLength = sizeof(uint16_t)
+		},
+		.serial_state = state
+	};
+
+	notification_busy = 1;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_CDC_NOTIFICATION & 0x0F, &serial_state_notification,
+		sizeof(serial_state_notification));
+}
+
+static void cdc_out_data_received(uint8_t endpoint_number, uint16_t byte_count)
+{
+	uint8_t *span;
+	uint32_t span_size = ring_buffer_write_span(&rx_ring, &span);
+
+	if (span_size >= byte_count) {
+		// The packet is popped straight into the ring
+		usb_driver.read_packet(span, byte_count);
+		ring_buffer_commit(&rx_ring, byte_count);
+	} else {
+		// The packet wraps around the end of the ring (it fits, the transfer was sized by the free space)
+		uint8_t packet[CDC_DATA_PACKET_SIZE];
+
+		usb_driver.read_packet(packet, byte_count);
+		ring_buffer_write(&rx_ring, packet, byte_count);
+	}
+}
+
+static void cdc_out_transfer_completed(uint8_t endpoint_number)
+{
+	receive_next();
+}
+
+static void cdc_in_transfer_completed(uint8_t endpoint_number)
+{
+	if (endpoint_number == (USBD_ENDPOINT_CDC_NOTIFICATION & 0x0F)) {
+		notification_busy = 0;
+		return;
+	}
+
+	uint32_t previous_size = tx_size;
+
+	ring_buffer_consume(&tx_ring, previous_size);
+	send_next(previous_size);
+}
+
+static void cdc_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	if (endpoint_address == USBD_ENDPOINT_CDC_IN) {
+		tx_size = 0;
+		send_next(0);
+	} else if (endpoint_address == USBD_ENDPOINT_CDC_NOTIFICATION) {
+		notification_busy = 0;
+	}
+	// Note: The OUT endpoint is armed for one packet by the activation, its completion arms the rest
+}
+
+static void cdc_endpoint_deactivated(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_CDC_IN) {
+		// The dropped transfer is sent again once the endpoint is active again
+		tx_busy = 1;
+	} else if (endpoint_address == USBD_ENDPOINT_CDC_NOTIFICATION) {
+		notification_busy = 1;
+	} else {
+		rx_paused = 0;
+	}
+}
+
+/**
+ * @brief Clearing the halt dropped the transfer in progress, so start it again
+ */
+static void cdc_endpoint_halt_cleared(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_CDC_IN) {
+		send_next(0);
+	} else if (endpoint_address == USBD_ENDPOINT_CDC_NOTIFICATION) {
+		notification_busy = 0;
+	}
+}
+
+const UsbEndpointHandler usbd_cdc_endpoint_handler = {
+	.on_out_data_received = &cdc_out_data_received,
+	.on_out_transfer_completed = &cdc_out_transfer_completed,
+	.on_in_transfer_completed = &cdc_in_transfer_completed,
+	.on_endpoint_activated = &cdc_endpoint_activated,
+	.on_endpoint_deactivated = &cdc_endpoint_deactivated,
+	.on_endpoint_halt_cleared = &cdc_endpoint_halt_cleared
+};
+
+static uint8_t set_line_coding_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if (request->wLength != sizeof(UsbCdcLineCoding)) {
+		return 0;
+	}
+
+	// The data stage is received straight into the line coding
+	if (usb_device->control_transfer_stage == USB_CONTROL_STAGE_SETUP) {
+		usb_device->ptr_control_out_data = &line_coding;
+		return 1;
+	}
+
+	log_info("CDC line coding: %lu baud, %u data bits.", line_coding.dwDTERate, line_coding.bDataBits);
+	return 1;
+}
+
+static uint8_t get_line_coding_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	usb_device->ptr_in_buffer = &line_coding;
+	usb_device->in_data_size = sizeof(line_coding);
+	return 1;
+}
+
+static uint8_t set_control_line_state_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	control_line_state = request->wValue & (USB_CDC_CONTROL_LINE_DTR | USB_CDC_CONTROL_LINE_RTS);
+	notify_serial_state();
+	return 1;
+}
+
+static uint8_t send_break_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	// There is no UART to send the break to
+	return 1;
+}
+
+static UsbRequestHandler const cdc_request_handlers[] = {
+	[USB_CDC_REQUEST_SET_LINE_CODING - USB_CDC_REQUEST_SET_LINE_CODING] = &set_line_coding_handler,
+	[USB_CDC_REQUEST_GET_LINE_CODING - USB_CDC_REQUEST_SET_LINE_CODING] = &get_line_coding_handler,
+	[USB_CDC_REQUEST_SET_CONTROL_LINE_STATE - USB_CDC_REQUEST_SET_LINE_CODING] = &set_control_line_state_handler,
+	[USB_CDC_REQUEST_SEND_BREAK - USB_CDC_REQUEST_SET_LINE_CODING] = &send_break_handler
+};
+
+static UsbRequestHandlers const cdc_requests = {
+	.first_request = USB_CDC_REQUEST_SET_LINE_CODING,
+	.request_count = sizeof(cdc_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = cdc_request_handlers
+};
+
+void usbd_cdc_initialize()
+{
+	ring_buffer_initialize(&rx_ring, rx_storage, sizeof(rx_storage));
+	ring_buffer_initialize(&tx_ring, tx_storage, sizeof(tx_storage));
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE,
+		USBD_INTERFACE_CDC_CONTROL, &cdc_requests);
+}
+
+/**
+ * @brief Copy up to `size` received bytes out of the receive ring
+ * @return The count of bytes copied
+ * @note Called by the application. When the ring was full, the host is let send again.
+ */
+uint32_t usbd_cdc_read(void *data, uint32_t size)
+{
+	uint32_t read = ring_buffer_read(&rx_ring, data, size);
+
+	if (rx_paused) {
+		uint32_t primask = __get_PRIMASK();
+
+		// The USB interrupt pauses the endpoint too, so the check and the arming must not be split by it
+		__disable_irq();
+		if (rx_paused) {
+			receive_next();
+		}
+		__set_PRIMASK(primask);
+	}
+
+	return read;
+}
+
+/**
+ * @brief Queue up to `size` bytes for the host
+ * @return The count of bytes queued (less than `size` when the transmit ring is full)
+ * @note Called by the application.
+ */
+uint32_t usbd_cdc_write(void const *data, uint32_t size)
+{
+	uint32_t written = ring_buffer_write(&tx_ring, data, size);
+
+	if (!tx_busy) {
+		uint32_t primask = __get_PRIMASK();
+
+		// The USB interrupt starts transfers too, so the check and the start must not be split by it
+		__disable_irq();
+		if (!tx_busy) {
+			send_next(0);
+		}
+		__set_PRIMASK(primask);
+	}
+
+	return written;
+}
+
+/**
+ * @brief Return the count of received bytes waiting in the receive ring
+ */
+uint32_t usbd_cdc_available()
+{
+	return ring_buffer_used(&rx_ring);
+}
+
+/**
+ * @brief Return the count of bytes that usbd_cdc_write() accepts right now
+ */
+uint32_t usbd_cdc_write_space()
+{
+	return ring_buffer_free(&tx_ring);
+}
+
+/**
+ * @brief Return the DTR and RTS signals set by the host (USB_CDC_CONTROL_LINE_*)
+ */
+uint8_t usbd_cdc_control_line_state()
+{
+	return control_line_state;
+}
+
+UsbCdcLineCoding usbd_cdc_line_coding()
+{
+	return line_coding;
+}
+
+#endif
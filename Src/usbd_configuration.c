@@ -0,0 +1,157 @@
+/*
+ * usbd_configuration.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include <stddef.h>
+#include "usbd_configuration.h"
+#include "usbd_config.h"
+#include "Helpers/math.h"
+
+#define IN_ENDPOINT_SIZE(address, max_packet_size) (((address) & 0x80) ? ((max_packet_size) + 3) / 4 : 0)
+
+/// \brief The depth of the TxFIFO0 in words (the core accepts no TxFIFO shallower than 16 words)
+#define TXFIFO0_DEPTH MAX(USBD_EP0_MAX_PACKET_SIZE / 4, 16)
+
+#define MINIMAL_TXFIFO_OF_ENDPOINT(name, address, type, max_packet_size, interval, handler, ...) \
+	uint32_t name[IN_ENDPOINT_SIZE(address, max_packet_size)];
+#define MINIMAL_TXFIFOS_OF_ALTERNATE_SETTING(name, endpoints, ...) \
+	struct { uint32_t name[0]; endpoints(MINIMAL_TXFIFO_OF_ENDPOINT, USBD_NO_DESCRIPTOR, MINIMAL_TXFIFO_OF_ENDPOINT) };
+#define MINIMAL_TXFIFOS_OF_INTERFACE(name, class, subclass, protocol, alternate_settings) \
+	union { alternate_settings(MINIMAL_TXFIFOS_OF_ALTERNATE_SETTING) };
+
+/// \brief The FIFO RAM needed by the configuration when every TxFIFO holds a single packet
+typedef struct
+{
+	uint32_t rxfifo[RXFIFO_DEPTH(MAX(USBD_MAX_OUT_PACKET_SIZE, USBD_EP0_MAX_PACKET_SIZE))];
+	uint32_t txfifo0[TXFIFO0_DEPTH];
+	USBD_INTERFACES(MINIMAL_TXFIFOS_OF_INTERFACE)
+} UsbMinimalFifoLayout;
+
+_Static_assert(sizeof(UsbMinimalFifoLayout) <= FIFO_RAM_DEPTH * 4, "The FIFOs do not fit in the FIFO RAM");
+
+// The RxFIFO is shared by all OUT endpoints, so it is sized for the largest packet any of them may receive
+#define OUT_ENDPOINT_FITS_RXFIFO(name, address, type, max_packet_size, ...) \
+	_Static_assert(((address) & 0x80) || (max_packet_size) <= USBD_MAX_OUT_PACKET_SIZE, \
+		"The endpoint " #name " is larger than USBD_MAX_OUT_PACKET_SIZE");
+#define OUT_ENDPOINTS_FIT_RXFIFO(name, endpoints, ...) \
+	endpoints(OUT_ENDPOINT_FITS_RXFIFO, USBD_NO_DESCRIPTOR, OUT_ENDPOINT_FITS_RXFIFO)
+#define OUT_ENDPOINTS_OF_INTERFACE_FIT_RXFIFO(name, class, subclass, protocol, alternate_settings) \
+	alternate_settings(OUT_ENDPOINTS_FIT_RXFIFO)
+
+USBD_INTERFACES(OUT_ENDPOINTS_OF_INTERFACE_FIT_RXFIFO)
+
+#define PLUS_ONE_IF_IN(name, address, ...) + (((address) & 0x80) != 0)
+#define IN_ENDPOINTS_OF_ALTERNATE_SETTING(name, endpoints, ...) endpoints(PLUS_ONE_IF_IN, USBD_NO_DESCRIPTOR, PLUS_ONE_IF_IN)
+#define IN_ENDPOINTS_OF_INTERFACE(name, class, subclass, protocol, alternate_settings) \
+	alternate_settings(IN_ENDPOINTS_OF_ALTERNATE_SETTING)
+
+/**
+ * \brief The spare FIFO RAM given to each IN endpoint (in words)
+ * \details The RAM left by the minimal layout is split evenly between all IN endpoints of all
+ * alternate settings, so it is enough even if the largest alternate settings are selected together.
+ */
+enum { IN_ENDPOINT_ENTRY_COUNT = 0 USBD_INTERFACES(IN_ENDPOINTS_OF_INTERFACE) };
+#define FAIR_SHARE ((FIFO_RAM_DEPTH - sizeof(UsbMinimalFifoLayout) / 4) / MAX(IN_ENDPOINT_ENTRY_COUNT, 1))
+
+// An endpoint takes at most a second packet from the share (double buffering), the rest stays free
+#define TXFIFO_OF_ENDPOINT(name, address, type, max_packet_size, interval, handler, ...) \
+	uint32_t name[IN_ENDPOINT_SIZE(address, max_packet_size) + MIN(FAIR_SHARE, IN_ENDPOINT_SIZE(address, max_packet_size))];
+#define TXFIFOS_OF_ALTERNATE_SETTING(name, endpoints, ...) \
+	struct { uint32_t name[0]; endpoints(TXFIFO_OF_ENDPOINT, USBD_NO_DESCRIPTOR, TXFIFO_OF_ENDPOINT) };
+#define TXFIFOS_OF_INTERFACE(name, class, subclass, protocol, alternate_settings) \
+	union { alternate_settings(TXFIFOS_OF_ALTERNATE_SETTING) };
+
+/**
+ * \brief The layout of the FIFO RAM, one member per FIFO
+ * \details The compiler lays the FIFOs out: the start of each TxFIFO is the offset of its member.
+ * OUT endpoints get zero-sized members, as they all share the RxFIFO.
+ *
+ * The alternate settings of an interface overlap in an anonymous union, so each interface owns
+ * a region sized for its largest alternate setting. Selecting another alternate setting re-plans
+ * the TxFIFOs inside that region only and leaves the FIFOs of the other interfaces in place.
+ */
+typedef struct
+{
+	uint32_t rxfifo[RXFIFO_DEPTH(MAX(USBD_MAX_OUT_PACKET_SIZE, USBD_EP0_MAX_PACKET_SIZE))];
+	uint32_t txfifo0[TXFIFO0_DEPTH];
+	USBD_INTERFACES(TXFIFOS_OF_INTERFACE)
+} UsbFifoLayout;
+
+_Static_assert(sizeof(UsbFifoLayout) <= FIFO_RAM_DEPTH * 4, "The FIFOs do not fit in the FIFO RAM");
+
+// The TxFIFO0 lies between the RxFIFO and the TxFIFOs of the endpoints, which it must not reach into
+#define TXFIFO_AFTER_TXFIFO0(name, address, ...) \
+	_Static_assert(!((address) & 0x80) || offsetof(UsbFifoLayout, name) >= \
+		offsetof(UsbFifoLayout, txfifo0) + sizeof(((UsbFifoLayout *)0)->txfifo0), \
+		"The TxFIFO of " #name " overlaps the TxFIFO0");
+#define TXFIFOS_OF_ALTERNATE_SETTING_AFTER_TXFIFO0(name, endpoints, ...) \
+	endpoints(TXFIFO_AFTER_TXFIFO0, USBD_NO_DESCRIPTOR, TXFIFO_AFTER_TXFIFO0)
+#define TXFIFOS_OF_INTERFACE_AFTER_TXFIFO0(name, class, subclass, protocol, alternate_settings) \
+	alternate_settings(TXFIFOS_OF_ALTERNATE_SETTING_AFTER_TXFIFO0)
+
+USBD_INTERFACES(TXFIFOS_OF_INTERFACE_AFTER_TXFIFO0)
+
+const UsbEndpoint0Fifos usbd_endpoint0_fifos = {
+	.rxfifo_depth = sizeof(((UsbFifoLayout *)0)->rxfifo) / 4,
+	.txfifo0_start = offsetof(UsbFifoLayout, txfifo0) / 4,
+	.txfifo0_depth = sizeof(((UsbFifoLayout *)0)->txfifo0) / 4
+};
+
+#define ENDPOINT_CONFIGURATION(name, address, type_, max_packet_size_, interval, handler_, ...) \
+	{ \
+		.activation = { \
+			.endpoint_address = (address), \
+			.type = (type_) & USB_ENDPOINT_TYPE_MASK, \
+			.max_packet_size = (max_packet_size_), \
+			.txfifo_start = offsetof(UsbFifoLayout, name) / 4, \
+			.txfifo_depth = sizeof(((UsbFifoLayout *)0)->name) / 4 \
+		}, \
+		.handler = (handler_) \
+	},
+#define ENDPOINTS_OF_ALTERNATE_SETTING(name, endpoints, ...) \
+	static const UsbEndpointConfiguration endpoints_of_##name[] = { endpoints(ENDPOINT_CONFIGURATION, USBD_NO_DESCRIPTOR, ENDPOINT_CONFIGURATION) };
+
+#define ENDPOINTS_OF_INTERFACE(name, class, subclass, protocol, alternate_settings) \
+	alternate_settings(ENDPOINTS_OF_ALTERNATE_SETTING)
+
+// The endpoints activated by each alternate setting
+USBD_INTERFACES(ENDPOINTS_OF_INTERFACE)
+
+#define ALTERNATE_SETTING_CONFIGURATION(name, ...) \
+	{ \
+		.endpoints = endpoints_of_##name, \
+		.endpoint_count = sizeof(endpoints_of_##name) / sizeof(UsbEndpointConfiguration) \
+	},
+#define ALTERNATE_SETTINGS_OF_INTERFACE(name, class, subclass, protocol, alternate_settings) \
+	static const UsbAlternateSettingConfiguration alternate_settings_of_##name[] = { \
+		alternate_settings(ALTERNATE_SETTING_CONFIGURATION) \
+	};
+
+USBD_INTERFACES(ALTERNATE_SETTINGS_OF_INTERFACE)
+
+#define INTERFACE_CONFIGURATION(name, ...) \
+	[USBD_INTERFACE_##name] = { \
+		.alternate_settings = alternate_settings_of_##name, \
+		.alternate_setting_count = sizeof(alternate_settings_of_##name) / sizeof(UsbAlternateSettingConfiguration) \
+	},
+
+const UsbInterfaceConfiguration usbd_interface_configurations[USBD_INTERFACE_COUNT] = {
+	USBD_INTERFACES(INTERFACE_CONFIGURATION)
+};
+
+#define PLUS_ONE(...) + 1
+#define FUNCTION_CONFIGURATION(name, class, subclass, protocol, initialize_, endpoint_addresses, interfaces, ...) \
+	{ \
+		.initialize = (initialize_), \
+		.first_interface = USBD_FIRST_INTERFACE_OF_##name, \
+		.interface_count = 0 interfaces(PLUS_ONE) \
+	},
+
+const UsbFunctionConfiguration usbd_function_configurations[] = {
+	USBD_FUNCTIONS(FUNCTION_CONFIGURATION)
+};
+
+const uint8_t usbd_function_count = sizeof(usbd_function_configurations) / sizeof(UsbFunctionConfiguration);
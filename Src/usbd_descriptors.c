@@ -0,0 +1,449 @@
+/*
+ * usbd_descriptors.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include <stddef.h>
+#include "usbd_descriptors.h"
+#include "usbd_config.h"
+#include "usbd_configuration.h"
+#include "usb_standards.h"
+#include "stm32f4xx.h"
+
+/** \name String descriptor indexes
+ *@{*/
+#define STRING_INDEX_LANGID 0
+#define STRING_INDEX_MANUFACTURER 1
+#define STRING_INDEX_PRODUCT 2
+#define STRING_INDEX_SERIAL_NUMBER 3
+#define STRING_INDEX_MAC_ADDRESS USBD_STRING_INDEX_MAC_ADDRESS
+/**@}*/
+
+/// \brief The serial number is the 96-bit unique ID of the MCU in hexadecimal
+#define SERIAL_NUMBER_LENGTH 24
+
+/// \brief The MAC address is 6 bytes in hexadecimal
+#define MAC_ADDRESS_LENGTH 12
+
+/** \brief The string descriptor 0, which lists the supported languages */
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t wLANGID[1];
+} UsbLangidDescriptor;
+
+/** \brief The string descriptors stored in the blob */
+typedef struct __attribute__((packed))
+{
+	UsbLangidDescriptor langid;
+	USB_STRING_DESCRIPTOR_STRUCT(USBD_MANUFACTURER_STRING) manufacturer;
+	USB_STRING_DESCRIPTOR_STRUCT(USBD_PRODUCT_STRING) product;
+} UsbStringDescriptors;
+
+#define ENDPOINT_DESCRIPTOR_MEMBER(name, address, type, max_packet_size, interval, handler) \
+	UsbEndpointDescriptor name;
+#define CLASS_DESCRIPTOR_MEMBER(name, type, initializer) \
+	type name;
+#define AUDIO_ENDPOINT_DESCRIPTOR_MEMBER(name, ...) \
+	UsbAudioEndpointDescriptor name;
+#define ALTERNATE_SETTING_DESCRIPTOR_MEMBERS(name, endpoints, ...) \
+	UsbInterfaceDescriptor name; \
+	endpoints(ENDPOINT_DESCRIPTOR_MEMBER, CLASS_DESCRIPTOR_MEMBER, AUDIO_ENDPOINT_DESCRIPTOR_MEMBER)
+#define INTERFACE_DESCRIPTOR_MEMBERS(name, class, subclass, protocol, alternate_settings) \
+	alternate_settings(ALTERNATE_SETTING_DESCRIPTOR_MEMBERS)
+#define FUNCTION_DESCRIPTOR_MEMBERS(name, class, subclass, protocol, initialize, endpoint_addresses, interfaces, ...) \
+	UsbInterfaceAssociationDescriptor name; \
+	interfaces(INTERFACE_DESCRIPTOR_MEMBERS)
+
+#define ENDPOINT_DESCRIPTOR(name, address, type, max_packet_size, interval, handler) \
+	.name = { \
+		.bLength = sizeof(UsbEndpointDescriptor), \
+		.bDescriptorType = USB_DESCRIPTOR_TYPE_ENDPOINT, \
+		.bEndpointAddress = (address), \
+		.bmAttributes = (type), \
+		.wMaxPacketSize = (max_packet_size), \
+		.bInterval = (interval) \
+	},
+#define CLASS_DESCRIPTOR(name, type, initializer) \
+	.name = initializer,
+#define AUDIO_ENDPOINT_DESCRIPTOR(name, address, type, max_packet_size, interval, handler, refresh, synch_address) \
+	.name = { \
+		.bLength = sizeof(UsbAudioEndpointDescriptor), \
+		.bDescriptorType = USB_DESCRIPTOR_TYPE_ENDPOINT, \
+		.bEndpointAddress = (address), \
+		.bmAttributes = (type), \
+		.wMaxPacketSize = (max_packet_size), \
+		.bInterval = (interval), \
+		.bRefresh = (refresh), \
+		.bSynchAddress = (synch_address) \
+	},
+#define PLUS_ONE(...) + 1
+#define ALTERNATE_SETTING_DESCRIPTORS(name, endpoints, interface_name, class, subclass, protocol) \
+	.name = { \
+		.bLength = sizeof(UsbInterfaceDescriptor), \
+		.bDescriptorType = USB_DESCRIPTOR_TYPE_INTERFACE, \
+		.bInterfaceNumber = USBD_INTERFACE_##interface_name, \
+		.bAlternateSetting = USBD_ALTERNATE_SETTING_##name, \
+		.bNumEndpoints = 0 endpoints(PLUS_ONE, USBD_NO_DESCRIPTOR, PLUS_ONE), \
+		.bInterfaceClass = (class), \
+		.bInterfaceSubClass = (subclass), \
+		.bInterfaceProtocol = (protocol), \
+		.iInterface = 0 \
+	}, \
+	endpoints(ENDPOINT_DESCRIPTOR, CLASS_DESCRIPTOR, AUDIO_ENDPOINT_DESCRIPTOR)
+#define INTERFACE_DESCRIPTORS(name, class, subclass, protocol, alternate_settings) \
+	alternate_settings(ALTERNATE_SETTING_DESCRIPTORS, name, class, subclass, protocol)
+#define FUNCTION_DESCRIPTORS(name, class, subclass, protocol, initialize, endpoint_addresses, interfaces, ...) \
+	.name = { \
+		.bLength = sizeof(UsbInterfaceAssociationDescriptor), \
+		.bDescriptorType = USB_DESCRIPTOR_TYPE_INTERFASEASSOC, \
+		.bFirstInterface = USBD_FIRST_INTERFACE_OF_##name, \
+		.bInterfaceCount = 0 interfaces(PLUS_ONE), \
+		.bFunctionClass = (class), \
+		.bFunctionSubClass = (subclass), \
+		.bFunctionProtocol = (protocol), \
+		.iFunction = 0 \
+	}, \
+	interfaces(INTERFACE_DESCRIPTORS)
+
+/**
+ * \brief The configuration descriptor followed by all of its subdescriptors
+ * \details The host reads the whole structure at once, so its size is the wTotalLength.
+ * The members are generated from \ref USBD_FUNCTIONS: each function is an interface association
+ * descriptor followed by its interfaces.
+ */
+typedef struct __attribute__((packed))
+{
+	UsbConfigurationDescriptor configuration;
+	USBD_FUNCTIONS(FUNCTION_DESCRIPTOR_MEMBERS)
+} UsbConfigurationDescriptorCombination;
+
+/** \brief The BOS descriptor followed by its device capabilities */
+typedef struct __attribute__((packed))
+{
+	UsbBosDescriptor bos;
+	UsbUsb20ExtensionDescriptor usb20_extension;
+} UsbBosDescriptorCombination;
+
+/**
+ * \brief All descriptors of the device in one packed blob
+ * \details The blob is constant (stored in the flash) and the descriptors are sent straight from it.
+ */
+typedef struct __attribute__((packed))
+{
+	UsbDeviceDescriptor device;
+	UsbConfigurationDescriptorCombination configuration;
+	UsbBosDescriptorCombination bos;
+	UsbStringDescriptors strings;
+} UsbDescriptorSet;
+
+static const UsbDescriptorSet descriptor_set = {
+	.device = {
+		.bLength = sizeof(UsbDeviceDescriptor),
+		.bDescriptorType = USB_DESCRIPTOR_TYPE_DEVICE,
+		.bcdUSB = 0x0201, // 0xJJMN (2.01 makes the host read the BOS descriptor)
+		// The functions are announced by interface association descriptors
+		.bDeviceClass = USB_CLASS_IAD,
+		.bDeviceSubClass = USB_SUBCLASS_IAD,
+		.bDeviceProtocol = USB_PROTOCOL_IAD,
+		.bMaxPacketSize0 = USBD_EP0_MAX_PACKET_SIZE,
+		.idVendor = 0x6666,
+		.idProduct = 0x13AA,
+		.bcdDevice = 0x0100,
+		.iManufacturer = STRING_INDEX_MANUFACTURER,
+		.iProduct = STRING_INDEX_PRODUCT,
+		.iSerialNumber = STRING_INDEX_SERIAL_NUMBER,
+		.bNumConfigurations = 1
+	},
+	.configuration = {
+		.configuration = {
+			.bLength = sizeof(UsbConfigurationDescriptor),
+			.bDescriptorType = USB_DESCRIPTOR_TYPE_CONFIGURATION,
+			.wTotalLength = sizeof(UsbConfigurationDescriptorCombination),
+			.bNumInterfaces = USBD_INTERFACE_COUNT,
+			.bConfigurationValue = USBD_CONFIGURATION_VALUE,
+			.iConfiguration = 0,
+			.bmAttributes = USBD_CONFIGURATION_ATTRIBUTES,
+			.bMaxPower = 50 // In units of 2 mA
+		},
+		USBD_FUNCTIONS(FUNCTION_DESCRIPTORS)
+	},
+	.bos = {
+		.bos = {
+			.bLength = sizeof(UsbBosDescriptor),
+			.bDescriptorType = USB_DESCRIPTOR_TYPE_BOS,
+			.wTotalLength = sizeof(UsbBosDescriptorCombination),
+			.bNumDeviceCaps = 1
+		},
+		.usb20_extension = {
+			.bLength = sizeof(UsbUsb20ExtensionDescriptor),
+			.bDescriptorType = USB_DESCRIPTOR_TYPE_DEVICE_CAPABILITY,
+			.bDevCapabilityType = USB_DEVICE_CAPABILITY_USB20_EXTENSION,
+			.bmAttributes = 0 // No link power management
+		}
+	},
+	.strings = {
+		.langid = {
+			.bLength = sizeof(UsbLangidDescriptor),
+			.bDescriptorType = USB_DESCRIPTOR_TYPE_STRING,
+			.wLANGID = { USB_LANGID_ENGLISH_US }
+		},
+		.manufacturer = USB_STRING_DESCRIPTOR(USBD_MANUFACTURER_STRING),
+		.product = USB_STRING_DESCRIPTOR(USBD_PRODUCT_STRING)
+	}
+};
+
+#if USBD_DFU_ENABLED
+/**
+ * \brief The descriptors that replace those of the blob in DFU mode: the DFU interface alone
+ * \details The strings are the same, the product ID tells the host the device is another one.
+ */
+static const struct __attribute__((packed))
+{
+	UsbDeviceDescriptor device;
+	struct __attribute__((packed))
+	{
+		UsbConfigurationDescriptor configuration;
+		UsbInterfaceDescriptor interface;
+		UsbDfuFunctionalDescriptor functional;
+	} configuration;
+} dfu_mode_descriptors = {
+	.device = {
+		.bLength = sizeof(UsbDeviceDescriptor),
+		.bDescriptorType = USB_DESCRIPTOR_TYPE_DEVICE,
+		.bcdUSB = 0x0201,
+		.bDeviceClass = USB_CLASS_PER_INTERFACE,
+		.bDeviceSubClass = 0,
+		.bDeviceProtocol = 0,
+		.bMaxPacketSize0 = USBD_EP0_MAX_PACKET_SIZE,
+		.idVendor = 0x6666,
+		.idProduct = USBD_DFU_MODE_PRODUCT_ID,
+		.bcdDevice = 0x0100,
+		.iManufacturer = STRING_INDEX_MANUFACTURER,
+		.iProduct = STRING_INDEX_PRODUCT,
+		.iSerialNumber = STRING_INDEX_SERIAL_NUMBER,
+		.bNumConfigurations = 1
+	},
+	.configuration = {
+		.configuration = {
+			.bLength = sizeof(UsbConfigurationDescriptor),
+			.bDescriptorType = USB_DESCRIPTOR_TYPE_CONFIGURATION,
+			.wTotalLength = sizeof(dfu_mode_descriptors.configuration),
+			.bNumInterfaces = 1,
+			.bConfigurationValue = USBD_CONFIGURATION_VALUE,
+			.iConfiguration = 0,
+			.bmAttributes = USBD_CONFIGURATION_ATTRIBUTES,
+			.bMaxPower = 50
+		},
+		.interface = {
+			.bLength = sizeof(UsbInterfaceDescriptor),
+			.bDescriptorType = USB_DESCRIPTOR_TYPE_INTERFACE,
+			.bInterfaceNumber = 0,
+			.bAlternateSetting = 0,
+			.bNumEndpoints = 0,
+			.bInterfaceClass = USB_CLASS_APP_SPEC,
+			.bInterfaceSubClass = USB_SUBCLASS_DFU,
+			.bInterfaceProtocol = USB_PROTOCOL_DFU_MODE,
+			.iInterface = 0
+		},
+		.functional = USBD_DFU_FUNCTIONAL_DESCRIPTOR
+	}
+};
+#endif
+
+/**
+ * \brief The serial number string descriptor
+ * \details It is the only descriptor built at run time, once, and is then sent from the RAM as it is.
+ */
+static struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t bString[SERIAL_NUMBER_LENGTH];
+} serial_number_descriptor;
+
+#if USBD_NCM_ENABLED
+/**
+ * \brief The MAC address string descriptor of the network function
+ * \details A locally administered address folded from the unique ID, so every device has its own.
+ */
+static struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t bString[MAC_ADDRESS_LENGTH];
+} mac_address_descriptor;
+#endif
+
+/// \brief The string descriptors built at run time (not in the blob), indexed by the string index
+static void const *const ram_string_descriptors[] = {
+	[STRING_INDEX_SERIAL_NUMBER] = &serial_number_descriptor,
+#if USBD_NCM_ENABLED
+	[STRING_INDEX_MAC_ADDRESS] = &mac_address_descriptor
+#endif
+};
+
+_Static_assert(sizeof(UsbDeviceDescriptor) == 18, "The device descriptor must be packed");
+_Static_assert(sizeof(UsbConfigurationDescriptor) == 9, "The configuration descriptor must be packed");
+
+#define DESCRIPTOR_LOCATION(member) { offsetof(UsbDescriptorSet, member), sizeof(((UsbDescriptorSet *)0)->member) }
+
+static const UsbDescriptorLocation device_descriptor_locations[] = {
+	DESCRIPTOR_LOCATION(device)
+};
+
+static const UsbDescriptorLocation configuration_descriptor_locations[] = {
+	DESCRIPTOR_LOCATION(configuration)
+};
+
+static const UsbDescriptorLocation bos_descriptor_locations[] = {
+	DESCRIPTOR_LOCATION(bos)
+};
+
+/// \brief Indexed by the string index (the run-time strings are not in the blob, see \ref ram_string_descriptors)
+static const UsbDescriptorLocation string_descriptor_locations[] = {
+	[STRING_INDEX_LANGID] = DESCRIPTOR_LOCATION(strings.langid),
+	[STRING_INDEX_MANUFACTURER] = DESCRIPTOR_LOCATION(strings.manufacturer),
+	[STRING_INDEX_PRODUCT] = DESCRIPTOR_LOCATION(strings.product),
+	[STRING_INDEX_SERIAL_NUMBER] = { 0, sizeof(serial_number_descriptor) },
+#if USBD_NCM_ENABLED
+	[STRING_INDEX_MAC_ADDRESS] = { 0, sizeof(mac_address_descriptor) }
+#endif
+};
+
+/// \brief The descriptors of each type, indexed by the descriptor type
+static const struct
+{
+	UsbDescriptorLocation const *locations;
+	uint8_t count;
+} descriptors_by_type[USB_DESCRIPTOR_TYPE_BOS + 1] = {
+	[USB_DESCRIPTOR_TYPE_DEVICE] = { device_descriptor_locations, 1 },
+	[USB_DESCRIPTOR_TYPE_CONFIGURATION] = { configuration_descriptor_locations, 1 },
+	[USB_DESCRIPTOR_TYPE_STRING] = { string_descriptor_locations, sizeof(string_descriptor_locations) / sizeof(UsbDescriptorLocation) },
+	[USB_DESCRIPTOR_TYPE_BOS] = { bos_descriptor_locations, 1 }
+};
+
+static uint16_t hexadecimal_digit(uint8_t value)
+{
+	return value < 10 ? '0' + value : 'A' + value - 10;
+}
+
+/**
+ * @brief Build the descriptors that depend on the device (the serial number and the MAC address)
+ */
+void usbd_descriptors_initialize()
+{
+	uint32_t const *unique_id = (uint32_t const *)UID_BASE;
+
+	// Eight digits per 32-bit word, the most significant digit first
+	for (uint8_t i = 0; i < SERIAL_NUMBER_LENGTH; i++) {
+		serial_number_descriptor.bString[i] = hexadecimal_digit((unique_id[i / 8] >> (28 - 4 * (i % 8))) & 0x0F);
+	}
+
+	serial_number_descriptor.bLength = sizeof(serial_number_descriptor);
+	serial_number_descriptor.bDescriptorType = USB_DESCRIPTOR_TYPE_STRING;
+
+#if USBD_NCM_ENABLED
+	// The first byte marks a locally administered unicast address, the 12 bytes of the ID are folded into the rest
+	uint8_t mac_address[MAC_ADDRESS_LENGTH / 2] = { 0x02 };
+	uint8_t const *unique_id_bytes = (uint8_t const *)UID_BASE;
+
+	for (uint8_t i = 0; i < 12; i++) {
+		mac_address[1 + i % 5] ^= unique_id_bytes[i];
+	}
+
+	for (uint8_t i = 0; i < MAC_ADDRESS_LENGTH; i++) {
+		mac_address_descriptor.bString[i] = hexadecimal_digit((mac_address[i / 2] >> (i % 2 ? 0 : 4)) & 0x0F);
+	}
+
+	mac_address_descriptor.bLength = sizeof(mac_address_descriptor);
+	mac_address_descriptor.bDescriptorType = USB_DESCRIPTOR_TYPE_STRING;
+#endif
+}
+
+/**
+ * @brief Find a descriptor
+ * @param descriptor_type The type of the descriptor (the high byte of wValue)
+ * @param descriptor_index The index of the descriptor (the low byte of wValue)
+ * @param descriptor Set to the descriptor
+ * @param length Set to the size of the descriptor in bytes
+ * @return Non-zero when the descriptor exists
+ */
+uint8_t usbd_get_descriptor(uint8_t descriptor_type, uint8_t descriptor_index, void const **descriptor, uint16_t *length)
+{
+	if (descriptor_type > USB_DESCRIPTOR_TYPE_BOS || descriptor_index >= descriptors_by_type[descriptor_type].count) {
+		return 0;
+	}
+
+#if USBD_DFU_ENABLED
+	if (usbd_dfu_mode_active() && descriptor_type == USB_DESCRIPTOR_TYPE_DEVICE) {
+		*descriptor = &dfu_mode_descriptors.device;
+		*length = sizeof(dfu_mode_descriptors.device);
+		return 1;
+	}
+
+	if (usbd_dfu_mode_active() && descriptor_type == USB_DESCRIPTOR_TYPE_CONFIGURATION) {
+		*descriptor = &dfu_mode_descriptors.configuration;
+		*length = sizeof(dfu_mode_descriptors.configuration);
+		return 1;
+	}
+#endif
+
+	UsbDescriptorLocation const *location = &descriptors_by_type[descriptor_type].locations[descriptor_index];
+
+	if (descriptor_type == USB_DESCRIPTOR_TYPE_STRING &&
+		descriptor_index < sizeof(ram_string_descriptors) / sizeof(ram_string_descriptors[0]) &&
+		ram_string_descriptors[descriptor_index]) {
+		*descriptor = ram_string_descriptors[descriptor_index];
+		*length = location->length;
+		return 1;
+	}
+
+	*descriptor = (uint8_t const *)&descriptor_set + location->offset;
+	*length = location->length;
+	return 1;
+}
+
+/**
+ * \brief The class descriptors read by GET_DESCRIPTOR with the interface recipient (e.g. the HID report descriptor)
+ * \details One per interface, by interface number.
+ */
+static struct
+{
+	void const *descriptor;
+	uint16_t length;
+	uint8_t type;
+} interface_descriptors[USBD_MAX_INTERFACE_COUNT];
+
+/**
+ * @brief Register the class descriptor of an interface
+ * @param descriptor The descriptor (must stay valid)
+ * @note Called by the functions when they are initialized.
+ */
+void usbd_register_interface_descriptor(uint8_t interface_number, uint8_t descriptor_type, void const *descriptor, uint16_t length)
+{
+	if (interface_number < USBD_MAX_INTERFACE_COUNT) {
+		interface_descriptors[interface_number].descriptor = descriptor;
+		interface_descriptors[interface_number].length = length;
+		interface_descriptors[interface_number].type = descriptor_type;
+	}
+}
+
+/**
+ * @brief Find the class descriptor of an interface
+ * @return Non-zero when the interface has a descriptor of that type
+ */
+uint8_t usbd_get_interface_descriptor(uint8_t interface_number, uint8_t descriptor_type, void const **descriptor, uint16_t *length)
+{
+	if (interface_number >= USBD_MAX_INTERFACE_COUNT || !interface_descriptors[interface_number].descriptor ||
+		interface_descriptors[interface_number].type != descriptor_type) {
+		return 0;
+	}
+
+	*descriptor = interface_descriptors[interface_number].descriptor;
+	*length = interface_descriptors[interface_number].length;
+	return 1;
+}
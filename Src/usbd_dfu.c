@@ -0,0 +1,586 @@
+/*
+ * usbd_dfu.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_dfu.h"
+#include "usbd_config.h"
+
+#if USBD_DFU_ENABLED
+
+#include <string.h>
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+#include "usbd_requests.h"
+#include "Helpers/cycle_counter.h"
+#include "Helpers/flash.h"
+#include "Helpers/flash_disk.h"
+#include "Helpers/math.h"
+
+/*
+ * The application announces the runtime interface. DETACH makes it reset into DFU mode, where the
+ * device is the DFU interface alone (see usbd_framework.c and usbd_descriptors.c), until a bus reset
+ * after the download brings the application back. The mode is a word of the CCM RAM, which the
+ * startup code does not clear, so it survives the reset.
+ *
+ * The firmware is downloaded into a slot of bank 2, which is erased and programmed while the code
+ * keeps running from bank 1, and is left there for the boot loader. The flash is slow next to the
+ * bus: a block of 2 KB takes 8 ms to program, a sector of 128 KB takes 1 s to erase. So the USB
+ * interrupt only queues the blocks, and usbd_dfu_process() writes them from the main loop while the
+ * host sends the next ones:
+ *  - a block is done for the host as soon as it is queued, GETSTATUS reports dfuDNBUSY only while
+ *    both buffers are full, with the time the flash still needs to free one as bwPollTimeout,
+ *  - while no block waits, the sector after the one the download has reached is erased ahead,
+ *  - an error of the flash is reported by the next GETSTATUS.
+ * The flash has a single controller, so the erases and the programming take turns: it is the
+ * transfers of the host that overlap with them.
+ */
+
+/** \name Typical flash timings at a parallelism of 32 bits (from the datasheet)
+ *@{*/
+#define WORD_PROGRAM_TIME_US 16
+#define ERASE_16K_TIME_US 250000
+#define ERASE_64K_TIME_US 550000
+#define ERASE_128K_TIME_US 1000000
+/**@}*/
+
+/// \brief Words programmed between two updates of the progress seen by GETSTATUS (about 0.5 ms)
+#define PROGRAM_CHUNK_WORDS 32
+
+/// \brief Time left to the status stage of DETACH before the reset
+#define DETACH_DELAY_MS 10
+
+/// \brief The value of `dfu_mode_word` while the firmware runs in DFU mode
+#define DFU_MODE_MAGIC 0x4D554644 /* "DFUM" */
+
+#define BLOCK_COUNT 2
+#define BLOCK_WORDS (USBD_DFU_TRANSFER_SIZE / 4)
+
+_Static_assert(USBD_DFU_TRANSFER_SIZE % 4 == 0, "The blocks are programmed a word at a time");
+_Static_assert(USBD_DFU_TRANSFER_SIZE <= USBD_CONTROL_OUT_MAX_SIZE, "A block must fit the data stage of a control request");
+_Static_assert(USBD_DFU_FIRST_SECTOR >= FLASH_BANK2_FIRST_SECTOR && USBD_DFU_SECTOR_COUNT > 0 &&
+	USBD_DFU_FIRST_SECTOR + USBD_DFU_SECTOR_COUNT <= FLASH_SECTOR_COUNT, "The slot must be in bank 2, the firmware runs from bank 1");
+#if USBD_MSC_ENABLED && USBD_MSC_LUN_COUNT > 1
+_Static_assert(USBD_DFU_FIRST_SECTOR + USBD_DFU_SECTOR_COUNT <= FLASH_DISK_FIRST_SECTOR ||
+	USBD_DFU_FIRST_SECTOR >= FLASH_DISK_FIRST_SECTOR + FLASH_DISK_SECTOR_COUNT, "The slot must not overlap the flash disk");
+#endif
+
+/** \brief A block of the download, queued for the flash */
+typedef struct
+{
+	uint32_t offset; /**<\brief Where the block goes, from the start of the slot */
+	uint32_t size;
+	uint32_t data[BLOCK_WORDS];
+} DfuBlock;
+
+static DfuBlock blocks[BLOCK_COUNT];
+
+/// \brief Counts of blocks queued by the USB interrupt and written by the main loop, block n is `blocks[n % BLOCK_COUNT]`
+static volatile uint32_t queued_count;
+static volatile uint32_t written_count;
+/// \brief Words of the oldest queued block programmed so far
+static volatile uint32_t programmed_words;
+/// \brief Sectors of the slot erased for the download, the next one is being erased since `erase_start` while `erasing`
+static volatile uint8_t erased_sectors;
+static volatile uint8_t erasing;
+static volatile uint32_t erase_start;
+/// \brief The first error of the flash (a DFU status), reported by the next GETSTATUS
+static volatile uint8_t flash_status;
+
+/// \brief Counts the downloads, the main loop starts over with the whole slot to erase when it changes
+static volatile uint8_t download_session;
+/// \brief The host is downloading, so the main loop may erase ahead of the blocks
+static volatile uint8_t downloading;
+/// \brief Where the next block of DNLOAD or UPLOAD goes in the slot
+static volatile uint32_t transfer_offset;
+/// \brief The stack pointer and the reset handler of the downloaded firmware
+static uint32_t firmware_vectors[2];
+
+static uint32_t slot_address;
+static uint32_t slot_size;
+
+static uint8_t state;
+static uint8_t status;
+static UsbDfuStatus status_response;
+/// \brief The host has used the DFU mode, so the next bus reset returns to the application
+static uint8_t dfu_used;
+/// \brief DETACH was received (at `detach_time`), the main loop resets into DFU mode
+static volatile uint8_t detaching;
+static volatile uint32_t detach_time;
+
+/// \brief \ref DFU_MODE_MAGIC in DFU mode (in the CCM RAM that is neither loaded nor cleared at startup)
+static uint32_t dfu_mode_word __attribute__((section(".ccmbss")));
+
+/**
+ * @brief Return non-zero when the firmware runs in DFU mode
+ */
+uint8_t usbd_dfu_mode_active()
+{
+	return dfu_mode_word == DFU_MODE_MAGIC;
+}
+
+/**
+ * @brief Restart the firmware in DFU mode or in the application (the host sees the device detach)
+ */
+static void restart(uint8_t dfu_mode)
+{
+	dfu_mode_word = dfu_mode ? DFU_MODE_MAGIC : 0;
+	usb_driver.disconnect();
+	NVIC_SystemReset();
+}
+
+/**
+ * @brief Return the typical time to erase a sector of the slot
+ * @param index The index of the sector in the slot
+ */
+static uint32_t erase_time_us(uint8_t index)
+{
+	uint32_t size = flash_sector_size(USBD_DFU_FIRST_SECTOR + index);
+
+	return size == 0x4000 ? ERASE_16K_TIME_US : size == 0x10000 ? ERASE_64K_TIME_US : ERASE_128K_TIME_US;
+}
+
+/**
+ * @brief Return the end of the first sectors of the slot, as an offset from the start of the slot
+ */
+static uint32_t erased_end(uint8_t sector_count)
+{
+	if (sector_count == 0) {
+		return 0;
+	}
+
+	uint8_t sector = USBD_DFU_FIRST_SECTOR + sector_count - 1;
+
+	return flash_sector_address(sector) + flash_sector_size(sector) - slot_address;
+}
+
+/**
+ * @brief Estimate the time the flash needs to write the oldest queued blocks, from the work left
+ * @param block_count The count of blocks to write (from the oldest one)
+ * @return Milliseconds, rounded up
+ */
+static uint32_t remaining_work_ms(uint32_t block_count)
+{
+	uint32_t microseconds = 0;
+	uint8_t sectors = erased_sectors;
+	uint32_t first = written_count;
+
+	// The erase in progress goes first, whether the blocks need it or not
+	if (erasing) {
+		uint32_t elapsed = (cycle_counter_read() - erase_start) / (SystemCoreClock / 1000000);
+
+		microseconds += erase_time_us(sectors) - MIN(elapsed, erase_time_us(sectors));
+		sectors++;
+	}
+
+	block_count = MIN(block_count, queued_count - first);
+
+	for (uint32_t i = 0; i < block_count; i++) {
+		DfuBlock const *block = &blocks[(first + i) % BLOCK_COUNT];
+
+		while (sectors < USBD_DFU_SECTOR_COUNT && erased_end(sectors) < block->offset + block->size) {
+			microseconds += erase_time_us(sectors);
+			sectors++;
+		}
+
+		microseconds += ((block->size + 3) / 4 - (i == 0 ? programmed_words : 0)) * WORD_PROGRAM_TIME_US;
+	}
+
+	return (microseconds + 999) / 1000;
+}
+
+/**
+ * @brief Check that the downloaded firmware starts with a plausible vector table
+ * @details The firmware is linked to run from bank 1, with its stack in the RAM or in the CCM RAM.
+ */
+static uint8_t is_firmware_valid()
+{
+	uint32_t stack_pointer = firmware_vectors[0];
+	uint32_t reset_handler = firmware_vectors[1];
+
+	uint8_t stack_in_ram = (stack_pointer > SRAM1_BASE && stack_pointer <= SRAM1_BASE + 0x30000) ||
+		(stack_pointer > CCMDATARAM_BASE && stack_pointer <= CCMDATARAM_BASE + 0x10000);
+
+	return stack_in_ram && (reset_handler & 1) && reset_handler >= FLASH_BASE && reset_handler < FLASH_BASE + 0x100000;
+}
+
+/**
+ * @brief Enter the error state (the request is stalled)
+ * @return 0, to stall the request
+ */
+static uint8_t fail(uint8_t error_status)
+{
+	state = USB_DFU_STATE_ERROR;
+	status = error_status;
+	downloading = 0;
+	return 0;
+}
+
+static uint8_t detach_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if (state != USB_DFU_STATE_APP_IDLE) {
+		return 0;
+	}
+
+	// The device detaches itself (wDetachTimeOut does not matter)
+	state = USB_DFU_STATE_APP_DETACH;
+	detach_time = cycle_counter_read();
+	detaching = 1;
+	return 1;
+}
+
+/**
+ * @brief Queue a block of the firmware, or end the download with a zero-length one
+ * @details The block is received straight into a free buffer, which GETSTATUS has promised.
+ */
+static uint8_t dnload_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	dfu_used = 1;
+
+	if (state != USB_DFU_STATE_IDLE && state != USB_DFU_STATE_DNLOAD_IDLE) {
+		return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+	}
+
+	if (request->wLength == 0) {
+		if (state == USB_DFU_STATE_IDLE) {
+			return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+		}
+
+		downloading = 0;
+		state = USB_DFU_STATE_MANIFEST_SYNC;
+		return 1;
+	}
+
+	DfuBlock *block = &blocks[queued_count % BLOCK_COUNT];
+
+	if (usb_device->control_transfer_stage == USB_CONTROL_STAGE_SETUP) {
+		if (state == USB_DFU_STATE_IDLE) {
+			// The blocks of an aborted download are still being written
+			if (queued_count != written_count) {
+				return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+			}
+
+			firmware_vectors[0] = 0;
+			firmware_vectors[1] = 0;
+			transfer_offset = 0;
+			download_session++;
+			downloading = 1;
+		}
+
+		if (request->wLength > USBD_DFU_TRANSFER_SIZE || queued_count - written_count == BLOCK_COUNT) {
+			return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+		}
+
+		// Only the last block may be shorter than a word
+		if (transfer_offset % 4 != 0 || request->wLength > slot_size - transfer_offset) {
+			return fail(USB_DFU_STATUS_ERR_ADDRESS);
+		}
+
+		usb_device->ptr_control_out_data = block->data;
+		return 1;
+	}
+
+	block->offset = transfer_offset;
+	block->size = usb_device->out_data_size;
+
+	// The rest of the last word stays erased
+	memset((uint8_t *)block->data + block->size, 0xFF, (4 - block->size % 4) % 4);
+
+	if (block->offset == 0 && block->size >= sizeof(firmware_vectors)) {
+		memcpy(firmware_vectors, block->data, sizeof(firmware_vectors));
+	}
+
+	transfer_offset += block->size;
+	queued_count++;
+	state = USB_DFU_STATE_DNLOAD_SYNC;
+	return 1;
+}
+
+/**
+ * @brief Send a block of the slot straight from the flash, a short block ends the upload
+ */
+static uint8_t upload_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	dfu_used = 1;
+
+	if (state != USB_DFU_STATE_IDLE && state != USB_DFU_STATE_UPLOAD_IDLE) {
+		return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+	}
+
+	// The blocks of an aborted download are still being written, or a sector is being erased: the slot would read torn
+	if (erasing || queued_count != written_count) {
+		return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+	}
+
+	if (state == USB_DFU_STATE_IDLE) {
+		transfer_offset = 0;
+	}
+
+	uint32_t size = MIN(request->wLength, slot_size - transfer_offset);
+
+	usb_device->ptr_in_buffer = (void const *)(slot_address + transfer_offset);
+	usb_device->in_data_size = size;
+	transfer_offset += size;
+	state = size < request->wLength ? USB_DFU_STATE_IDLE : USB_DFU_STATE_UPLOAD_IDLE;
+	return 1;
+}
+
+/**
+ * @brief Report the state, and move the download on: the synchronization states end here
+ */
+static uint8_t get_status_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	uint32_t poll_timeout = 0;
+
+	dfu_used = 1;
+
+	if (status == USB_DFU_STATUS_OK && flash_status != USB_DFU_STATUS_OK) {
+		fail(flash_status);
+	}
+
+	switch (state)
+	{
+	case USB_DFU_STATE_DNLOAD_SYNC:
+	case USB_DFU_STATE_DNBUSY:
+		if (queued_count - written_count < BLOCK_COUNT) {
+			state = USB_DFU_STATE_DNLOAD_IDLE;
+		} else {
+			state = USB_DFU_STATE_DNBUSY;
+			poll_timeout = MAX(remaining_work_ms(1), 1);
+		}
+		break;
+	case USB_DFU_STATE_MANIFEST_SYNC:
+	case USB_DFU_STATE_MANIFEST:
+		// An erase ahead of the blocks may still run, but the firmware is complete
+		if (queued_count != written_count) {
+			state = USB_DFU_STATE_MANIFEST;
+			poll_timeout = MAX(remaining_work_ms(BLOCK_COUNT), 1);
+		} else if (!is_firmware_valid()) {
+			fail(USB_DFU_STATUS_ERR_FIRMWARE);
+		} else {
+			state = USB_DFU_STATE_IDLE;
+		}
+		break;
+	}
+
+	status_response = (UsbDfuStatus){
+		.bStatus = status,
+		.bwPollTimeout = { poll_timeout & 0xFF, (poll_timeout >> 8) & 0xFF, (poll_timeout >> 16) & 0xFF },
+		.bState = state,
+		.iString = 0
+	};
+
+	usb_device->ptr_in_buffer = &status_response;
+	usb_device->in_data_size = sizeof(status_response);
+	return 1;
+}
+
+static uint8_t clear_status_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if (state != USB_DFU_STATE_ERROR) {
+		return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+	}
+
+	flash_status = USB_DFU_STATUS_OK;
+	status = USB_DFU_STATUS_OK;
+	state = USB_DFU_STATE_IDLE;
+	return 1;
+}
+
+static uint8_t get_state_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	usb_device->ptr_in_buffer = &state;
+	usb_device->in_data_size = 1;
+	return 1;
+}
+
+/**
+ * @brief Return to the idle state (the queued blocks are still written)
+ */
+static uint8_t abort_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	switch (state)
+	{
+	case USB_DFU_STATE_IDLE:
+	case USB_DFU_STATE_DNLOAD_SYNC:
+	case USB_DFU_STATE_DNLOAD_IDLE:
+	case USB_DFU_STATE_MANIFEST_SYNC:
+	case USB_DFU_STATE_UPLOAD_IDLE:
+		downloading = 0;
+		state = USB_DFU_STATE_IDLE;
+		return 1;
+	default:
+		return fail(USB_DFU_STATUS_ERR_STALLEDPKT);
+	}
+}
+
+static UsbRequestHandler const runtime_request_handlers[] = {
+	[USB_DFU_REQUEST_DETACH] = &detach_handler,
+	[USB_DFU_REQUEST_GETSTATUS] = &get_status_handler,
+	[USB_DFU_REQUEST_GETSTATE] = &get_state_handler
+};
+
+static UsbRequestHandlers const runtime_requests = {
+	.first_request = USB_DFU_REQUEST_DETACH,
+	.request_count = sizeof(runtime_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = runtime_request_handlers
+};
+
+static UsbRequestHandler const dfu_mode_request_handlers[] = {
+	[USB_DFU_REQUEST_DNLOAD] = &dnload_handler,
+	[USB_DFU_REQUEST_UPLOAD] = &upload_handler,
+	[USB_DFU_REQUEST_GETSTATUS] = &get_status_handler,
+	[USB_DFU_REQUEST_CLRSTATUS] = &clear_status_handler,
+	[USB_DFU_REQUEST_GETSTATE] = &get_state_handler,
+	[USB_DFU_REQUEST_ABORT] = &abort_handler
+};
+
+static UsbRequestHandlers const dfu_mode_requests = {
+	.first_request = USB_DFU_REQUEST_DETACH,
+	.request_count = sizeof(dfu_mode_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = dfu_mode_request_handlers
+};
+
+/**
+ * @brief Register the requests of the runtime interface, or of the only interface in DFU mode
+ */
+void usbd_dfu_initialize()
+{
+	uint8_t last_sector = USBD_DFU_FIRST_SECTOR + USBD_DFU_SECTOR_COUNT - 1;
+
+	slot_address = flash_sector_address(USBD_DFU_FIRST_SECTOR);
+	slot_size = flash_sector_address(last_sector) + flash_sector_size(last_sector) - slot_address;
+	cycle_counter_initialize();
+
+	if (usbd_dfu_mode_active()) {
+		state = USB_DFU_STATE_IDLE;
+		usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE, 0,
+			&dfu_mode_requests);
+	} else {
+		state = USB_DFU_STATE_APP_IDLE;
+		usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE,
+			USBD_INTERFACE_DFU, &runtime_requests);
+	}
+}
+
+/**
+ * @brief Enter DFU mode after DETACH, or leave it once the host is done (called on each bus reset)
+ * @note The host resets the device to enumerate it in DFU mode, so only a later reset leaves it.
+ */
+void usbd_dfu_reset_received()
+{
+	if (state == USB_DFU_STATE_APP_DETACH) {
+		restart(1);
+	} else if (usbd_dfu_mode_active() && dfu_used) {
+		restart(0);
+	}
+}
+
+/**
+ * @brief Start erasing the next sector of the slot
+ */
+static void start_erase()
+{
+	flash_unlock();
+	erase_start = cycle_counter_read();
+	erasing = 1;
+	flash_start_erase(USBD_DFU_FIRST_SECTOR + erased_sectors);
+}
+
+static void finish_erase()
+{
+	if (flash_finish()) {
+		erased_sectors++;
+	} else if (flash_status == USB_DFU_STATUS_OK) {
+		flash_status = USB_DFU_STATUS_ERR_ERASE;
+	}
+
+	erasing = 0;
+}
+
+/**
+ * @brief Program a block a chunk at a time, so GETSTATUS sees the progress, and read it back
+ */
+static void write_block(DfuBlock const *block)
+{
+	uint32_t address = slot_address + block->offset;
+	uint32_t word_count = (block->size + 3) / 4;
+
+	flash_unlock();
+
+	while (programmed_words < word_count) {
+		uint32_t count = MIN(word_count - programmed_words, PROGRAM_CHUNK_WORDS);
+
+		if (!flash_program(address + programmed_words * 4, &block->data[programmed_words], count)) {
+			flash_status = USB_DFU_STATUS_ERR_PROG;
+			return;
+		}
+
+		programmed_words += count;
+	}
+
+	if (memcmp((void const *)address, block->data, word_count * 4) != 0) {
+		flash_status = USB_DFU_STATUS_ERR_VERIFY;
+	}
+}
+
+/**
+ * @brief Write the queued blocks and erase ahead of them, or reset into DFU mode after DETACH
+ * @note Called from the main loop. It returns while the flash erases, the USB interrupt keeps running.
+ */
+void usbd_dfu_process()
+{
+	static uint8_t session;
+
+	if (detaching) {
+		if (cycle_counter_read() - detach_time >= DETACH_DELAY_MS * (SystemCoreClock / 1000)) {
+			restart(1);
+		}
+		return;
+	}
+
+	if (erasing) {
+		if (flash_is_busy()) {
+			return;
+		}
+
+		finish_erase();
+	}
+
+	// A new download erases the slot again
+	if (session != download_session) {
+		session = download_session;
+		erased_sectors = 0;
+	}
+
+	if (written_count != queued_count) {
+		DfuBlock const *block = &blocks[written_count % BLOCK_COUNT];
+
+		// After an error the rest of the download is dropped
+		if (flash_status == USB_DFU_STATUS_OK) {
+			if (erased_end(erased_sectors) < block->offset + block->size) {
+				start_erase();
+				return;
+			}
+
+			write_block(block);
+		}
+
+		programmed_words = 0;
+		written_count++;
+		return;
+	}
+
+	// Nothing to write: erase the sector after the one the download has reached
+	if (downloading && flash_status == USB_DFU_STATUS_OK && erased_sectors < USBD_DFU_SECTOR_COUNT &&
+		(erased_sectors == 0 || erased_end(erased_sectors - 1) <= transfer_offset)) {
+		start_erase();
+		return;
+	}
+
+	flash_lock();
+}
+
+#endif
@@ -6,9 +6,32 @@
  */
 
 #include "usbd_driver.h"
+#include "usbd_capture.h"
+#include "usbd_config.h"
+#include "usbd_statistics.h"
 #include "Helpers/logger.h"
+#include "Helpers/math.h"
 #include <strings.h>
 
+_Static_assert(USBD_EP0_MAX_PACKET_SIZE == 8 || USBD_EP0_MAX_PACKET_SIZE == 16 ||
+	USBD_EP0_MAX_PACKET_SIZE == 32 || USBD_EP0_MAX_PACKET_SIZE == 64, "Endpoint0 supports 8, 16, 32 or 64 bytes packets");
+_Static_assert(USBD_PERIODIC_FRAME_INTERVAL == 80 || USBD_PERIODIC_FRAME_INTERVAL == 85 ||
+	USBD_PERIODIC_FRAME_INTERVAL == 90 || USBD_PERIODIC_FRAME_INTERVAL == 95, "The periodic frame interval is 80, 85, 90 or 95 percent");
+
+/// \brief A transfer on an IN endpoint, which may span many packets
+typedef struct
+{
+	uint8_t const *buffer; /**<\brief The next byte to be pushed into the TxFIFO. */
+	uint32_t pending_size; /**<\brief Count of bytes not yet programmed into the endpoint. */
+	uint32_t chunk_size; /**<\brief Count of bytes programmed into the endpoint but not yet pushed into the TxFIFO. */
+} UsbInTransfer;
+
+/// \brief The endpoint and the status of the RxFIFO entry currently being popped
+static uint8_t rx_endpoint_number;
+static uint8_t rx_packet_status;
+
+static UsbInTransfer in_transfers[ENDPOINT_COUNT];
+
 static void initialize_gpio_pins()
 {
 	// Enable the clock for GPIOB
@@ -38,10 +61,10 @@ static void initialize_core()
 		USB_OTG_GUSBCFG_FDMOD | USB_OTG_GUSBCFG_PHYSEL | _VAL2FLD(USB_OTG_GUSBCFG_TRDT, 0x09)
 	);
 
-	// Configure the device to run in full speed mode
+	// Configure the device to run in full speed mode, and raise the end of periodic frame late in the frame
 	MODIFY_REG(USB_OTG_HS_DEVICE->DCFG,
-		USB_OTG_DCFG_DSPD,
-		_VAL2FLD(USB_OTG_DCFG_DSPD, 0x03)
+		USB_OTG_DCFG_DSPD | USB_OTG_DCFG_PFIVL,
+		_VAL2FLD(USB_OTG_DCFG_DSPD, 0x03) | _VAL2FLD(USB_OTG_DCFG_PFIVL, (USBD_PERIODIC_FRAME_INTERVAL - 80) / 5)
 	);
 
 	// Enable VBUS sensing device
@@ -49,9 +72,10 @@ static void initialize_core()
 
 	// Unmask the main USB core interrupts
 	SET_BIT(USB_OTG_HS->GINTMSK,
-		USB_OTG_GINTMSK_USBRST | USB_OTG_GINTMSK_ENUMDNEM | USB_OTG_GINTMSK_SOFM |
+		USB_OTG_GINTMSK_USBRST | USB_OTG_GINTMSK_ENUMDNEM | USB_OTG_GINTMSK_SOFM | USB_OTG_GINTMSK_EOPFM |
 		USB_OTG_GINTMSK_USBSUSPM | USB_OTG_GINTMSK_WUIM | USB_OTG_GINTMSK_IEPINT |
-		USB_OTG_GINTMSK_OEPINT | USB_OTG_GINTMSK_RXFLVLM
+		USB_OTG_GINTMSK_OEPINT | USB_OTG_GINTMSK_RXFLVLM | USB_OTG_GINTMSK_IISOIXFRM |
+		USB_OTG_GINTMSK_PXFRM_IISOOXFRM
 	);
 
 	// Clear all pending core interrupts
@@ -60,9 +84,15 @@ static void initialize_core()
 	// Unmask USB global interrupt
 	SET_BIT(USB_OTG_HS->GAHBCFG, USB_OTG_GAHBCFG_GINT);
 
-	// Unmask transfer completed interrupts for all endpoints
-	SET_BIT(USB_OTG_HS_DEVICE->DOEPMSK, USB_OTG_DOEPMSK_XFRCM);
-	SET_BIT(USB_OTG_HS_DEVICE->DIEPMSK, USB_OTG_DIEPMSK_XFRCM);
+	// Unmask transfer completed and FIFO error interrupts for all endpoints
+	SET_BIT(USB_OTG_HS_DEVICE->DOEPMSK, USB_OTG_DOEPMSK_XFRCM | USB_OTG_DOEPMSK_OPEM);
+	SET_BIT(USB_OTG_HS_DEVICE->DIEPMSK, USB_OTG_DIEPMSK_XFRCM | USB_OTG_DIEPMSK_TXFURM);
+
+#if USBD_STATISTICS_COUNT_NAKS
+	// Unmask the interrupts raised when a token is answered with NAK
+	SET_BIT(USB_OTG_HS_DEVICE->DOEPMSK, USB_OTG_DOEPMSK_NAKM);
+	SET_BIT(USB_OTG_HS_DEVICE->DIEPMSK, USB_OTG_DIEPMSK_ITTXFEMSK);
+#endif
 }
 
 static void set_device_address(uint8_t address)
@@ -74,6 +104,29 @@ static void set_device_address(uint8_t address)
 	);
 }
 
+/**
+ * @brief Return the maximum packet size of an endpoint in bytes
+ * @param endpoint_ctl The content of the DIEPCTL or DOEPCTL register of the endpoint
+ * @param endpoint_number The number of the endpoint
+ */
+static uint16_t endpoint_max_packet_size(uint32_t endpoint_ctl, uint8_t endpoint_number)
+{
+	uint16_t mpsiz = _FLD2VAL(USB_OTG_DIEPCTL_MPSIZ, endpoint_ctl);
+
+	// Endpoint0 encodes its size: 0 = 64, 1 = 32, 2 = 16 and 3 = 8 bytes
+	return endpoint_number == 0 ? (64 >> (mpsiz & 0x03)) : mpsiz;
+}
+
+/**
+ * @brief Return the depth of the TxFIFO of an IN endpoint in 32-bit words
+ */
+static uint16_t txfifo_depth(uint8_t endpoint_number)
+{
+	return endpoint_number == 0
+		? _FLD2VAL(USB_OTG_TX0FD, USB_OTG_HS->DIEPTXF0_HNPTXFSIZ)
+		: _FLD2VAL(USB_OTG_NPTXFD, USB_OTG_HS->DIEPTXF[endpoint_number - 1]);
+}
+
 /**
  * Connect the USB device to the bus
  */
@@ -108,6 +161,9 @@ static void read_packet(void const *buffer, uint16_t size)
 	// Note: There is only one RxFIFO
 	__IO uint32_t *fifo = FIFO(0);
 
+	void const *packet = buffer;
+	uint16_t packet_size = size;
+
 	for (; size >= 4; size -= 4, buffer += 4)
 	{
 		// Pop one 32-bit word of data (until there is less than one word remaining)
@@ -127,31 +183,36 @@ static void read_packet(void const *buffer, uint16_t size)
 			*((uint8_t*)buffer) = 0xFF & data;
 		}
 	}
+
+	usbd_capture_packet(
+		rx_packet_status == 0x06 ? USBD_CAPTURE_EVENT_SETUP : USBD_CAPTURE_EVENT_OUT,
+		rx_endpoint_number,
+		_FLD2VAL(USB_OTG_DOEPCTL_EPTYP, OUT_ENDPOINT(rx_endpoint_number)->DOEPCTL),
+		packet, packet_size
+	);
 }
 
 
 /**
- * @brief Push a packet into the TxFIFO on an IN endpoint
+ * @brief Push a packet into the TxFIFO of an IN endpoint (the transfer must be programmed already)
  * @param endpoint_number The number of the endpoint, to which the data will be written
  * @param buffer Pointer to the buffer contains the data to be written to the endpoint
  * @param size The size of data to be written in bytes
  */
-static void write_packet(uint8_t endpoint_number, void const *buffer, uint16_t size)
+static void push_packet(uint8_t endpoint_number, void const *buffer, uint16_t size)
 {
 	__IO uint32_t *fifo = FIFO(endpoint_number);
 	USB_OTG_INEndpointTypeDef *in_endpoint = IN_ENDPOINT(endpoint_number);
 
-	// Configure the transmission (1 packet that has `size` bytes)
-	MODIFY_REG(in_endpoint->DIEPTSIZ,
-		USB_OTG_DIEPTSIZ_PKTCNT | USB_OTG_DIEPTSIZ_XFRSIZ,
-		_VAL2FLD(USB_OTG_DIEPTSIZ_PKTCNT, 1) | _VAL2FLD(USB_OTG_DIEPTSIZ_XFRSIZ, size)
-	);
+	usbd_capture_packet(USBD_CAPTURE_EVENT_IN, 0x80 | endpoint_number,
+		_FLD2VAL(USB_OTG_DIEPCTL_EPTYP, in_endpoint->DIEPCTL), buffer, size);
 
-	// Enable the transmission after clearing both STALL and NAK of the endpoint
-	MODIFY_REG(in_endpoint->DIEPCTL,
-		USB_OTG_DIEPCTL_STALL,
-		USB_OTG_DIEPCTL_CNAK | USB_OTG_DIEPCTL_EPENA
-	);
+	UsbEndpointStatistics *statistics = &usbd_statistics.in_endpoints[endpoint_number];
+	statistics->packets++;
+	statistics->bytes += size;
+	if (size < endpoint_max_packet_size(in_endpoint->DIEPCTL, endpoint_number)) {
+		statistics->short_packets++;
+	}
 
 	// Get the size in term of 32-bit words (to avoid integer overflow in the loop)
 	size = (size + 3) / 4;
@@ -161,75 +222,137 @@ static void write_packet(uint8_t endpoint_number, void const *buffer, uint16_t s
 		// Push the data to the TxFIFO
 		*fifo = *((uint32_t*)buffer);
 	}
+
+	uint16_t fifo_fill = (txfifo_depth(endpoint_number) - _FLD2VAL(USB_OTG_DTXFSTS_INEPTFSAV, in_endpoint->DTXFSTS)) * 4;
+	if (fifo_fill > statistics->max_fifo_fill) {
+		statistics->max_fifo_fill = fifo_fill;
+	}
 }
 
 /**
- * @brief Update the start addresses of all FIFOs according to the size of each FIFO
+ * @brief Send a single packet on an IN endpoint
+ * @param endpoint_number The number of the endpoint, to which the data will be written
+ * @param buffer Pointer to the buffer contains the data to be written to the endpoint
+ * @param size The size of data to be written in bytes (at most the maximum packet size)
  */
-static void refresh_fifo_start_addresses()
+static void write_packet(uint8_t endpoint_number, void const *buffer, uint16_t size)
 {
-	// The first changeable start address begins after the region of RxFIFO
-	uint16_t start_address = _FLD2VAL(USB_OTG_GRXFSIZ_RXFD, USB_OTG_HS->GRXFSIZ) * 4;
+	USB_OTG_INEndpointTypeDef *in_endpoint = IN_ENDPOINT(endpoint_number);
 
-	// Update the start address of the FIFO0
-	MODIFY_REG(USB_OTG_HS->DIEPTXF0_HNPTXFSIZ,
-		USB_OTG_TX0FSA,
-		_VAL2FLD(USB_OTG_TX0FSA, start_address)
+	// Configure the transmission (1 packet that has `size` bytes)
+	MODIFY_REG(in_endpoint->DIEPTSIZ,
+		USB_OTG_DIEPTSIZ_PKTCNT | USB_OTG_DIEPTSIZ_XFRSIZ,
+		_VAL2FLD(USB_OTG_DIEPTSIZ_PKTCNT, 1) | _VAL2FLD(USB_OTG_DIEPTSIZ_XFRSIZ, size)
 	);
 
-	// The next start address is after where the last TxFIFO ends
-	start_address += _FLD2VAL(USB_OTG_TX0FD, USB_OTG_HS->DIEPTXF0_HNPTXFSIZ) * 4;
+	// Enable the transmission after clearing both STALL and NAK of the endpoint
+	MODIFY_REG(in_endpoint->DIEPCTL,
+		USB_OTG_DIEPCTL_STALL,
+		USB_OTG_DIEPCTL_CNAK | USB_OTG_DIEPCTL_EPENA
+	);
 
-	// Update the start addresses of the rest TxFOFOs
-	for (uint8_t txfifo_number = 0; txfifo_number < ENDPOINT_COUNT - 1; txfifo_number++) {
-		MODIFY_REG(USB_OTG_HS->DIEPTXF[txfifo_number],
-			USB_OTG_NPTXFSA,
-			_VAL2FLD(USB_OTG_NPTXFSA, start_address)
-		);
+	push_packet(endpoint_number, buffer, size);
+}
+
+/**
+ * @brief Push the packets of the programmed transfer while they fit in the TxFIFO
+ * @note When the TxFIFO is full, the TxFIFO empty interrupt is unmasked to push the rest later.
+ */
+static void fill_txfifo(uint8_t endpoint_number)
+{
+	UsbInTransfer *transfer = &in_transfers[endpoint_number];
+	USB_OTG_INEndpointTypeDef *in_endpoint = IN_ENDPOINT(endpoint_number);
+	uint16_t max_packet_size = endpoint_max_packet_size(in_endpoint->DIEPCTL, endpoint_number);
 
-		start_address += _FLD2VAL(USB_OTG_NPTXFD, USB_OTG_HS->DIEPTXF[txfifo_number]) * 4;
+	while (transfer->chunk_size > 0) {
+		uint16_t packet_size = MIN(transfer->chunk_size, max_packet_size);
+
+		if (_FLD2VAL(USB_OTG_DTXFSTS_INEPTFSAV, in_endpoint->DTXFSTS) < (uint32_t)(packet_size + 3) / 4) {
+			SET_BIT(USB_OTG_HS_DEVICE->DIEPEMPMSK, 1 << endpoint_number);
+			return;
+		}
+
+		push_packet(endpoint_number, transfer->buffer, packet_size);
+		transfer->buffer += packet_size;
+		transfer->chunk_size -= packet_size;
 	}
+
+	CLEAR_BIT(USB_OTG_HS_DEVICE->DIEPEMPMSK, 1 << endpoint_number);
 }
 
-/*
- * @brief Configure the RxFIFO of OUT endpoints
- * @param size The size of the largest OUT endpoint in bytes
- * @note The RxFIFO is shared between all OUT endpoints
+/**
+ * @brief Return the DIEPCTL bit that selects the parity of the next (micro)frame
  */
-static void configure_rxfifo_size(uint16_t size)
+static uint32_t next_frame_parity()
 {
-	// Consider the space required to save status packets in RxFIFO and get the size in term of 32-bit words
-	size = 10 + (2 * ((size / 4) + 1));
+	return (_FLD2VAL(USB_OTG_DSTS_FNSOF, USB_OTG_HS_DEVICE->DSTS) & 1)
+		? USB_OTG_DIEPCTL_SD0PID_SEVNFRM
+		: USB_OTG_DIEPCTL_SODDFRM;
+}
 
-	// Configure the depth of the FIFO
-	MODIFY_REG(USB_OTG_HS->GRXFSIZ,
-		USB_OTG_GRXFSIZ_RXFD,
-		_VAL2FLD(USB_OTG_GRXFSIZ_RXFD, size)
+/**
+ * @brief Program the next part of the transfer into an IN endpoint and start pushing its packets
+ */
+static void start_in_chunk(uint8_t endpoint_number)
+{
+	UsbInTransfer *transfer = &in_transfers[endpoint_number];
+	USB_OTG_INEndpointTypeDef *in_endpoint = IN_ENDPOINT(endpoint_number);
+	uint16_t max_packet_size = endpoint_max_packet_size(in_endpoint->DIEPCTL, endpoint_number);
+
+	// The size of a programmed transfer is limited by the width of the PKTCNT and XFRSIZ fields,
+	// which are only 2 and 7 bits wide for endpoint0
+	uint32_t max_chunk_size = endpoint_number == 0
+		? MIN(3 * max_packet_size, 0x7F)
+		: MIN(0x3FF * max_packet_size, 0x7FFFF);
+	uint32_t chunk_size = transfer->pending_size;
+
+	if (chunk_size > max_chunk_size) {
+		// Only the last part of the transfer may end with a short packet
+		chunk_size = max_chunk_size - (max_chunk_size % max_packet_size);
+	}
+
+	uint16_t packet_count = chunk_size ? (chunk_size + max_packet_size - 1) / max_packet_size : 1;
+
+	MODIFY_REG(in_endpoint->DIEPTSIZ,
+		USB_OTG_DIEPTSIZ_PKTCNT | USB_OTG_DIEPTSIZ_XFRSIZ,
+		_VAL2FLD(USB_OTG_DIEPTSIZ_PKTCNT, packet_count) | _VAL2FLD(USB_OTG_DIEPTSIZ_XFRSIZ, chunk_size)
 	);
 
-	refresh_fifo_start_addresses();
+	if (_FLD2VAL(USB_OTG_DIEPCTL_EPTYP, in_endpoint->DIEPCTL) == USB_ENDPOINT_TYPE_ISOCHRONOUS) {
+		// One packet per frame, sent only in a frame of the programmed parity
+		MODIFY_REG(in_endpoint->DIEPTSIZ, USB_OTG_DIEPTSIZ_MULCNT, _VAL2FLD(USB_OTG_DIEPTSIZ_MULCNT, 1));
+		SET_BIT(in_endpoint->DIEPCTL, next_frame_parity());
+	}
+
+	// Enable the transmission after clearing both STALL and NAK of the endpoint
+	MODIFY_REG(in_endpoint->DIEPCTL,
+		USB_OTG_DIEPCTL_STALL,
+		USB_OTG_DIEPCTL_CNAK | USB_OTG_DIEPCTL_EPENA
+	);
+
+	transfer->pending_size -= chunk_size;
+	transfer->chunk_size = chunk_size;
+
+	// A zero-length packet is sent without pushing anything
+	fill_txfifo(endpoint_number);
 }
 
 /**
- * @brief Configure the TxFIFO of an IN endpoint
- * @param endpoint_number The number of the IN endpoint we want to configure its TxFIFO
- * @param size The size of the IN endpoint in bytes
- * @note Any change on any FIFO will update the registers of all TxFIFO to adapt start offsets
+ * @brief Send a buffer of any size on an IN endpoint as one transfer of many packets
+ * @param endpoint_number The number of the IN endpoint
+ * @param buffer Pointer to the data, which must stay valid until the transfer completes
+ * @param size The size of the data in bytes (0 sends a zero-length packet)
+ * @note The packets are pushed from the USB interrupt and `on_in_transfer_completed` is raised
+ * once, after the last packet is sent.
  */
-static void configure_txfifo_size(uint8_t endpoint_number, uint16_t size)
+static void start_in_transfer(uint8_t endpoint_number, void const *buffer, uint32_t size)
 {
-	// Get the FIFO size in term of 32-bit words
-	size = (size + 3) / 4;
+	UsbInTransfer *transfer = &in_transfers[endpoint_number];
 
-	// Configure the depth of the TxFIFO
-	if (endpoint_number == 0) {
-		MODIFY_REG(USB_OTG_HS->DIEPTXF0_HNPTXFSIZ,
-			USB_OTG_TX0FD,
-			_VAL2FLD(USB_OTG_TX0FD, size)
-		);
-	}
+	transfer->buffer = buffer;
+	transfer->pending_size = size;
 
-	refresh_fifo_start_addresses();
+	start_in_chunk(endpoint_number);
 }
 
 /**
@@ -253,41 +376,178 @@ static void flush_txfifo(uint8_t endpoint_number)
 	);
 }
 
+/**
+ * @brief Forget the transfer of a disabled IN endpoint and flush the data it left in its TxFIFO
+ */
+static void drop_in_transfer(uint8_t endpoint_number)
+{
+	CLEAR_BIT(USB_OTG_HS_DEVICE->DIEPEMPMSK, 1 << endpoint_number);
+	in_transfers[endpoint_number] = (UsbInTransfer){ 0 };
+	flush_txfifo(endpoint_number);
+
+	while (USB_OTG_HS->GRSTCTL & USB_OTG_GRSTCTL_TXFFLSH) {
+	}
+}
+
+/**
+ * @brief Set or clear the STALL handshake of an endpoint
+ * @param endpoint_address The endpoint number (bit 7 is set for IN endpoints)
+ * @param stall Stall the endpoint if non-zero, otherwise clear the stall (and reset the data toggle to DATA0)
+ * @note The core clears the STALL of endpoint0 when it receives a SETUP packet.
+ */
+static void set_endpoint_stall(uint8_t endpoint_address, uint8_t stall)
+{
+	uint8_t endpoint_number = endpoint_address & 0x0F;
+
+	if (endpoint_address & 0x80) {
+		USB_OTG_INEndpointTypeDef *in_endpoint = IN_ENDPOINT(endpoint_number);
+
+		if (stall) {
+			// Disable an enabled endpoint as well, so it drops the data waiting in the TxFIFO
+			SET_BIT(in_endpoint->DIEPCTL,
+				USB_OTG_DIEPCTL_STALL | ((in_endpoint->DIEPCTL & USB_OTG_DIEPCTL_EPENA) ? USB_OTG_DIEPCTL_EPDIS : 0)
+			);
+		} else if (endpoint_number != 0) {
+			if (in_endpoint->DIEPCTL & USB_OTG_DIEPCTL_STALL) {
+				// The halt disabled the endpoint, so the transfer it stopped is dropped
+				drop_in_transfer(endpoint_number);
+			} else if (in_endpoint->DIEPCTL & USB_OTG_DIEPCTL_EPENA) {
+				// A transfer is armed: it must be disabled before its data is flushed, or the endpoint keeps waiting for it
+				SET_BIT(in_endpoint->DIEPCTL, USB_OTG_DIEPCTL_SNAK | USB_OTG_DIEPCTL_EPDIS);
+				while (!(in_endpoint->DIEPINT & USB_OTG_DIEPINT_EPDISD)) {
+				}
+				WRITE_REG(in_endpoint->DIEPINT, USB_OTG_DIEPINT_EPDISD);
+				drop_in_transfer(endpoint_number);
+			}
+
+			// The next transfer starts with DATA0
+			MODIFY_REG(in_endpoint->DIEPCTL, USB_OTG_DIEPCTL_STALL, USB_OTG_DIEPCTL_SD0PID_SEVNFRM);
+		} else {
+			CLEAR_BIT(in_endpoint->DIEPCTL, USB_OTG_DIEPCTL_STALL);
+		}
+	} else {
+		if (stall) {
+			SET_BIT(OUT_ENDPOINT(endpoint_number)->DOEPCTL, USB_OTG_DOEPCTL_STALL);
+		} else if (endpoint_number != 0) {
+			// The host restarts the pipe with DATA0 after clearing the halt
+			MODIFY_REG(OUT_ENDPOINT(endpoint_number)->DOEPCTL, USB_OTG_DOEPCTL_STALL, USB_OTG_DOEPCTL_SD0PID_SEVNFRM);
+		} else {
+			CLEAR_BIT(OUT_ENDPOINT(endpoint_number)->DOEPCTL, USB_OTG_DOEPCTL_STALL);
+		}
+	}
+}
+
+/**
+ * @brief Arm an OUT endpoint to receive up to `size` bytes, as whole packets
+ * @param size Rounded down to a multiple of the maximum packet size (but at least one packet is armed)
+ * @note The packets are raised one by one by `on_out_data_received`, then `on_out_transfer_completed`
+ * is raised after the last packet or after a short packet. Until it is armed again, the endpoint
+ * answers the host with NAK, which is how a receiver holds off the host while its buffer is full.
+ */
+static void start_out_transfer(uint8_t endpoint_number, uint32_t size)
+{
+	USB_OTG_OUTEndpointTypeDef *out_endpoint = OUT_ENDPOINT(endpoint_number);
+	// Note: The MPSIZ of OUT endpoint0 is a read-only copy of the IN one
+	uint16_t max_packet_size = endpoint_max_packet_size(
+		endpoint_number == 0 ? IN_ENDPOINT(0)->DIEPCTL : out_endpoint->DOEPCTL, endpoint_number);
+
+	// The PKTCNT field is 10 bits wide (only 1 bit for endpoint0)
+	uint16_t packet_count = endpoint_number == 0 ? 1 : MIN(MAX(size / max_packet_size, 1), 0x3FF);
+
+	MODIFY_REG(out_endpoint->DOEPTSIZ,
+		USB_OTG_DOEPTSIZ_STUPCNT | USB_OTG_DOEPTSIZ_PKTCNT | USB_OTG_DOEPTSIZ_XFRSIZ,
+		_VAL2FLD(USB_OTG_DOEPTSIZ_STUPCNT, endpoint_number == 0 ? 3 : 0) | _VAL2FLD(USB_OTG_DOEPTSIZ_PKTCNT, packet_count) |
+		_VAL2FLD(USB_OTG_DOEPTSIZ_XFRSIZ, packet_count * max_packet_size)
+	);
+
+	if (_FLD2VAL(USB_OTG_DOEPCTL_EPTYP, out_endpoint->DOEPCTL) == USB_ENDPOINT_TYPE_ISOCHRONOUS) {
+		// Received only in a frame of the programmed parity (the bits are at the same positions as in DIEPCTL)
+		SET_BIT(out_endpoint->DOEPCTL, next_frame_parity());
+	}
+
+	// Clear NAK, and enable endpoint data transmission
+	SET_BIT(out_endpoint->DOEPCTL,
+		USB_OTG_DOEPCTL_EPENA | USB_OTG_DOEPCTL_CNAK
+	);
+}
+
+/**
+ * @brief Arm an OUT endpoint to receive the next data packet (and endpoint0 up to 3 back-to-back SETUP packets)
+ * @note Until it is armed again, the endpoint answers the host with NAK.
+ */
+static void enable_out_endpoint(uint8_t endpoint_number)
+{
+	start_out_transfer(endpoint_number, 0);
+}
+
+/**
+ * @brief Configure endpoint0 after the enumeration
+ * @param endpoint_size The maximum packet size of endpoint0 (8, 16, 32 or 64 bytes)
+ */
 static void configure_endpoint0(uint8_t endpoint_size)
 {
 	// Unmask all interrupts of IN and OUT endpoint0
 	SET_BIT(USB_OTG_HS_DEVICE->DAINTMSK, 1 << 0 | 1 << 16);
 
+	// Endpoint0 encodes its maximum packet size: 0 = 64, 1 = 32, 2 = 16 and 3 = 8 bytes
+	uint8_t mpsiz = ffs(64 / endpoint_size) - 1;
+
 	// Configure the maximum packet size, activate endpoint, and NAK the endpoint (cannot send data)
 	MODIFY_REG(IN_ENDPOINT(0)->DIEPCTL,
 		USB_OTG_DIEPCTL_MPSIZ,
-		USB_OTG_DIEPCTL_USBAEP | _VAL2FLD(USB_OTG_DIEPCTL_MPSIZ, endpoint_size) | USB_OTG_DIEPCTL_SNAK
+		USB_OTG_DIEPCTL_USBAEP | _VAL2FLD(USB_OTG_DIEPCTL_MPSIZ, mpsiz) | USB_OTG_DIEPCTL_SNAK
 	);
 
-	// Clear NAK, and enable endpoint data transmission
-	SET_BIT(OUT_ENDPOINT(0)->DOEPCTL,
-		USB_OTG_DOEPCTL_EPENA | USB_OTG_DOEPCTL_CNAK
-	);
+	enable_out_endpoint(0);
 
-	// Note: 64 bytes is the maximum packet size for full speed USB devices
-	configure_rxfifo_size(64);
-	configure_txfifo_size(0, endpoint_size);
+	// Place the RxFIFO (shared by endpoint0 and the OUT endpoints of the configuration) and the TxFIFO0
+	// as planned by the FIFO layout of the configuration, all in 32-bit words
+	MODIFY_REG(USB_OTG_HS->GRXFSIZ,
+		USB_OTG_GRXFSIZ_RXFD,
+		_VAL2FLD(USB_OTG_GRXFSIZ_RXFD, usbd_endpoint0_fifos.rxfifo_depth)
+	);
+	WRITE_REG(USB_OTG_HS->DIEPTXF0_HNPTXFSIZ,
+		_VAL2FLD(USB_OTG_TX0FSA, usbd_endpoint0_fifos.txfifo0_start) |
+		_VAL2FLD(USB_OTG_TX0FD, usbd_endpoint0_fifos.txfifo0_depth)
+	);
 }
 
-static void configure_in_endpoint(uint8_t endpoint_number, UsbEndpointType endpoint_type, uint16_t endpoint_size)
+/**
+ * @brief Activate an endpoint of the selected configuration
+ * @param activation The precomputed settings of the endpoint (including the location of its TxFIFO)
+ * @note OUT endpoints are armed to receive their first packet.
+ */
+static void activate_endpoint(UsbEndpointActivation const *activation)
 {
-	// Unmask all interrupts of the targeted IN endpoint
-	SET_BIT(USB_OTG_HS_DEVICE->DAINTMSK, 1 << endpoint_number);
+	uint8_t endpoint_number = activation->endpoint_address & 0x0F;
 
-	// Activate the endpoint, set endpoint handshake to NAK (not ready to send data), set DATA0 packet identifier,
-	// configure its type, its maximum packet size and assign it a TxFIFO
-	MODIFY_REG(IN_ENDPOINT(endpoint_number)->DIEPCTL,
-		USB_OTG_DIEPCTL_MPSIZ | USB_OTG_DIEPCTL_EPTYP | USB_OTG_DIEPCTL_TXFNUM,
-		USB_OTG_DIEPCTL_USBAEP | _VAL2FLD(USB_OTG_DIEPCTL_MPSIZ, endpoint_size) | USB_OTG_DIEPCTL_SNAK |
-		_VAL2FLD(USB_OTG_DIEPCTL_EPTYP, endpoint_type) | _VAL2FLD(USB_OTG_DIEPCTL_TXFNUM, endpoint_number) | USB_OTG_DIEPCTL_SD0PID_SEVNFRM
-	);
+	if (activation->endpoint_address & 0x80) {
+		// Place the TxFIFO (TxFIFO n belongs to IN endpoint n)
+		WRITE_REG(USB_OTG_HS->DIEPTXF[endpoint_number - 1],
+			_VAL2FLD(USB_OTG_NPTXFSA, activation->txfifo_start) | _VAL2FLD(USB_OTG_NPTXFD, activation->txfifo_depth)
+		);
+
+		// Activate the endpoint, clear its halt, set endpoint handshake to NAK (not ready to send data), set DATA0 packet identifier,
+		// configure its type, its maximum packet size and assign it its TxFIFO
+		MODIFY_REG(IN_ENDPOINT(endpoint_number)->DIEPCTL,
+			USB_OTG_DIEPCTL_MPSIZ | USB_OTG_DIEPCTL_EPTYP | USB_OTG_DIEPCTL_TXFNUM | USB_OTG_DIEPCTL_STALL,
+			USB_OTG_DIEPCTL_USBAEP | _VAL2FLD(USB_OTG_DIEPCTL_MPSIZ, activation->max_packet_size) | USB_OTG_DIEPCTL_SNAK |
+			_VAL2FLD(USB_OTG_DIEPCTL_EPTYP, activation->type) | _VAL2FLD(USB_OTG_DIEPCTL_TXFNUM, endpoint_number) |
+			USB_OTG_DIEPCTL_SD0PID_SEVNFRM
+		);
+
+		SET_BIT(USB_OTG_HS_DEVICE->DAINTMSK, 1 << endpoint_number);
+	} else {
+		MODIFY_REG(OUT_ENDPOINT(endpoint_number)->DOEPCTL,
+			USB_OTG_DOEPCTL_MPSIZ | USB_OTG_DOEPCTL_EPTYP | USB_OTG_DOEPCTL_STALL,
+			USB_OTG_DOEPCTL_USBAEP | _VAL2FLD(USB_OTG_DOEPCTL_MPSIZ, activation->max_packet_size) |
+			_VAL2FLD(USB_OTG_DOEPCTL_EPTYP, activation->type) | USB_OTG_DOEPCTL_SD0PID_SEVNFRM
+		);
 
-	configure_txfifo_size(endpoint_number, endpoint_size);
+		SET_BIT(USB_OTG_HS_DEVICE->DAINTMSK, 1 << 16 << endpoint_number);
+
+		enable_out_endpoint(endpoint_number);
+	}
 }
 
 static void deconfigure_endpoint(uint8_t endpoint_number)
@@ -299,6 +559,10 @@ static void deconfigure_endpoint(uint8_t endpoint_number)
 	CLEAR_BIT(USB_OTG_HS_DEVICE->DAINTMSK,
 		(1 << endpoint_number) | (1 << 16 << endpoint_number)
 	);
+	CLEAR_BIT(USB_OTG_HS_DEVICE->DIEPEMPMSK, 1 << endpoint_number);
+
+	// Drop the transfer in progress
+	in_transfers[endpoint_number] = (UsbInTransfer){ 0 };
 
 	// Clear all interrupt of the endpoint
 	SET_BIT(in_endpoint->DIEPINT, 0x29FF);
@@ -325,26 +589,27 @@ static void deconfigure_endpoint(uint8_t endpoint_number)
 		CLEAR_BIT(out_endpoint->DOEPCTL, USB_OTG_DOEPCTL_USBAEP);
 	}
 
-	// Flush the FIFOs
+	// Flush the TxFIFO (the RxFIFO is shared, so the packets of the other endpoints are kept in it)
 	flush_txfifo(endpoint_number);
-	flush_rxfifo();
 }
 
 static void usbrst_handler()
 {
 	log_info("USB reset signal was detected");
 
-	for (uint8_t i = 0; i <= ENDPOINT_COUNT; i++) {
+	for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
 		deconfigure_endpoint(i);
 	}
 
+	flush_rxfifo();
+
 	usb_events.on_usb_reset_received();
 }
 
 static void enumdne_handler()
 {
 	log_info("USB device speed enumeration done");
-	configure_endpoint0(8);
+	configure_endpoint0(USBD_EP0_MAX_PACKET_SIZE);
 }
 
 static void rxflvl_handler()
@@ -355,31 +620,48 @@ static void rxflvl_handler()
 	// The endpoint that received the data
 	uint8_t endpoint_number = _FLD2VAL(USB_OTG_GRXSTSP_EPNUM, receive_status);
 	// The count of bytes in the received packet
-	uint8_t bcnt = _FLD2VAL(USB_OTG_GRXSTSP_BCNT, receive_status);
+	uint16_t bcnt = _FLD2VAL(USB_OTG_GRXSTSP_BCNT, receive_status);
 	// The status of the received packet
 	uint8_t pktsts = _FLD2VAL(USB_OTG_GRXSTSP_PKTSTS, receive_status);
 
+	rx_endpoint_number = endpoint_number;
+	rx_packet_status = pktsts;
+
+	if (pktsts == 0x06 || pktsts == 0x02) {
+		UsbEndpointStatistics *statistics = &usbd_statistics.out_endpoints[endpoint_number];
+		statistics->packets++;
+		statistics->bytes += bcnt;
+		if (bcnt < endpoint_max_packet_size(OUT_ENDPOINT(endpoint_number)->DOEPCTL, endpoint_number)) {
+			statistics->short_packets++;
+		}
+		if (bcnt > statistics->max_fifo_fill) {
+			statistics->max_fifo_fill = bcnt;
+		}
+	}
+
 	switch (pktsts)
 	{
 		case 0x06: // SETUP packet (includes data)
 			usb_events.on_setup_data_received(endpoint_number, bcnt);
 			break;
 		case 0x02: // OUT packet (includes data)
-			//TODO
+			usb_events.on_out_data_received(endpoint_number, bcnt);
 			break;
 		case 0x04: // SETUP stage has completed
 
 			// Re-enable the transmission on the endpoint
-			SET_BIT(OUT_ENDPOINT(endpoint_number)->DOEPCTL,
-				USB_OTG_DOEPCTL_CNAK | USB_OTG_DOEPCTL_EPENA
-			);
+			enable_out_endpoint(0);
+
+			// The last SETUP packet is valid now, so answer it without waiting for another interrupt
+			usb_events.on_setup_stage_completed(endpoint_number);
 			break;
 		case 0x03: // OUT transfer has completed
 
-			// Re-enable the transmission on the endpoint
-			SET_BIT(OUT_ENDPOINT(endpoint_number)->DOEPCTL,
-				USB_OTG_DOEPCTL_CNAK | USB_OTG_DOEPCTL_EPENA
-			);
+			// Re-enable the transmission on endpoint0. The other OUT endpoints NAK the host
+			// until their owner has consumed the data and arms them again (flow control)
+			if (endpoint_number == 0) {
+				enable_out_endpoint(0);
+			}
 			break;
 	}
 }
@@ -388,56 +670,195 @@ static void rxflvl_handler()
  */
 static void iepint_handler()
 {
-	// Find the endpoint caused the interrupt
-	uint8_t endpoint_number = ffs(USB_OTG_HS_DEVICE->DAINT) - 1;
+	// Find the endpoints caused the interrupt
+	uint16_t pending_endpoints = USB_OTG_HS_DEVICE->DAINT & USB_OTG_HS_DEVICE->DAINTMSK;
+
+	for (; pending_endpoints; pending_endpoints &= pending_endpoints - 1) {
+		uint8_t endpoint_number = ffs(pending_endpoints) - 1;
+		USB_OTG_INEndpointTypeDef *in_endpoint = IN_ENDPOINT(endpoint_number);
+		UsbEndpointStatistics *statistics = &usbd_statistics.in_endpoints[endpoint_number];
+		// Note: The bits of DIEPMSK have the same positions as the bits of DIEPINT
+		uint32_t diepint = in_endpoint->DIEPINT & USB_OTG_HS_DEVICE->DIEPMSK &
+			(USB_OTG_DIEPINT_XFRC | USB_OTG_DIEPINT_ITTXFE | USB_OTG_DIEPINT_TXFIFOUDRN);
+
+		if (diepint & USB_OTG_DIEPINT_XFRC) {
+			if (in_transfers[endpoint_number].pending_size) {
+				// Continue with the next part of a long transfer
+				start_in_chunk(endpoint_number);
+			} else {
+				statistics->transfer_completions++;
+				usb_events.on_in_transfer_completed(endpoint_number);
+			}
+		}
+
+		// The TxFIFO empty flag is read-only and is unmasked (per endpoint) only while packets are waiting for space
+		if ((USB_OTG_HS_DEVICE->DIEPEMPMSK & (1 << endpoint_number)) && (in_endpoint->DIEPINT & USB_OTG_DIEPINT_TXFE)) {
+			fill_txfifo(endpoint_number);
+		}
+
+		if (diepint & USB_OTG_DIEPINT_ITTXFE) {
+			statistics->naks++;
+		}
 
-	if (IN_ENDPOINT(endpoint_number)->DIEPINT & USB_OTG_DIEPINT_XFRC) {
-		usb_events.on_in_transfer_completed(endpoint_number);
-		// Clear the interrupt flag
-		SET_BIT(IN_ENDPOINT(endpoint_number)->DIEPINT, USB_OTG_DIEPINT_XFRC);
+		if (diepint & USB_OTG_DIEPINT_TXFIFOUDRN) {
+			statistics->fifo_underruns++;
+		}
+
+		// Clear the handled interrupt flags
+		WRITE_REG(in_endpoint->DIEPINT, diepint);
 	}
 }
 
 static void oepint_handler()
 {
-	// Find the endpoint caused the interrupt
-	uint8_t endpoint_number = ffs(USB_OTG_HS_DEVICE->DAINT >> 16) - 1;
+	// Find the endpoints caused the interrupt
+	uint16_t pending_endpoints = (USB_OTG_HS_DEVICE->DAINT & USB_OTG_HS_DEVICE->DAINTMSK) >> 16;
+
+	for (; pending_endpoints; pending_endpoints &= pending_endpoints - 1) {
+		uint8_t endpoint_number = ffs(pending_endpoints) - 1;
+		USB_OTG_OUTEndpointTypeDef *out_endpoint = OUT_ENDPOINT(endpoint_number);
+		UsbEndpointStatistics *statistics = &usbd_statistics.out_endpoints[endpoint_number];
+		// Note: The bits of DOEPMSK have the same positions as the bits of DOEPINT
+		uint32_t doepint = out_endpoint->DOEPINT & USB_OTG_HS_DEVICE->DOEPMSK &
+			(USB_OTG_DOEPINT_XFRC | USB_OTG_DOEPINT_NAK | USB_OTG_DOEPINT_OUTPKTERR);
+
+		if (doepint & USB_OTG_DOEPINT_XFRC) {
+			statistics->transfer_completions++;
+			usb_events.on_out_transfer_completed(endpoint_number);
+		}
+
+		if (doepint & USB_OTG_DOEPINT_NAK) {
+			statistics->naks++;
+		}
+
+		if (doepint & USB_OTG_DOEPINT_OUTPKTERR) {
+			statistics->fifo_overruns++;
+		}
 
-	if (OUT_ENDPOINT(endpoint_number)->DOEPINT & USB_OTG_DOEPINT_XFRC) {
-		usb_events.on_out_transfer_completed(endpoint_number);
-		// Clear the interrupt flag
-		SET_BIT(OUT_ENDPOINT(endpoint_number)->DOEPINT, USB_OTG_DOEPINT_XFRC);
+		// Clear the handled interrupt flags
+		WRITE_REG(out_endpoint->DOEPINT, doepint);
+	}
+}
+
+/**
+ * @brief Count the isochronous endpoints that did not complete their transfer in the last frame
+ * @param incomplete_in Handle IN endpoints if non-zero, otherwise OUT endpoints
+ */
+static void incomplete_isochronous_handler(uint8_t incomplete_in)
+{
+	for (uint8_t endpoint_number = 1; endpoint_number < ENDPOINT_COUNT; endpoint_number++) {
+		uint32_t endpoint_ctl = incomplete_in ? IN_ENDPOINT(endpoint_number)->DIEPCTL : OUT_ENDPOINT(endpoint_number)->DOEPCTL;
+
+		// The incomplete endpoints are still enabled at the end of the periodic frame
+		if (_FLD2VAL(USB_OTG_DIEPCTL_EPTYP, endpoint_ctl) == USB_ENDPOINT_TYPE_ISOCHRONOUS && (endpoint_ctl & USB_OTG_DIEPCTL_EPENA)) {
+			if (incomplete_in) {
+				usbd_statistics.in_endpoints[endpoint_number].incomplete_isochronous++;
+
+				// The host did not read the packet in this frame, so offer it in the next one
+				SET_BIT(IN_ENDPOINT(endpoint_number)->DIEPCTL, next_frame_parity());
+			} else {
+				usbd_statistics.out_endpoints[endpoint_number].incomplete_isochronous++;
+
+				// The packet of this frame was lost, so wait for the one of the next frame
+				SET_BIT(OUT_ENDPOINT(endpoint_number)->DOEPCTL, next_frame_parity());
+			}
+		}
 	}
 }
 
 /**
- * Handle the USB core interrupts (poll)
+ * @brief Notify the framework about the SOF (sent by the host every 1 ms at full speed)
+ */
+static void sof_handler()
+{
+	usb_events.on_start_of_frame_received();
+}
+
+/**
+ * @brief Notify the framework that the periodic part of the frame is over (the next SOF is near)
+ */
+static void eopf_handler()
+{
+	usb_events.on_end_of_periodic_frame();
+}
+
+static void usbsusp_handler()
+{
+	log_info("USB suspend detected.");
+}
+
+static void wkuint_handler()
+{
+	log_info("USB resume detected.");
+}
+
+/**
+ * @brief Handle all pending USB core interrupts (poll)
+ * @note The interrupt flags are cleared by writing 1 to them, so each flag is cleared
+ * with WRITE_REG (a read-modify-write would also clear the flags raised meanwhile).
  */
 static void gintsts_handler()
 {
-	volatile uint32_t gintsts = USB_OTG_HS_GLOBAL->GINTSTS;
+	volatile uint32_t gintsts = USB_OTG_HS_GLOBAL->GINTSTS & USB_OTG_HS_GLOBAL->GINTMSK;
 
 	if (gintsts & USB_OTG_GINTSTS_USBRST) {
 		usbrst_handler();
 		// Clear the interrupt
-		SET_BIT(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_USBRST);
-	} else if (gintsts & USB_OTG_GINTSTS_ENUMDNE) {
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_USBRST);
+	}
+
+	if (gintsts & USB_OTG_GINTSTS_ENUMDNE) {
 		enumdne_handler();
-		SET_BIT(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_ENUMDNE);
-	} else if (gintsts & USB_OTG_GINTSTS_RXFLVL) {
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_ENUMDNE);
+	}
+
+	if (gintsts & USB_OTG_GINTSTS_SOF) {
+		sof_handler();
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_SOF);
+	}
+
+	if (gintsts & USB_OTG_GINTSTS_EOPF) {
+		eopf_handler();
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_EOPF);
+	}
+
+	// The RXFLVL flag is read-only: it stays set (and the interrupt pending) until the RxFIFO is empty
+	if (gintsts & USB_OTG_GINTSTS_RXFLVL) {
 		rxflvl_handler();
-		SET_BIT(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_RXFLVL);
-	} else if (gintsts & USB_OTG_GINTSTS_IEPINT) {
+	}
+
+	// The IEPINT and OEPINT flags are read-only: they are cleared with the endpoint flags
+	if (gintsts & USB_OTG_GINTSTS_IEPINT) {
 		iepint_handler();
-		// Clear the interrupt
-		SET_BIT(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_IEPINT);
-	} else if (gintsts & USB_OTG_GINTSTS_OEPINT) {
+	}
+
+	if (gintsts & USB_OTG_GINTSTS_OEPINT) {
 		oepint_handler();
-		// Clear the interrupt
-		SET_BIT(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_OEPINT);
 	}
 
-	usb_events.on_usb_polled();
+	if (gintsts & USB_OTG_GINTSTS_IISOIXFR) {
+		incomplete_isochronous_handler(1);
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_IISOIXFR);
+	}
+
+	if (gintsts & USB_OTG_GINTSTS_PXFR_INCOMPISOOUT) {
+		incomplete_isochronous_handler(0);
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_PXFR_INCOMPISOOUT);
+	}
+
+	if (gintsts & USB_OTG_GINTSTS_USBSUSP) {
+		usbsusp_handler();
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_USBSUSP);
+	}
+
+	if (gintsts & USB_OTG_GINTSTS_WKUINT) {
+		wkuint_handler();
+		WRITE_REG(USB_OTG_HS_GLOBAL->GINTSTS, USB_OTG_GINTSTS_WKUINT);
+	}
+
+	if (usb_events.on_usb_polled) {
+		usb_events.on_usb_polled();
+	}
 }
 
 const UsbDriver usb_driver = {
@@ -448,8 +869,13 @@ const UsbDriver usb_driver = {
 	.disconnect = &disconnect,
 	.flush_rxfifo = &flush_rxfifo,
 	.flush_txfifo = &flush_txfifo,
-	.configure_in_endpoint = &configure_in_endpoint,
+	.activate_endpoint = &activate_endpoint,
+	.deconfigure_endpoint = &deconfigure_endpoint,
+	.enable_out_endpoint = &enable_out_endpoint,
+	.start_out_transfer = &start_out_transfer,
 	.read_packet = &read_packet,
 	.write_packet = &write_packet,
+	.start_in_transfer = &start_in_transfer,
+	.set_endpoint_stall = &set_endpoint_stall,
 	.poll = &gintsts_handler
 };
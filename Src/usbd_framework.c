@@ -7,96 +7,559 @@
 
 #include <stddef.h>
 #include "Helpers/logger.h"
+#include "Helpers/cpu_load.h"
+#include "Helpers/cycle_counter.h"
 #include "usbd_framework.h"
 #include "usbd_driver.h"
 #include "usb_device.h"
+#include "usbd_capture.h"
+#include "usbd_config.h"
+#include "usbd_configuration.h"
+#include "usbd_requests.h"
+#include "usbd_statistics.h"
 #include "usbd_descriptors.h"
+#include "usbd_dfu.h"
 #include "usb_standards.h"
 #include "Helpers/math.h"
 
 static UsbDevice *usbd_handle;
+static UsbRequestHandlers const standard_device_requests;
+static UsbRequestHandlers const standard_interface_requests;
+static UsbRequestHandlers const standard_endpoint_requests;
+
+/// \brief The handlers of the active endpoints, by endpoint number
+static UsbEndpointHandler const *in_endpoint_handlers[ENDPOINT_COUNT];
+static UsbEndpointHandler const *out_endpoint_handlers[ENDPOINT_COUNT];
+
+/// \brief The active isochronous endpoints, the IN ones in the low half-word and the OUT ones in the high one (as in DAINT)
+static uint32_t isochronous_endpoints;
+
+/// \brief The selected alternate setting of each interface (valid while configured)
+static uint8_t alternate_settings[USBD_INTERFACE_COUNT];
+
+/**
+ * \brief The answers to GET_STATUS, kept up to date as the state changes
+ * \details The data stage of GET_STATUS is sent straight from the word of the recipient.
+ */
+typedef struct
+{
+	uint16_t device;
+	uint16_t interface; /**<\brief All bits are reserved (zero) */
+	uint16_t in_endpoints[ENDPOINT_COUNT];
+	uint16_t out_endpoints[ENDPOINT_COUNT];
+} UsbStatusBlock;
+
+static UsbStatusBlock status_block;
 
 void usbd_initialize(UsbDevice *usb_device)
 {
 	usbd_handle = usb_device;
+	usbd_capture_start();
+	cpu_load_initialize();
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_STANDARD | USB_BM_REQUEST_TYPE_RECIPIENT_DEVICE, 0,
+		&standard_device_requests);
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_STANDARD | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE, 0,
+		&standard_interface_requests);
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_STANDARD | USB_BM_REQUEST_TYPE_RECIPIENT_ENDPOINT, 0,
+		&standard_endpoint_requests);
+	usbd_statistics_initialize();
+	usbd_descriptors_initialize();
+
+	for (uint8_t i = 0; i < usbd_function_count; i++) {
+#if USBD_DFU_ENABLED
+		// In DFU mode the device is the DFU function alone, the others stay off
+		if (usbd_dfu_mode_active() && usbd_function_configurations[i].initialize != &usbd_dfu_initialize) {
+			continue;
+		}
+#endif
+
+		if (usbd_function_configurations[i].initialize) {
+			usbd_function_configurations[i].initialize();
+		}
+	}
+
 	usb_driver.initialize_gpio_pins();
 	usb_driver.initialize_core();
 	usb_driver.connect();
+
+	// From now on the driver is serviced by the USB interrupt
+	NVIC_EnableIRQ(OTG_HS_IRQn);
+}
+
+/**
+ * @brief Return the bit of an endpoint in \ref isochronous_endpoints
+ */
+static uint32_t endpoint_bit(uint8_t endpoint_address)
+{
+	return (endpoint_address & 0x80) ? 1 << (endpoint_address & 0x0F) : 1 << 16 << endpoint_address;
+}
+
+/**
+ * @brief Tell the handler of a deactivated endpoint that its transfers are over and forget the handler
+ */
+static void release_endpoint_handler(uint8_t endpoint_address)
+{
+	UsbEndpointHandler const **handler = (endpoint_address & 0x80)
+		? &in_endpoint_handlers[endpoint_address & 0x0F]
+		: &out_endpoint_handlers[endpoint_address];
+
+	if (*handler && (*handler)->on_endpoint_deactivated) {
+		(*handler)->on_endpoint_deactivated(endpoint_address);
+	}
+
+	*handler = NULL;
+}
+
+/**
+ * @brief Deactivate all endpoints (but endpoint0)
+ */
+static void usbd_deconfigure()
+{
+	for (uint8_t endpoint_number = 1; endpoint_number < ENDPOINT_COUNT; endpoint_number++) {
+		if (in_endpoint_handlers[endpoint_number] || out_endpoint_handlers[endpoint_number]) {
+			usb_driver.deconfigure_endpoint(endpoint_number);
+		}
+
+		release_endpoint_handler(0x80 | endpoint_number);
+		release_endpoint_handler(endpoint_number);
+		status_block.in_endpoints[endpoint_number] = 0;
+		status_block.out_endpoints[endpoint_number] = 0;
+	}
+}
+
+/**
+ * @brief Activate the endpoints of an alternate setting in one pass over its precomputed table
+ */
+static void activate_alternate_setting(uint8_t interface_number, uint8_t alternate_setting)
+{
+	UsbAlternateSettingConfiguration const *setting =
+		&usbd_interface_configurations[interface_number].alternate_settings[alternate_setting];
+
+	for (uint8_t i = 0; i < setting->endpoint_count; i++) {
+		UsbEndpointConfiguration const *configuration = &setting->endpoints[i];
+		uint8_t endpoint_address = configuration->activation.endpoint_address;
+
+		// Note: The activation clears the halt of the endpoint
+		if (endpoint_address & 0x80) {
+			in_endpoint_handlers[endpoint_address & 0x0F] = configuration->handler;
+			status_block.in_endpoints[endpoint_address & 0x0F] = 0;
+		} else {
+			out_endpoint_handlers[endpoint_address] = configuration->handler;
+			status_block.out_endpoints[endpoint_address] = 0;
+		}
+
+		if (configuration->activation.type == USB_ENDPOINT_TYPE_ISOCHRONOUS) {
+			isochronous_endpoints |= endpoint_bit(endpoint_address);
+		} else {
+			isochronous_endpoints &= ~endpoint_bit(endpoint_address);
+		}
+
+		usb_driver.activate_endpoint(&configuration->activation);
+
+		if (configuration->handler->on_endpoint_activated) {
+			configuration->handler->on_endpoint_activated(endpoint_address, configuration->activation.max_packet_size);
+		}
+	}
+
+	alternate_settings[interface_number] = alternate_setting;
+}
+
+/**
+ * @brief Deactivate the endpoints of the selected alternate setting of an interface
+ * @note The other interfaces keep transferring data, and keep their FIFOs.
+ */
+static void deactivate_alternate_setting(uint8_t interface_number)
+{
+	UsbAlternateSettingConfiguration const *setting =
+		&usbd_interface_configurations[interface_number].alternate_settings[alternate_settings[interface_number]];
+
+	for (uint8_t i = 0; i < setting->endpoint_count; i++) {
+		uint8_t endpoint_address = setting->endpoints[i].activation.endpoint_address;
+
+		usb_driver.deconfigure_endpoint(endpoint_address & 0x0F);
+		release_endpoint_handler(endpoint_address);
+	}
 }
 
+/**
+ * @brief Return the count of interfaces of the descriptor set the host sees
+ * @note The interface numbers are compared with it rather than with USBD_INTERFACE_COUNT, which is 0
+ * (so the comparisons would be constant) when every function is disabled.
+ */
+static uint8_t active_interface_count()
+{
+#if USBD_DFU_ENABLED
+	// The DFU mode has its own configuration, with the DFU interface alone
+	if (usbd_dfu_mode_active()) {
+		return 1;
+	}
+#endif
+
+	return USBD_INTERFACE_COUNT;
+}
+
+/**
+ * @brief Activate the endpoints of the selected configuration (alternate setting 0 of every interface)
+ */
 void usbd_configure()
 {
-	//TODO: Configure the device (e.g. the endpoints active in this configuration)
+	usbd_deconfigure();
+
+	if (usbd_handle->configuration_value != USBD_CONFIGURATION_VALUE) {
+		return;
+	}
+
+#if USBD_DFU_ENABLED
+	// The only interface of the DFU mode has no endpoints
+	if (usbd_dfu_mode_active()) {
+		return;
+	}
+#endif
+
+	for (uint8_t interface_number = 0; interface_number < active_interface_count(); interface_number++) {
+		activate_alternate_setting(interface_number, 0);
+	}
 }
 
-static void process_standard_device_request()
+static uint8_t get_descriptor_handler(UsbDevice *usb_device, UsbRequest const *request)
 {
-	UsbRequest const *request = (UsbRequest *)usbd_handle->ptr_out_buffer;
+	log_info("Standard Get Descriptor request received");
+	const uint8_t descriptor_type = request->wValue >> 8;
+	const uint8_t descriptor_index = request->wValue & 0xFF;
+	void const *descriptor;
+	uint16_t descriptor_length;
+
+	if (!usbd_get_descriptor(descriptor_type, descriptor_index, &descriptor, &descriptor_length)) {
+		return 0;
+	}
 
-	switch(request->bRequest)
-	{
-		case USB_STANDARD_GET_DESCRIPTOR:
-			log_info("Standard Get Descriptor request received");
-			const uint8_t descriptor_type = request->wValue >> 8;
-			const uint16_t descriptor_length = request->wLength;
-			//const uint8_t descriptor_index = request->wValue & 0xFF;
-
-			switch(descriptor_type)
-			{
-			case USB_DESCRIPTOR_TYPE_DEVICE:
-				log_info("- Get Device Descriptor.");
-				usbd_handle->ptr_in_buffer = &device_descriptor;
-				usbd_handle->in_data_size = descriptor_length;
-
-				log_info("Switching control stage to IN-DATA.");
-				usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_IN;
-				break;
-			case USB_DESCRIPTOR_TYPE_CONFIGURATION:
-				log_info("- Get Configuration Descriptor.");
-				usbd_handle->ptr_in_buffer = &configuration_descriptor_combination;
-				usbd_handle->in_data_size = descriptor_length;
-
-				log_info("Switching control stage to IN-DATA.");
-				usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_IN;
-				break;
-			}
-
-			break;
-		case USB_STANDARD_SET_ADDRESS:
-			log_info("Standard Set Address request received");
-			const uint16_t device_address = request->wValue;
-
-			usb_driver.set_device_address(device_address);
-			usbd_handle->device_state = USB_DEVICE_STATE_ADDRESSED;
-
-			log_info("Switching control transfer stage to IN-STATUS");
-			usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_STATUS_IN;
-			break;
-		case USB_STANDARD_SET_CONFIG:
-			log_info("Standard Set Configuration request received.");
-			usbd_handle->configuration_value = request->wValue;
-
-			usbd_configure();
-
-			usbd_handle->device_state = USB_DEVICE_STATE_CONFIGURED;
-			log_info("Switching control transfer stage to IN-STATUS");
-			usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_STATUS_IN;
-			break;
+	// Note: The data stage is clamped to wLength by the framework
+	usb_device->ptr_in_buffer = descriptor;
+	usb_device->in_data_size = descriptor_length;
+	return 1;
+}
+
+static uint8_t get_interface_descriptor_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Get Descriptor request received for an interface");
+	void const *descriptor;
+	uint16_t descriptor_length;
+
+	if (!usbd_get_interface_descriptor(request->wIndex & 0xFF, request->wValue >> 8, &descriptor, &descriptor_length)) {
+		return 0;
+	}
+
+	usb_device->ptr_in_buffer = descriptor;
+	usb_device->in_data_size = descriptor_length;
+	return 1;
+}
+
+static uint8_t set_address_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Set Address request received");
+	const uint16_t device_address = request->wValue;
+
+	usb_driver.set_device_address(device_address);
+	usb_device->device_state = USB_DEVICE_STATE_ADDRESSED;
+	return 1;
+}
+
+static uint8_t get_configuration_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Get Configuration request received.");
+	usb_device->ptr_in_buffer = &usb_device->configuration_value;
+	usb_device->in_data_size = 1;
+	return 1;
+}
+
+static uint8_t set_configuration_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Set Configuration request received.");
+
+	if (request->wValue != 0 && request->wValue != USBD_CONFIGURATION_VALUE) {
+		return 0;
+	}
+
+	usb_device->configuration_value = request->wValue;
+
+	usbd_configure();
+
+	usb_device->device_state = request->wValue ? USB_DEVICE_STATE_CONFIGURED : USB_DEVICE_STATE_ADDRESSED;
+	return 1;
+}
+
+static uint8_t get_interface_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Get Interface request received.");
+
+	if (usb_device->device_state != USB_DEVICE_STATE_CONFIGURED || request->wIndex >= active_interface_count()) {
+		return 0;
+	}
+
+	usb_device->ptr_in_buffer = &alternate_settings[request->wIndex];
+	usb_device->in_data_size = 1;
+	return 1;
+}
+
+/**
+ * @brief Select another alternate setting of an interface without a bus reset
+ * @details The endpoints of the old setting are deactivated, their TxFIFOs are re-planned inside
+ * the FIFO region of the interface and the endpoints of the new setting are armed.
+ */
+static uint8_t set_interface_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Set Interface request received.");
+	const uint16_t interface_number = request->wIndex;
+	const uint16_t alternate_setting = request->wValue;
+
+	if (usb_device->device_state != USB_DEVICE_STATE_CONFIGURED || interface_number >= active_interface_count() ||
+		alternate_setting >= usbd_interface_configurations[interface_number].alternate_setting_count) {
+		return 0;
+	}
+
+#if USBD_DFU_ENABLED
+	if (usbd_dfu_mode_active()) {
+		return interface_number == 0 && alternate_setting == 0;
+	}
+#endif
+
+	deactivate_alternate_setting(interface_number);
+	activate_alternate_setting(interface_number, alternate_setting);
+	return 1;
+}
+
+/**
+ * @brief Return the status word of an endpoint of the selected configuration
+ * @return NULL if the endpoint does not exist or is not active
+ */
+static uint16_t *endpoint_status(uint8_t endpoint_address)
+{
+	uint8_t endpoint_number = endpoint_address & 0x0F;
+
+	if ((endpoint_address & 0x70) || endpoint_number >= ENDPOINT_COUNT) {
+		return NULL;
+	}
+
+	if (endpoint_address & 0x80) {
+		return (endpoint_number == 0 || in_endpoint_handlers[endpoint_number])
+			? &status_block.in_endpoints[endpoint_number]
+			: NULL;
+	}
+
+	return (endpoint_number == 0 || out_endpoint_handlers[endpoint_number])
+		? &status_block.out_endpoints[endpoint_number]
+		: NULL;
+}
+
+/**
+ * @brief Halt (stall) an endpoint or clear its halt, keeping the answer to GET_STATUS up to date
+ * @param endpoint_address The endpoint number (bit 7 is set for IN endpoints), not endpoint0
+ * @param halt Halt the endpoint if non-zero, otherwise clear the halt and reset the data toggle to DATA0
+ * @note The functions halt their endpoints through here too (e.g. to report an error of their protocol).
+ */
+void usbd_set_endpoint_halt(uint8_t endpoint_address, uint8_t halt)
+{
+	uint16_t *status = endpoint_status(endpoint_address);
+
+	if (status == NULL || (endpoint_address & 0x0F) == 0) {
+		return;
+	}
+
+	*status = halt ? USB_STATUS_ENDPOINT_HALT : 0;
+	usb_driver.set_endpoint_stall(endpoint_address, halt);
+}
+
+static uint8_t get_device_status_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Get Status (device) request received.");
+	usb_device->ptr_in_buffer = &status_block.device;
+	usb_device->in_data_size = sizeof(status_block.device);
+	return 1;
+}
+
+static uint8_t get_interface_status_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Get Status (interface) request received.");
+
+	if (usb_device->device_state != USB_DEVICE_STATE_CONFIGURED || request->wIndex >= active_interface_count()) {
+		return 0;
+	}
+
+	usb_device->ptr_in_buffer = &status_block.interface;
+	usb_device->in_data_size = sizeof(status_block.interface);
+	return 1;
+}
+
+static uint8_t get_endpoint_status_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Get Status (endpoint) request received.");
+	uint16_t const *status = endpoint_status(request->wIndex);
+
+	if (status == NULL) {
+		return 0;
 	}
+
+	usb_device->ptr_in_buffer = status;
+	usb_device->in_data_size = sizeof(*status);
+	return 1;
+}
+
+/**
+ * @brief Handle both CLEAR_FEATURE and SET_FEATURE of the device (only remote wakeup is supported)
+ */
+static uint8_t device_feature_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Clear/Set Feature (device) request received.");
+
+	// The remote wakeup can only be enabled if the configuration descriptor announces it
+	if (request->wValue != USB_FEATURE_DEVICE_REMOTE_WAKEUP ||
+		!(USBD_CONFIGURATION_ATTRIBUTES & USB_CONFIGURATION_ATTRIBUTES_REMOTE_WAKEUP)) {
+		return 0;
+	}
+
+	if (request->bRequest == USB_STANDARD_SET_FEATURE) {
+		status_block.device |= USB_STATUS_DEVICE_REMOTE_WAKEUP;
+	} else {
+		status_block.device &= ~USB_STATUS_DEVICE_REMOTE_WAKEUP;
+	}
+	return 1;
+}
+
+/**
+ * @brief Handle both CLEAR_FEATURE and SET_FEATURE of an endpoint (ENDPOINT_HALT)
+ * @details Clearing the halt always resets the data toggle, even if the endpoint was not halted,
+ * so the host and the device agree on DATA0 and the pipe recovers with this single request.
+ */
+static uint8_t endpoint_feature_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Standard Clear/Set Feature (endpoint) request received.");
+	const uint8_t endpoint_address = request->wIndex;
+	const uint8_t halt = request->bRequest == USB_STANDARD_SET_FEATURE;
+
+	if (request->wValue != USB_FEATURE_ENDPOINT_HALT || endpoint_status(endpoint_address) == NULL) {
+		return 0;
+	}
+
+	// Note: Endpoint0 only stalls a rejected request, which the next SETUP clears
+	if ((endpoint_address & 0x0F) == 0) {
+		return 1;
+	}
+
+	// Isochronous endpoints have no handshake, so they cannot be halted
+	if (halt && (isochronous_endpoints & endpoint_bit(endpoint_address))) {
+		return 0;
+	}
+
+	usbd_set_endpoint_halt(endpoint_address, halt);
+
+	UsbEndpointHandler const *handler = (endpoint_address & 0x80)
+		? in_endpoint_handlers[endpoint_address & 0x0F]
+		: out_endpoint_handlers[endpoint_address];
+
+	if (!halt && handler->on_endpoint_halt_cleared) {
+		handler->on_endpoint_halt_cleared(endpoint_address);
+	}
+	return 1;
+}
+
+static UsbRequestHandler const standard_interface_request_handlers[] = {
+	[USB_STANDARD_GET_STATUS] = &get_interface_status_handler,
+	[USB_STANDARD_GET_DESCRIPTOR] = &get_interface_descriptor_handler,
+	[USB_STANDARD_GET_INTERFACE] = &get_interface_handler,
+	[USB_STANDARD_SET_INTERFACE] = &set_interface_handler
+};
+
+static UsbRequestHandlers const standard_interface_requests = {
+	.first_request = 0,
+	.request_count = sizeof(standard_interface_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = standard_interface_request_handlers
+};
+
+static UsbRequestHandler const standard_endpoint_request_handlers[] = {
+	[USB_STANDARD_GET_STATUS] = &get_endpoint_status_handler,
+	[USB_STANDARD_CLEAR_FEATURE] = &endpoint_feature_handler,
+	[USB_STANDARD_SET_FEATURE] = &endpoint_feature_handler
+};
+
+static UsbRequestHandlers const standard_endpoint_requests = {
+	.first_request = 0,
+	.request_count = sizeof(standard_endpoint_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = standard_endpoint_request_handlers
+};
+
+static UsbRequestHandler const standard_device_request_handlers[] = {
+	[USB_STANDARD_GET_STATUS] = &get_device_status_handler,
+	[USB_STANDARD_CLEAR_FEATURE] = &device_feature_handler,
+	[USB_STANDARD_SET_FEATURE] = &device_feature_handler,
+	[USB_STANDARD_SET_ADDRESS] = &set_address_handler,
+	[USB_STANDARD_GET_DESCRIPTOR] = &get_descriptor_handler,
+	[USB_STANDARD_GET_CONFIG] = &get_configuration_handler,
+	[USB_STANDARD_SET_CONFIG] = &set_configuration_handler
+};
+
+static UsbRequestHandlers const standard_device_requests = {
+	.first_request = 0,
+	.request_count = sizeof(standard_device_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = standard_device_request_handlers
+};
+
+/**
+ * @brief Stall endpoint0 to reject the current control request (cleared by the next SETUP)
+ */
+static void stall_control_request()
+{
+	usb_driver.set_endpoint_stall(0x80, 1);
+	usb_driver.set_endpoint_stall(0x00, 1);
 }
 
+/**
+ * @brief Dispatch the received request to its handler and select the next control stage
+ */
 static void process_request()
 {
 	UsbRequest const *request = (UsbRequest *)usbd_handle->ptr_out_buffer;
+	UsbRequestHandler handler = usbd_find_request_handler(request);
 
-	switch(request->bmRequestType & (USB_BM_REQUEST_TYPE_TYPE_MASK | USB_BM_REQUEST_TYPE_RECIPIENT_MASK))
-	{
-		case USB_BM_REQUEST_TYPE_TYPE_STANDARD | USB_BM_REQUEST_TYPE_RECIPIENT_DEVICE:
-			process_standard_device_request();
-			break;
+	uint8_t direction_out = !(request->bmRequestType & USB_BM_REQUEST_TYPE_DIRECTION_TOHOST);
+
+	usbd_handle->in_data_size = 0;
+	usbd_handle->out_data_size = 0;
+	usbd_handle->ptr_control_out_data = NULL;
+
+	if (direction_out && request->wLength > USBD_CONTROL_OUT_MAX_SIZE) {
+		handler = NULL;
+	}
+
+	if (handler == NULL || !handler(usbd_handle, request)) {
+		log_info("Unsupported request, stalling endpoint0.");
+		stall_control_request();
+		return;
+	}
+
+	if (request->wLength == 0) {
+		log_info("Switching control transfer stage to IN-STATUS");
+		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_STATUS_IN;
+	} else if (direction_out) {
+		if (usbd_handle->ptr_control_out_data == NULL) {
+			log_info("No buffer for the OUT-DATA stage, stalling endpoint0.");
+			stall_control_request();
+			return;
+		}
+
+		log_info("Switching control stage to OUT-DATA.");
+		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_OUT;
+	} else {
+		// The host never reads more than wLength bytes
+		usbd_handle->in_data_size = MIN(usbd_handle->in_data_size, request->wLength);
+
+		log_info("Switching control stage to IN-DATA.");
+		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_IN;
 	}
 }
 
+/**
+ * @brief Arm the data or status stage chosen by the request just processed
+ */
 static void process_control_transfer_stage()
 {
 	switch(usbd_handle->control_transfer_stage)
@@ -106,61 +569,135 @@ static void process_control_transfer_stage()
 	case USB_CONTROL_STAGE_DATA_IN:
 		log_info("Processing IN-DATA stage.");
 
-		uint8_t data_size = MIN(usbd_handle->in_data_size, device_descriptor.bMaxPacketSize0);
+		UsbRequest const *request = (UsbRequest *)usbd_handle->ptr_out_buffer;
+		uint32_t data_size = usbd_handle->in_data_size;
 
-		usb_driver.write_packet(0, usbd_handle->ptr_in_buffer, data_size);
-		usbd_handle->in_data_size -= data_size;
+		// Send the whole data stage as one transfer (the driver splits it into packets)
+		usb_driver.start_in_transfer(0, usbd_handle->ptr_in_buffer, data_size);
+		usbd_handle->in_data_size = 0;
 		usbd_handle->ptr_in_buffer += data_size;
 
-		log_info("Switching control stage to IN-DATA IDLE");
-		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_IN_IDLE;
-
-		if (usbd_handle->in_data_size == 0) {
-
-			if (data_size == device_descriptor.bMaxPacketSize0) {
-				log_info("Switching control stage to IN-DATA ZERO");
-				usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_IN_ZERO;
-			} else {
-				log_info("Switching control stage to OUT-STATUS");
-				usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_STATUS_OUT;
-			}
+		// The host stops reading at a short packet or after wLength bytes,
+		// so a shorter data stage that ends with a full packet needs a zero-length packet
+		if (data_size > 0 && data_size < request->wLength && (data_size % USBD_EP0_MAX_PACKET_SIZE) == 0) {
+			log_info("Switching control stage to IN-DATA ZERO");
+			usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_IN_ZERO;
 		}
 
-		break;
-	case USB_CONTROL_STAGE_DATA_IN_IDLE:
-		break;
-	case USB_CONTROL_STAGE_STATUS_OUT:
-		log_info("Switching control stage to SETUP");
-		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_SETUP;
 		break;
 	case USB_CONTROL_STAGE_STATUS_IN:
 		usb_driver.write_packet(0, NULL, 0);
 		log_info("Switching control stage to SETUP");
 		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_SETUP;
 		break;
+	default:
+		// DATA_OUT, DATA_IN_ZERO and STATUS_OUT are completed by the endpoint callbacks
+		break;
 	}
 }
 
-static void usb_polled_handler()
-{
-	process_control_transfer_stage();
-}
-
 static void in_transfer_completed_handler(uint8_t endpoint_number)
 {
-	if (usbd_handle->in_data_size) {
-		log_info("Switching control stage to IN-DATA");
-		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_DATA_IN;
-	} else if (usbd_handle->control_transfer_stage == USB_CONTROL_STAGE_DATA_IN_ZERO) {
+	if (endpoint_number != 0) {
+		if (in_endpoint_handlers[endpoint_number] && in_endpoint_handlers[endpoint_number]->on_in_transfer_completed) {
+			in_endpoint_handlers[endpoint_number]->on_in_transfer_completed(endpoint_number);
+		}
+		return;
+	}
+
+	if (usbd_handle->control_transfer_stage == USB_CONTROL_STAGE_DATA_IN_ZERO) {
 		usb_driver.write_packet(0, NULL, 0);
 		log_info("Switching control stage to OUT-STATUS");
 		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_STATUS_OUT;
+	} else if (usbd_handle->control_transfer_stage == USB_CONTROL_STAGE_DATA_IN) {
+		log_info("Switching control stage to OUT-STATUS");
+		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_STATUS_OUT;
+	}
+}
+
+/**
+ * @brief Pop a packet nobody expects from the RxFIFO
+ */
+static void discard_packet(uint16_t byte_count)
+{
+	uint32_t packet[16];
+
+	for (; byte_count > 0; byte_count -= MIN(byte_count, sizeof(packet))) {
+		usb_driver.read_packet(packet, MIN(byte_count, sizeof(packet)));
+	}
+}
+
+/**
+ * @brief Receive a packet of the control OUT data stage and process the request when the stage is complete
+ */
+static void control_out_data_received(uint16_t byte_count)
+{
+	UsbRequest const *request = (UsbRequest *)usbd_handle->ptr_out_buffer;
+
+	if (usbd_handle->control_transfer_stage != USB_CONTROL_STAGE_DATA_OUT) {
+		// E.g. the zero-length packet of the OUT-STATUS stage
+		discard_packet(byte_count);
+		return;
+	}
+
+	if (byte_count > request->wLength - usbd_handle->out_data_size) {
+		log_info("The OUT-DATA stage is longer than wLength, stalling endpoint0.");
+		discard_packet(byte_count);
+		stall_control_request();
+		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_SETUP;
+		return;
+	}
+
+	// The data is popped straight into the buffer of the handler
+	usb_driver.read_packet(usbd_handle->ptr_control_out_data + usbd_handle->out_data_size, byte_count);
+	usbd_handle->out_data_size += byte_count;
+
+	// The data stage ends after wLength bytes or with a short packet
+	if (usbd_handle->out_data_size < request->wLength && byte_count == USBD_EP0_MAX_PACKET_SIZE) {
+		return;
+	}
+
+	log_debug_array("OUT-DATA: ", usbd_handle->ptr_control_out_data, usbd_handle->out_data_size);
+
+	UsbRequestHandler handler = usbd_find_request_handler(request);
+
+	if (!handler(usbd_handle, request)) {
+		log_info("OUT-DATA rejected, stalling endpoint0.");
+		stall_control_request();
+		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_SETUP;
+		return;
+	}
+
+	log_info("Switching control transfer stage to IN-STATUS");
+	usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_STATUS_IN;
+	process_control_transfer_stage();
+}
+
+static void out_data_received_handler(uint8_t endpoint_number, uint16_t byte_count)
+{
+	UsbEndpointHandler const *handler = out_endpoint_handlers[endpoint_number];
+
+	if (endpoint_number == 0) {
+		control_out_data_received(byte_count);
+	} else if (handler && handler->on_out_data_received) {
+		handler->on_out_data_received(endpoint_number, byte_count);
+	} else {
+		discard_packet(byte_count);
 	}
 }
 
 static void out_transfer_completed_handler(uint8_t endpoint_number)
 {
+	UsbEndpointHandler const *handler = out_endpoint_handlers[endpoint_number];
+
+	if (endpoint_number != 0 && handler && handler->on_out_transfer_completed) {
+		handler->on_out_transfer_completed(endpoint_number);
+	}
 
+	if (endpoint_number == 0 && usbd_handle->control_transfer_stage == USB_CONTROL_STAGE_STATUS_OUT) {
+		log_info("Switching control stage to SETUP");
+		usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_SETUP;
+	}
 }
 
 void usbd_poll()
@@ -168,30 +705,92 @@ void usbd_poll()
 	usb_driver.poll();
 }
 
+/**
+ * @brief The USB interrupt handler: polls the driver and accounts the cycles spent doing so
+ */
+void OTG_HS_IRQHandler()
+{
+	uint32_t start = cycle_counter_read();
+
+	usbd_poll();
+
+	cpu_load_add_usb_cycles(cycle_counter_read() - start);
+}
+
+static void start_of_frame_received_handler()
+{
+	cpu_load_close_interval();
+}
+
+/**
+ * @brief Let the IN endpoints arm the data of the next frame as late as possible
+ */
+static void end_of_periodic_frame_handler()
+{
+	for (uint8_t endpoint_number = 1; endpoint_number < ENDPOINT_COUNT; endpoint_number++) {
+		UsbEndpointHandler const *handler = in_endpoint_handlers[endpoint_number];
+
+		if (handler && handler->on_end_of_periodic_frame) {
+			handler->on_end_of_periodic_frame(0x80 | endpoint_number);
+		}
+	}
+}
+
 static void usb_reset_received_handler()
 {
 	usbd_handle->in_data_size = 0;
 	usbd_handle->out_data_size = 0;
 	usbd_handle->configuration_value = 0;
 	usbd_handle->device_state = USB_DEVICE_STATE_DEFAULT;
+
+	// The remote wakeup is disabled by a reset, and the endpoints are not halted any more
+	status_block = (UsbStatusBlock){
+		.device = (USBD_CONFIGURATION_ATTRIBUTES & USB_CONFIGURATION_ATTRIBUTES_SELF_POWERED)
+			? USB_STATUS_DEVICE_SELF_POWERED
+			: 0
+	};
+
+	// Note: The driver has deconfigured all endpoints already
+	for (uint8_t endpoint_number = 1; endpoint_number < ENDPOINT_COUNT; endpoint_number++) {
+		release_endpoint_handler(0x80 | endpoint_number);
+		release_endpoint_handler(endpoint_number);
+	}
 	usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_SETUP;
 	usb_driver.set_device_address(0);
+
+#if USBD_DFU_ENABLED
+	usbd_dfu_reset_received();
+#endif
 }
 
 static void setup_data_received_handler(uint8_t endpoint_number, uint16_t byte_count)
 {
+	// Note: The host may retry a SETUP packet, the request is processed once the SETUP stage completes
 	usb_driver.read_packet(usbd_handle->ptr_out_buffer, byte_count);
 
 	// Print out the received data
 	log_debug_array("SETUP data: ", usbd_handle->ptr_out_buffer, byte_count);
+}
+
+/**
+ * @brief Process the request and arm its data or status stage right away (in the same interrupt)
+ */
+static void setup_stage_completed_handler(uint8_t endpoint_number)
+{
+	// A new SETUP aborts any control transfer in progress
+	usbd_handle->control_transfer_stage = USB_CONTROL_STAGE_SETUP;
 
 	process_request();
+	process_control_transfer_stage();
 }
 
 UsbEvents usb_events = {
 	.on_usb_reset_received = &usb_reset_received_handler,
 	.on_setup_data_received = &setup_data_received_handler,
-	.on_usb_polled = &usb_polled_handler,
+	.on_setup_stage_completed = &setup_stage_completed_handler,
+	.on_out_data_received = &out_data_received_handler,
+	.on_start_of_frame_received = &start_of_frame_received_handler,
+	.on_end_of_periodic_frame = &end_of_periodic_frame_handler,
 	.on_in_transfer_completed = &in_transfer_completed_handler,
 	.on_out_transfer_completed = &out_transfer_completed_handler
 };
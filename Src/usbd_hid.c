@@ -0,0 +1,244 @@
+/*
+ * usbd_hid.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_hid.h"
+#include "usbd_config.h"
+
+#if USBD_HID_ENABLED
+
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+#include "usbd_descriptors.h"
+#include "usbd_requests.h"
+#include "usbd_statistics.h"
+#include "Helpers/cycle_counter.h"
+#include "Helpers/logger.h"
+#include "Helpers/math.h"
+
+static const uint8_t report_descriptor[] = { USBD_HID_REPORT_DESCRIPTOR };
+
+/*
+ * The input reports go through a mailbox that holds only the newest one: a report submitted
+ * while the previous one waits replaces it. The mailbox is emptied into the endpoint at the end
+ * of the periodic frame, just before the SOF, so the report polled by the host in the next frame
+ * is the newest one, not the one that happened to be armed first.
+ */
+static UsbHidInputReport mailbox;
+/// \brief When the oldest change not yet seen by the host was submitted (cycle counter)
+static uint32_t mailbox_timestamp;
+static volatile uint8_t mailbox_full;
+
+/// \brief The report armed in the endpoint
+static UsbHidInputReport in_flight_report;
+static uint32_t in_flight_timestamp;
+/// \brief The report armed is a repetition of the idle rate, so its latency is not measured
+static uint8_t in_flight_repeated;
+/// \brief A report is armed (or the endpoint is not active)
+static uint8_t in_busy = 1;
+
+/// \brief The newest report submitted (answers GET_REPORT and is repeated at the idle rate)
+static UsbHidInputReport current_report;
+static UsbHidOutputReport output_report;
+
+/// \brief In units of 4 ms, 0 - the reports are only sent when they change
+static uint8_t idle_rate;
+/// \brief Frames since the last report was sent
+static uint16_t idle_frames;
+
+/**
+ * @brief Account the latency of a delivered report
+ */
+static void record_latency(uint32_t cycles)
+{
+	UsbLatencyStatistics *latency = &usbd_statistics.hid_latency;
+	uint32_t microseconds = MIN(cycles / (SystemCoreClock / 1000000), 0xFFFF);
+
+	if (latency->reports == 0 || microseconds < latency->min_us) {
+		latency->min_us = microseconds;
+	}
+	if (microseconds > latency->max_us) {
+		latency->max_us = microseconds;
+	}
+
+	latency->reports++;
+	latency->total_us += microseconds;
+	latency->histogram[MIN(microseconds / USBD_LATENCY_HISTOGRAM_BUCKET_US, USBD_LATENCY_HISTOGRAM_BUCKET_COUNT - 1)]++;
+}
+
+static void hid_in_transfer_completed(uint8_t endpoint_number)
+{
+	// The host has acknowledged the report
+	if (!in_flight_repeated) {
+		record_latency(cycle_counter_read() - in_flight_timestamp);
+	}
+
+	in_busy = 0;
+}
+
+/**
+ * @brief Arm the newest report (or repeat the current one when the idle period is over)
+ */
+static void hid_end_of_periodic_frame(uint8_t endpoint_address)
+{
+	idle_frames++;
+
+	if (in_busy) {
+		return;
+	}
+
+	if (mailbox_full) {
+		in_flight_report = mailbox;
+		in_flight_timestamp = mailbox_timestamp;
+		in_flight_repeated = 0;
+		mailbox_full = 0;
+	} else if (idle_rate && idle_frames >= idle_rate * 4) {
+		in_flight_report = current_report;
+		in_flight_repeated = 1;
+	} else {
+		return;
+	}
+
+	idle_frames = 0;
+	in_busy = 1;
+	usb_driver.start_in_transfer(endpoint_address & 0x0F, &in_flight_report, sizeof(in_flight_report));
+}
+
+static void hid_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	// The host has not seen any report yet, so the current one goes out in the next frame
+	mailbox = current_report;
+	mailbox_timestamp = cycle_counter_read();
+	mailbox_full = 1;
+	idle_frames = 0;
+	in_busy = 0;
+}
+
+static void hid_endpoint_deactivated(uint8_t endpoint_address)
+{
+	in_busy = 1;
+}
+
+/**
+ * @brief Clearing the halt dropped the report armed, so the next frame arms the newest one
+ */
+static void hid_endpoint_halt_cleared(uint8_t endpoint_address)
+{
+	in_busy = 0;
+}
+
+const UsbEndpointHandler usbd_hid_endpoint_handler = {
+	.on_in_transfer_completed = &hid_in_transfer_completed,
+	.on_endpoint_activated = &hid_endpoint_activated,
+	.on_endpoint_deactivated = &hid_endpoint_deactivated,
+	.on_endpoint_halt_cleared = &hid_endpoint_halt_cleared,
+	.on_end_of_periodic_frame = &hid_end_of_periodic_frame
+};
+
+static uint8_t get_report_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	switch (request->wValue >> 8)
+	{
+	case USB_HID_REPORT_TYPE_INPUT:
+		usb_device->ptr_in_buffer = &current_report;
+		usb_device->in_data_size = sizeof(current_report);
+		return 1;
+	case USB_HID_REPORT_TYPE_OUTPUT:
+		usb_device->ptr_in_buffer = &output_report;
+		usb_device->in_data_size = sizeof(output_report);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static uint8_t set_report_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if ((request->wValue >> 8) != USB_HID_REPORT_TYPE_OUTPUT || request->wLength != sizeof(UsbHidOutputReport)) {
+		return 0;
+	}
+
+	// The data stage is received straight into the output report
+	if (usb_device->control_transfer_stage == USB_CONTROL_STAGE_SETUP) {
+		usb_device->ptr_control_out_data = &output_report;
+		return 1;
+	}
+
+	log_info("HID output report: LEDs 0x%04X.", output_report.leds);
+	return 1;
+}
+
+static uint8_t get_idle_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	usb_device->ptr_in_buffer = &idle_rate;
+	usb_device->in_data_size = sizeof(idle_rate);
+	return 1;
+}
+
+static uint8_t set_idle_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	// Note: There is only one report, so the report ID (low byte) is ignored
+	idle_rate = request->wValue >> 8;
+	idle_frames = 0;
+	return 1;
+}
+
+static UsbRequestHandler const hid_request_handlers[] = {
+	[USB_HID_REQUEST_GET_REPORT - USB_HID_REQUEST_GET_REPORT] = &get_report_handler,
+	[USB_HID_REQUEST_GET_IDLE - USB_HID_REQUEST_GET_REPORT] = &get_idle_handler,
+	[USB_HID_REQUEST_SET_REPORT - USB_HID_REQUEST_GET_REPORT] = &set_report_handler,
+	[USB_HID_REQUEST_SET_IDLE - USB_HID_REQUEST_GET_REPORT] = &set_idle_handler
+};
+
+static UsbRequestHandlers const hid_requests = {
+	.first_request = USB_HID_REQUEST_GET_REPORT,
+	.request_count = sizeof(hid_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = hid_request_handlers
+};
+
+void usbd_hid_initialize()
+{
+	cycle_counter_initialize();
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE,
+		USBD_INTERFACE_HID, &hid_requests);
+	usbd_register_interface_descriptor(USBD_INTERFACE_HID, USB_DESCRIPTOR_TYPE_HID_REPORT, report_descriptor,
+		sizeof(report_descriptor));
+}
+
+/**
+ * @brief Submit the newest input report, replacing the one still waiting (if any)
+ * @note Called by the application (also from interrupts), as soon as the input changes.
+ * The latency from this call to the acknowledgment of the host is measured in the statistics.
+ */
+void usbd_hid_send_report(UsbHidInputReport const *report)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	// The mailbox is emptied by the USB interrupt, so the report must not be torn by it
+	__disable_irq();
+
+	if (mailbox_full) {
+		usbd_statistics.hid_latency.overwritten++;
+	} else {
+		mailbox_timestamp = cycle_counter_read();
+	}
+
+	mailbox = *report;
+	current_report = *report;
+	mailbox_full = 1;
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Return the output report last set by the host
+ */
+UsbHidOutputReport usbd_hid_output_report()
+{
+	return output_report;
+}
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * usbd_midi.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_midi.h"
+#include "usbd_config.h"
+
+#if USBD_MIDI_ENABLED
+
+#include <stddef.h>
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+#include "Helpers/ring_buffer.h"
+
+_Static_assert((USBD_MIDI_QUEUE_SIZE & (USBD_MIDI_QUEUE_SIZE - 1)) == 0, "The event queue size must be a power of 2");
+_Static_assert((USBD_MIDI_RX_BUFFER_SIZE & (USBD_MIDI_RX_BUFFER_SIZE - 1)) == 0 &&
+	USBD_MIDI_RX_BUFFER_SIZE >= USBD_MIDI_PACKET_SIZE, "The receive ring size must be a power of 2 of at least a packet");
+_Static_assert(USBD_MIDI_CABLE_COUNT >= 1 && USBD_MIDI_CABLE_COUNT <= 16, "A MIDI function has 1 to 16 cables");
+_Static_assert(sizeof(UsbMidiEvent) == 4, "An event packet is 4 bytes");
+
+/*
+ * The events for the host go through a bounded queue with many producers (the application and
+ * interrupts of any priority) and one consumer (the USB interrupt), without disabling interrupts.
+ * A producer claims a slot by advancing the enqueue position with LDREX/STREX (an exception
+ * between the two clears the exclusive monitor, so a producer that was interrupted tries again),
+ * then fills the slot and publishes it through its sequence number. The consumer only takes
+ * published slots, in order: a producer interrupted between claiming and publishing holds the
+ * events behind it back until it resumes, so the order of the events is kept.
+ *
+ * The queue is emptied into the IN endpoint at the end of the periodic frame, up to 16 events
+ * per packet, so a burst of events is sent in one transaction instead of one per event. When a
+ * full packet is acknowledged and another full one is waiting, it is sent at once.
+ */
+typedef struct
+{
+	/// \brief Its position when it is free, its position + 1 when it holds an event (wraps at 2^32)
+	volatile uint32_t sequence;
+	UsbMidiEvent event;
+} QueueSlot;
+
+static QueueSlot queue[USBD_MIDI_QUEUE_SIZE];
+/// \brief The next slot claimed by a producer
+static volatile uint32_t enqueue_position;
+/// \brief The next slot taken by the USB interrupt
+static volatile uint32_t dequeue_position;
+
+/// \brief The packet armed in the IN endpoint
+static UsbMidiEvent in_packet[USBD_MIDI_EVENTS_PER_PACKET];
+/// \brief A packet is armed (or the endpoint is not active)
+static uint8_t in_busy = 1;
+
+static uint8_t rx_storage[USBD_MIDI_RX_BUFFER_SIZE];
+/// \brief Filled by the USB interrupt with whole events, emptied by usbd_midi_process()
+static RingBuffer rx_ring;
+/// \brief The OUT endpoint answers NAK until usbd_midi_process() frees a packet of the receive ring
+static volatile uint8_t rx_paused;
+
+/// \brief Where the events of each cable go, the events of a cable without a route are dropped
+static UsbMidiEventHandler routes[USBD_MIDI_CABLE_COUNT];
+
+/**
+ * @brief Take up to `max_count` published events out of the queue
+ * @return The count of events taken
+ * @note Called from the USB interrupt only.
+ */
+static uint32_t dequeue(UsbMidiEvent *events, uint32_t max_count)
+{
+	uint32_t position = dequeue_position;
+	uint32_t count = 0;
+
+	while (count < max_count) {
+		QueueSlot *slot = &queue[position & (USBD_MIDI_QUEUE_SIZE - 1)];
+
+		// Empty, or the next event is claimed but not filled yet
+		if (slot->sequence != position + 1) {
+			break;
+		}
+
+		events[count++] = slot->event;
+		// The event is read before the slot is handed to the producers of the next lap
+		__DMB();
+		slot->sequence = position + USBD_MIDI_QUEUE_SIZE;
+		position++;
+	}
+
+	dequeue_position = position;
+	return count;
+}
+
+/**
+ * @brief Return the count of events claimed by the producers and not taken yet
+ */
+static uint32_t queued_events()
+{
+	return enqueue_position - dequeue_position;
+}
+
+/**
+ * @brief Arm the IN endpoint with the events waiting, up to a full packet
+ * @note Called from the USB interrupt.
+ */
+static void send_next()
+{
+	uint32_t count = dequeue(in_packet, USBD_MIDI_EVENTS_PER_PACKET);
+
+	if (count == 0) {
+		return;
+	}
+
+	in_busy = 1;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_MIDI_IN & 0x0F, in_packet, count * sizeof(UsbMidiEvent));
+}
+
+/**
+ * @brief Arm the OUT endpoint for as many whole packets as fit in the free part of the receive ring
+ * @note Called from the USB interrupt, or by usbd_midi_process() with the interrupt disabled.
+ */
+static void receive_next()
+{
+	uint32_t free_size = ring_buffer_free(&rx_ring);
+
+	if (free_size < USBD_MIDI_PACKET_SIZE) {
+		rx_paused = 1;
+		return;
+	}
+
+	rx_paused = 0;
+	usb_driver.start_out_transfer(USBD_ENDPOINT_MIDI_OUT, free_size - free_size % USBD_MIDI_PACKET_SIZE);
+}
+
+static void midi_out_data_received(uint8_t endpoint_number, uint16_t byte_count)
+{
+	uint8_t packet[USBD_MIDI_PACKET_SIZE];
+
+	usb_driver.read_packet(packet, byte_count);
+	// Only whole events enter the ring, so usbd_midi_process() never sees a torn one
+	ring_buffer_write(&rx_ring, packet, byte_count & ~(sizeof(UsbMidiEvent) - 1));
+}
+
+static void midi_out_transfer_completed(uint8_t endpoint_number)
+{
+	receive_next();
+}
+
+static void midi_in_transfer_completed(uint8_t endpoint_number)
+{
+	in_busy = 0;
+
+	// Waiting for the end of the frame would only delay a full packet
+	if (queued_events() >= USBD_MIDI_EVENTS_PER_PACKET) {
+		send_next();
+	}
+}
+
+/**
+ * @brief Send the events queued during the frame in one packet
+ */
+static void midi_end_of_periodic_frame(uint8_t endpoint_address)
+{
+	if (!in_busy) {
+		send_next();
+	}
+}
+
+static void midi_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	if (endpoint_address == USBD_ENDPOINT_MIDI_IN) {
+		UsbMidiEvent stale[USBD_MIDI_EVENTS_PER_PACKET];
+
+		// The events queued while nobody listened would play late, so they are dropped
+		while (dequeue(stale, USBD_MIDI_EVENTS_PER_PACKET) > 0) {
+		}
+
+		in_busy = 0;
+	}
+	// Note: The OUT endpoint is armed for one packet by the activation, its completion arms the rest
+}
+
+static void midi_endpoint_deactivated(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_MIDI_IN) {
+		in_busy = 1;
+	} else {
+		rx_paused = 0;
+	}
+}
+
+/**
+ * @brief Clearing the halt dropped the packet armed, the next frame sends the events queued since
+ */
+static void midi_endpoint_halt_cleared(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_MIDI_IN) {
+		in_busy = 0;
+	}
+}
+
+const UsbEndpointHandler usbd_midi_endpoint_handler = {
+	.on_out_data_received = &midi_out_data_received,
+	.on_out_transfer_completed = &midi_out_transfer_completed,
+	.on_in_transfer_completed = &midi_in_transfer_completed,
+	.on_endpoint_activated = &midi_endpoint_activated,
+	.on_endpoint_deactivated = &midi_endpoint_deactivated,
+	.on_endpoint_halt_cleared = &midi_endpoint_halt_cleared,
+	.on_end_of_periodic_frame = &midi_end_of_periodic_frame
+};
+
+void usbd_midi_initialize()
+{
+	for (uint32_t i = 0; i < USBD_MIDI_QUEUE_SIZE; i++) {
+		queue[i].sequence = i;
+	}
+
+	ring_buffer_initialize(&rx_ring, rx_storage, sizeof(rx_storage));
+}
+
+/**
+ * @brief Deliver the events the host sends on `cable` to `handler` (NULL drops them)
+ * @note The handler is called by usbd_midi_process().
+ */
+void usbd_midi_route(uint8_t cable, UsbMidiEventHandler handler)
+{
+	if (cable < USBD_MIDI_CABLE_COUNT) {
+		routes[cable] = handler;
+	}
+}
+
+/**
+ * @brief Queue an event for the host, it is sent at the end of the frame
+ * @return 0 when the queue is full
+ * @note Called by the application or by interrupts of any priority, without locking.
+ */
+uint8_t usbd_midi_send_event(UsbMidiEvent event)
+{
+	uint32_t position;
+	QueueSlot *slot;
+
+	for (;;) {
+		position = __LDREXW(&enqueue_position);
+		slot = &queue[position & (USBD_MIDI_QUEUE_SIZE - 1)];
+
+		int32_t lag = (int32_t)(slot->sequence - position);
+
+		if (lag < 0) {
+			// The slot still holds the event of the previous lap
+			__CLREX();
+			return 0;
+		}
+
+		// A producer that interrupted this one has taken the slot, so the position is stale
+		if (lag > 0) {
+			__CLREX();
+			continue;
+		}
+
+		if (__STREXW(position + 1, &enqueue_position) == 0) {
+			break;
+		}
+	}
+
+	slot->event = event;
+	// The event is written before the slot is published to the USB interrupt
+	__DMB();
+	slot->sequence = position + 1;
+	return 1;
+}
+
+/**
+ * @brief Queue a MIDI message for the host on `cable`
+ * @param status The status byte, its data bytes follow (the unused ones are ignored)
+ * @return 0 when the queue is full, or the message is not one of a single event (system exclusive
+ *         messages are sent with usbd_midi_send_event())
+ */
+uint8_t usbd_midi_send(uint8_t cable, uint8_t status, uint8_t data1, uint8_t data2)
+{
+	uint8_t code_index;
+	uint8_t size;
+
+	if (cable >= USBD_MIDI_CABLE_COUNT || status < 0x80) {
+		return 0;
+	}
+
+	if (status < 0xF0) {
+		// Channel voice messages: program change and channel pressure have a single data byte
+		code_index = status >> 4;
+		size = (code_index == 0xC || code_index == 0xD) ? 2 : 3;
+	} else if (status == 0xF1 || status == 0xF3) {
+		code_index = USB_MIDI_CIN_SYSTEM_COMMON_2;
+		size = 2;
+	} else if (status == 0xF2) {
+		code_index = USB_MIDI_CIN_SYSTEM_COMMON_3;
+		size = 3;
+	} else if (status == 0xF6) {
+		code_index = USB_MIDI_CIN_SYSEX_END_1;
+		size = 1;
+	} else if (status >= 0xF8) {
+		code_index = USB_MIDI_CIN_SINGLE_BYTE;
+		size = 1;
+	} else {
+		return 0;
+	}
+
+	UsbMidiEvent event = {
+		.header = (cable << 4) | code_index,
+		.midi = { status, size > 1 ? data1 : 0, size > 2 ? data2 : 0 }
+	};
+
+	return usbd_midi_send_event(event);
+}
+
+/**
+ * @brief Hand the events received from the host to the routes of their cables
+ * @note Called by the application. When the ring was full, the host is let send again.
+ */
+void usbd_midi_process()
+{
+	UsbMidiEvent event;
+
+	while (ring_buffer_read(&rx_ring, &event, sizeof(event)) == sizeof(event)) {
+		uint8_t cable = event.header >> 4;
+		UsbMidiEventHandler handler = cable < USBD_MIDI_CABLE_COUNT ? routes[cable] : NULL;
+
+		// Hosts pad their packets with empty events
+		if ((event.header & 0x0F) != USB_MIDI_CIN_MISC && handler) {
+			handler(event);
+		}
+	}
+
+	if (rx_paused) {
+		uint32_t primask = __get_PRIMASK();
+
+		// The USB interrupt pauses the endpoint too, so the check and the arming must not be split by it
+		__disable_irq();
+		if (rx_paused) {
+			receive_next();
+		}
+		__set_PRIMASK(primask);
+	}
+}
+
+#endif
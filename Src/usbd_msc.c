@@ -0,0 +1,892 @@
+/*
+ * usbd_msc.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_msc.h"
+#include "usbd_config.h"
+
+#if USBD_MSC_ENABLED
+
+#include <string.h>
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+#include "usbd_framework.h"
+#include "usbd_requests.h"
+#include "Helpers/logger.h"
+#include "Helpers/math.h"
+
+/// \brief The maximum packet size of both bulk endpoints
+#define MSC_PACKET_SIZE 64
+
+/// \brief The count of blocks held by one data buffer
+#define BUFFER_BLOCKS (USBD_MSC_BUFFER_SIZE / BLOCK_DEVICE_BLOCK_SIZE)
+
+_Static_assert(USBD_MSC_BUFFER_SIZE % BLOCK_DEVICE_BLOCK_SIZE == 0 && USBD_MSC_BUFFER_SIZE <= 0x3FF * MSC_PACKET_SIZE,
+	"The buffer size must be a multiple of the block size that fits in one OUT transfer");
+_Static_assert(USBD_MSC_LUN_COUNT >= 1 && USBD_MSC_LUN_COUNT <= 16, "The bulk-only transport addresses 1 to 16 logical units");
+_Static_assert(sizeof(UsbMscCommandBlockWrapper) == 31 && sizeof(UsbMscCommandStatusWrapper) == 13,
+	"The wrappers must match the bulk-only transport");
+
+/** \brief The phases of the bulk-only transport */
+typedef enum
+{
+	MSC_PHASE_COMMAND, /**<\brief Waiting for a CBW */
+	MSC_PHASE_DATA_IN,
+	MSC_PHASE_DATA_OUT,
+	MSC_PHASE_EXECUTE, /**<\brief The command runs in the main loop without a data stage */
+	MSC_PHASE_STATUS, /**<\brief The CSW is sent (or waits for the host to clear the halt of the IN endpoint) */
+	MSC_PHASE_RESET_RECOVERY /**<\brief An invalid CBW halted both endpoints until a bulk-only mass storage reset */
+} MscPhase;
+
+/** \brief The work done by usbd_msc_process() for the current command */
+typedef enum
+{
+	MSC_JOB_NONE,
+	MSC_JOB_READ, /**<\brief Read the blocks into the buffers, the USB interrupt sends them */
+	MSC_JOB_WRITE, /**<\brief Write the buffers received by the USB interrupt to the blocks */
+	MSC_JOB_FLUSH
+} MscJob;
+
+/** \brief A logical unit: its medium and the sense data of its last failed command */
+typedef struct
+{
+	BlockDevice const *device; /**<\brief NULL - no medium */
+	uint8_t sense_key;
+	uint8_t additional_sense_code;
+	/// \brief A medium was attached, reported once as a unit attention so the host rereads the capacity
+	uint8_t medium_changed;
+} MscLogicalUnit;
+
+/** \brief The standard INQUIRY data */
+typedef struct __attribute__((packed))
+{
+	uint8_t peripheral_device_type;
+	uint8_t removable;
+	uint8_t version;
+	uint8_t response_data_format;
+	uint8_t additional_length;
+	uint8_t flags[3];
+	char vendor[8];
+	char product[16];
+	char revision[4];
+} ScsiInquiryData;
+
+static const ScsiInquiryData inquiry_data = {
+	.peripheral_device_type = 0x00, // Direct access block device
+	.removable = 0x80,
+	.version = 0x04, // SPC-2
+	.response_data_format = 0x02,
+	.additional_length = sizeof(ScsiInquiryData) - 5,
+	.vendor = "lototsky",
+	.product = "STM32 Storage   ",
+	.revision = "1.00"
+};
+
+static const uint8_t max_lun = USBD_MSC_LUN_COUNT - 1;
+
+static MscLogicalUnit logical_units[USBD_MSC_LUN_COUNT];
+
+/// \brief The CBW is received here (with room for a whole packet, as the host may send a malformed one)
+static uint32_t command_packet[MSC_PACKET_SIZE / 4];
+static UsbMscCommandBlockWrapper cbw;
+static UsbMscCommandStatusWrapper csw;
+/// \brief The logical unit addressed by the current command
+static MscLogicalUnit *unit;
+/// \brief The data stage of the commands answered by the USB interrupt (sense, capacity, mode pages)
+static uint8_t response[20] __attribute__((aligned(4)));
+static uint32_t response_size;
+
+static volatile uint8_t phase;
+static uint8_t in_busy = 1;
+static uint8_t in_halted;
+static uint8_t out_halted;
+/// \brief The bytes received by the OUT transfer in progress, and its size
+static uint32_t out_received;
+static uint32_t out_armed_size;
+
+/*
+ * The data stage of READ(10) and WRITE(10) goes through two buffers, so the medium and the bus
+ * work at the same time: the main loop reads the next blocks while the USB interrupt sends the
+ * previous ones, and writes the received blocks while the USB interrupt receives the next ones.
+ * The counters run freely: the buffer `count & 1` is the next one to fill or to drain.
+ */
+static uint8_t buffers[2][USBD_MSC_BUFFER_SIZE] __attribute__((aligned(4)));
+static uint32_t buffer_sizes[2];
+/// \brief The buffers filled: read from the medium (READ) or received from the host (WRITE)
+static volatile uint32_t filled_count;
+/// \brief The buffers drained: sent to the host (READ) or written to the medium (WRITE)
+static volatile uint32_t drained_count;
+
+static volatile uint8_t job;
+/// \brief Changed by every reset of the transport, so the main loop drops the result of a stale job
+static volatile uint8_t job_generation;
+static BlockDevice const *job_device;
+/// \brief The next block to read or write
+static uint32_t job_block;
+/// \brief The blocks left to read from the medium (READ)
+static volatile uint32_t job_blocks;
+/// \brief The bytes of the data stage left to receive (WRITE)
+static uint32_t out_remaining;
+/// \brief The OUT endpoint answers NAK until the main loop drains a buffer
+static volatile uint8_t out_paused;
+
+static uint16_t read_be16(uint8_t const *data)
+{
+	return (data[0] << 8) | data[1];
+}
+
+static uint32_t read_be32(uint8_t const *data)
+{
+	return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static void write_be32(uint8_t *data, uint32_t value)
+{
+	data[0] = value >> 24;
+	data[1] = value >> 16;
+	data[2] = value >> 8;
+	data[3] = value;
+}
+
+static void set_sense(uint8_t sense_key, uint8_t additional_sense_code)
+{
+	if (unit) {
+		unit->sense_key = sense_key;
+		unit->additional_sense_code = additional_sense_code;
+	}
+}
+
+static void receive_command()
+{
+	out_received = 0;
+	out_armed_size = MSC_PACKET_SIZE;
+	usb_driver.start_out_transfer(USBD_ENDPOINT_MSC_OUT, MSC_PACKET_SIZE);
+}
+
+static void send_status()
+{
+	phase = MSC_PHASE_STATUS;
+	csw.dCSWSignature = USB_MSC_CSW_SIGNATURE;
+	in_busy = 1;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_MSC_IN & 0x0F, &csw, sizeof(csw));
+}
+
+static void halt_endpoint(uint8_t endpoint_address)
+{
+	if (endpoint_address & 0x80) {
+		in_halted = 1;
+		in_busy = 0;
+	} else {
+		out_halted = 1;
+	}
+	usbd_set_endpoint_halt(endpoint_address, 1);
+}
+
+/**
+ * @brief End the current command with its CSW
+ * @details When the host expected more data than the command transferred, the endpoint of the
+ * data stage is halted first: a halted IN endpoint delays the CSW until the host clears it, a
+ * halted OUT endpoint only stops the host from sending.
+ * @note Called from the USB interrupt, or by the main loop with the interrupt disabled.
+ */
+static void finish_command()
+{
+	job = MSC_JOB_NONE;
+
+	if (csw.dCSWDataResidue > 0) {
+		if (cbw.bmCBWFlags & USB_MSC_CBW_FLAGS_DIRECTION_IN) {
+			halt_endpoint(USBD_ENDPOINT_MSC_IN);
+			phase = MSC_PHASE_STATUS;
+			return;
+		}
+		halt_endpoint(USBD_ENDPOINT_MSC_OUT);
+	}
+
+	send_status();
+}
+
+static void fail_command(uint8_t sense_key, uint8_t additional_sense_code)
+{
+	set_sense(sense_key, additional_sense_code);
+	csw.bCSWStatus = USB_MSC_CSW_STATUS_FAILED;
+	finish_command();
+}
+
+/**
+ * @brief End a command whose data stage disagrees with the one expected by the host
+ */
+static void fail_phase()
+{
+	csw.bCSWStatus = USB_MSC_CSW_STATUS_PHASE_ERROR;
+	finish_command();
+}
+
+/**
+ * @brief Send the data stage of a command answered at once
+ * @param size The size of the data, truncated to the size expected by the host (the allocation length)
+ */
+static void send_data(void const *data, uint32_t size)
+{
+	if (!(cbw.bmCBWFlags & USB_MSC_CBW_FLAGS_DIRECTION_IN) && cbw.dCBWDataTransferLength > 0) {
+		fail_phase();
+		return;
+	}
+
+	response_size = MIN(size, cbw.dCBWDataTransferLength);
+
+	if (response_size == 0) {
+		finish_command();
+		return;
+	}
+
+	phase = MSC_PHASE_DATA_IN;
+	in_busy = 1;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_MSC_IN & 0x0F, data, response_size);
+}
+
+/**
+ * @brief Send the next buffer read from the medium, or end the command once all are sent
+ * @note Called from the USB interrupt, or by the main loop with the interrupt disabled.
+ */
+static void send_next_buffer()
+{
+	if (in_busy || phase != MSC_PHASE_DATA_IN) {
+		return;
+	}
+
+	if (filled_count != drained_count) {
+		in_busy = 1;
+		usb_driver.start_in_transfer(USBD_ENDPOINT_MSC_IN & 0x0F, buffers[drained_count & 1],
+			buffer_sizes[drained_count & 1]);
+	} else if (job_blocks == 0) {
+		// Everything read is sent (the medium may have failed before the last block)
+		finish_command();
+	}
+}
+
+/**
+ * @brief Arm the OUT endpoint for the next buffer, unless both wait for the medium
+ * @note Called from the USB interrupt, or by the main loop with the interrupt disabled.
+ */
+static void receive_next_buffer()
+{
+	if (out_remaining == 0) {
+		return;
+	}
+
+	if (filled_count - drained_count == 2) {
+		out_paused = 1;
+		return;
+	}
+
+	out_paused = 0;
+	out_received = 0;
+	out_armed_size = MIN(out_remaining, USBD_MSC_BUFFER_SIZE);
+	usb_driver.start_out_transfer(USBD_ENDPOINT_MSC_OUT, out_armed_size);
+}
+
+/**
+ * @brief Drop the command in progress (the halts of the endpoints are kept)
+ */
+static void reset_transport()
+{
+	job_generation++;
+	job = MSC_JOB_NONE;
+	job_blocks = 0;
+	out_remaining = 0;
+	out_paused = 0;
+	filled_count = 0;
+	drained_count = 0;
+	phase = MSC_PHASE_COMMAND;
+}
+
+/**
+ * @brief Check that the logical unit has a medium, failing the command otherwise
+ */
+static uint8_t is_medium_ready()
+{
+	if (!unit->device) {
+		fail_command(SCSI_SENSE_NOT_READY, SCSI_ASC_MEDIUM_NOT_PRESENT);
+		return 0;
+	}
+
+	if (unit->medium_changed) {
+		unit->medium_changed = 0;
+		fail_command(SCSI_SENSE_UNIT_ATTENTION, SCSI_ASC_MEDIUM_MAY_HAVE_CHANGED);
+		return 0;
+	}
+
+	return 1;
+}
+
+static uint8_t are_blocks_in_range(uint32_t block, uint32_t count)
+{
+	uint32_t block_count = unit->device->block_count;
+
+	if (block > block_count || count > block_count - block) {
+		fail_command(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_LBA_OUT_OF_RANGE);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void inquiry(uint8_t const *command)
+{
+	// The vital product data pages are not supported
+	if (command[1] & 0x01) {
+		fail_command(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_INVALID_FIELD_IN_CDB);
+		return;
+	}
+
+	send_data(&inquiry_data, MIN(sizeof(inquiry_data), read_be16(&command[3])));
+}
+
+static void request_sense(uint8_t const *command)
+{
+	// Fixed format sense data
+	memset(response, 0, 18);
+	response[0] = 0x70;
+	response[2] = unit->sense_key;
+	response[7] = 18 - 8;
+	response[12] = unit->additional_sense_code;
+
+	set_sense(SCSI_SENSE_NO_SENSE, 0);
+	send_data(response, MIN(18, command[4]));
+}
+
+/**
+ * @brief Answer MODE SENSE(6) and MODE SENSE(10) with the mode parameter header alone
+ * @details The header tells the host whether the medium is write protected, no mode page is needed.
+ */
+static void mode_sense(uint8_t const *command)
+{
+	uint8_t write_protected = (unit->device && unit->device->read_only) ? 0x80 : 0x00;
+
+	memset(response, 0, 8);
+
+	if (command[0] == SCSI_MODE_SENSE_6) {
+		response[0] = 4 - 1;
+		response[2] = write_protected;
+		send_data(response, MIN(4, command[4]));
+	} else {
+		response[1] = 8 - 2;
+		response[3] = write_protected;
+		send_data(response, MIN(8, read_be16(&command[7])));
+	}
+}
+
+static void read_capacity(uint8_t const *command)
+{
+	if (!is_medium_ready()) {
+		return;
+	}
+
+	write_be32(&response[0], unit->device->block_count - 1);
+	write_be32(&response[4], BLOCK_DEVICE_BLOCK_SIZE);
+	send_data(response, 8);
+}
+
+static void read_format_capacities(uint8_t const *command)
+{
+	memset(response, 0, 12);
+	response[3] = 8;
+
+	if (unit->device) {
+		write_be32(&response[4], unit->device->block_count);
+		response[8] = 0x02; // Formatted media
+	} else {
+		write_be32(&response[4], 0xFFFFFFFF);
+		response[8] = 0x03; // No media present
+	}
+	response[10] = BLOCK_DEVICE_BLOCK_SIZE >> 8;
+	response[11] = BLOCK_DEVICE_BLOCK_SIZE & 0xFF;
+
+	send_data(response, MIN(12, read_be16(&command[7])));
+}
+
+/**
+ * @brief Start READ(10): the main loop reads the blocks, the USB interrupt sends them
+ */
+static void read_10(uint8_t const *command)
+{
+	uint32_t block = read_be32(&command[2]);
+	uint32_t count = read_be16(&command[7]);
+	uint32_t size = count * BLOCK_DEVICE_BLOCK_SIZE;
+
+	if (size > 0 && (!(cbw.bmCBWFlags & USB_MSC_CBW_FLAGS_DIRECTION_IN) || cbw.dCBWDataTransferLength < size)) {
+		fail_phase();
+		return;
+	}
+
+	if (!is_medium_ready() || !are_blocks_in_range(block, count)) {
+		return;
+	}
+
+	if (count == 0) {
+		finish_command();
+		return;
+	}
+
+	job_device = unit->device;
+	job_block = block;
+	job_blocks = count;
+	filled_count = 0;
+	drained_count = 0;
+	phase = MSC_PHASE_DATA_IN;
+	// The main loop (woken up by this interrupt) reads the first buffer
+	job = MSC_JOB_READ;
+}
+
+/**
+ * @brief Start WRITE(10): the USB interrupt receives the blocks, the main loop writes them
+ */
+static void write_10(uint8_t const *command)
+{
+	uint32_t block = read_be32(&command[2]);
+	uint32_t count = read_be16(&command[7]);
+	uint32_t size = count * BLOCK_DEVICE_BLOCK_SIZE;
+
+	if (size > 0 && ((cbw.bmCBWFlags & USB_MSC_CBW_FLAGS_DIRECTION_IN) || cbw.dCBWDataTransferLength < size)) {
+		fail_phase();
+		return;
+	}
+
+	if (!is_medium_ready() || !are_blocks_in_range(block, count)) {
+		return;
+	}
+
+	if (unit->device->read_only) {
+		fail_command(SCSI_SENSE_DATA_PROTECT, SCSI_ASC_WRITE_PROTECTED);
+		return;
+	}
+
+	if (count == 0) {
+		finish_command();
+		return;
+	}
+
+	job_device = unit->device;
+	job_block = block;
+	out_remaining = size;
+	filled_count = 0;
+	drained_count = 0;
+	phase = MSC_PHASE_DATA_OUT;
+	job = MSC_JOB_WRITE;
+	receive_next_buffer();
+}
+
+static void verify_10(uint8_t const *command)
+{
+	// The blocks are not compared with data sent by the host (BYTCHK)
+	if (command[1] & 0x02) {
+		fail_command(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_INVALID_FIELD_IN_CDB);
+		return;
+	}
+
+	if (is_medium_ready() && are_blocks_in_range(read_be32(&command[2]), read_be16(&command[7]))) {
+		finish_command();
+	}
+}
+
+static void synchronize_cache(uint8_t const *command)
+{
+	if (!is_medium_ready()) {
+		return;
+	}
+
+	if (!unit->device->flush) {
+		finish_command();
+		return;
+	}
+
+	job_device = unit->device;
+	phase = MSC_PHASE_EXECUTE;
+	job = MSC_JOB_FLUSH;
+}
+
+/**
+ * @brief Check the CBW received and start its command
+ */
+static void process_command()
+{
+	UsbMscCommandBlockWrapper const *received = (UsbMscCommandBlockWrapper const *)command_packet;
+
+	if (out_received != sizeof(UsbMscCommandBlockWrapper) || received->dCBWSignature != USB_MSC_CBW_SIGNATURE) {
+		log_error("MSC: invalid CBW of %u bytes.", out_received);
+		phase = MSC_PHASE_RESET_RECOVERY;
+		halt_endpoint(USBD_ENDPOINT_MSC_IN);
+		halt_endpoint(USBD_ENDPOINT_MSC_OUT);
+		return;
+	}
+
+	cbw = *received;
+	csw.dCSWTag = cbw.dCBWTag;
+	csw.dCSWDataResidue = cbw.dCBWDataTransferLength;
+	csw.bCSWStatus = USB_MSC_CSW_STATUS_PASSED;
+
+	if (cbw.bCBWLUN >= USBD_MSC_LUN_COUNT || cbw.bCBWCBLength == 0 || cbw.bCBWCBLength > sizeof(cbw.CBWCB)) {
+		unit = NULL;
+		fail_command(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_LOGICAL_UNIT_NOT_SUPPORTED);
+		return;
+	}
+
+	unit = &logical_units[cbw.bCBWLUN];
+	uint8_t const *command = cbw.CBWCB;
+
+	switch (command[0])
+	{
+	case SCSI_TEST_UNIT_READY:
+		if (is_medium_ready()) {
+			finish_command();
+		}
+		break;
+	case SCSI_REQUEST_SENSE:
+		request_sense(command);
+		break;
+	case SCSI_INQUIRY:
+		inquiry(command);
+		break;
+	case SCSI_MODE_SENSE_6:
+	case SCSI_MODE_SENSE_10:
+		mode_sense(command);
+		break;
+	case SCSI_START_STOP_UNIT:
+	case SCSI_PREVENT_ALLOW_MEDIUM_REMOVAL:
+		finish_command();
+		break;
+	case SCSI_READ_FORMAT_CAPACITIES:
+		read_format_capacities(command);
+		break;
+	case SCSI_READ_CAPACITY_10:
+		read_capacity(command);
+		break;
+	case SCSI_READ_10:
+		read_10(command);
+		break;
+	case SCSI_WRITE_10:
+		write_10(command);
+		break;
+	case SCSI_VERIFY_10:
+		verify_10(command);
+		break;
+	case SCSI_SYNCHRONIZE_CACHE_10:
+		synchronize_cache(command);
+		break;
+	default:
+		fail_command(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_INVALID_COMMAND_OPERATION_CODE);
+		break;
+	}
+}
+
+static void msc_out_data_received(uint8_t endpoint_number, uint16_t byte_count)
+{
+	// Note: The transfer is armed for the free part of the buffer, so the packet always fits
+	if (phase == MSC_PHASE_DATA_OUT) {
+		usb_driver.read_packet(buffers[filled_count & 1] + out_received, byte_count);
+	} else {
+		usb_driver.read_packet(command_packet, byte_count);
+	}
+	out_received += byte_count;
+}
+
+static void msc_out_transfer_completed(uint8_t endpoint_number)
+{
+	if (phase == MSC_PHASE_COMMAND) {
+		process_command();
+		return;
+	}
+
+	if (phase != MSC_PHASE_DATA_OUT) {
+		return;
+	}
+
+	buffer_sizes[filled_count & 1] = out_received;
+	out_remaining -= out_received;
+	csw.dCSWDataResidue -= out_received;
+
+	// A short packet ended the data stage before the blocks announced by the command
+	if (out_received < out_armed_size) {
+		out_remaining = 0;
+		csw.bCSWStatus = USB_MSC_CSW_STATUS_PHASE_ERROR;
+	}
+
+	filled_count++;
+	receive_next_buffer();
+}
+
+static void msc_in_transfer_completed(uint8_t endpoint_number)
+{
+	in_busy = 0;
+
+	if (phase == MSC_PHASE_DATA_IN) {
+		if (job == MSC_JOB_READ) {
+			csw.dCSWDataResidue -= buffer_sizes[drained_count & 1];
+			drained_count++;
+			send_next_buffer();
+		} else {
+			csw.dCSWDataResidue -= response_size;
+			finish_command();
+		}
+	} else if (phase == MSC_PHASE_STATUS) {
+		phase = MSC_PHASE_COMMAND;
+		if (!out_halted) {
+			receive_command();
+		}
+	}
+}
+
+static void msc_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	if (endpoint_address == USBD_ENDPOINT_MSC_IN) {
+		in_halted = 0;
+		in_busy = 0;
+	} else {
+		// Note: The activation arms the endpoint for one packet, the first CBW
+		out_halted = 0;
+		out_received = 0;
+		out_armed_size = MSC_PACKET_SIZE;
+		reset_transport();
+	}
+}
+
+static void msc_endpoint_deactivated(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_MSC_IN) {
+		in_busy = 1;
+	}
+	reset_transport();
+}
+
+/**
+ * @brief Continue the transport stopped by the halt: send the CSW or receive the next CBW
+ * @note After an invalid CBW the endpoints stay halted until a bulk-only mass storage reset.
+ */
+static void msc_endpoint_halt_cleared(uint8_t endpoint_address)
+{
+	if (phase == MSC_PHASE_RESET_RECOVERY) {
+		usbd_set_endpoint_halt(endpoint_address, 1);
+		return;
+	}
+
+	if (endpoint_address == USBD_ENDPOINT_MSC_IN) {
+		// Clearing the halt dropped the transfer in progress
+		in_halted = 0;
+		in_busy = 0;
+		if (phase == MSC_PHASE_STATUS) {
+			send_status();
+		}
+	} else {
+		out_halted = 0;
+		if (phase == MSC_PHASE_COMMAND) {
+			receive_command();
+		}
+	}
+}
+
+const UsbEndpointHandler usbd_msc_endpoint_handler = {
+	.on_out_data_received = &msc_out_data_received,
+	.on_out_transfer_completed = &msc_out_transfer_completed,
+	.on_in_transfer_completed = &msc_in_transfer_completed,
+	.on_endpoint_activated = &msc_endpoint_activated,
+	.on_endpoint_deactivated = &msc_endpoint_deactivated,
+	.on_endpoint_halt_cleared = &msc_endpoint_halt_cleared
+};
+
+static uint8_t get_max_lun_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	usb_device->ptr_in_buffer = &max_lun;
+	usb_device->in_data_size = sizeof(max_lun);
+	return 1;
+}
+
+static uint8_t reset_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if (request->wValue != 0 || request->wLength != 0) {
+		return 0;
+	}
+
+	log_info("MSC: bulk-only mass storage reset.");
+	reset_transport();
+
+	// The halts stay until the host clears them, which arms the OUT endpoint then
+	if (!out_halted) {
+		receive_command();
+	}
+	return 1;
+}
+
+static UsbRequestHandler const msc_request_handlers[] = {
+	[USB_MSC_REQUEST_GET_MAX_LUN - USB_MSC_REQUEST_GET_MAX_LUN] = &get_max_lun_handler,
+	[USB_MSC_REQUEST_RESET - USB_MSC_REQUEST_GET_MAX_LUN] = &reset_handler
+};
+
+static UsbRequestHandlers const msc_requests = {
+	.first_request = USB_MSC_REQUEST_GET_MAX_LUN,
+	.request_count = sizeof(msc_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = msc_request_handlers
+};
+
+void usbd_msc_initialize()
+{
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE,
+		USBD_INTERFACE_MSC, &msc_requests);
+}
+
+/**
+ * @brief Insert a medium into a logical unit (NULL ejects it)
+ * @note Called by the application.
+ */
+void usbd_msc_attach(uint8_t lun, BlockDevice const *device)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	if (lun >= USBD_MSC_LUN_COUNT) {
+		return;
+	}
+
+	// The USB interrupt reads the medium of the unit while it answers a command
+	__disable_irq();
+	logical_units[lun].device = device;
+	logical_units[lun].medium_changed = 1;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Read the blocks of READ(10) into the free buffers (while the USB interrupt sends the full ones)
+ */
+static void read_blocks()
+{
+	uint8_t generation = job_generation;
+
+	while (job_blocks > 0 && filled_count - drained_count < 2) {
+		uint8_t index = filled_count & 1;
+		uint32_t count = MIN(job_blocks, BUFFER_BLOCKS);
+		uint8_t success = job_device->read(job_block, buffers[index], count);
+		uint32_t primask = __get_PRIMASK();
+
+		__disable_irq();
+
+		// A reset of the transport dropped the command while the medium was read
+		if (generation != job_generation) {
+			__set_PRIMASK(primask);
+			return;
+		}
+
+		if (success) {
+			buffer_sizes[index] = count * BLOCK_DEVICE_BLOCK_SIZE;
+			job_block += count;
+			job_blocks -= count;
+			filled_count++;
+		} else {
+			set_sense(SCSI_SENSE_MEDIUM_ERROR, SCSI_ASC_UNRECOVERED_READ_ERROR);
+			csw.bCSWStatus = USB_MSC_CSW_STATUS_FAILED;
+			job_blocks = 0;
+		}
+
+		send_next_buffer();
+		__set_PRIMASK(primask);
+	}
+}
+
+/**
+ * @brief Write the buffers of WRITE(10) received so far (while the USB interrupt receives the next one)
+ */
+static void write_blocks()
+{
+	uint8_t generation = job_generation;
+
+	while (filled_count != drained_count) {
+		uint8_t index = drained_count & 1;
+		uint32_t count = buffer_sizes[index] / BLOCK_DEVICE_BLOCK_SIZE;
+		// After a failure the rest of the data stage is only received, not written
+		uint8_t success = csw.bCSWStatus != USB_MSC_CSW_STATUS_PASSED || count == 0 ||
+			job_device->write(job_block, buffers[index], count);
+		uint32_t primask = __get_PRIMASK();
+
+		__disable_irq();
+
+		if (generation != job_generation) {
+			__set_PRIMASK(primask);
+			return;
+		}
+
+		if (!success) {
+			set_sense(SCSI_SENSE_MEDIUM_ERROR, SCSI_ASC_WRITE_FAULT);
+			csw.bCSWStatus = USB_MSC_CSW_STATUS_FAILED;
+		}
+
+		job_block += count;
+		drained_count++;
+
+		if (out_remaining == 0 && filled_count == drained_count) {
+			finish_command();
+		} else if (out_paused) {
+			receive_next_buffer();
+		}
+
+		__set_PRIMASK(primask);
+	}
+}
+
+static void flush_blocks()
+{
+	uint8_t generation = job_generation;
+	uint8_t success = job_device->flush();
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	if (generation == job_generation) {
+		if (!success) {
+			fail_command(SCSI_SENSE_MEDIUM_ERROR, SCSI_ASC_WRITE_FAULT);
+		} else {
+			finish_command();
+		}
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Let the media work in the background (e.g. flush their caches) while no command uses them
+ */
+static void poll_media()
+{
+	for (uint8_t lun = 0; lun < USBD_MSC_LUN_COUNT; lun++) {
+		BlockDevice const *device = logical_units[lun].device;
+
+		if (device && device->poll) {
+			device->poll();
+		}
+	}
+}
+
+/**
+ * @brief Move the blocks of the current command between the medium and the buffers
+ * @note Called from the main loop, as the operations of the medium may take long. Between the
+ * commands, the media do their background work.
+ */
+void usbd_msc_process()
+{
+	switch (job)
+	{
+	case MSC_JOB_READ:
+		read_blocks();
+		break;
+	case MSC_JOB_WRITE:
+		write_blocks();
+		break;
+	case MSC_JOB_FLUSH:
+		flush_blocks();
+		break;
+	default:
+		poll_media();
+		break;
+	}
+}
+
+#endif
@@ -0,0 +1,580 @@
+/*
+ * usbd_ncm.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_ncm.h"
+#include "usbd_config.h"
+
+#if USBD_NCM_ENABLED
+
+#include <string.h>
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+#include "usbd_requests.h"
+#include "Helpers/logger.h"
+#include "Helpers/math.h"
+
+_Static_assert((USBD_NCM_DATAGRAM_ALIGNMENT & (USBD_NCM_DATAGRAM_ALIGNMENT - 1)) == 0 && USBD_NCM_DATAGRAM_ALIGNMENT >= 4,
+	"The datagram alignment must be a power of 2 of at least 4");
+_Static_assert(USBD_NCM_NTB_IN_SIZE % 4 == 0 && USBD_NCM_NTB_IN_SIZE >= 2048 && USBD_NCM_NTB_IN_SIZE <= 0xFFFF,
+	"The NTB16 input size must be a multiple of 4 between 2048 and 65535 bytes");
+_Static_assert(USBD_NCM_NTB_OUT_SIZE % 64 == 0 && USBD_NCM_NTB_OUT_SIZE >= 2048 && USBD_NCM_NTB_OUT_SIZE <= 0xFFFF,
+	"The NTB16 output size must be a multiple of 64 between 2048 and 65535 bytes");
+
+/// \brief The maximum packet size of both data endpoints
+#define NCM_DATA_PACKET_SIZE 64
+
+/// \brief The smallest NTB input size accepted from the host (a full frame must fit in one NTB)
+#define NCM_MIN_NTB_IN_SIZE 2048
+
+/// \brief The bit rate reported to the host in both directions (full speed)
+#define NCM_BIT_RATE 12000000
+
+#define ALIGN(value, alignment) (((value) + (alignment) - 1) & ~((alignment) - 1))
+
+/// \brief The offset of the first datagram of an NTB
+#define FIRST_DATAGRAM_OFFSET ALIGN(sizeof(UsbNcmNth16), USBD_NCM_DATAGRAM_ALIGNMENT)
+
+/// \brief The size of a datagram pointer table of `count` datagrams (with its terminating entry)
+#define NDP_SIZE(count) (sizeof(UsbNcmNdp16) + ((count) + 1) * sizeof(UsbNcmDatagramPointer16))
+
+/** \name Pending notifications
+ *@{*/
+#define NOTIFY_CONNECTION_SPEED (1 << 0)
+#define NOTIFY_NETWORK_CONNECTION (1 << 1)
+/**@}*/
+
+/** \brief A notification: a request header followed by the data of CONNECTION_SPEED_CHANGE */
+typedef struct __attribute__((packed))
+{
+	UsbRequest header;
+	uint32_t downlink_bit_rate;
+	uint32_t uplink_bit_rate;
+} UsbNcmNotification;
+
+static const UsbNcmNtbParameters ntb_parameters = {
+	.wLength = sizeof(UsbNcmNtbParameters),
+	.bmNtbFormatsSupported = 0x0001,
+	.dwNtbInMaxSize = USBD_NCM_NTB_IN_SIZE,
+	.wNdpInDivisor = USBD_NCM_DATAGRAM_ALIGNMENT,
+	.wNdpInPayloadRemainder = 0,
+	.wNdpInAlignment = 4,
+	.dwNtbOutMaxSize = USBD_NCM_NTB_OUT_SIZE,
+	.wNdpOutDivisor = USBD_NCM_DATAGRAM_ALIGNMENT,
+	.wNdpOutPayloadRemainder = 0,
+	.wNdpOutAlignment = 4,
+	.wNtbOutMaxDatagrams = 0
+};
+
+/*
+ * Both directions use two NTB buffers: one on the bus and one owned by the application.
+ * The datagrams are written and read in place, so a frame is never copied by the function.
+ */
+static uint8_t in_ntbs[2][USBD_NCM_NTB_IN_SIZE] __attribute__((aligned(4)));
+static uint8_t out_ntbs[2][USBD_NCM_NTB_OUT_SIZE] __attribute__((aligned(4)));
+
+/// \brief The largest NTB sent to the host (it may lower it with SET_NTB_INPUT_SIZE)
+static uint32_t ntb_in_size = USBD_NCM_NTB_IN_SIZE;
+/// \brief The data stage of SET_NTB_INPUT_SIZE
+static uint32_t requested_ntb_in_size;
+static uint16_t packet_filter;
+
+/// \brief The data interface has its endpoints (alternate setting 1), so frames can flow
+static volatile uint8_t connected;
+
+/// \brief The NTB being filled by the application
+static uint8_t in_fill;
+/// \brief Where the next datagram goes in the NTB being filled
+static uint16_t in_fill_offset;
+/// \brief The datagrams of the NTB being filled (written as its NDP when it is closed)
+static UsbNcmDatagramPointer16 in_datagrams[USBD_NCM_MAX_IN_DATAGRAMS];
+static uint8_t in_datagram_count;
+/// \brief The space handed out by usbd_ncm_allocate() (0 - none)
+static uint16_t in_allocated_offset;
+/// \brief An NTB is on the bus (or the endpoint is not active), its completion sends the next one
+static volatile uint8_t in_busy = 1;
+static uint16_t in_sequence;
+
+/// \brief The count of NTBs received, written by the USB interrupt
+static volatile uint32_t out_write_count;
+/// \brief The count of NTBs released, written by the application
+static volatile uint32_t out_read_count;
+static uint16_t out_block_lengths[2];
+/// \brief The bytes received of the NTB in progress
+static uint16_t out_received;
+/// \brief The NTB in progress has ended with a short packet
+static uint8_t out_short_packet;
+/// \brief The OUT endpoint answers NAK until the application releases an NTB
+static volatile uint8_t out_paused;
+
+/// \brief Where the application is in the oldest received NTB: its NDP (0 - not started) and datagram
+static uint16_t out_ndp_offset;
+static uint16_t out_datagram;
+
+static UsbNcmNotification notification;
+static uint8_t notification_busy = 1;
+static uint8_t pending_notifications;
+
+/**
+ * @brief Send the next pending notification (the connection speed goes first)
+ */
+static void notify_next()
+{
+	if (notification_busy || !pending_notifications) {
+		return;
+	}
+
+	notification.header.bmRequestType = USB_BM_REQUEST_TYPE_DIRECTION_TOHOST | USB_BM_REQUEST_TYPE_TYPE_CLASS |
+		USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE;
+	notification.header.wIndex = USBD_INTERFACE_NCM_CONTROL;
+
+	if (pending_notifications & NOTIFY_CONNECTION_SPEED) {
+		pending_notifications &= ~NOTIFY_CONNECTION_SPEED;
+		notification.header.bRequest = USB_CDC_NOTIFICATION_CONNECTION_SPEED_CHANGE;
+		notification.header.wValue = 0;
+		notification.header.wLength = 2 * sizeof(uint32_t);
+		notification.downlink_bit_rate = NCM_BIT_RATE;
+		notification.uplink_bit_rate = NCM_BIT_RATE;
+	} else {
+		pending_notifications &= ~NOTIFY_NETWORK_CONNECTION;
+		notification.header.bRequest = USB_CDC_NOTIFICATION_NETWORK_CONNECTION;
+		notification.header.wValue = connected;
+		notification.header.wLength = 0;
+	}
+
+	notification_busy = 1;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_NCM_NOTIFICATION & 0x0F, &notification,
+		sizeof(UsbRequest) + notification.header.wLength);
+}
+
+/**
+ * @brief Forget the datagrams of the NTB being filled
+ */
+static void reset_in_fill()
+{
+	in_fill_offset = FIRST_DATAGRAM_OFFSET;
+	in_datagram_count = 0;
+	in_allocated_offset = 0;
+}
+
+/**
+ * @brief Close the NTB being filled (append its NDP and write its header) and send it
+ * @note Called from the USB interrupt, or by the application with the interrupt disabled.
+ */
+static void send_ntb()
+{
+	uint8_t *ntb = in_ntbs[in_fill];
+	uint16_t ndp_offset = ALIGN(in_fill_offset, 4);
+	UsbNcmNdp16 *ndp = (UsbNcmNdp16 *)(ntb + ndp_offset);
+
+	ndp->dwSignature = USB_NCM_NDP16_SIGNATURE;
+	ndp->wLength = NDP_SIZE(in_datagram_count);
+	ndp->wNextNdpIndex = 0;
+	memcpy(ndp->datagrams, in_datagrams, in_datagram_count * sizeof(UsbNcmDatagramPointer16));
+	ndp->datagrams[in_datagram_count] = (UsbNcmDatagramPointer16){ 0, 0 };
+
+	uint16_t block_length = ndp_offset + ndp->wLength;
+
+	// The host reads whole NTBs, so one ending with a full packet would need a zero-length packet.
+	// A padding byte (covered by wBlockLength) ends it with a short packet instead.
+	if (block_length % NCM_DATA_PACKET_SIZE == 0 && block_length < ntb_in_size) {
+		block_length++;
+	}
+
+	*(UsbNcmNth16 *)ntb = (UsbNcmNth16){
+		.dwSignature = USB_NCM_NTH16_SIGNATURE,
+		.wHeaderLength = sizeof(UsbNcmNth16),
+		.wSequence = in_sequence++,
+		.wBlockLength = block_length,
+		.wNdpIndex = ndp_offset
+	};
+
+	in_busy = 1;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_NCM_IN & 0x0F, ntb, block_length);
+
+	in_fill ^= 1;
+	reset_in_fill();
+}
+
+/**
+ * @brief Arm the OUT endpoint for the next NTB, unless the application holds both buffers
+ * @note Called from the USB interrupt, or by the application with the interrupt disabled.
+ */
+static void receive_next()
+{
+	if (out_write_count - out_read_count == 2) {
+		out_paused = 1;
+		return;
+	}
+
+	out_paused = 0;
+	out_received = 0;
+	out_short_packet = 0;
+	usb_driver.start_out_transfer(USBD_ENDPOINT_NCM_OUT, USBD_NCM_NTB_OUT_SIZE);
+}
+
+/**
+ * @brief Check the header of a received NTB (the datagram pointers are checked as they are read)
+ */
+static uint8_t is_valid_ntb(uint8_t const *ntb, uint16_t size)
+{
+	UsbNcmNth16 const *nth = (UsbNcmNth16 const *)ntb;
+
+	return size >= sizeof(UsbNcmNth16) &&
+		nth->dwSignature == USB_NCM_NTH16_SIGNATURE &&
+		nth->wHeaderLength == sizeof(UsbNcmNth16) &&
+		nth->wBlockLength <= size &&
+		nth->wNdpIndex >= sizeof(UsbNcmNth16);
+}
+
+static void ncm_out_data_received(uint8_t endpoint_number, uint16_t byte_count)
+{
+	// Note: The transfer is armed for the free part of the buffer, so the packet always fits
+	usb_driver.read_packet(out_ntbs[out_write_count & 1] + out_received, byte_count);
+	out_received += byte_count;
+
+	if (byte_count < NCM_DATA_PACKET_SIZE) {
+		out_short_packet = 1;
+	}
+}
+
+static void ncm_out_transfer_completed(uint8_t endpoint_number)
+{
+	// An NTB ends with a short packet or when it fills the whole buffer, the activation
+	// of the endpoint (and PKTCNT) may have ended the transfer earlier
+	if (!out_short_packet && out_received < USBD_NCM_NTB_OUT_SIZE) {
+		usb_driver.start_out_transfer(USBD_ENDPOINT_NCM_OUT, USBD_NCM_NTB_OUT_SIZE - out_received);
+		return;
+	}
+
+	uint8_t index = out_write_count & 1;
+
+	if (is_valid_ntb(out_ntbs[index], out_received)) {
+		out_block_lengths[index] = ((UsbNcmNth16 const *)out_ntbs[index])->wBlockLength;
+		out_write_count++;
+	} else {
+		log_error("NCM: dropped a malformed NTB of %u bytes.", out_received);
+	}
+
+	receive_next();
+}
+
+static void ncm_in_transfer_completed(uint8_t endpoint_number)
+{
+	if (endpoint_number == (USBD_ENDPOINT_NCM_NOTIFICATION & 0x0F)) {
+		notification_busy = 0;
+		notify_next();
+		return;
+	}
+
+	in_busy = 0;
+
+	// The datagrams queued meanwhile go out in one NTB. If the application is writing one, its
+	// usbd_ncm_send() sends them.
+	if (in_datagram_count > 0 && !in_allocated_offset) {
+		send_ntb();
+	}
+}
+
+static void ncm_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	if (endpoint_address == USBD_ENDPOINT_NCM_IN) {
+		reset_in_fill();
+		in_sequence = 0;
+		in_busy = 0;
+		connected = 1;
+		pending_notifications = NOTIFY_CONNECTION_SPEED | NOTIFY_NETWORK_CONNECTION;
+		notify_next();
+	} else if (endpoint_address == USBD_ENDPOINT_NCM_OUT) {
+		// Note: The activation arms the endpoint for one packet, so the first NTB goes to the buffer
+		// the application does not hold (it released them all when the endpoint was deactivated)
+		out_received = 0;
+		out_short_packet = 0;
+	} else {
+		notification_busy = 0;
+		notify_next();
+	}
+}
+
+static void ncm_endpoint_deactivated(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_NCM_IN) {
+		in_busy = 1;
+		connected = 0;
+		pending_notifications = NOTIFY_NETWORK_CONNECTION;
+		notify_next();
+	} else if (endpoint_address == USBD_ENDPOINT_NCM_OUT) {
+		// The received NTBs are dropped
+		out_read_count = out_write_count;
+		out_ndp_offset = 0;
+		out_datagram = 0;
+		out_paused = 0;
+	} else {
+		notification_busy = 1;
+		pending_notifications = 0;
+	}
+}
+
+/**
+ * @brief Clearing the halt dropped the transfer in progress, so start the next one
+ */
+static void ncm_endpoint_halt_cleared(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_NCM_IN) {
+		in_busy = 0;
+		if (in_datagram_count > 0 && !in_allocated_offset) {
+			send_ntb();
+		}
+	} else if (endpoint_address == USBD_ENDPOINT_NCM_OUT) {
+		receive_next();
+	} else {
+		notification_busy = 0;
+		notify_next();
+	}
+}
+
+const UsbEndpointHandler usbd_ncm_endpoint_handler = {
+	.on_out_data_received = &ncm_out_data_received,
+	.on_out_transfer_completed = &ncm_out_transfer_completed,
+	.on_in_transfer_completed = &ncm_in_transfer_completed,
+	.on_endpoint_activated = &ncm_endpoint_activated,
+	.on_endpoint_deactivated = &ncm_endpoint_deactivated,
+	.on_endpoint_halt_cleared = &ncm_endpoint_halt_cleared
+};
+
+static uint8_t set_ethernet_packet_filter_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	// Every frame is passed to the host anyway, the filter is only kept
+	packet_filter = request->wValue;
+	return 1;
+}
+
+static uint8_t get_ntb_parameters_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	usb_device->ptr_in_buffer = &ntb_parameters;
+	usb_device->in_data_size = sizeof(ntb_parameters);
+	return 1;
+}
+
+static uint8_t get_ntb_input_size_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	usb_device->ptr_in_buffer = &ntb_in_size;
+	usb_device->in_data_size = sizeof(ntb_in_size);
+	return 1;
+}
+
+static uint8_t set_ntb_input_size_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if (request->wLength != sizeof(requested_ntb_in_size)) {
+		return 0;
+	}
+
+	if (usb_device->control_transfer_stage == USB_CONTROL_STAGE_SETUP) {
+		usb_device->ptr_control_out_data = &requested_ntb_in_size;
+		return 1;
+	}
+
+	if (requested_ntb_in_size < NCM_MIN_NTB_IN_SIZE || requested_ntb_in_size > USBD_NCM_NTB_IN_SIZE) {
+		return 0;
+	}
+
+	ntb_in_size = requested_ntb_in_size & ~3;
+	return 1;
+}
+
+static UsbRequestHandler const ncm_request_handlers[] = {
+	[USB_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER - USB_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER] = &set_ethernet_packet_filter_handler,
+	[USB_NCM_REQUEST_GET_NTB_PARAMETERS - USB_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER] = &get_ntb_parameters_handler,
+	[USB_NCM_REQUEST_GET_NTB_INPUT_SIZE - USB_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER] = &get_ntb_input_size_handler,
+	[USB_NCM_REQUEST_SET_NTB_INPUT_SIZE - USB_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER] = &set_ntb_input_size_handler
+};
+
+static UsbRequestHandlers const ncm_requests = {
+	.first_request = USB_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER,
+	.request_count = sizeof(ncm_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = ncm_request_handlers
+};
+
+void usbd_ncm_initialize()
+{
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE,
+		USBD_INTERFACE_NCM_CONTROL, &ncm_requests);
+}
+
+/**
+ * @brief Give the oldest received NTB back to the USB interrupt
+ */
+static void release_ntb()
+{
+	uint32_t primask = __get_PRIMASK();
+
+	// The USB interrupt drops the received NTBs when the endpoint is deactivated and pauses the
+	// endpoint too, so neither the release nor the arming must be split by it
+	__disable_irq();
+
+	out_ndp_offset = 0;
+	out_datagram = 0;
+
+	if (out_read_count != out_write_count) {
+		out_read_count++;
+	}
+	if (out_paused) {
+		receive_next();
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Find the next datagram of a received NTB, walking its chain of NDPs
+ * @return The datagram pointer, or NULL when there are no more (or the NTB is malformed)
+ */
+static UsbNcmDatagramPointer16 const *next_datagram(uint8_t const *ntb, uint16_t block_length)
+{
+	if (out_ndp_offset == 0) {
+		out_ndp_offset = ((UsbNcmNth16 const *)ntb)->wNdpIndex;
+	}
+
+	for (;;) {
+		UsbNcmNdp16 const *ndp = (UsbNcmNdp16 const *)(ntb + out_ndp_offset);
+
+		if ((out_ndp_offset & 3) || out_ndp_offset + sizeof(UsbNcmNdp16) > block_length ||
+			ndp->dwSignature != USB_NCM_NDP16_SIGNATURE || out_ndp_offset + ndp->wLength > block_length) {
+			return NULL;
+		}
+
+		for (; NDP_SIZE(out_datagram) <= ndp->wLength; out_datagram++) {
+			UsbNcmDatagramPointer16 const *datagram = &ndp->datagrams[out_datagram];
+
+			if (datagram->wDatagramIndex == 0 || datagram->wDatagramLength == 0) {
+				break;
+			}
+			// Skip the datagrams that lie outside of the NTB
+			if (datagram->wDatagramIndex + datagram->wDatagramLength <= block_length) {
+				return datagram;
+			}
+		}
+
+		// The chain only goes forward, so a malformed one cannot loop
+		if (ndp->wNextNdpIndex <= out_ndp_offset) {
+			return NULL;
+		}
+
+		out_ndp_offset = ndp->wNextNdpIndex;
+		out_datagram = 0;
+	}
+}
+
+/**
+ * @brief Return the next frame received from the host, in place in its NTB
+ * @param size Set to the size of the frame in bytes
+ * @return The frame, or NULL when there is none. It stays valid until usbd_ncm_release() and is
+ * returned again by the next call until then.
+ * @note Called by the application.
+ */
+uint8_t const *usbd_ncm_receive(uint16_t *size)
+{
+	while (out_read_count != out_write_count) {
+		uint8_t index = out_read_count & 1;
+		UsbNcmDatagramPointer16 const *datagram = next_datagram(out_ntbs[index], out_block_lengths[index]);
+
+		if (datagram) {
+			*size = datagram->wDatagramLength;
+			return out_ntbs[index] + datagram->wDatagramIndex;
+		}
+
+		// All datagrams are consumed, so the buffer can receive the next NTB
+		release_ntb();
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Consume the frame returned by usbd_ncm_receive()
+ * @note Called by the application. Its NTB is given back to the USB interrupt once all of its
+ * frames are consumed (by the usbd_ncm_receive() call that finds no more).
+ */
+void usbd_ncm_release()
+{
+	out_datagram++;
+}
+
+/**
+ * @brief Reserve the space of a frame in the NTB being filled
+ * @param size The size of the frame in bytes (at most \ref USBD_NCM_MAX_SEGMENT_SIZE)
+ * @return Where to write the frame, or NULL when both NTBs are full or the host is not connected
+ * @note Called by the application, which then writes the frame and queues it with usbd_ncm_send().
+ */
+uint8_t *usbd_ncm_allocate(uint16_t size)
+{
+	uint8_t *frame = NULL;
+	uint32_t primask = __get_PRIMASK();
+
+	if (size == 0 || size > USBD_NCM_MAX_SEGMENT_SIZE) {
+		return NULL;
+	}
+
+	// The USB interrupt closes the NTB being filled, so the space must not be reserved across it
+	__disable_irq();
+
+	if (connected) {
+		uint16_t offset = ALIGN(in_fill_offset, USBD_NCM_DATAGRAM_ALIGNMENT);
+		uint8_t full = in_datagram_count == USBD_NCM_MAX_IN_DATAGRAMS ||
+			ALIGN(offset + size, 4) + NDP_SIZE(in_datagram_count + 1) > ntb_in_size;
+
+		if (full && !in_busy) {
+			send_ntb();
+			offset = in_fill_offset;
+			full = 0;
+		}
+
+		if (!full) {
+			in_allocated_offset = offset;
+			frame = in_ntbs[in_fill] + offset;
+		}
+	}
+
+	__set_PRIMASK(primask);
+	return frame;
+}
+
+/**
+ * @brief Queue the frame written to the space returned by usbd_ncm_allocate()
+ * @param size The size of the frame in bytes (at most the allocated size, 0 gives the space back)
+ * @note Called by the application. The frame goes out at once when the IN endpoint is idle,
+ * otherwise it is batched with the next frames into the NTB sent after the current one.
+ */
+void usbd_ncm_send(uint16_t size)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	if (connected && in_allocated_offset) {
+		if (size > 0) {
+			in_datagrams[in_datagram_count++] = (UsbNcmDatagramPointer16){ in_allocated_offset, size };
+			in_fill_offset = in_allocated_offset + size;
+		}
+		in_allocated_offset = 0;
+
+		if (!in_busy && in_datagram_count > 0) {
+			send_ntb();
+		}
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Return non-zero while the host has the data interface up (frames can be sent)
+ */
+uint8_t usbd_ncm_is_connected()
+{
+	return connected;
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * usbd_requests.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include <stddef.h>
+#include "usbd_requests.h"
+#include "usbd_config.h"
+#include "usbd_driver.h"
+
+/*
+ * The handler tables are indexed by the request type and by a target slot:
+ * slot 0 is the device, then one slot per interface, then one per endpoint address.
+ * Standard requests are handled for all targets of a recipient alike, so they use one
+ * slot per recipient instead.
+ */
+#define TARGET_SLOT_DEVICE 0
+#define TARGET_SLOT_INTERFACE(interface_number) (1 + (interface_number))
+#define TARGET_SLOT_ENDPOINT(endpoint_index) (1 + USBD_MAX_INTERFACE_COUNT + (endpoint_index))
+#define TARGET_SLOT_COUNT (1 + USBD_MAX_INTERFACE_COUNT + 2 * ENDPOINT_COUNT)
+
+#define NO_TARGET_SLOT 0xFF
+
+/// \brief The handlers of standard requests, by recipient
+static UsbRequestHandlers const *standard_handlers[4];
+/// \brief The handlers of class (index 0) and vendor (index 1) requests, by target slot
+static UsbRequestHandlers const *custom_handlers[2][TARGET_SLOT_COUNT];
+
+/**
+ * @brief Return the target slot of a request
+ * @param recipient The recipient field of bmRequestType
+ * @param target The interface number or the endpoint address (ignored for the device)
+ */
+static uint8_t target_slot(uint8_t recipient, uint8_t target)
+{
+	uint8_t endpoint_number = target & 0x0F;
+
+	switch (recipient)
+	{
+	case USB_BM_REQUEST_TYPE_RECIPIENT_DEVICE:
+		return TARGET_SLOT_DEVICE;
+	case USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE:
+		return target < USBD_MAX_INTERFACE_COUNT ? TARGET_SLOT_INTERFACE(target) : NO_TARGET_SLOT;
+	case USB_BM_REQUEST_TYPE_RECIPIENT_ENDPOINT:
+		if (endpoint_number >= ENDPOINT_COUNT) {
+			return NO_TARGET_SLOT;
+		}
+		// OUT endpoints come first, then IN endpoints
+		return TARGET_SLOT_ENDPOINT(endpoint_number + ((target & 0x80) ? ENDPOINT_COUNT : 0));
+	default:
+		return NO_TARGET_SLOT;
+	}
+}
+
+/**
+ * @brief Register the handlers of a range of requests
+ * @param request_type The type and the recipient of the requests (bits of bmRequestType, the direction is ignored)
+ * @param target The interface number or the endpoint address the handlers are for (ignored for the device and for standard requests)
+ * @param handlers The handlers (must stay valid), NULL to remove the registered ones
+ */
+void usbd_register_request_handlers(uint8_t request_type, uint8_t target, UsbRequestHandlers const *handlers)
+{
+	uint8_t type = request_type & USB_BM_REQUEST_TYPE_TYPE_MASK;
+	uint8_t recipient = request_type & USB_BM_REQUEST_TYPE_RECIPIENT_MASK;
+
+	if (type == USB_BM_REQUEST_TYPE_TYPE_STANDARD) {
+		standard_handlers[recipient] = handlers;
+		return;
+	}
+
+	uint8_t slot = target_slot(recipient, target);
+
+	if (slot != NO_TARGET_SLOT && type != USB_BM_REQUEST_TYPE_TYPE_RESERVED) {
+		custom_handlers[(type >> 5) - 1][slot] = handlers;
+	}
+}
+
+/**
+ * @brief Find the handler of a request in constant time
+ * @return The handler, or NULL when the request is not supported
+ */
+UsbRequestHandler usbd_find_request_handler(UsbRequest const *request)
+{
+	uint8_t type = request->bmRequestType & USB_BM_REQUEST_TYPE_TYPE_MASK;
+	uint8_t recipient = request->bmRequestType & USB_BM_REQUEST_TYPE_RECIPIENT_MASK;
+	UsbRequestHandlers const *handlers = NULL;
+
+	if (type == USB_BM_REQUEST_TYPE_TYPE_STANDARD) {
+		handlers = standard_handlers[recipient];
+	} else if (type != USB_BM_REQUEST_TYPE_TYPE_RESERVED) {
+		// Note: The interface number and the endpoint address are in the low byte of wIndex
+		uint8_t slot = target_slot(recipient, request->wIndex & 0xFF);
+
+		if (slot != NO_TARGET_SLOT) {
+			handlers = custom_handlers[(type >> 5) - 1][slot];
+		}
+	}
+
+	if (handlers == NULL) {
+		return NULL;
+	}
+
+	// Note: The subtraction wraps for requests below the range, so one comparison checks both ends
+	uint8_t index = request->bRequest - handlers->first_request;
+
+	return index < handlers->request_count ? handlers->handlers[index] : NULL;
+}
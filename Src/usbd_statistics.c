@@ -0,0 +1,68 @@
+/*
+ * usbd_statistics.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: olexandr
+ */
+
+#include <string.h>
+#include "usbd_statistics.h"
+#include "usbd_config.h"
+#include "usbd_requests.h"
+#include "Helpers/logger.h"
+
+UsbStatistics usbd_statistics = {
+	.version = USBD_STATISTICS_VERSION,
+	.size = sizeof(UsbStatistics),
+	.endpoint_count = ENDPOINT_COUNT
+};
+
+/// \brief Holds the copy sent to the host (the data stage may span many packets)
+static UsbStatistics statistics_snapshot;
+
+/**
+ * @brief Take a consistent copy of all counters
+ * @return Pointer to the copy, which stays valid until the next snapshot
+ */
+UsbStatistics const *usbd_statistics_snapshot()
+{
+	uint32_t primask = __get_PRIMASK();
+
+	// The counters are updated from the USB interrupt, so block it while copying
+	__disable_irq();
+	memcpy(&statistics_snapshot, &usbd_statistics, sizeof(UsbStatistics));
+	__set_PRIMASK(primask);
+
+	// The stack high-water mark is only copied, the main loop scans for it (see memory_usage_update())
+	memory_usage_read(&statistics_snapshot.memory);
+	cpu_load_read(&statistics_snapshot.cpu);
+
+	return &statistics_snapshot;
+}
+
+static uint8_t get_statistics_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	log_info("Vendor Get Statistics request received");
+	usb_device->ptr_in_buffer = usbd_statistics_snapshot();
+	usb_device->in_data_size = sizeof(UsbStatistics);
+	return 1;
+}
+
+static UsbRequestHandler const vendor_device_request_handlers[] = {
+	&get_statistics_handler
+};
+
+static UsbRequestHandlers const vendor_device_requests = {
+	.first_request = USBD_VENDOR_REQUEST_GET_STATISTICS,
+	.request_count = sizeof(vendor_device_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = vendor_device_request_handlers
+};
+
+/**
+ * @brief Register the vendor requests that read the statistics
+ */
+void usbd_statistics_initialize()
+{
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_VENDOR | USB_BM_REQUEST_TYPE_RECIPIENT_DEVICE, 0,
+		&vendor_device_requests);
+}
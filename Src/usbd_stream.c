@@ -0,0 +1,49 @@
+/*
+ * usbd_stream.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_stream.h"
+#include "usbd_config.h"
+
+#if USBD_STREAM_ENABLED
+
+#include "usbd_driver.h"
+
+/// \brief The packet sent every frame (large enough for the largest full-speed isochronous packet)
+static uint32_t stream_buffer[1024 / 4];
+/// \brief The packet size of the selected alternate setting
+static uint16_t stream_packet_size;
+
+/**
+ * @brief Start streaming with the packet size of the selected alternate setting
+ */
+static void stream_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	stream_packet_size = max_packet_size;
+
+	for (uint16_t i = 0; i < sizeof(stream_buffer) / 4; i++) {
+		stream_buffer[i] = 0xA5A50000 | i;
+	}
+	stream_buffer[0] = 0;
+
+	usb_driver.start_in_transfer(endpoint_address & 0x0F, stream_buffer, stream_packet_size);
+}
+
+/**
+ * @brief Queue the packet of the next frame (the first word counts the packets sent)
+ */
+static void stream_in_transfer_completed(uint8_t endpoint_number)
+{
+	stream_buffer[0]++;
+	usb_driver.start_in_transfer(endpoint_number, stream_buffer, stream_packet_size);
+}
+
+const UsbEndpointHandler usbd_stream_endpoint_handler = {
+	.on_in_transfer_completed = &stream_in_transfer_completed,
+	.on_endpoint_activated = &stream_endpoint_activated
+};
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * usbd_vendor.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_vendor.h"
+#include "usbd_config.h"
+
+#if USBD_VENDOR_ENABLED
+
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+
+/// \brief Holds the last received packet until it is sent back
+static uint32_t loopback_buffer[64 / 4];
+static uint16_t loopback_size;
+
+static void vendor_out_data_received(uint8_t endpoint_number, uint16_t byte_count)
+{
+	usb_driver.read_packet(loopback_buffer, byte_count);
+	loopback_size = byte_count;
+}
+
+/**
+ * @brief Send the packet back (the OUT endpoint NAKs the host meanwhile)
+ */
+static void vendor_out_transfer_completed(uint8_t endpoint_number)
+{
+	usb_driver.start_in_transfer(USBD_ENDPOINT_VENDOR_IN & 0x0F, loopback_buffer, loopback_size);
+}
+
+/**
+ * @brief The buffer is free again, so accept the next packet
+ */
+static void vendor_in_transfer_completed(uint8_t endpoint_number)
+{
+	usb_driver.enable_out_endpoint(USBD_ENDPOINT_VENDOR_OUT);
+}
+
+/**
+ * @brief Clearing the halt of the IN endpoint dropped the packet being sent back, so accept the next one
+ */
+static void vendor_endpoint_halt_cleared(uint8_t endpoint_address)
+{
+	if (endpoint_address == USBD_ENDPOINT_VENDOR_IN) {
+		usb_driver.enable_out_endpoint(USBD_ENDPOINT_VENDOR_OUT);
+	}
+}
+
+const UsbEndpointHandler usbd_vendor_endpoint_handler = {
+	.on_out_data_received = &vendor_out_data_received,
+	.on_out_transfer_completed = &vendor_out_transfer_completed,
+	.on_in_transfer_completed = &vendor_in_transfer_completed,
+	.on_endpoint_halt_cleared = &vendor_endpoint_halt_cleared
+};
+
+#endif
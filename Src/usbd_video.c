@@ -0,0 +1,392 @@
+/*
+ * usbd_video.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+#include "usbd_video.h"
+#include "usbd_config.h"
+
+#if USBD_VIDEO_ENABLED
+
+#include "usbd_driver.h"
+#include "usbd_configuration.h"
+#include "usbd_requests.h"
+#include "usbd_statistics.h"
+#include "Helpers/cycle_counter.h"
+#include "Helpers/frame_grabber.h"
+#include "Helpers/math.h"
+
+/*
+ * The stream is cut into bands of USBD_VIDEO_BAND_LINES lines, each sent as one payload transfer
+ * (a header and the YUY2 pixels of the band) on the bulk endpoint. Three stages work on three
+ * bands at once:
+ *  - the DMA2D copies band n + 2 out of the framebuffer, as ARGB8888 pixels,
+ *  - the DMA2D interrupt converts band n + 1 to YUY2 (the DMA2D cannot write YUV) into a payload,
+ *  - the core sends the payload of band n.
+ * There are two payloads, so a band waits in the pixel buffer while both are queued, and the DMA2D
+ * waits for it to be converted. Both interrupts have the same priority, so the stages share their
+ * state without locking.
+ *
+ * A bulk stream starts when the host commits the stream parameters, and stops when the host
+ * clears the halt of the endpoint (or leaves the configuration).
+ */
+
+/// \brief The maximum packet size of the bulk endpoint
+#define VIDEO_PACKET_SIZE 64
+
+#define BAND_COUNT (USBD_VIDEO_HEIGHT / USBD_VIDEO_BAND_LINES)
+#define BAND_PIXELS (USBD_VIDEO_WIDTH * USBD_VIDEO_BAND_LINES)
+#define PAYLOAD_SIZE (sizeof(UsbVideoPayloadHeader) + BAND_PIXELS * 2)
+
+_Static_assert(USBD_VIDEO_HEIGHT % USBD_VIDEO_BAND_LINES == 0, "The bands must cover the frame");
+_Static_assert(USBD_VIDEO_WIDTH % 2 == 0, "YUY2 takes pixels in pairs");
+_Static_assert(PAYLOAD_SIZE % VIDEO_PACKET_SIZE != 0, "Each payload transfer must end with a short packet");
+
+/// \brief The band copied by the DMA2D (the DMA2D must not access the CCM RAM)
+static uint32_t band_pixels[BAND_PIXELS];
+static uint8_t payloads[2][PAYLOAD_SIZE] __attribute__((aligned(4)));
+
+/// \brief The host committed the stream parameters, and has not stopped the stream since
+static uint8_t streaming;
+/// \brief The next band copied by the DMA2D, and the frame ID of its frame
+static uint16_t band;
+static uint8_t frame_id;
+/// \brief The DMA2D is copying a band
+static uint8_t grabbing;
+/// \brief `band_pixels` holds a band that waits for a free payload
+static uint8_t grabbed;
+/// \brief Counts of payloads converted and sent, the payload of a band is `payloads[count % 2]`
+static uint32_t filled_count;
+static uint32_t sent_count;
+/// \brief The IN endpoint is sending (or is not active)
+static uint8_t in_busy = 1;
+/// \brief When the last frame was sent, in core clock cycles
+static uint32_t frame_timestamp;
+
+static const UsbVideoProbeCommit default_probe = {
+	.bmHint = 0,
+	.bFormatIndex = 1,
+	.bFrameIndex = 1,
+	.dwFrameInterval = USBD_VIDEO_FRAME_INTERVAL,
+	.dwMaxVideoFrameSize = USBD_VIDEO_FRAME_SIZE,
+	.dwMaxPayloadTransferSize = PAYLOAD_SIZE,
+	.dwClockFrequency = USBD_VIDEO_CLOCK_FREQUENCY,
+	.bmFramingInfo = USB_VIDEO_HEADER_FRAME_ID | USB_VIDEO_HEADER_END_OF_FRAME
+};
+
+static UsbVideoProbeCommit probe;
+static UsbVideoProbeCommit commit;
+static const uint16_t control_length = sizeof(UsbVideoProbeCommit);
+static const uint8_t control_info = USB_VIDEO_CONTROL_INFO_GET | USB_VIDEO_CONTROL_INFO_SET;
+
+/**
+ * @brief Convert a band of ARGB8888 pixels to YUY2 (BT.601, limited range), a pair of pixels at a time
+ * @details Both pixels of a pair share the average of their chroma.
+ */
+static void convert_band(uint8_t *data, uint32_t const *pixels)
+{
+	for (uint32_t i = 0; i < BAND_PIXELS; i += 2, data += 4) {
+		int32_t r0 = (pixels[i] >> 16) & 0xFF, g0 = (pixels[i] >> 8) & 0xFF, b0 = pixels[i] & 0xFF;
+		int32_t r1 = (pixels[i + 1] >> 16) & 0xFF, g1 = (pixels[i + 1] >> 8) & 0xFF, b1 = pixels[i + 1] & 0xFF;
+		int32_t r = r0 + r1, g = g0 + g1, b = b0 + b1;
+
+		data[0] = ((66 * r0 + 129 * g0 + 25 * b0 + 128) >> 8) + 16;
+		data[1] = ((-38 * r - 74 * g + 112 * b + 256) >> 9) + 128;
+		data[2] = ((66 * r1 + 129 * g1 + 25 * b1 + 128) >> 8) + 16;
+		data[3] = ((112 * r - 94 * g - 18 * b + 256) >> 9) + 128;
+	}
+}
+
+/**
+ * @brief Convert the grabbed band into the next payload, if one is free
+ */
+static void fill_payload()
+{
+	if (!grabbed) {
+		return;
+	}
+
+	if (filled_count - sent_count == 2) {
+		usbd_statistics.video.conversion_stalls++;
+		return;
+	}
+
+	uint32_t start = cycle_counter_read();
+	uint8_t *payload = payloads[filled_count % 2];
+	UsbVideoPayloadHeader *header = (UsbVideoPayloadHeader *)payload;
+
+	header->bHeaderLength = sizeof(UsbVideoPayloadHeader);
+	header->bmHeaderInfo = USB_VIDEO_HEADER_END_OF_HEADER | frame_id |
+		(band == BAND_COUNT - 1 ? USB_VIDEO_HEADER_END_OF_FRAME : 0);
+	convert_band(payload + sizeof(UsbVideoPayloadHeader), band_pixels);
+
+	filled_count++;
+	grabbed = 0;
+	if (++band == BAND_COUNT) {
+		band = 0;
+		frame_id ^= USB_VIDEO_HEADER_FRAME_ID;
+	}
+
+	uint32_t microseconds = MIN((cycle_counter_read() - start) / (SystemCoreClock / 1000000), 0xFFFF);
+	usbd_statistics.video.conversion_max_us = MAX(usbd_statistics.video.conversion_max_us, microseconds);
+}
+
+/**
+ * @brief Let the DMA2D copy the next band once the pixel buffer is free
+ */
+static void grab_next()
+{
+	if (!streaming || grabbing || grabbed) {
+		return;
+	}
+
+	// The layer is looked up once per frame, so a frame is never torn between two layouts
+	if (band == 0) {
+		frame_grabber_open(USBD_VIDEO_WIDTH, USBD_VIDEO_HEIGHT);
+	}
+
+	grabbing = 1;
+	frame_grabber_start(band_pixels, band * USBD_VIDEO_BAND_LINES, USBD_VIDEO_BAND_LINES);
+}
+
+static void send_next()
+{
+	if (in_busy || filled_count == sent_count) {
+		return;
+	}
+
+	in_busy = 1;
+	usb_driver.start_in_transfer(USBD_ENDPOINT_VIDEO_IN & 0x0F, payloads[sent_count % 2], PAYLOAD_SIZE);
+}
+
+/**
+ * @brief Convert the band copied by the DMA2D and start copying the next one
+ */
+static void band_grabbed()
+{
+	grabbing = 0;
+
+	if (!streaming) {
+		return;
+	}
+
+	grabbed = 1;
+	fill_payload();
+	grab_next();
+	send_next();
+}
+
+static void start_streaming()
+{
+	streaming = 1;
+	band = 0;
+	frame_id = 0;
+	grabbed = 0;
+	frame_timestamp = cycle_counter_read();
+	grab_next();
+}
+
+/**
+ * @brief Drop the bands of the stream that are not being sent
+ * @note The counts run on, so the completion of a payload that is still being sent finds it in place.
+ */
+static void stop_streaming()
+{
+	streaming = 0;
+	frame_grabber_abort();
+	grabbing = 0;
+	grabbed = 0;
+	filled_count = sent_count + in_busy;
+}
+
+/**
+ * @brief Count a frame as the host receives its last payload
+ */
+static void record_frame()
+{
+	UsbVideoStatistics *statistics = &usbd_statistics.video;
+	uint32_t now = cycle_counter_read();
+	uint32_t microseconds = (now - frame_timestamp) / (SystemCoreClock / 1000000);
+
+	frame_timestamp = now;
+	statistics->frames++;
+	statistics->frame_period_us = microseconds;
+	statistics->bytes_per_second = microseconds ? (uint64_t)BAND_COUNT * PAYLOAD_SIZE * 1000000 / microseconds : 0;
+}
+
+static void video_in_transfer_completed(uint8_t endpoint_number)
+{
+	uint8_t end_of_frame = ((UsbVideoPayloadHeader *)payloads[sent_count % 2])->bmHeaderInfo & USB_VIDEO_HEADER_END_OF_FRAME;
+
+	in_busy = 0;
+	sent_count++;
+	usbd_statistics.video.bytes += PAYLOAD_SIZE;
+	if (end_of_frame) {
+		record_frame();
+	}
+
+	// A payload is free now, so the band waiting for one goes on
+	fill_payload();
+	grab_next();
+	send_next();
+
+	if (!in_busy && streaming) {
+		usbd_statistics.video.usb_starvations++;
+	}
+}
+
+static void video_endpoint_activated(uint8_t endpoint_address, uint16_t max_packet_size)
+{
+	in_busy = 0;
+}
+
+static void video_endpoint_deactivated(uint8_t endpoint_address)
+{
+	in_busy = 0;
+	stop_streaming();
+	in_busy = 1;
+}
+
+/**
+ * @brief The host stops a bulk stream by clearing the halt of its endpoint
+ */
+static void video_endpoint_halt_cleared(uint8_t endpoint_address)
+{
+	// Clearing the halt dropped the transfer in progress
+	in_busy = 0;
+	stop_streaming();
+}
+
+const UsbEndpointHandler usbd_video_endpoint_handler = {
+	.on_in_transfer_completed = &video_in_transfer_completed,
+	.on_endpoint_activated = &video_endpoint_activated,
+	.on_endpoint_deactivated = &video_endpoint_deactivated,
+	.on_endpoint_halt_cleared = &video_endpoint_halt_cleared
+};
+
+/**
+ * @brief Return the probe or the commit control selected by a request, NULL for other controls
+ */
+static UsbVideoProbeCommit *selected_control(UsbRequest const *request)
+{
+	switch (request->wValue >> 8)
+	{
+	case USB_VIDEO_CONTROL_PROBE:
+		return &probe;
+	case USB_VIDEO_CONTROL_COMMIT:
+		return &commit;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * @brief Take the parameters proposed by the host, or start the stream with the committed ones
+ * @details The stream has a single format, frame size and interval, so whatever the host
+ * proposes, the negotiated parameters are the default ones.
+ */
+static uint8_t set_cur_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	UsbVideoProbeCommit *control = selected_control(request);
+
+	// Video 1.0 hosts send the first 26 bytes only
+	if (control == NULL || request->wLength > sizeof(UsbVideoProbeCommit)) {
+		return 0;
+	}
+
+	if (usb_device->control_transfer_stage == USB_CONTROL_STAGE_SETUP) {
+		usb_device->ptr_control_out_data = control;
+		return 1;
+	}
+
+	*control = default_probe;
+
+	if (control == &commit) {
+		stop_streaming();
+		start_streaming();
+	}
+	return 1;
+}
+
+static uint8_t get_cur_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	UsbVideoProbeCommit *control = selected_control(request);
+
+	if (control == NULL) {
+		return 0;
+	}
+
+	usb_device->ptr_in_buffer = control;
+	usb_device->in_data_size = sizeof(UsbVideoProbeCommit);
+	return 1;
+}
+
+/**
+ * @brief Answer GET_MIN, GET_MAX and GET_DEF of the probe control: there is only one choice
+ */
+static uint8_t get_range_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if ((request->wValue >> 8) != USB_VIDEO_CONTROL_PROBE) {
+		return 0;
+	}
+
+	usb_device->ptr_in_buffer = &default_probe;
+	usb_device->in_data_size = sizeof(UsbVideoProbeCommit);
+	return 1;
+}
+
+static uint8_t get_len_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if (selected_control(request) == NULL) {
+		return 0;
+	}
+
+	usb_device->ptr_in_buffer = &control_length;
+	usb_device->in_data_size = sizeof(control_length);
+	return 1;
+}
+
+static uint8_t get_info_handler(UsbDevice *usb_device, UsbRequest const *request)
+{
+	if (selected_control(request) == NULL) {
+		return 0;
+	}
+
+	usb_device->ptr_in_buffer = &control_info;
+	usb_device->in_data_size = sizeof(control_info);
+	return 1;
+}
+
+// Note: The table spans the unused codes between SET_CUR and the GET requests (0x02 to 0x80)
+static UsbRequestHandler const video_request_handlers[] = {
+	[USB_VIDEO_REQUEST_SET_CUR - USB_VIDEO_REQUEST_SET_CUR] = &set_cur_handler,
+	[USB_VIDEO_REQUEST_GET_CUR - USB_VIDEO_REQUEST_SET_CUR] = &get_cur_handler,
+	[USB_VIDEO_REQUEST_GET_MIN - USB_VIDEO_REQUEST_SET_CUR] = &get_range_handler,
+	[USB_VIDEO_REQUEST_GET_MAX - USB_VIDEO_REQUEST_SET_CUR] = &get_range_handler,
+	[USB_VIDEO_REQUEST_GET_LEN - USB_VIDEO_REQUEST_SET_CUR] = &get_len_handler,
+	[USB_VIDEO_REQUEST_GET_INFO - USB_VIDEO_REQUEST_SET_CUR] = &get_info_handler,
+	[USB_VIDEO_REQUEST_GET_DEF - USB_VIDEO_REQUEST_SET_CUR] = &get_range_handler
+};
+
+static UsbRequestHandlers const video_requests = {
+	.first_request = USB_VIDEO_REQUEST_SET_CUR,
+	.request_count = sizeof(video_request_handlers) / sizeof(UsbRequestHandler),
+	.handlers = video_request_handlers
+};
+
+/**
+ * @brief Register the requests of the streaming interface (the control interface has no controls)
+ */
+void usbd_video_initialize()
+{
+	probe = default_probe;
+	commit = default_probe;
+	cycle_counter_initialize();
+	frame_grabber_initialize(&band_grabbed);
+	usbd_register_request_handlers(USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIPIENT_INTERFACE,
+		USBD_INTERFACE_VIDEO_STREAMING, &video_requests);
+}
+
+#endif
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Measure the throughput of the CDC-ACM port in each direction.
+
+The firmware switches its serial port into a benchmark mode from the baud rate set by the
+host (see serve_cdc in Src/main.c): 300 discards the received data, 600 sends data as fast
+as the host reads it, any other rate echoes the data back.
+
+    $ python3 Tools/cdc_benchmark.py /dev/ttyACM0             # both directions, 16 MiB each
+    $ python3 Tools/cdc_benchmark.py COM5 -m echo -s 4M       # echo with data verification
+
+Full-speed bulk transfers share about 1.2 MB/s of bus time, so the out and in modes measure
+one direction alone and the echo mode reports the rate of each direction while both run.
+
+Requires pyserial (pip install pyserial).
+"""
+
+import argparse
+import os
+import sys
+import threading
+import time
+
+import serial
+
+SINK_BAUD_RATE = 300
+SOURCE_BAUD_RATE = 600
+ECHO_BAUD_RATE = 115200
+
+CHUNK_SIZE = 64 * 1024
+
+
+def parse_size(text):
+    units = {"K": 1024, "M": 1024 * 1024}
+    if text[-1:].upper() in units:
+        return int(text[:-1]) * units[text[-1:].upper()]
+    return int(text)
+
+
+def open_port(name, baud_rate):
+    port = serial.Serial(name, baud_rate, timeout=1.0, write_timeout=5.0)
+    port.reset_input_buffer()
+    return port
+
+
+def drain(port):
+    """Discard the data left from a previous run (e.g. the tail of the source stream)."""
+    port.timeout = 0.1
+    while port.read(CHUNK_SIZE):
+        pass
+    port.timeout = 1.0
+
+
+def report(name, size, seconds):
+    print("%-4s %10d bytes in %7.3f s: %6.3f MB/s" % (name, size, seconds, size / seconds / 1e6))
+
+
+def benchmark_out(name, size):
+    with open_port(name, SINK_BAUD_RATE) as port:
+        data = os.urandom(CHUNK_SIZE)
+        start = time.perf_counter()
+        for offset in range(0, size, CHUNK_SIZE):
+            port.write(data[:min(CHUNK_SIZE, size - offset)])
+        port.flush()
+        report("out", size, time.perf_counter() - start)
+
+
+def benchmark_in(name, size):
+    with open_port(name, SOURCE_BAUD_RATE) as port:
+        received = 0
+        start = time.perf_counter()
+        while received < size:
+            chunk = port.read(min(CHUNK_SIZE, size - received))
+            if not chunk:
+                sys.exit("error: the device stopped sending after %d bytes" % received)
+            received += len(chunk)
+        report("in", size, time.perf_counter() - start)
+        drain(port)
+
+
+def benchmark_echo(name, size):
+    with open_port(name, ECHO_BAUD_RATE) as port:
+        drain(port)
+        data = os.urandom(size)
+        received = bytearray()
+        elapsed = {}
+
+        def writer():
+            for offset in range(0, size, CHUNK_SIZE):
+                port.write(data[offset:offset + CHUNK_SIZE])
+            port.flush()
+            elapsed["out"] = time.perf_counter() - start
+
+        start = time.perf_counter()
+        thread = threading.Thread(target=writer)
+        thread.start()
+        while len(received) < size:
+            chunk = port.read(min(CHUNK_SIZE, size - len(received)))
+            if not chunk:
+                break
+            received += chunk
+        elapsed["in"] = time.perf_counter() - start
+        thread.join()
+
+        report("out", size, elapsed["out"])
+        report("in", len(received), elapsed["in"])
+        if received != data:
+            sys.exit("error: the echoed data differs from the sent data (%d of %d bytes received)" %
+                     (len(received), size))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial port of the device (e.g. /dev/ttyACM0 or COM5)")
+    parser.add_argument("-m", "--mode", choices=("out", "in", "both", "echo"), default="both",
+                        help="direction to measure (default: out, then in)")
+    parser.add_argument("-s", "--size", type=parse_size, default="16M",
+                        help="bytes to transfer per direction, K and M suffixes allowed (default: 16M)")
+    arguments = parser.parse_args()
+
+    if arguments.mode in ("out", "both"):
+        benchmark_out(arguments.port, arguments.size)
+    if arguments.mode in ("in", "both"):
+        benchmark_in(arguments.port, arguments.size)
+    if arguments.mode == "echo":
+        benchmark_echo(arguments.port, arguments.size)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,449 @@
+/*
+ * sample_format_check.c
+ *
+ *  Created on: Oct 20, 2026
+ *      Author: olexandr
+ */
+
+/*
+ * Run the SIMD sample format kernels on the host against the reference kernels.
+ *
+ * The SIMD kernels are built from Src/Helpers/sample_format.c with portable shims of the
+ * Cortex-M4 intrinsics they use, and must give exactly the same bytes and samples as the
+ * reference kernels for random samples, the boundary values (INT32_MIN, INT32_MAX, INT16_MIN,
+ * INT16_MAX, the rounding edges and the extreme gains), every count up to a few words (so the
+ * odd samples left to the reference kernels are covered) and buffers at every alignment. The
+ * whole output buffers are compared, so a kernel that writes too much is caught as well.
+ *
+ *     $ cc -O2 -I Inc -I Inc/CMSIS/Device/ST/STM32F4xx/Include Tools/sample_format_check.c -o sample_format_check
+ *     $ ./sample_format_check
+ *
+ * Then it times both paths per sample. On the host this only compares the word-at-a-time
+ * structure of the kernels (the shims are plain C), the cycles on the target are measured with
+ * the DWT cycle counter (Inc/Helpers/cycle_counter.h).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** \name Portable shims of the intrinsics of the SIMD kernels (the stm32f4xx.h they come from is skipped)
+ *@{*/
+#define __STM32F4xx_H
+
+static inline uint32_t __UNALIGNED_UINT32_READ(void const *address)
+{
+	uint32_t value;
+
+	memcpy(&value, address, sizeof(value));
+	return value;
+}
+
+static inline void __UNALIGNED_UINT32_WRITE(void *address, uint32_t value)
+{
+	memcpy(address, &value, sizeof(value));
+}
+
+// The bottom half of the first operand and the top half of the second one shifted left
+#define __PKHBT(arg1, arg2, shift) (((uint32_t)(arg1) & 0x0000FFFF) | (((uint32_t)(arg2) << (shift)) & 0xFFFF0000))
+// The top half of the first operand and the bottom half of the second one shifted right (arithmetically)
+#define __PKHTB(arg1, arg2, shift) (((uint32_t)(arg1) & 0xFFFF0000) | (((uint32_t)((int32_t)(arg2) >> (shift))) & 0x0000FFFF))
+
+static inline int32_t __QADD(int32_t arg1, int32_t arg2)
+{
+	int64_t sum = (int64_t)arg1 + arg2;
+
+	return sum > INT32_MAX ? INT32_MAX : sum < INT32_MIN ? INT32_MIN : (int32_t)sum;
+}
+
+static inline int32_t __SSAT(int32_t value, uint32_t bits)
+{
+	int32_t const max = (int32_t)((1U << (bits - 1)) - 1);
+
+	return value > max ? max : value < -max - 1 ? -max - 1 : value;
+}
+
+// The most significant word of the product, added to the accumulator
+static inline int32_t __SMMLA(int32_t arg1, int32_t arg2, int32_t arg3)
+{
+	return arg3 + (int32_t)(((int64_t)arg1 * arg2) >> 32);
+}
+
+// The sum of the products of the bottom halves and of the top halves (wraps like the instruction)
+static inline uint32_t __SMUAD(uint32_t arg1, uint32_t arg2)
+{
+	return (uint32_t)((int64_t)(int16_t)arg1 * (int16_t)arg2 + (int64_t)(int16_t)(arg1 >> 16) * (int16_t)(arg2 >> 16));
+}
+
+static inline uint32_t __QADD16(uint32_t arg1, uint32_t arg2)
+{
+	int32_t low = __SSAT((int16_t)arg1 + (int16_t)arg2, 16);
+	int32_t high = __SSAT((int16_t)(arg1 >> 16) + (int16_t)(arg2 >> 16), 16);
+
+	return ((uint32_t)low & 0xFFFF) | (uint32_t)high << 16;
+}
+/**@}*/
+
+#undef SAMPLE_FORMAT_SIMD
+#define SAMPLE_FORMAT_SIMD 1
+#include "../Src/Helpers/sample_format.c"
+#include "../Src/Helpers/sample_format_reference.c"
+
+/// \brief The most samples converted at once (a stereo 24-bit packet at 48 kHz is 98)
+#define MAX_COUNT 128
+/// \brief The counts up to this one are all checked, at every alignment
+#define ALL_COUNTS 12
+#define RANDOM_ROUNDS 2000
+#define TIMED_ROUNDS 200000
+
+typedef void (*FromKernel)(int32_t *samples, void const *data, uint32_t count);
+typedef void (*ToKernel)(void *data, int32_t const *samples, uint32_t count);
+
+typedef struct
+{
+	char const *name;
+	uint8_t sample_size;
+	FromKernel simd;
+	FromKernel reference;
+} FromCase;
+
+typedef struct
+{
+	char const *name;
+	uint8_t sample_size;
+	ToKernel simd;
+	ToKernel reference;
+} ToCase;
+
+static FromCase const from_cases[] = {
+	{ "from_s16", 2, &sample_format_from_s16, &sample_format_reference_from_s16 },
+	{ "from_s24", 3, &sample_format_from_s24, &sample_format_reference_from_s24 },
+	{ "from_s32", 4, &sample_format_from_s32, &sample_format_reference_from_s32 }
+};
+
+static ToCase const to_cases[] = {
+	{ "to_s16", 2, &sample_format_to_s16, &sample_format_reference_to_s16 },
+	{ "to_s24", 3, &sample_format_to_s24, &sample_format_reference_to_s24 },
+	{ "to_s32", 4, &sample_format_to_s32, &sample_format_reference_to_s32 }
+};
+
+/// \brief The samples where saturation and rounding change: the limits and both sides of the rounding edges
+static int32_t const boundary_samples[] = {
+	INT32_MIN, INT32_MIN + 1, INT32_MAX, INT32_MAX - 1, 0, 1, -1,
+	0x7FFF7FFF, 0x7FFF8000, 0x7FFFFF7F, 0x7FFFFF80, (int32_t)0x80007FFF, (int32_t)0x80008000,
+	0x00007FFF, 0x00008000, (int32_t)0xFFFF7FFF, (int32_t)0xFFFF8000,
+	0x0000007F, 0x00000080, (int32_t)0xFFFFFF7F, (int32_t)0xFFFFFF80
+};
+
+#define BOUNDARY_COUNT (sizeof(boundary_samples) / sizeof(boundary_samples[0]))
+
+static int16_t const boundary_samples_s16[] = { INT16_MIN, INT16_MIN + 1, INT16_MAX, INT16_MAX - 1, 0, 1, -1, 0x4000, -0x4000 };
+
+/// \brief The gains where the products saturate or vanish: -2.0, just under 2.0, 0, 1.0, -1.0 and the smallest ones
+static int16_t const boundary_gains[] = {
+	INT16_MIN, INT16_MAX, 0, SAMPLE_FORMAT_UNITY_GAIN, -SAMPLE_FORMAT_UNITY_GAIN, 1, -1
+};
+
+static uint32_t failures;
+/// \brief Keeps the timed conversions from being optimized out
+static uint32_t volatile sink;
+
+static uint32_t random_word()
+{
+	return (uint32_t)rand() << 17 ^ (uint32_t)rand() << 6 ^ (uint32_t)rand();
+}
+
+/**
+ * @brief Fill samples with random values, mixed with boundary ones
+ */
+static void fill_samples(int32_t *samples, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = (rand() & 1) ? boundary_samples[rand() % BOUNDARY_COUNT] : (int32_t)random_word();
+	}
+}
+
+static void fill_samples_s16(int16_t *samples, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = (rand() & 1)
+			? boundary_samples_s16[rand() % (sizeof(boundary_samples_s16) / sizeof(boundary_samples_s16[0]))]
+			: (int16_t)rand();
+	}
+}
+
+static int16_t random_gain()
+{
+	return (rand() & 1) ? boundary_gains[rand() % (sizeof(boundary_gains) / sizeof(boundary_gains[0]))] : (int16_t)rand();
+}
+
+/**
+ * @brief Fill packet bytes with random values, with whole samples of boundary bytes among them
+ */
+static void fill_bytes(uint8_t *bytes, uint32_t size, uint8_t sample_size)
+{
+	static uint8_t const boundary_bytes[] = { 0x00, 0xFF, 0x7F, 0x80 };
+
+	for (uint32_t i = 0; i < size; i += sample_size) {
+		uint8_t boundary = rand() & 1;
+
+		for (uint32_t j = i; j < i + sample_size && j < size; j++) {
+			bytes[j] = boundary ? boundary_bytes[rand() % 4] : (uint8_t)rand();
+		}
+	}
+}
+
+/**
+ * @brief Count a mismatch of a SIMD kernel with its reference kernel (the first ones are printed)
+ */
+static void compare(char const *name, void const *simd, void const *reference, size_t size, uint32_t count, uint32_t alignment)
+{
+	if (memcmp(simd, reference, size) != 0 && failures++ < 10) {
+		printf("%s: mismatch, %u samples at alignment %u\n", name, count, alignment);
+	}
+}
+
+static void check_from(FromCase const *test, uint8_t const *data, uint32_t count, uint32_t alignment)
+{
+	// One guard sample past the end catches a kernel that writes too much
+	int32_t simd_samples[MAX_COUNT + 1];
+	int32_t reference_samples[MAX_COUNT + 1];
+
+	memset(simd_samples, 0x5A, sizeof(simd_samples));
+	memset(reference_samples, 0x5A, sizeof(reference_samples));
+	test->simd(simd_samples, data, count);
+	test->reference(reference_samples, data, count);
+
+	compare(test->name, simd_samples, reference_samples, (count + 1) * sizeof(int32_t), count, alignment);
+}
+
+static void check_to(ToCase const *test, int32_t const *samples, uint32_t count, uint32_t alignment)
+{
+	// The output starts `alignment` bytes into the buffers, a guard byte follows it
+	uint8_t simd_bytes[MAX_COUNT * 4 + 8];
+	uint8_t reference_bytes[MAX_COUNT * 4 + 8];
+	uint32_t size = alignment + count * test->sample_size + 1;
+
+	memset(simd_bytes, 0xA5, sizeof(simd_bytes));
+	memset(reference_bytes, 0xA5, sizeof(reference_bytes));
+	test->simd(simd_bytes + alignment, samples, count);
+	test->reference(reference_bytes + alignment, samples, count);
+
+	compare(test->name, simd_bytes, reference_bytes, size, count, alignment);
+}
+
+/**
+ * @brief Check the stereo kernels, with the frames and the channels `offset` samples into their buffers
+ */
+static void check_stereo(uint32_t frame_count, uint32_t offset)
+{
+	int32_t frames[2 * MAX_COUNT + 4];
+	int32_t left[MAX_COUNT + 4];
+	int32_t right[MAX_COUNT + 4];
+	// Left, right and frames of each kernel, the samples around the output are the guard
+	int32_t simd[3][2 * MAX_COUNT + 8];
+	int32_t reference[3][2 * MAX_COUNT + 8];
+
+	fill_samples(frames + offset, 2 * frame_count);
+	fill_samples(left + offset, frame_count);
+	fill_samples(right + offset, frame_count);
+
+	memset(simd, 0x5A, sizeof(simd));
+	memset(reference, 0x5A, sizeof(reference));
+	sample_format_deinterleave(simd[0] + offset, simd[1] + offset, frames + offset, frame_count);
+	sample_format_reference_deinterleave(reference[0] + offset, reference[1] + offset, frames + offset, frame_count);
+	compare("deinterleave", simd, reference, 2 * sizeof(simd[0]), frame_count, offset);
+
+	sample_format_interleave(simd[2] + offset, left + offset, right + offset, frame_count);
+	sample_format_reference_interleave(reference[2] + offset, left + offset, right + offset, frame_count);
+	compare("interleave", simd[2], reference[2], sizeof(simd[2]), frame_count, offset);
+}
+
+static void check_stereo_s16(uint32_t frame_count, uint32_t offset)
+{
+	int16_t frames[2 * MAX_COUNT + 4];
+	int16_t left[MAX_COUNT + 4];
+	int16_t right[MAX_COUNT + 4];
+	int16_t simd[3][2 * MAX_COUNT + 8];
+	int16_t reference[3][2 * MAX_COUNT + 8];
+
+	fill_samples_s16(frames + offset, 2 * frame_count);
+	fill_samples_s16(left + offset, frame_count);
+	fill_samples_s16(right + offset, frame_count);
+
+	memset(simd, 0x5A, sizeof(simd));
+	memset(reference, 0x5A, sizeof(reference));
+	sample_format_deinterleave_s16(simd[0] + offset, simd[1] + offset, frames + offset, frame_count);
+	sample_format_reference_deinterleave_s16(reference[0] + offset, reference[1] + offset, frames + offset, frame_count);
+	compare("deinterleave_s16", simd, reference, 2 * sizeof(simd[0]), frame_count, offset);
+
+	sample_format_interleave_s16(simd[2] + offset, left + offset, right + offset, frame_count);
+	sample_format_reference_interleave_s16(reference[2] + offset, left + offset, right + offset, frame_count);
+	compare("interleave_s16", simd[2], reference[2], sizeof(simd[2]), frame_count, offset);
+}
+
+/**
+ * @brief Check the in-place kernels: both kernels start from copies of the same samples
+ */
+static void check_gain_mix(uint32_t count, uint32_t offset)
+{
+	int32_t source[MAX_COUNT + 4];
+	int32_t simd[MAX_COUNT + 8];
+	int32_t reference[MAX_COUNT + 8];
+	int16_t gain = random_gain();
+
+	memset(simd, 0x5A, sizeof(simd));
+	fill_samples(simd + offset, count);
+	memcpy(reference, simd, sizeof(simd));
+	sample_format_gain(simd + offset, count, gain);
+	sample_format_reference_gain(reference + offset, count, gain);
+	compare("gain", simd, reference, sizeof(simd), count, offset);
+
+	fill_samples(source + offset, count);
+	sample_format_mix(simd + offset, source + offset, count);
+	sample_format_reference_mix(reference + offset, source + offset, count);
+	compare("mix", simd, reference, sizeof(simd), count, offset);
+}
+
+static void check_gain_mix_s16(uint32_t count, uint32_t offset)
+{
+	int16_t source[MAX_COUNT + 4];
+	int16_t simd[MAX_COUNT + 8];
+	int16_t reference[MAX_COUNT + 8];
+	int16_t gain = random_gain();
+
+	memset(simd, 0x5A, sizeof(simd));
+	fill_samples_s16(simd + offset, count);
+	memcpy(reference, simd, sizeof(simd));
+	sample_format_gain_s16(simd + offset, count, gain);
+	sample_format_reference_gain_s16(reference + offset, count, gain);
+	compare("gain_s16", simd, reference, sizeof(simd), count, offset);
+
+	fill_samples_s16(source + offset, count);
+	sample_format_mix_s16(simd + offset, source + offset, count);
+	sample_format_reference_mix_s16(reference + offset, source + offset, count);
+	compare("mix_s16", simd, reference, sizeof(simd), count, offset);
+}
+
+static void check_all()
+{
+	uint8_t bytes[MAX_COUNT * 4 + 8];
+	int32_t samples[MAX_COUNT + 4];
+
+	for (uint32_t round = 0; round < RANDOM_ROUNDS; round++) {
+		// Every small count, then random ones up to the largest packet
+		uint32_t count = round < ALL_COUNTS * 8 ? round / 8 : (uint32_t)rand() % (MAX_COUNT + 1);
+
+		for (uint32_t alignment = 0; alignment < 4; alignment++) {
+			for (uint32_t i = 0; i < sizeof(from_cases) / sizeof(from_cases[0]); i++) {
+				fill_bytes(bytes + alignment, count * from_cases[i].sample_size, from_cases[i].sample_size);
+				check_from(&from_cases[i], bytes + alignment, count, alignment);
+			}
+
+			// The samples are read at any word alignment the compiler may give them
+			fill_samples(samples + alignment, count);
+			for (uint32_t i = 0; i < sizeof(to_cases) / sizeof(to_cases[0]); i++) {
+				check_to(&to_cases[i], samples + alignment, count, alignment);
+			}
+
+			// The channel kernels work on samples: an odd offset leaves the 16-bit ones half a word off
+			check_stereo(count, alignment);
+			check_stereo_s16(count, alignment);
+			check_gain_mix(count, alignment);
+			check_gain_mix_s16(count, alignment);
+		}
+	}
+
+	// Every boundary gain on every boundary sample
+	for (uint32_t i = 0; i < sizeof(boundary_gains) / sizeof(boundary_gains[0]); i++) {
+		int32_t simd[BOUNDARY_COUNT];
+		int32_t reference[BOUNDARY_COUNT];
+		int16_t simd_s16[sizeof(boundary_samples_s16) / sizeof(boundary_samples_s16[0])];
+		int16_t reference_s16[sizeof(boundary_samples_s16) / sizeof(boundary_samples_s16[0])];
+
+		memcpy(simd, boundary_samples, sizeof(simd));
+		memcpy(reference, boundary_samples, sizeof(reference));
+		sample_format_gain(simd, BOUNDARY_COUNT, boundary_gains[i]);
+		sample_format_reference_gain(reference, BOUNDARY_COUNT, boundary_gains[i]);
+		compare("gain", simd, reference, sizeof(simd), BOUNDARY_COUNT, 0);
+
+		memcpy(simd_s16, boundary_samples_s16, sizeof(simd_s16));
+		memcpy(reference_s16, boundary_samples_s16, sizeof(reference_s16));
+		sample_format_gain_s16(simd_s16, sizeof(simd_s16) / 2, boundary_gains[i]);
+		sample_format_reference_gain_s16(reference_s16, sizeof(reference_s16) / 2, boundary_gains[i]);
+		compare("gain_s16", simd_s16, reference_s16, sizeof(simd_s16), sizeof(simd_s16) / 2, 0);
+	}
+
+	// All boundary samples in a row, at every alignment
+	for (uint32_t alignment = 0; alignment < 4; alignment++) {
+		for (uint32_t i = 0; i < sizeof(to_cases) / sizeof(to_cases[0]); i++) {
+			check_to(&to_cases[i], boundary_samples, BOUNDARY_COUNT, alignment);
+		}
+	}
+}
+
+static double seconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Return the nanoseconds per sample of a kernel, on a full unaligned stereo 24-bit packet
+ */
+static double time_from(FromKernel kernel, uint8_t const *data)
+{
+	int32_t samples[MAX_COUNT];
+	double start = seconds();
+
+	for (uint32_t round = 0; round < TIMED_ROUNDS; round++) {
+		kernel(samples, data, 98);
+		sink = samples[round % 98];
+	}
+	return (seconds() - start) * 1e9 / ((double)TIMED_ROUNDS * 98);
+}
+
+static double time_to(ToKernel kernel, int32_t const *samples)
+{
+	uint8_t bytes[MAX_COUNT * 4 + 8];
+	double start = seconds();
+
+	for (uint32_t round = 0; round < TIMED_ROUNDS; round++) {
+		kernel(bytes + 1, samples, 98);
+		sink = bytes[1 + round % 98];
+	}
+	return (seconds() - start) * 1e9 / ((double)TIMED_ROUNDS * 98);
+}
+
+int main()
+{
+	srand(1);
+	check_all();
+
+	if (failures > 0) {
+		printf("FAILED: %u mismatches\n", failures);
+		return 1;
+	}
+	printf("All kernels match the reference kernels\n\n");
+
+	uint8_t bytes[MAX_COUNT * 4 + 8];
+	int32_t samples[MAX_COUNT];
+
+	fill_bytes(bytes, sizeof(bytes), 3);
+	fill_samples(samples, MAX_COUNT);
+
+	printf("%-10s %12s %12s\n", "kernel", "simd ns", "reference ns");
+	for (uint32_t i = 0; i < sizeof(from_cases) / sizeof(from_cases[0]); i++) {
+		printf("%-10s %12.2f %12.2f\n", from_cases[i].name,
+			time_from(from_cases[i].simd, bytes + 1), time_from(from_cases[i].reference, bytes + 1));
+	}
+	for (uint32_t i = 0; i < sizeof(to_cases) / sizeof(to_cases[0]); i++) {
+		printf("%-10s %12.2f %12.2f\n", to_cases[i].name,
+			time_to(to_cases[i].simd, samples), time_to(to_cases[i].reference, samples));
+	}
+	return 0;
+}
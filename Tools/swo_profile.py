@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""Print a flat PC-sampling profile and exception statistics from a raw SWO capture.
+
+The firmware must be built with PROFILER_ENABLED=1 (see Inc/Helpers/profiler.h). Record the
+SWO stream to a file, e.g. with OpenOCD:
+
+    tpiu config internal swo.bin uart off 72000000 2000000
+
+then map the samples onto the functions of the ELF image:
+
+    $ python3 Tools/swo_profile.py swo.bin Debug/USB_Device.elf
+
+The exception section reports how many times each traced exception was entered, how long it
+stayed active (including time preempted by nested exceptions) and which share of the traced
+time it took, e.g. OTG_HS_IRQHandler for the USB stack.
+"""
+
+import argparse
+import bisect
+import os
+import re
+import subprocess
+import sys
+from collections import Counter, defaultdict
+
+DWT_DISCRIMINATOR_EXCEPTION = 1
+DWT_DISCRIMINATOR_PC_SAMPLE = 2
+
+EXCEPTION_ENTRY = 1
+EXCEPTION_EXIT = 2
+EXCEPTION_RETURN = 3
+
+DEFAULT_STARTUP = os.path.join(os.path.dirname(__file__), "..", "Startup", "startup_stm32f429zitx.s")
+
+
+class ItmDecoder:
+    """Decode the ITM/DWT packet protocol (ARMv7-M Architecture Reference Manual, appendix D)."""
+
+    def __init__(self):
+        self.time = 0
+        self.pending = []
+        self.overflows = 0
+        self.pc_samples = []
+        self.sleep_samples = 0
+        self.exception_events = []
+
+    def decode(self, stream):
+        index = 0
+        length = len(stream)
+
+        while index < length:
+            header = stream[index]
+            index += 1
+
+            if header == 0x00:
+                # Synchronization packet: zeros terminated by 0x80
+                while index < length and stream[index] == 0x00:
+                    index += 1
+                if index < length and stream[index] == 0x80:
+                    index += 1
+            elif header == 0x70:
+                self.overflows += 1
+            elif header & 0x0F == 0x00:
+                index = self.local_timestamp(stream, index, header)
+            elif header & 0x0B == 0x08 or header in (0x94, 0xB4):
+                # Extension or global timestamp packet: skip the continuation bytes
+                while header & 0x80 and index < length:
+                    header = stream[index]
+                    index += 1
+            elif header & 0x03 == 0x00:
+                # Reserved encoding
+                continue
+            else:
+                size = (1, 2, 4)[(header & 0x03) - 1]
+                payload = int.from_bytes(stream[index:index + size], "little")
+                index += size
+
+                if header & 0x04:
+                    self.hardware_source(header >> 3, payload, size)
+
+        self.flush_pending()
+
+    def local_timestamp(self, stream, index, header):
+        if header & 0x80:
+            delta = 0
+            shift = 0
+            while index < len(stream):
+                byte = stream[index]
+                index += 1
+                delta |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    break
+        else:
+            delta = (header >> 4) & 0x07
+
+        # A local timestamp follows the packets it relates to
+        self.time += delta
+        self.flush_pending()
+        return index
+
+    def flush_pending(self):
+        for event in self.pending:
+            self.exception_events.append((self.time,) + event)
+        self.pending = []
+
+    def hardware_source(self, discriminator, payload, size):
+        if discriminator == DWT_DISCRIMINATOR_PC_SAMPLE:
+            if size == 1:
+                self.sleep_samples += 1
+            else:
+                self.pc_samples.append(payload)
+        elif discriminator == DWT_DISCRIMINATOR_EXCEPTION and size == 2:
+            exception_number = payload & 0x1FF
+            function = (payload >> 12) & 0x03
+            self.pending.append((exception_number, function))
+
+
+def load_symbols(elf, nm):
+    output = subprocess.run([nm, "-n", "-S", "--defined-only", elf],
+                            check=True, capture_output=True, text=True).stdout
+    symbols = []
+
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "tTwW":
+            # Clear the Thumb bit of function addresses
+            symbols.append((int(fields[0], 16) & ~1, int(fields[1], 16), fields[3]))
+
+    symbols.sort()
+    return symbols
+
+
+def function_name(symbols, addresses, pc):
+    position = bisect.bisect_right(addresses, pc) - 1
+    if position >= 0:
+        address, size, name = symbols[position]
+        if pc < address + max(size, 2):
+            return name
+    return "0x%08X" % pc
+
+
+def load_exception_names(startup):
+    """Read the handler names from the vector table of the startup file (index = exception number)."""
+    names = {}
+    try:
+        with open(startup) as source:
+            text = source.read()
+    except OSError:
+        return names
+
+    table = text[text.find("g_pfnVectors:"):]
+    for number, name in enumerate(re.findall(r"^\s*\.word\s+(\w+)", table, re.MULTILINE)):
+        if name != "0":
+            names[number] = name
+    return names
+
+
+def exception_statistics(events):
+    statistics = defaultdict(lambda: {"count": 0, "total": 0, "max": 0})
+    active = {}
+
+    for time, number, function in events:
+        if function == EXCEPTION_ENTRY:
+            active[number] = time
+            statistics[number]["count"] += 1
+        elif function == EXCEPTION_EXIT and number in active:
+            duration = time - active.pop(number)
+            statistics[number]["total"] += duration
+            statistics[number]["max"] = max(statistics[number]["max"], duration)
+
+    return statistics
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("swo", help="raw SWO capture (ITM packets, no TPIU formatting)")
+    parser.add_argument("elf", help="firmware image used to resolve the sampled PCs")
+    parser.add_argument("--nm", default="arm-none-eabi-nm", help="nm executable (default: arm-none-eabi-nm)")
+    parser.add_argument("--startup", default=DEFAULT_STARTUP, help="startup file holding the vector table")
+    parser.add_argument("--top", type=int, default=30, help="count of functions to print (default: 30)")
+    arguments = parser.parse_args()
+
+    with open(arguments.swo, "rb") as capture:
+        decoder = ItmDecoder()
+        decoder.decode(capture.read())
+
+    symbols = load_symbols(arguments.elf, arguments.nm)
+    addresses = [symbol[0] for symbol in symbols]
+    profile = Counter(function_name(symbols, addresses, pc) for pc in decoder.pc_samples)
+    total_samples = len(decoder.pc_samples) + decoder.sleep_samples
+
+    if not total_samples:
+        sys.exit("error: no PC samples found in the capture")
+
+    print("Flat profile (%d samples, %d while sleeping, %d overflows):" %
+          (total_samples, decoder.sleep_samples, decoder.overflows))
+    print("%8s %8s  %s" % ("%", "samples", "function"))
+    if decoder.sleep_samples:
+        print("%7.2f%% %8d  %s" % (100.0 * decoder.sleep_samples / total_samples, decoder.sleep_samples, "<sleep>"))
+    for name, count in profile.most_common(arguments.top):
+        print("%7.2f%% %8d  %s" % (100.0 * count / total_samples, count, name))
+
+    statistics = exception_statistics(decoder.exception_events)
+    if not statistics:
+        return
+
+    names = load_exception_names(arguments.startup)
+    traced_cycles = max(decoder.time, 1)
+
+    print()
+    print("Exceptions (%d traced cycles):" % decoder.time)
+    print("%4s %-28s %10s %12s %12s %8s" % ("#", "handler", "entries", "avg cycles", "max cycles", "% time"))
+    for number in sorted(statistics):
+        entry = statistics[number]
+        average = entry["total"] / entry["count"] if entry["count"] else 0
+        print("%4d %-28s %10d %12.1f %12d %7.2f%%" % (
+            number, names.get(number, "IRQ%d" % (number - 16)), entry["count"], average, entry["max"],
+            100.0 * entry["total"] / traced_cycles))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Convert a memory dump of the on-device USB capture ring into a pcapng file.
+
+The firmware must be built with USBD_CAPTURE_ENABLED=1. Halt the target and dump the
+ring with GDB, then convert it and open the result in Wireshark:
+
+    (gdb) dump binary value capture.bin usbd_capture_buffer
+    $ python3 Tools/usbd_capture_to_pcapng.py capture.bin -o capture.pcapng
+
+Packets are written with the Linux usbmon (memory-mapped) link type, one URB per packet:
+SETUP and OUT packets as submissions, IN packets as completions.
+"""
+
+import argparse
+import struct
+import sys
+
+USBD_CAPTURE_MAGIC = 0x50414355
+USBD_CAPTURE_VERSION = 1
+
+# struct UsbCaptureBuffer header
+BUFFER_HEADER = struct.Struct("<IHHIIII")
+# struct UsbCaptureRecord header (the payload follows)
+RECORD_HEADER = struct.Struct("<IHHBBBBB3x")
+
+EVENT_SETUP = 0
+EVENT_OUT = 1
+EVENT_IN = 2
+
+LINKTYPE_USB_LINUX_MMAPPED = 220
+
+# UsbEndpointType -> usbmon transfer type
+USBMON_TRANSFER_TYPES = {
+    0: 2,  # control
+    1: 0,  # isochronous
+    2: 3,  # bulk
+    3: 1,  # interrupt
+}
+
+EINPROGRESS = 115
+
+
+def read_records(dump):
+    magic, version, record_size, record_count, frequency, write_index, _ = BUFFER_HEADER.unpack_from(dump, 0)
+
+    if magic != USBD_CAPTURE_MAGIC:
+        sys.exit("error: the dump does not start with a capture buffer (bad magic 0x%08X)" % magic)
+    if version != USBD_CAPTURE_VERSION:
+        sys.exit("error: unsupported capture buffer version %d" % version)
+
+    # The ring keeps the last `record_count` packets
+    first_index = max(0, write_index - record_count)
+    records = []
+
+    for index in range(first_index, write_index):
+        offset = BUFFER_HEADER.size + (index % record_count) * record_size
+        (timestamp, frame_number, length, endpoint_address, transfer_type, event,
+         captured_length, device_address) = RECORD_HEADER.unpack_from(dump, offset)
+        data_offset = offset + RECORD_HEADER.size
+        records.append({
+            "index": index,
+            "timestamp": timestamp,
+            "frame_number": frame_number,
+            "length": length,
+            "endpoint_address": endpoint_address,
+            "transfer_type": transfer_type,
+            "event": event,
+            "device_address": device_address,
+            "data": dump[data_offset:data_offset + captured_length],
+        })
+
+    return records, frequency, write_index - first_index, first_index
+
+
+def unwrap_timestamps(records, frequency):
+    """Turn the wrapping 32-bit cycle counter into microseconds since the first record."""
+    elapsed_cycles = 0
+    previous = None
+
+    for record in records:
+        if previous is not None:
+            elapsed_cycles += (record["timestamp"] - previous) & 0xFFFFFFFF
+        previous = record["timestamp"]
+        record["microseconds"] = elapsed_cycles * 1000000 // frequency
+
+
+def usbmon_packet(record, bus_number):
+    event = record["event"]
+    data = record["data"]
+    setup = b"\0" * 8
+    flag_setup = ord("-")
+    flag_data = 0 if data else ord("<")
+
+    if event == EVENT_SETUP:
+        setup = data[:8].ljust(8, b"\0")
+        flag_setup = 0
+        flag_data = ord("<")
+        data = b""
+        urb_type = ord("S")
+        status = -EINPROGRESS
+        urb_length = 0
+    elif event == EVENT_OUT:
+        urb_type = ord("S")
+        status = -EINPROGRESS
+        urb_length = record["length"]
+    else:
+        urb_type = ord("C")
+        status = 0
+        urb_length = record["length"]
+
+    seconds, microseconds = divmod(record["microseconds"], 1000000)
+
+    header = struct.pack(
+        "<QBBBBHbbqiiII8siiII",
+        record["index"],
+        urb_type,
+        USBMON_TRANSFER_TYPES.get(record["transfer_type"], 3),
+        record["endpoint_address"],
+        record["device_address"],
+        bus_number,
+        flag_setup if flag_setup < 128 else flag_setup - 256,
+        flag_data if flag_data < 128 else flag_data - 256,
+        seconds,
+        microseconds,
+        status,
+        urb_length,
+        len(data),
+        setup,
+        0,  # interval
+        record["frame_number"],  # start frame
+        0,  # transfer flags
+        0,  # count of isochronous descriptors
+    )
+
+    return header + data
+
+
+def pcapng_block(block_type, body):
+    body += b"\0" * (-len(body) % 4)
+    length = len(body) + 12
+    return struct.pack("<II", block_type, length) + body + struct.pack("<I", length)
+
+
+def write_pcapng(output, packets):
+    # Section header block
+    output.write(pcapng_block(0x0A0D0D0A, struct.pack("<IHHq", 0x1A2B3C4D, 1, 0, -1)))
+    # Interface description block (microsecond timestamps by default)
+    output.write(pcapng_block(0x00000001, struct.pack("<HHI", LINKTYPE_USB_LINUX_MMAPPED, 0, 0)))
+
+    for microseconds, packet in packets:
+        body = struct.pack(
+            "<IIIII", 0, microseconds >> 32, microseconds & 0xFFFFFFFF, len(packet), len(packet)
+        ) + packet
+        # Enhanced packet block
+        output.write(pcapng_block(0x00000006, body))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="raw dump of usbd_capture_buffer")
+    parser.add_argument("-o", "--output", required=True, help="pcapng file to write")
+    parser.add_argument("--bus", type=int, default=1, help="bus number shown in Wireshark (default: 1)")
+    arguments = parser.parse_args()
+
+    with open(arguments.dump, "rb") as dump_file:
+        dump = dump_file.read()
+
+    records, frequency, count, first_index = read_records(dump)
+    unwrap_timestamps(records, frequency)
+
+    with open(arguments.output, "wb") as output:
+        write_pcapng(output, ((record["microseconds"], usbmon_packet(record, arguments.bus)) for record in records))
+
+    lost = " (%d older packets were overwritten)" % first_index if first_index else ""
+    print("%d packets written to %s%s" % (count, arguments.output, lost))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Read the statistics block of the device through its vendor control request.
+
+    $ python3 Tools/usbd_statistics.py            # print one snapshot
+    $ python3 Tools/usbd_statistics.py -i 1.0     # print a snapshot every second
+
+Requires pyusb (pip install pyusb) and access rights to the device.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import usb.core
+
+VENDOR_ID = 0x6666
+PRODUCT_ID = 0x13AA
+
+USBD_VENDOR_REQUEST_GET_STATISTICS = 0x01
+# bmRequestType: device-to-host, vendor, device recipient
+REQUEST_TYPE_VENDOR_IN = 0xC0
+
+STATISTICS_HEADER = struct.Struct("<HHB3x")
+ENDPOINT_STATISTICS = struct.Struct("<IIIIHHHHH2x")
+ENDPOINT_FIELDS = ("packets", "bytes", "naks", "transfer_completions", "short_packets",
+                   "fifo_underruns", "fifo_overruns", "incomplete_isochronous", "max_fifo_fill")
+MEMORY_USAGE = struct.Struct("<IIIIII")
+MEMORY_FIELDS = ("stack_size", "stack_high_water_mark", "heap_size", "heap_used", "heap_failed_requests",
+                 "unused_ram")
+CPU_LOAD = struct.Struct("<HHHHHHI")
+CPU_FIELDS = ("load", "load_average", "load_peak", "usb_load", "usb_load_average", "usb_load_peak",
+              "interval_cycles")
+LATENCY = struct.Struct("<IIIHH8H")
+LATENCY_BUCKET_US = 250
+AUDIO = struct.Struct("<IIH8HHHHHHH2x")
+SOF_JITTER_BUCKET_NS = 50
+VIDEO = struct.Struct("<IIIIHHH2x")
+VIDEO_FIELDS = ("frames", "bytes", "frame_period_us", "bytes_per_second", "conversion_max_us", "conversion_stalls",
+                "usb_starvations")
+
+
+def parse_statistics(block):
+    version, size, endpoint_count = STATISTICS_HEADER.unpack_from(block, 0)
+    offset = STATISTICS_HEADER.size
+    statistics = {"version": version, "in": [], "out": []}
+
+    for direction in ("in", "out"):
+        for _ in range(endpoint_count):
+            values = ENDPOINT_STATISTICS.unpack_from(block, offset)
+            statistics[direction].append(dict(zip(ENDPOINT_FIELDS, values)))
+            offset += ENDPOINT_STATISTICS.size
+
+    if version >= 2:
+        statistics["memory"] = dict(zip(MEMORY_FIELDS, MEMORY_USAGE.unpack_from(block, offset)))
+        offset += MEMORY_USAGE.size
+
+    if version >= 3:
+        statistics["cpu"] = dict(zip(CPU_FIELDS, CPU_LOAD.unpack_from(block, offset)))
+        offset += CPU_LOAD.size
+
+    if version >= 4:
+        values = LATENCY.unpack_from(block, offset)
+        statistics["hid_latency"] = {"reports": values[0], "overwritten": values[1], "total_us": values[2],
+                                     "min_us": values[3], "max_us": values[4], "histogram": values[5:]}
+        offset += LATENCY.size
+
+    if version >= 5:
+        values = AUDIO.unpack_from(block, offset)
+        statistics["audio"] = {"feedback": values[0], "sof_period_ns": values[1], "sof_jitter_max_ns": values[2],
+                               "sof_jitter_histogram": values[3:11], "missed_sofs": values[11],
+                               "speaker_level": values[12], "speaker_level_min": values[13],
+                               "speaker_level_max": values[14], "speaker_underruns": values[15],
+                               "speaker_overruns": values[16]}
+        offset += AUDIO.size
+
+    if version >= 6:
+        statistics["video"] = dict(zip(VIDEO_FIELDS, VIDEO.unpack_from(block, offset)))
+        offset += VIDEO.size
+
+    return statistics
+
+
+def print_statistics(statistics):
+    print("%-6s %10s %12s %8s %10s %8s %6s %6s %6s %6s" % (
+        "ep", "packets", "bytes", "naks", "transfers", "short", "undrn", "ovrrn", "iso", "fill"))
+
+    for direction in ("in", "out"):
+        for number, endpoint in enumerate(statistics[direction]):
+            if not endpoint["packets"] and not endpoint["naks"]:
+                continue
+            print("%-6s %10d %12d %8d %10d %8d %6d %6d %6d %6d" % (
+                "%d %s" % (number, direction.upper()), endpoint["packets"], endpoint["bytes"], endpoint["naks"],
+                endpoint["transfer_completions"], endpoint["short_packets"], endpoint["fifo_underruns"],
+                endpoint["fifo_overruns"], endpoint["incomplete_isochronous"], endpoint["max_fifo_fill"]))
+
+    memory = statistics.get("memory")
+    if memory:
+        print("stack: %d of %d bytes used (high-water mark), heap: %d of %d bytes used, %d failed requests, "
+              "%d bytes of RAM never used" % (
+                  memory["stack_high_water_mark"], memory["stack_size"], memory["heap_used"], memory["heap_size"],
+                  memory["heap_failed_requests"], memory["unused_ram"]))
+
+    cpu = statistics.get("cpu")
+    if cpu:
+        # The loads are in hundredths of a percent
+        print("cpu load: %.2f%% (average %.2f%%, peak %.2f%%), usb interrupt: %.2f%% (average %.2f%%, peak %.2f%%), "
+              "%d cycles per frame" % (
+                  cpu["load"] / 100, cpu["load_average"] / 100, cpu["load_peak"] / 100, cpu["usb_load"] / 100,
+                  cpu["usb_load_average"] / 100, cpu["usb_load_peak"] / 100, cpu["interval_cycles"]))
+
+    latency = statistics.get("hid_latency")
+    if latency and latency["reports"]:
+        print("hid latency: %d reports (%d overwritten), min %d us, average %d us, max %d us" % (
+            latency["reports"], latency["overwritten"], latency["min_us"], latency["total_us"] // latency["reports"],
+            latency["max_us"]))
+        for bucket, count in enumerate(latency["histogram"]):
+            last = bucket == len(latency["histogram"]) - 1
+            print("  %5d us%s %10d" % (bucket * LATENCY_BUCKET_US,
+                                      "+     " if last else " - %-4d" % ((bucket + 1) * LATENCY_BUCKET_US), count))
+
+    audio = statistics.get("audio")
+    if audio and audio["sof_period_ns"]:
+        # The feedback is in samples per frame, 10.14 fixed point
+        print("audio: feedback %.4f samples per frame, sof period %d ns (jitter max %d ns, %d missed), "
+              "speaker buffer %d frames (min %d, max %d), %d underruns, %d overruns" % (
+                  audio["feedback"] / 16384, audio["sof_period_ns"], audio["sof_jitter_max_ns"], audio["missed_sofs"],
+                  audio["speaker_level"], audio["speaker_level_min"], audio["speaker_level_max"],
+                  audio["speaker_underruns"], audio["speaker_overruns"]))
+        for bucket, count in enumerate(audio["sof_jitter_histogram"]):
+            last = bucket == len(audio["sof_jitter_histogram"]) - 1
+            print("  %5d ns%s %10d" % (bucket * SOF_JITTER_BUCKET_NS,
+                                      "+     " if last else " - %-4d" % ((bucket + 1) * SOF_JITTER_BUCKET_NS), count))
+
+    video = statistics.get("video")
+    if video and video["frames"]:
+        print("video: %d frames, %d bytes, %.2f frames per second, %d bytes per second, band conversion max %d us, "
+              "%d conversion stalls, %d usb starvations" % (
+                  video["frames"], video["bytes"],
+                  1000000 / video["frame_period_us"] if video["frame_period_us"] else 0, video["bytes_per_second"],
+                  video["conversion_max_us"], video["conversion_stalls"], video["usb_starvations"]))
+
+
+def read_statistics(device):
+    # Ask for the header first, then for the whole block (its size depends on the firmware)
+    header = bytes(device.ctrl_transfer(REQUEST_TYPE_VENDOR_IN, USBD_VENDOR_REQUEST_GET_STATISTICS, 0, 0,
+                                        STATISTICS_HEADER.size))
+    _, size, _ = STATISTICS_HEADER.unpack(header)
+    return bytes(device.ctrl_transfer(REQUEST_TYPE_VENDOR_IN, USBD_VENDOR_REQUEST_GET_STATISTICS, 0, 0, size))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-i", "--interval", type=float, help="poll every INTERVAL seconds")
+    arguments = parser.parse_args()
+
+    device = usb.core.find(idVendor=VENDOR_ID, idProduct=PRODUCT_ID)
+    if device is None:
+        sys.exit("error: device %04X:%04X not found" % (VENDOR_ID, PRODUCT_ID))
+
+    while True:
+        print_statistics(parse_statistics(read_statistics(device)))
+        if not arguments.interval:
+            break
+        time.sleep(arguments.interval)
+        print()
+
+
+if __name__ == "__main__":
+    main()